@@ -165,6 +165,7 @@ void show_conn_flags(unsigned int f)
 	SHOW_FLAG(f, CO_FL_WAIT_ROOM);
 	SHOW_FLAG(f, CO_FL_XPRT_READY);
 	SHOW_FLAG(f, CO_FL_CTRL_READY);
+	SHOW_FLAG(f, CO_FL_WARM);
 	SHOW_FLAG(f, CO_FL_IDLE_LIST);
 	SHOW_FLAG(f, CO_FL_SAFE_LIST);
 
@@ -343,6 +344,8 @@ void show_strm_flags(unsigned int f)
 		return;
 	}
 
+	SHOW_FLAG(f, SF_HEDGING);
+	SHOW_FLAG(f, SF_HEDGED);
 	SHOW_FLAG(f, SF_SRV_REUSED);
 	SHOW_FLAG(f, SF_IGNORE_PRST);
 
@@ -0,0 +1,312 @@
+/*
+ * Map and ACL file compiler
+ *
+ * This program reads a map file (key and value per line) or an ACL pattern
+ * file (one pattern per line, with -a) exactly like haproxy does, and writes
+ * an image of it which haproxy maps read-only instead of parsing the file. The
+ * image indexes the keys for exact string lookups ("-m str", map_str, map),
+ * and for longest prefix lookups ("-m ip", map_ip) when all keys are IPv4 or
+ * IPv6 networks. The output is written to a temporary file which is renamed
+ * over the destination once complete, so that running processes which mapped
+ * the previous image are not affected.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <haproxy/mapimg.h>
+#include <haproxy/poptrie.h>
+
+#define MAXLINE 16384     /* same as haproxy's default tune.bufsize */
+
+static struct mapimg_ent *ent;
+static unsigned int nb_ent, alloc_ent;
+static char *text;
+static size_t text_len, text_alloc;
+
+static void die(const char *msg)
+{
+	fprintf(stderr, "%s\n", msg);
+	exit(1);
+}
+
+/* appends <len> bytes of <str> and a trailing zero to the text area, returns
+ * their offset.
+ */
+static uint32_t add_text(const char *str, size_t len)
+{
+	size_t ofs = text_len;
+
+	if (text_len + len + 1 > text_alloc) {
+		text_alloc = text_alloc ? text_alloc * 2 : 1 << 20;
+		while (text_len + len + 1 > text_alloc)
+			text_alloc *= 2;
+		text = realloc(text, text_alloc);
+		if (!text)
+			die("out of memory");
+	}
+	memcpy(text + text_len, str, len);
+	text[text_len + len] = 0;
+	text_len += len + 1;
+	if (text_len > MAPIMG_NO_VAL)
+		die("text area too large for the image format");
+	return ofs;
+}
+
+static void add_entry(const char *key, size_t key_len, const char *val, size_t val_len, int line)
+{
+	if (nb_ent == alloc_ent) {
+		alloc_ent = alloc_ent ? alloc_ent * 2 : 65536;
+		ent = realloc(ent, alloc_ent * sizeof(*ent));
+		if (!ent)
+			die("out of memory");
+	}
+	ent[nb_ent].key = add_text(key, key_len);
+	ent[nb_ent].key_len = key_len;
+	ent[nb_ent].val = val ? add_text(val, val_len) : MAPIMG_NO_VAL;
+	ent[nb_ent].line = line;
+	nb_ent++;
+}
+
+/* reads <file> the same way as pat_ref_read_from_file_smp() if <smp> is set,
+ * otherwise as pat_ref_read_from_file().
+ */
+static void read_file(FILE *file, int smp)
+{
+	static char buf[MAXLINE];
+	char *c, *key_beg, *key_end, *value_beg, *value_end;
+	int line = 0;
+
+	while (fgets(buf, sizeof(buf), file) != NULL) {
+		line++;
+		c = buf;
+
+		/* ignore lines beginning with a dash */
+		if (*c == '#')
+			continue;
+
+		/* strip leading spaces and tabs */
+		while (*c == ' ' || *c == '\t')
+			c++;
+
+		if (!smp) {
+			key_beg = c;
+			while (*c && *c != '\n' && *c != '\r')
+				c++;
+			if (c == key_beg)
+				continue;
+			add_entry(key_beg, c - key_beg, NULL, 0, line);
+			continue;
+		}
+
+		/* empty lines are ignored too */
+		if (*c == '\0' || *c == '\r' || *c == '\n')
+			continue;
+
+		/* look for the end of the key */
+		key_beg = c;
+		while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+			c++;
+		key_end = c;
+
+		/* strip middle spaces and tabs */
+		while (*c == ' ' || *c == '\t')
+			c++;
+
+		/* look for the end of the value, it is the end of the line */
+		value_beg = c;
+		while (*c && *c != '\n' && *c != '\r')
+			c++;
+		value_end = c;
+
+		/* trim possibly trailing spaces and tabs */
+		while (value_end > value_beg && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+			value_end--;
+
+		add_entry(key_beg, key_end - key_beg, value_beg, value_end - value_beg, line);
+	}
+
+	if (ferror(file))
+		die("read error");
+}
+
+/* sorts entries by key, then by position for identical keys */
+static int cmp_sorted(const void *a, const void *b)
+{
+	const struct mapimg_ent *ea = &ent[*(const uint32_t *)a];
+	const struct mapimg_ent *eb = &ent[*(const uint32_t *)b];
+	int ret;
+
+	ret = mapimg_cmp(text + ea->key, ea->key_len, text + eb->key, eb->key_len);
+	if (ret)
+		return ret;
+	return (ea > eb) - (ea < eb);
+}
+
+/* Builds the IPv4 and IPv6 tries if all keys are networks, and makes their
+ * leaves designate entries. Returns 0 if some keys are not networks.
+ */
+static int build_tries(struct poptrie *v4, struct poptrie *v6)
+{
+	unsigned char addr[16];
+	unsigned int i, len;
+	int is_v6;
+
+	for (i = 0; i < nb_ent; i++) {
+		if (!mapimg_parse_ip(text + ent[i].key, &is_v6, addr, &len))
+			return 0;
+		if (!poptrie_add(is_v6 ? v6 : v4, addr, len, (void *)(uintptr_t)(i + 1)))
+			die("out of memory");
+	}
+
+	if (!poptrie_compile(v4) || !poptrie_compile(v6))
+		die("out of memory");
+
+	for (i = 0; i < v4->nb_leaves; i++)
+		if (v4->leaves[i])
+			v4->leaves[i] = (uintptr_t)v4->items[v4->leaves[i] - 1];
+	for (i = 0; i < v6->nb_leaves; i++)
+		if (v6->leaves[i])
+			v6->leaves[i] = (uintptr_t)v6->items[v6->leaves[i] - 1];
+	return 1;
+}
+
+static void write_area(FILE *out, const void *area, size_t len, uint64_t *ofs)
+{
+	static const char pad[8];
+
+	if (len && fwrite(area, len, 1, out) != 1)
+		die("write error");
+	*ofs += len;
+	if (*ofs & 7) {
+		if (fwrite(pad, 8 - (*ofs & 7), 1, out) != 1)
+			die("write error");
+		*ofs += 8 - (*ofs & 7);
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+	        "Usage: %s [-a] <input> <output>\n"
+	        "  Compiles map file <input> into image <output>.\n"
+	        "  -a : <input> is an ACL pattern file (one pattern per line, no value)\n",
+	        name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct mapimg_hdr hdr;
+	struct poptrie *v4, *v6;
+	uint32_t *sorted;
+	uint64_t ofs;
+	char *tmp;
+	FILE *in, *out;
+	unsigned int i;
+	int smp = 1;
+
+	if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+		smp = 0;
+		argc--; argv++;
+	}
+	if (argc != 3)
+		usage(argv[0]);
+
+	in = fopen(argv[1], "r");
+	if (!in) {
+		perror(argv[1]);
+		return 1;
+	}
+	read_file(in, smp);
+	fclose(in);
+
+	sorted = malloc((nb_ent + 1) * sizeof(*sorted));
+	if (!sorted)
+		die("out of memory");
+	for (i = 0; i < nb_ent; i++)
+		sorted[i] = i;
+	qsort(sorted, nb_ent, sizeof(*sorted), cmp_sorted);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MAPIMG_MAGIC, sizeof(hdr.magic));
+	hdr.byteorder = MAPIMG_BYTEORDER;
+	hdr.flags = smp ? MAPIMG_F_SMP : 0;
+	hdr.nb_entries = nb_ent;
+
+	v4 = poptrie_new(32);
+	v6 = poptrie_new(128);
+	if (!v4 || !v6)
+		die("out of memory");
+	if (build_tries(v4, v6)) {
+		hdr.flags |= MAPIMG_F_IP;
+		hdr.nb_v4_nodes = v4->nb_nodes;
+		hdr.nb_v4_leaves = v4->nb_leaves;
+		hdr.nb_v6_nodes = v6->nb_nodes;
+		hdr.nb_v6_leaves = v6->nb_leaves;
+	}
+
+	/* compute the layout, sections are 8-byte aligned */
+	ofs = sizeof(hdr);
+	hdr.ent_ofs = ofs;
+	ofs += ((uint64_t)nb_ent * sizeof(*ent) + 7) & ~7ULL;
+	hdr.sorted_ofs = ofs;
+	ofs += ((uint64_t)nb_ent * sizeof(*sorted) + 7) & ~7ULL;
+	hdr.v4_nodes_ofs = ofs;
+	ofs += (uint64_t)hdr.nb_v4_nodes * sizeof(struct poptrie_node);
+	hdr.v4_leaves_ofs = ofs;
+	ofs += ((uint64_t)hdr.nb_v4_leaves * sizeof(unsigned int) + 7) & ~7ULL;
+	hdr.v6_nodes_ofs = ofs;
+	ofs += (uint64_t)hdr.nb_v6_nodes * sizeof(struct poptrie_node);
+	hdr.v6_leaves_ofs = ofs;
+	ofs += ((uint64_t)hdr.nb_v6_leaves * sizeof(unsigned int) + 7) & ~7ULL;
+	hdr.text_ofs = ofs;
+	hdr.text_len = text_len;
+	ofs += (text_len + 7) & ~7ULL;
+	hdr.size = ofs;
+
+	tmp = malloc(strlen(argv[2]) + 5);
+	if (!tmp)
+		die("out of memory");
+	sprintf(tmp, "%s.tmp", argv[2]);
+	out = fopen(tmp, "w");
+	if (!out) {
+		perror(tmp);
+		return 1;
+	}
+
+	ofs = 0;
+	write_area(out, &hdr, sizeof(hdr), &ofs);
+	write_area(out, ent, (size_t)nb_ent * sizeof(*ent), &ofs);
+	write_area(out, sorted, (size_t)nb_ent * sizeof(*sorted), &ofs);
+	if (hdr.flags & MAPIMG_F_IP) {
+		write_area(out, v4->nodes, (size_t)hdr.nb_v4_nodes * sizeof(struct poptrie_node), &ofs);
+		write_area(out, v4->leaves, (size_t)hdr.nb_v4_leaves * sizeof(unsigned int), &ofs);
+		write_area(out, v6->nodes, (size_t)hdr.nb_v6_nodes * sizeof(struct poptrie_node), &ofs);
+		write_area(out, v6->leaves, (size_t)hdr.nb_v6_leaves * sizeof(unsigned int), &ofs);
+	}
+	write_area(out, text, text_len, &ofs);
+
+	if (fclose(out) != 0 || ofs != hdr.size) {
+		unlink(tmp);
+		die("write error");
+	}
+	if (rename(tmp, argv[2]) < 0) {
+		perror(argv[2]);
+		unlink(tmp);
+		return 1;
+	}
+
+	fprintf(stderr, "%u entries, %s, %llu bytes\n", nb_ent,
+	        (hdr.flags & MAPIMG_F_IP) ? "string and network indexes" : "string index",
+	        (unsigned long long)hdr.size);
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * include/haproxy/acm-t.h
+ * Aho-Corasick multi-pattern string matching - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_ACM_T_H
+#define _HAPROXY_ACM_T_H
+
+#include <haproxy/api-t.h>
+
+/* flags passed to acm_new() */
+#define ACM_F_ICASE      0x00000001  /* ASCII case-insensitive matching */
+#define ACM_F_REV        0x00000002  /* patterns are stored reversed (suffix matching) */
+#define ACM_F_COMPILED   0x00000004  /* internal: acm_compile() succeeded */
+#define ACM_F_ALL        0x00000008  /* build the links needed by acm_mark_sub() */
+
+/* A state of the automaton. States are numbered in breadth-first order from
+ * the root (state 0), and the edges leaving a state are stored contiguously,
+ * sorted by character, so that the states close to the root, which are the
+ * most visited ones, share the same cache lines. Pattern numbers are stored
+ * plus one so that zero means "none".
+ */
+struct acm_state {
+	unsigned int edges;       /* index of the first edge in acm->chr[] and acm->dst[] */
+	unsigned int nb_edges;    /* number of edges leaving this state */
+	unsigned int fail;        /* state of the longest proper suffix present in the trie */
+	unsigned int own;         /* 1 + first pattern ending exactly at this state, or 0 */
+	unsigned int out;         /* 1 + first pattern ending at this state or a suffix, or 0 */
+};
+
+/* node of the trie used while patterns are being added */
+struct acm_bnode {
+	unsigned int child;       /* first child, 0 if none (the root is never a child) */
+	unsigned int sibling;     /* next child of the same parent, 0 if none */
+	unsigned int own;         /* 1 + first pattern ending here, or 0 */
+	unsigned char c;          /* character leading to this node */
+};
+
+/* An Aho-Corasick automaton. Patterns are added with acm_add() then the
+ * automaton is built with acm_compile(), after which it is read-only and may
+ * be shared between threads. Each pattern is associated with an opaque item
+ * which is what lookups return. When several patterns match, the item of the
+ * first added one is returned.
+ */
+struct acm {
+	unsigned int flags;           /* ACM_F_* */
+	unsigned int nb_items;        /* number of patterns added */
+	unsigned int alloc_items;     /* allocated entries in <items> */
+	void **items;                 /* items associated with the patterns */
+
+	/* build-time trie, released by acm_compile() */
+	struct acm_bnode *bnodes;
+	unsigned int nb_bnodes;
+	unsigned int alloc_bnodes;
+
+	/* compiled automaton */
+	unsigned int nb_states;
+	struct acm_state *states;     /* nb_states states */
+	unsigned char *chr;           /* characters of the edges (nb_states - 1 of them) */
+	unsigned int *dst;            /* destination states of the edges */
+	unsigned int *dict;           /* with ACM_F_ALL, per state, closest state on the
+	                               * failure chain where a pattern ends, or 0 */
+	unsigned int root[256];       /* direct transitions from the root, 0 if none */
+};
+
+#endif /* _HAPROXY_ACM_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,41 @@
+/*
+ * include/haproxy/acm.h
+ * Aho-Corasick multi-pattern string matching - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_ACM_H
+#define _HAPROXY_ACM_H
+
+#include <haproxy/acm-t.h>
+#include <haproxy/api.h>
+
+struct acm *acm_new(unsigned int flags);
+int acm_add(struct acm *acm, const char *str, size_t len, void *item);
+int acm_compile(struct acm *acm);
+void acm_free(struct acm *acm);
+void *acm_find_sub(const struct acm *acm, const char *str, size_t len);
+void *acm_find_pfx(const struct acm *acm, const char *str, size_t len);
+unsigned int acm_mark_sub(const struct acm *acm, const char *str, size_t len, unsigned long *map);
+
+#endif /* _HAPROXY_ACM_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -63,6 +63,11 @@ struct activity {
 	unsigned int accq_full;    // accept queue connection not pushed because full
 	unsigned int pool_fail;    // failed a pool allocation
 	unsigned int buf_wait;     // waited on a buffer allocation
+	unsigned int stolen;       // tasks stolen from other threads' run queues
+	unsigned int rx_lookups;   // regex lists looked up through the prefilter
+	unsigned int rx_cand;      // regexes run because the prefilter selected them
+	unsigned int rx_match;     // regexes selected by the prefilter which matched
+	unsigned int rx_skip;      // regexes not run thanks to the prefilter
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	unsigned int ctr0;         // general purposee debug counter
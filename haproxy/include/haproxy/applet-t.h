@@ -147,6 +147,7 @@ struct appctx {
 			void *target;		/* table we want to dump, or NULL for all */
 			struct stktable *t;	/* table being currently dumped (first if NULL) */
 			struct stksess *entry;	/* last entry we were trying to dump (or first if NULL) */
+			unsigned int shard;	/* shard of the table being dumped */
 			long long value[STKTABLE_FILTER_LEN];	     /* value to compare against */
 			signed char data_type[STKTABLE_FILTER_LEN];  /* type of data to compare, or -1 if none */
 			signed char data_op[STKTABLE_FILTER_LEN];    /* operator (STD_OP_*) when data_type set */
@@ -156,6 +157,10 @@ struct appctx {
 			unsigned int display_flags;
 			struct pat_ref *ref;
 			struct bref bref;	/* back-reference from the pat_ref_elt being dumped */
+			unsigned int img_idx;	/* next entry of the reference's image to dump */
+			unsigned int ver;	/* version of the reference being updated, or 0 */
+			unsigned int gen;	/* generation of the reference when <expr> was taken */
+			unsigned int expr_idx;	/* position of <expr> in the reference */
 			struct pattern_expr *expr;
 			struct buffer chunk;
 		} map;
@@ -39,6 +39,7 @@ void back_handle_st_req(struct stream *s);
 void back_handle_st_con(struct stream *s);
 void back_handle_st_rdy(struct stream *s);
 void back_handle_st_cer(struct stream *s);
+struct task *srv_warm_conns(struct task *t, void *context, unsigned short state);
 
 const char *backend_lb_algo_str(int algo);
 int backend_parse_balance(const char **args, char **err, struct proxy *curproxy);
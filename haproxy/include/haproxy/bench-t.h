@@ -0,0 +1,56 @@
+/*
+ * include/haproxy/bench-t.h
+ * This file contains the types used by the built-in micro-benchmarks.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_BENCH_T_H
+#define _HAPROXY_BENCH_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/list-t.h>
+
+/* One run of a benchmark. The benchmark function performs <iters> operations
+ * between bench_start() and bench_stop(), and reports in <bytes> the number of
+ * bytes processed by each of them, and in <syscalls> the total number of
+ * system calls they made, if relevant. It sets <failed> if it could not run.
+ */
+struct bench_run {
+	unsigned long long iters;      /* number of operations to perform */
+	unsigned long long start;      /* date of the last bench_start(), in ns */
+	unsigned long long elapsed;    /* time spent in the measured sections, in ns */
+	unsigned long long bytes;      /* bytes processed per operation */
+	unsigned long long syscalls;   /* syscalls made by all operations, if counted */
+	int failed;                    /* non-zero if the benchmark could not run */
+};
+
+/* A registered benchmark. Names are made of the subsystem, the measured
+ * function and possibly a variant, separated by dots.
+ */
+struct bench {
+	struct list list;              /* chaining in the list of benchmarks */
+	const char *name;
+	void (*fct)(struct bench_run *run);
+};
+
+#endif /* _HAPROXY_BENCH_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
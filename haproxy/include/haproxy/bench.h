@@ -0,0 +1,57 @@
+/*
+ * include/haproxy/bench.h
+ * This file contains the functions used by the built-in micro-benchmarks.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_BENCH_H
+#define _HAPROXY_BENCH_H
+
+#include <haproxy/api.h>
+#include <haproxy/bench-t.h>
+#include <haproxy/time.h>
+
+/* results are accumulated there so that the compiler can't drop the work */
+extern volatile unsigned long long bench_sink;
+
+void bench_register(struct bench *bench);
+int bench_run_all(int argc, char **argv);
+
+/* starts a measured section of run <run> */
+static inline void bench_start(struct bench_run *run)
+{
+	run->start = now_mono_time();
+}
+
+/* ends a measured section of run <run> */
+static inline void bench_stop(struct bench_run *run)
+{
+	run->elapsed += now_mono_time() - run->start;
+}
+
+/* registers benchmark function <f> under name <nam> */
+#define REGISTER_BENCH(nam, f)                                            \
+	static struct bench __bench_##f = { .name = (nam), .fct = (f) };   \
+	INITCALL1(STG_REGISTER, bench_register, &__bench_##f)
+
+#endif /* _HAPROXY_BENCH_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
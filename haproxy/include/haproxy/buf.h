@@ -896,6 +896,16 @@ static inline unsigned int br_full(const struct buffer *r)
 	return r->data + 1 == r->head || r->data + 1 == r->head - 1 + r->size;
 }
 
+/* Returns the number of buffers in use in the ring, tail included */
+static inline unsigned int br_count(const struct buffer *r)
+{
+	BUG_ON(r->area != BUF_RING.area);
+
+	if (r->data >= r->head)
+		return r->data - r->head + 1;
+	return r->data + r->size - r->head;
+}
+
 /* Returns the index of the ring's head buffer */
 static inline unsigned int br_head_idx(const struct buffer *r)
 {
@@ -28,6 +28,7 @@
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 
+#include <import/eb64tree.h>
 #include <import/ist.h>
 
 #include <haproxy/api-t.h>
@@ -117,7 +118,9 @@ enum {
 	CO_FL_IDLE_LIST     = 0x00000002,  /* 2 = in idle_list, 3 = invalid */
 	CO_FL_LIST_MASK     = 0x00000003,  /* Is the connection in any server-managed list ? */
 
-	/* unused : 0x00000004, 0x00000008 */
+	CO_FL_WARM          = 0x00000004,  /* established in advance for the server's warm pool, not used yet */
+
+	/* unused : 0x00000008 */
 
 	/* unused : 0x00000010 */
 	/* unused : 0x00000020 */
@@ -346,6 +349,8 @@ struct xprt_ops {
 	size_t (*snd_buf)(struct connection *conn, void *xprt_ctx, const struct buffer *buf, size_t count, int flags); /* send callback */
 	int  (*rcv_pipe)(struct connection *conn, void *xprt_ctx, struct pipe *pipe, unsigned int count); /* recv-to-pipe callback */
 	int  (*snd_pipe)(struct connection *conn, void *xprt_ctx, struct pipe *pipe); /* send-to-pipe callback */
+	int  (*can_snd_pipe)(const struct connection *conn, void *xprt_ctx); /* NULL or non-zero if snd_pipe may be used now */
+	size_t (*snd_iov)(struct connection *conn, void *xprt_ctx, const struct iovec *iov, int iovcnt, int flags); /* scattered send callback */
 	void (*shutr)(struct connection *conn, void *xprt_ctx, int);    /* shutr function */
 	void (*shutw)(struct connection *conn, void *xprt_ctx, int);    /* shutw function */
 	void (*close)(struct connection *conn, void *xprt_ctx);         /* close the transport layer */
@@ -494,6 +499,40 @@ struct connection {
 	unsigned int idle_time;                 /* Time the connection was added to the idle list, or 0 if not in the idle list */
 	uint8_t proxy_authority_len;  /* Length of authority TLV received via PROXYv2 */
 	struct ist proxy_unique_id;  /* Value of the unique ID TLV received via PROXYv2 */
+	struct eb64_node hash_node;   /* attach point to the server's idle/safe/available trees, key is the conn hash */
+	struct conn_hash_ext *hash_ext; /* parameters hashed into hash_node.key other than the target, or NULL */
+};
+
+/* Parameters which make a backend connection unsuitable for another request
+ * when they differ. They are combined by conn_calculate_hash() into the key
+ * used to index the server's idle connections. Unset fields are ignored.
+ */
+struct conn_hash_params {
+	void *target;                            /* server or proxy the connection is made to */
+	const char *sni;                         /* SNI sent, or NULL if none */
+	size_t sni_len;
+	const char *proxy;                       /* PROXY protocol header sent, or NULL if none */
+	size_t proxy_len;
+	const struct sockaddr_storage *src_addr; /* address the connection is bound to, or NULL */
+	const struct sockaddr_storage *dst_addr; /* destination when not fixed by the server, or NULL */
+};
+
+/* length of the significant part of an address in a conn_hash_ext: its family,
+ * an IPv6 address and a port.
+ */
+#define CONN_HASH_ADDR_LEN  (1 + 16 + 2)
+
+/* Copy of the parameters a backend connection was made with, except its
+ * target, which conn_hash_match() compares with the ones of a request whose
+ * hash matches, so that a collision never hands a connection over to a request
+ * with different parameters. It only exists if one of them is set.
+ */
+struct conn_hash_ext {
+	char src[CONN_HASH_ADDR_LEN];  /* bound address, all zeroes if unset */
+	char dst[CONN_HASH_ADDR_LEN];  /* destination, all zeroes if unset */
+	int sni_len;                   /* length of the SNI at the beginning of <data>, <0 if unset */
+	int proxy_len;                 /* length of the PROXY header following it, <0 if unset */
+	char data[VAR_ARRAY];
 };
 
 struct mux_proto_list {
@@ -605,7 +644,8 @@ struct tlv_ssl {
 
 /* This structure is used to manage idle connections, their locking, and the
  * list of such idle connections to be removed. It is per-thread and must be
- * accessible from foreign threads.
+ * accessible from foreign threads. The takeover lock also protects the
+ * servers' idle and safe trees of the thread.
  */
 struct idle_conns {
 	struct mt_list toremove_conns;
@@ -77,6 +77,10 @@ int conn_recv_socks4_proxy_response(struct connection *conn);
 /* If we delayed the mux creation because we were waiting for the handshake, do it now */
 int conn_create_mux(struct connection *conn);
 
+uint64_t conn_calculate_hash(const struct conn_hash_params *params);
+void conn_hash_store(struct connection *conn, const struct conn_hash_params *params);
+int conn_hash_match(const struct connection *conn, const struct conn_hash_params *params);
+
 extern struct idle_conns idle_conns[MAX_THREADS];
 
 /* returns true is the transport layer is ready */
@@ -91,6 +95,13 @@ static inline int conn_ctrl_ready(const struct connection *conn)
 	return (conn->flags & CO_FL_CTRL_READY);
 }
 
+/* returns true if the transport layer may currently send data from a pipe */
+static inline int conn_xprt_can_snd_pipe(const struct connection *conn)
+{
+	return conn->xprt && conn->xprt->snd_pipe &&
+	       (!conn->xprt->can_snd_pipe || conn->xprt->can_snd_pipe(conn, conn->xprt_ctx));
+}
+
 /* Calls the init() function of the transport layer if any and if not done yet,
  * and sets the CO_FL_XPRT_READY flag to indicate it was properly initialized.
  * Returns <0 in case of error.
@@ -333,6 +344,9 @@ static inline void conn_init(struct connection *conn)
 	conn->dst = NULL;
 	conn->proxy_authority = NULL;
 	conn->proxy_unique_id = IST_NULL;
+	conn->hash_node.node.leaf_p = NULL;
+	conn->hash_node.key = 0;
+	conn->hash_ext = NULL;
 }
 
 /* sets <owner> as the connection's owner */
@@ -448,6 +462,16 @@ static inline void conn_force_unsubscribe(struct connection *conn)
 	conn->subs = NULL;
 }
 
+/* Removes <conn> from the server tree it is in, if any (idle, safe or
+ * available), as well as from its thread's list of connections to remove.
+ * The caller must hold the takeover lock of the current thread.
+ */
+static inline void conn_delete_from_tree(struct connection *conn)
+{
+	MT_LIST_DEL(&conn->list);
+	eb64_delete(&conn->hash_node);
+}
+
 /* Releases a connection previously allocated by conn_new() */
 static inline void conn_free(struct connection *conn)
 {
@@ -470,6 +494,8 @@ static inline void conn_free(struct connection *conn)
 		pool_free(pool_head_uniqueid, conn->proxy_unique_id.ptr);
 		conn->proxy_unique_id = IST_NULL;
 	}
+	free(conn->hash_ext);
+	conn->hash_ext = NULL;
 
 	/* By convention we always place a NULL where the ctx points to if the
 	 * mux is null. It may have been used to store the connection as a
@@ -486,6 +512,8 @@ static inline void conn_free(struct connection *conn)
 		_HA_ATOMIC_SUB(&srv->curr_idle_conns, 1);
 		_HA_ATOMIC_SUB(conn->flags & CO_FL_SAFE_LIST ? &srv->curr_safe_nb : &srv->curr_idle_nb, 1);
 		_HA_ATOMIC_SUB(&srv->curr_idle_thr[tid], 1);
+		if (conn->flags & CO_FL_WARM)
+			_HA_ATOMIC_SUB(&srv->curr_warm_thr[tid], 1);
 	} else {
 		struct server *srv = objt_server(conn->target);
 
@@ -495,6 +523,11 @@ static inline void conn_free(struct connection *conn)
 
 	conn_force_unsubscribe(conn);
 	MT_LIST_DEL((struct mt_list *)&conn->list);
+	if (conn->hash_node.node.leaf_p) {
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
+		conn_delete_from_tree(conn);
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
+	}
 	pool_free(pool_head_connection, conn);
 }
 
@@ -88,12 +88,16 @@ struct be_counters {
 
 	long long connect;                      /* number of connection establishment attempts */
 	long long reuse;                        /* number of connection reuses */
+	long long warm_hit;                     /* number of requests served by a warm connection */
+	long long warm_miss;                    /* number of new connections while a warm pool was set */
 	long long failed_conns;                 /* failed connect() attempts (BE only) */
 	long long failed_resp;                  /* failed responses (BE only) */
 	long long cli_aborts;                   /* aborted responses during DATA phase caused by the client */
 	long long srv_aborts;                   /* aborted responses during DATA phase caused by the server */
 	long long retries;                      /* retried and redispatched connections (BE only) */
 	long long redispatches;                 /* retried and redispatched connections (BE only) */
+	long long hedge_sent;                   /* requests hedged to another server */
+	long long hedge_resp;                   /* responses received after a hedge */
 	long long failed_rewrites;              /* failed rewrites (warning) */
 	long long internal_errors;              /* internal processing errors */
 
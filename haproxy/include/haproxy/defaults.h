@@ -383,6 +383,25 @@
 #define DEFAULT_PAT_LRU_SIZE 10000
 #endif
 
+/* interval in milliseconds between two refills of the servers' warm pools of
+ * idle connections, which are also refilled as soon as they are used.
+ */
+#ifndef SRV_WARM_CONN_INTERVAL
+#define SRV_WARM_CONN_INTERVAL 1000
+#endif
+
+/* number of response time samples after which a backend's hedging histogram
+ * is halved so that old samples progressively fade out, and minimum number
+ * of samples it must hold before a percentile-based hedge delay is applied.
+ */
+#ifndef PX_HEDGE_WINDOW
+#define PX_HEDGE_WINDOW 1024
+#endif
+
+#ifndef PX_HEDGE_MIN_SAMPLES
+#define PX_HEDGE_MIN_SAMPLES 100
+#endif
+
 /* maximum number of pollers that may be registered */
 #ifndef MAX_POLLERS
 #define MAX_POLLERS	10
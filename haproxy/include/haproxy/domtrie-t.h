@@ -0,0 +1,74 @@
+/*
+ * include/haproxy/domtrie-t.h
+ * Reversed-label trie for domain-like word matching - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_DOMTRIE_T_H
+#define _HAPROXY_DOMTRIE_T_H
+
+#include <haproxy/api-t.h>
+
+/* flags passed to domtrie_new() */
+#define DOMTRIE_F_ICASE  0x00000001  /* ASCII case-insensitive matching */
+
+/* An edge of the trie. Edges are stored in a single open-addressing hash
+ * table keyed on the parent node and the edge's label, so that following an
+ * edge costs one hash computation and usually one cache miss. Nodes are only
+ * numbers, the root being node 0.
+ */
+struct domtrie_edge {
+	unsigned int parent;      /* node this edge leaves */
+	unsigned int child;       /* node it leads to, 0 if the slot is free */
+	unsigned int hash;        /* hash of <parent> and of the label */
+	unsigned int len;         /* label length */
+	unsigned int key;         /* label offset in domtrie->text */
+};
+
+/* A trie of patterns made of words separated by delimiters, such as host
+ * names. Patterns are split into labels, each word with the delimiter which
+ * follows it except for the last one, and inserted from the last label to the
+ * first, so that "api.example.com" is stored as "com", "example.", "api.".
+ * Each pattern is associated with an opaque item which is what lookups
+ * return. When several patterns match, the item of the first added one is
+ * returned. Patterns may be added at any time but the trie must not be
+ * modified while it is looked up.
+ */
+struct domtrie {
+	unsigned int flags;           /* DOMTRIE_F_* */
+	uint64_t delim[4];            /* bitmap of the delimiter characters */
+	unsigned int nb_items;        /* number of patterns added */
+	unsigned int alloc_items;     /* allocated entries in <items> */
+	void **items;                 /* items associated with the patterns */
+	unsigned int nb_nodes;        /* number of nodes, including the root */
+	unsigned int alloc_nodes;     /* allocated entries in <out> */
+	unsigned int *out;            /* per node, 1 + first pattern ending there, or 0 */
+	unsigned int nb_edges;        /* number of edges (nb_nodes - 1) */
+	unsigned int mask;            /* number of slots in <edges> minus one */
+	struct domtrie_edge *edges;   /* hash table of the edges */
+	char *text;                   /* labels, case-folded if DOMTRIE_F_ICASE */
+	size_t text_len;              /* bytes used in <text> */
+	size_t text_alloc;            /* bytes allocated for <text> */
+};
+
+#endif /* _HAPROXY_DOMTRIE_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,38 @@
+/*
+ * include/haproxy/domtrie.h
+ * Reversed-label trie for domain-like word matching - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_DOMTRIE_H
+#define _HAPROXY_DOMTRIE_H
+
+#include <haproxy/api.h>
+#include <haproxy/domtrie-t.h>
+
+struct domtrie *domtrie_new(unsigned int flags, const char *delims);
+int domtrie_add(struct domtrie *dt, const char *str, size_t len, void *item);
+void domtrie_free(struct domtrie *dt);
+void *domtrie_find(const struct domtrie *dt, const char *str, size_t len);
+
+#endif /* _HAPROXY_DOMTRIE_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
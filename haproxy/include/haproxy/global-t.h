@@ -69,6 +69,13 @@
 #define GTUNE_FD_ET              (1<<18)
 #define GTUNE_SCHED_LOW_LATENCY  (1<<19)
 #define GTUNE_IDLE_POOL_SHARED   (1<<20)
+#define GTUNE_USE_IOURING        (1<<21)
+#define GTUNE_IOURING_SOCKIO     (1<<22)
+#define GTUNE_SCHED_WORK_STEALING (1<<23)
+#define GTUNE_POOL_HUGEPAGES     (1<<24)
+#define GTUNE_PATTERN_IPTRIE     (1<<25)
+#define GTUNE_PATTERN_RXSET      (1<<26)
+#define GTUNE_PATTERN_CACHE_IDX  (1<<27)
 
 /* SSL server verify mode */
 enum {
@@ -155,6 +162,7 @@ struct global {
 		int requri_len;    /* max len of request URI, use REQURI_LEN if zero */
 		int cookie_len;    /* max length of cookie captures */
 		int pattern_cache; /* max number of entries in the pattern cache. */
+		int pattern_cache_budget; /* max number of entries of one expression in the pattern cache, 0=no limit */
 		int sslcachesize;  /* SSL cache size in session, defaults to 20000 */
 		int comp_maxlevel;    /* max HTTP compression level */
 		int pool_low_ratio;   /* max ratio of FDs used before we stop using new idle connections */
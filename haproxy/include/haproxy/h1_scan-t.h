@@ -0,0 +1,49 @@
+/*
+ * include/haproxy/h1_scan-t.h
+ * This file contains the types used by the HTTP/1 parser's vector scanners.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_H1_SCAN_T_H
+#define _HAPROXY_H1_SCAN_T_H
+
+/* A set of scanners skipping over the bytes of a message which do not need
+ * any decision from the parser. Each of them starts at <ptr>, only looks at
+ * whole strides before <end>, and returns a pointer to the first byte it did
+ * not skip, which is either a byte the parser must look at, or one less than
+ * a stride before <end>. The parser then goes on byte per byte from there.
+ * NULL scanners are not called.
+ */
+struct h1_scan_ops {
+	const char *name;
+	/* skips bytes 0x21 to 0x7e of a request URI */
+	char *(*uri)(char *ptr, const char *end);
+	/* skips bytes of a header value until a CR or LF */
+	char *(*hdr_val)(char *ptr, const char *end);
+	/* skips letters, digits and dashes of a header name, turning the
+	 * skipped upper case letters to lower case if <lower> is non-zero.
+	 */
+	char *(*hdr_name)(char *ptr, const char *end, int lower);
+};
+
+#endif /* _HAPROXY_H1_SCAN_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
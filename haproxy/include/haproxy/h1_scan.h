@@ -0,0 +1,71 @@
+/*
+ * include/haproxy/h1_scan.h
+ * This file contains the vector scanners used by the HTTP/1 parser.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_H1_SCAN_H
+#define _HAPROXY_H1_SCAN_H
+
+#include <haproxy/api.h>
+#include <haproxy/h1_scan-t.h>
+
+/* SSE2 is always available on x86_64, AVX2 is detected at run time */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define H1_SCAN_X86
+#endif
+
+extern const struct h1_scan_ops h1_scan_scalar;
+#ifdef H1_SCAN_X86
+extern const struct h1_scan_ops h1_scan_sse2;
+extern const struct h1_scan_ops h1_scan_avx2;
+#endif
+extern const struct h1_scan_ops *h1_scan;
+
+void h1_scan_init(void);
+
+/* the smallest stride of all scanners, below which calling them is useless */
+#define H1_SCAN_MIN_LEN 16
+
+static inline char *h1_scan_uri(char *ptr, const char *end)
+{
+	if (h1_scan->uri && end - ptr >= H1_SCAN_MIN_LEN)
+		ptr = h1_scan->uri(ptr, end);
+	return ptr;
+}
+
+static inline char *h1_scan_hdr_val(char *ptr, const char *end)
+{
+	if (h1_scan->hdr_val && end - ptr >= H1_SCAN_MIN_LEN)
+		ptr = h1_scan->hdr_val(ptr, end);
+	return ptr;
+}
+
+static inline char *h1_scan_hdr_name(char *ptr, const char *end, int lower)
+{
+	if (h1_scan->hdr_name && end - ptr >= H1_SCAN_MIN_LEN)
+		ptr = h1_scan->hdr_name(ptr, end, lower);
+	return ptr;
+}
+
+#endif /* _HAPROXY_H1_SCAN_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,91 @@
+/*
+ * HPACK compressor (RFC7541) - type definitions
+ *
+ * Copyright (C) 2014-2020 Willy Tarreau <willy@haproxy.org>
+ * Copyright (C) 2017 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _HAPROXY_HPACK_ENC_T_H
+#define _HAPROXY_HPACK_ENC_T_H
+
+#include <inttypes.h>
+
+/* Encoder's Dynamic Table. It mirrors the dynamic table the peer's decoder
+ * builds from what we send, in order to reference previously sent header
+ * fields instead of repeating them.
+ *
+ * Entries are identified by a 32-bit insertion number. The newest one is
+ * <head> and the <used> ones before it are still present, so that HPACK
+ * index 62 designates <head>, 63 designates <head> - 1, etc. Their name and
+ * value are stored contiguously in the <data> ring, in insertion order. Two
+ * sets of hash chains link entries having the same name and value, and the
+ * same name, from the newest to the oldest. Chains are not unlinked when the
+ * oldest entries are evicted: walks simply stop on the first identifier which
+ * is not present anymore.
+ *
+ * The header fields emitted for a header block are only known to the peer
+ * once the block is sent, but the mux may have to encode a block again after
+ * a failed attempt, so each block is a transaction which either commits, or
+ * is rolled back when the next one begins. During a transaction, no more than
+ * <max> bytes (as counted by the protocol) may be inserted. Since the table
+ * held no more than this before, twice as many slots and data bytes as the
+ * table may hold guarantee that evicted entries are not overwritten until
+ * the transaction commits, and may be brought back by restoring the state
+ * saved in <txn>.
+ */
+struct hpack_edte {
+	uint32_t next_nv; /* next older entry with the same name and value hash */
+	uint32_t next_n;  /* next older entry with the same name hash */
+	uint32_t pos;     /* position of the name followed by the value in <data> */
+	uint16_t nlen;    /* name length */
+	uint16_t vlen;    /* value length */
+};
+
+/* state of the table which is restored when a transaction is rolled back */
+struct hpack_edt_state {
+	uint32_t head;    /* identifier of the newest entry */
+	uint32_t used;    /* number of entries in the table */
+	uint32_t total;   /* sum of nlen + vlen + 32 of the entries */
+	uint32_t dpos;    /* next free position in <data> */
+	uint64_t raw;     /* bytes of header fields encoded (name + value) */
+	uint64_t enc;     /* bytes emitted to encode them */
+};
+
+struct hpack_edt {
+	uint32_t cap;     /* largest size the table was allocated for */
+	uint32_t max;     /* current max size of the table, <= cap */
+	uint32_t upd_min; /* lowest max size since the last size update sent */
+	uint32_t slots;   /* number of entry slots, power of 2 */
+	uint32_t buckets; /* number of hash buckets, power of 2 */
+	uint32_t dsize;   /* size of <data> */
+	uint32_t budget;  /* bytes left to insert during this transaction */
+	uint8_t  upd;     /* a size update must start the next header block */
+	uint8_t  in_txn;  /* a transaction is in progress */
+	struct hpack_edt_state cur; /* current state */
+	struct hpack_edt_state txn; /* state when the transaction started */
+	struct hpack_edte *dte;   /* <slots> entries */
+	uint32_t *head_nv;        /* <buckets> heads of name+value chains */
+	uint32_t *head_n;         /* <buckets> heads of name chains */
+	char *data;               /* <dsize> bytes of names and values */
+};
+
+#endif /* _HAPROXY_HPACK_ENC_T_H */
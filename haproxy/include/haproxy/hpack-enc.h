@@ -32,10 +32,18 @@
 #include <import/ist.h>
 #include <haproxy/api.h>
 #include <haproxy/buf-t.h>
+#include <haproxy/hpack-enc-t.h>
 #include <haproxy/http-t.h>
 
 int hpack_encode_header(struct buffer *out, const struct ist n,
 			const struct ist v);
+size_t hpack_edt_size(uint32_t cap);
+struct hpack_edt *hpack_edt_init(void *area, uint32_t cap, uint32_t max);
+void hpack_edt_set_max(struct hpack_edt *edt, uint32_t max);
+int hpack_edt_begin(struct hpack_edt *edt, struct buffer *out);
+void hpack_edt_commit(struct hpack_edt *edt);
+int hpack_encode_header_edt(struct hpack_edt *edt, struct buffer *out, const struct ist n,
+                            const struct ist v);
 
 /* Returns the number of bytes required to encode the string length <len>. The
  * number of usable bits is an integral multiple of 7 plus 6 for the last byte.
@@ -0,0 +1,63 @@
+/*
+ * include/haproxy/iouring-t.h
+ * io_uring based socket I/O - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_IOURING_T_H
+#define _HAPROXY_IOURING_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/buf-t.h>
+
+/* iou_sock flags */
+#define IOU_SOCK_RX_POSTED   0x00000001  /* a recv request is queued */
+#define IOU_SOCK_TX_POSTED   0x00000002  /* a send request is queued */
+#define IOU_SOCK_RX_DRAINED  0x00000004  /* last recv didn't fill the buffer */
+#define IOU_SOCK_RX_SHUT     0x00000008  /* last recv reported a shutdown */
+#define IOU_SOCK_RX_ENABLED  0x00000010  /* recv may be posted by the poller */
+#define IOU_SOCK_RX_SPLICE   0x00000020  /* splicing in use, never recv in advance */
+
+/* operations reported in the requests' user_data */
+#define IOU_OP_RECV          1
+#define IOU_OP_SEND          2
+
+/* Socket I/O context used by the raw_sock transport layer when its recv() and
+ * send() calls are posted to the io_uring poller's ring instead of being
+ * performed immediately. Received data are placed in <rx> during the poller's
+ * pass and delivered later to the upper layers. Data to be sent are copied
+ * into <tx>, and are only reported as sent once the kernel has accepted them,
+ * so that the upper layers keep them until then.
+ */
+struct iou_sock {
+	int fd;                  /* the socket */
+	unsigned int flags;      /* IOU_SOCK_* */
+	unsigned int seq;        /* identifies this context's requests */
+	int rx_err;              /* errno reported by the last recv, or 0 */
+	int tx_err;              /* errno reported by the last send, or 0 */
+	size_t tx_acked;         /* bytes sent but not yet reported as such */
+	struct buffer rx;        /* data received in advance */
+	struct buffer tx;        /* copy of the data being sent */
+};
+
+#endif /* _HAPROXY_IOURING_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,57 @@
+/*
+ * include/haproxy/iouring.h
+ * io_uring based socket I/O - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_IOURING_H
+#define _HAPROXY_IOURING_H
+
+#include <haproxy/api.h>
+#include <haproxy/iouring-t.h>
+
+#ifdef USE_IOURING
+
+struct iou_sock *iou_sock_new(int fd);
+void iou_sock_free(struct iou_sock *s);
+int iou_sock_post_send(struct iou_sock *s, int msg_flags);
+
+#else
+
+static inline struct iou_sock *iou_sock_new(int fd)
+{
+	return NULL;
+}
+
+static inline void iou_sock_free(struct iou_sock *s)
+{
+}
+
+static inline int iou_sock_post_send(struct iou_sock *s, int msg_flags)
+{
+	return 0;
+}
+
+#endif /* USE_IOURING */
+
+#endif /* _HAPROXY_IOURING_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,99 @@
+/*
+ * include/haproxy/mapimg-t.h
+ * Precompiled map and ACL file images - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_MAPIMG_T_H
+#define _HAPROXY_MAPIMG_T_H
+
+#include <inttypes.h>
+#include <haproxy/api-t.h>
+#include <haproxy/poptrie-t.h>
+
+/* An image is produced from a map or ACL file by contrib/mapc and is mapped
+ * read-only by the processes using it, so that they share the same pages and
+ * do not have to parse nor index the entries. It is made of the following
+ * sections, all aligned to 8 bytes :
+ *
+ *   - the header (struct mapimg_hdr) ;
+ *   - the entries in file order (struct mapimg_ent) ;
+ *   - the entries' indexes sorted by key, for exact string lookups ;
+ *   - if MAPIMG_F_IP is set, the nodes and leaves of two compiled tries
+ *     (see poptrie-t.h) for IPv4 and IPv6 longest prefix lookups, whose
+ *     leaves hold 1 + the index of the entry ;
+ *   - the text area holding the NUL-terminated keys and values.
+ *
+ * Integers are stored in the byte order of the machine which produced it.
+ */
+
+#define MAPIMG_MAGIC       "HAPMAP1\n"   /* 8 bytes, no trailing zero */
+#define MAPIMG_BYTEORDER   0x01020304
+#define MAPIMG_NO_VAL      0xffffffffU   /* mapimg_ent->val for one-column files */
+
+/* mapimg_hdr->flags */
+#define MAPIMG_F_SMP       0x00000001    /* two-column file (key and value) */
+#define MAPIMG_F_IP        0x00000002    /* all keys are networks, tries present */
+
+struct mapimg_hdr {
+	char magic[8];              /* MAPIMG_MAGIC */
+	uint32_t byteorder;         /* MAPIMG_BYTEORDER */
+	uint32_t flags;             /* MAPIMG_F_* */
+	uint32_t nb_entries;
+	uint32_t nb_v4_nodes;
+	uint32_t nb_v4_leaves;
+	uint32_t nb_v6_nodes;
+	uint32_t nb_v6_leaves;
+	uint32_t reserved;
+	uint64_t size;              /* total image size in bytes */
+	uint64_t ent_ofs;           /* offset of the entries */
+	uint64_t sorted_ofs;        /* offset of the sorted index */
+	uint64_t v4_nodes_ofs;      /* offset of the IPv4 trie nodes */
+	uint64_t v4_leaves_ofs;     /* offset of the IPv4 trie leaves */
+	uint64_t v6_nodes_ofs;      /* offset of the IPv6 trie nodes */
+	uint64_t v6_leaves_ofs;     /* offset of the IPv6 trie leaves */
+	uint64_t text_ofs;          /* offset of the text area */
+	uint64_t text_len;          /* length of the text area */
+};
+
+struct mapimg_ent {
+	uint32_t key;               /* offset of the key in the text area */
+	uint32_t key_len;           /* length of the key */
+	uint32_t val;               /* offset of the value, or MAPIMG_NO_VAL */
+	uint32_t line;              /* line number in the source file */
+};
+
+/* A mapped image. The tries only point to the image's nodes and leaves. */
+struct mapimg {
+	const char *area;           /* start of the mapping */
+	size_t size;                /* size of the mapping */
+	unsigned int flags;         /* MAPIMG_F_* */
+	unsigned int nb_entries;
+	const struct mapimg_ent *ent;
+	const uint32_t *sorted;
+	const char *text;
+	struct poptrie v4;          /* IPv4 trie if MAPIMG_F_IP */
+	struct poptrie v6;          /* IPv6 trie if MAPIMG_F_IP */
+};
+
+#endif /* _HAPROXY_MAPIMG_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,144 @@
+/*
+ * include/haproxy/mapimg.h
+ * Precompiled map and ACL file images - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_MAPIMG_H
+#define _HAPROXY_MAPIMG_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <haproxy/api.h>
+#include <haproxy/mapimg-t.h>
+#include <haproxy/net_helper.h>
+#include <haproxy/poptrie.h>
+
+int mapimg_open(const char *path, struct mapimg **img, char **err);
+void mapimg_close(struct mapimg *img);
+int mapimg_find(const struct mapimg *img, const char *key, size_t len);
+
+/* Returns the key of entry <idx> of image <img> */
+static inline const char *mapimg_key(const struct mapimg *img, unsigned int idx)
+{
+	return img->text + img->ent[idx].key;
+}
+
+/* Returns the value of entry <idx> of image <img>, or NULL if it has none */
+static inline const char *mapimg_val(const struct mapimg *img, unsigned int idx)
+{
+	if (img->ent[idx].val == MAPIMG_NO_VAL)
+		return NULL;
+	return img->text + img->ent[idx].val;
+}
+
+/* Compares key <a> of length <alen> with key <b> of length <blen>, bytewise.
+ * Returns <0, 0 or >0 like memcmp(). This defines the order of the sorted
+ * index of the images.
+ */
+static inline int mapimg_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+	int ret = memcmp(a, b, alen < blen ? alen : blen);
+
+	if (ret)
+		return ret;
+	return (alen > blen) - (alen < blen);
+}
+
+/* Parses network <text> the same way as the "ip" patterns do, except that
+ * host names are not resolved : an IPv4 address followed by an optional
+ * "/<bits>" or dotted mask, or an IPv6 address followed by an optional
+ * "/<bits>". On success, <*v6> tells the family, <addr> receives the address
+ * in network byte order (4 or 16 bytes) and <*len> the prefix length, and 1 is
+ * returned. 0 is returned if the text is not valid, or if the mask is not
+ * contiguous since such networks cannot be indexed.
+ */
+static inline int mapimg_parse_ip(const char *text, int *v6, void *addr, unsigned int *len)
+{
+	char buf[64], *slash, *end;
+	size_t tlen = strlen(text);
+	struct in_addr mask;
+	unsigned long bits;
+	uint32_t m;
+
+	if (tlen >= sizeof(buf))
+		return 0;
+	memcpy(buf, text, tlen + 1);
+
+	slash = strrchr(buf, '/');
+	if (slash)
+		*slash++ = 0;
+
+	if (inet_pton(AF_INET, buf, addr) > 0) {
+		*v6 = 0;
+		*len = 32;
+		if (!slash)
+			return 1;
+		if (strchr(slash, '.')) {
+			if (inet_pton(AF_INET, slash, &mask) <= 0)
+				return 0;
+			m = ntohl(mask.s_addr);
+			if (m + (m & -m) != 0)
+				return 0;
+			*len = m ? 33 - __builtin_ffs(m) : 0;
+			return 1;
+		}
+		bits = strtoul(slash, &end, 10);
+		if (!*slash || *end || bits > 32)
+			return 0;
+		*len = bits;
+		return 1;
+	}
+
+	if (strchr(buf, '.') && !strchr(buf, ':'))
+		return 0;
+
+	if (inet_pton(AF_INET6, buf, addr) > 0) {
+		*v6 = 1;
+		*len = 128;
+		if (!slash)
+			return 1;
+		bits = strtoul(slash, &end, 10);
+		if (!*slash || *end || bits > 128)
+			return 0;
+		*len = bits;
+		return 1;
+	}
+	return 0;
+}
+
+/* Looks up address <addr> (network byte order, IPv6 if <v6> is set, otherwise
+ * IPv4) in the tries of image <img>, which must have MAPIMG_F_IP. Returns the
+ * index of the entry holding the longest matching network, the first one in
+ * file order among identical networks, or -1 if none matches.
+ */
+static inline int mapimg_lookup_ip(const struct mapimg *img, int v6, const void *addr)
+{
+	if (v6)
+		return (int)poptrie_lookup_leaf(&img->v6, read_n64(addr), read_n64((const char *)addr + 8)) - 1;
+	return (int)poptrie_lookup_leaf(&img->v4, (uint64_t)read_n32(addr) << 32, 0) - 1;
+}
+
+#endif /* _HAPROXY_MAPIMG_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
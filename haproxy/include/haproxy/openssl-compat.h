@@ -59,6 +59,11 @@
 #define HAVE_SSL_SCTL
 #endif
 
+/* kTLS needs the keylog callback and the HKDF/TLS1-PRF key derivations */
+#if (defined(USE_KTLS) && (HA_OPENSSL_VERSION_NUMBER >= 0x10101000L) && !defined(LIBRESSL_VERSION_NUMBER) && !defined(OPENSSL_IS_BORINGSSL))
+#define HAVE_SSL_KTLS
+#endif
+
 #if (HA_OPENSSL_VERSION_NUMBER < 0x0090800fL)
 /* Functions present in OpenSSL 0.9.8, older not tested */
 static inline const unsigned char *SSL_SESSION_get_id(const SSL_SESSION *sess, unsigned int *sid_length)
@@ -0,0 +1,61 @@
+/*
+ * include/haproxy/patcache-t.h
+ * Set-associative cache of pattern lookup results - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_PATCACHE_T_H
+#define _HAPROXY_PATCACHE_T_H
+
+#include <haproxy/api-t.h>
+
+/* number of entries per set, so that a set fits in a cache line */
+#define PATCACHE_WAYS 4
+
+/* An entry remembers the result of a lookup. The key is a 64-bit hash of the
+ * looked up value mixed with the domain (the expression) and its revision, so
+ * that entries of a modified expression are never found again. A null key
+ * marks a free entry.
+ */
+struct patcache_ent {
+	unsigned long long key;
+	void *data;
+};
+
+/* A set holds its entries from the most to the least recently used one */
+struct patcache_set {
+	struct patcache_ent ent[PATCACHE_WAYS];
+} ALIGNED(64);
+
+/* The cache. A domain only uses the <budget_mask> + 1 consecutive sets which
+ * start at a position depending on it, which bounds the number of entries it
+ * may hold.
+ */
+struct patcache {
+	unsigned int mask;          /* number of sets - 1, a power of two - 1 */
+	unsigned int budget_mask;   /* number of sets a domain may use - 1 */
+	struct patcache_set *sets;  /* <mask> + 1 sets, aligned in <area> */
+	void *area;                 /* allocated memory */
+};
+
+#endif /* _HAPROXY_PATCACHE_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
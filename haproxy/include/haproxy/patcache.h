@@ -0,0 +1,104 @@
+/*
+ * include/haproxy/patcache.h
+ * Set-associative cache of pattern lookup results - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_PATCACHE_H
+#define _HAPROXY_PATCACHE_H
+
+#include <haproxy/api.h>
+#include <haproxy/patcache-t.h>
+
+struct patcache *patcache_new(unsigned int entries, unsigned int budget);
+void patcache_free(struct patcache *pc);
+
+/* Returns the key of a value whose hash is <hash> in domain <domain> at
+ * revision <rev>. The key is never null.
+ */
+static inline unsigned long long patcache_key(unsigned long long hash, const void *domain,
+                                              unsigned long long rev)
+{
+	unsigned long long k;
+
+	k = hash ^ ((unsigned long)domain * 0x9E3779B97F4A7C15ULL) ^ (rev * 0xC2B2AE3D27D4EB4FULL);
+	k ^= k >> 33;
+	k *= 0xFF51AFD7ED558CCDULL;
+	k ^= k >> 33;
+	k *= 0xC4CEB9FE1A85EC53ULL;
+	k ^= k >> 33;
+	return k ? k : 1;
+}
+
+/* Returns the set of <pc> where <key> of domain <domain> is stored */
+static inline struct patcache_set *patcache_set(const struct patcache *pc, const void *domain,
+                                                unsigned long long key)
+{
+	unsigned int base = ((unsigned long)domain >> 4) * 2654435761U;
+
+	return &pc->sets[(base + ((unsigned int)key & pc->budget_mask)) & pc->mask];
+}
+
+/* Looks up <key> of domain <domain> in <pc>. If it is found, it becomes the
+ * most recently used entry of its set, its data is stored into <data> and 1 is
+ * returned. Otherwise 0 is returned.
+ */
+static inline int patcache_get(struct patcache *pc, const void *domain,
+                               unsigned long long key, void **data)
+{
+	struct patcache_set *set = patcache_set(pc, domain, key);
+	struct patcache_ent ent;
+	int i;
+
+	for (i = 0; i < PATCACHE_WAYS; i++) {
+		if (set->ent[i].key != key)
+			continue;
+		ent = set->ent[i];
+		for (; i > 0; i--)
+			set->ent[i] = set->ent[i - 1];
+		set->ent[0] = ent;
+		*data = ent.data;
+		return 1;
+	}
+	return 0;
+}
+
+/* Stores <data> for <key> of domain <domain> into <pc>, as the most recently
+ * used entry of its set, which must not already contain <key>. The least
+ * recently used entry is dropped. Returns 1 if it was in use, otherwise 0.
+ */
+static inline int patcache_put(struct patcache *pc, const void *domain,
+                               unsigned long long key, void *data)
+{
+	struct patcache_set *set = patcache_set(pc, domain, key);
+	int evicted = !!set->ent[PATCACHE_WAYS - 1].key;
+	int i;
+
+	for (i = PATCACHE_WAYS - 1; i > 0; i--)
+		set->ent[i] = set->ent[i - 1];
+	set->ent[0].key = key;
+	set->ent[0].data = data;
+	return evicted;
+}
+
+#endif /* _HAPROXY_PATCACHE_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
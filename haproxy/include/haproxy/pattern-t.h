@@ -24,7 +24,13 @@
 
 #include <import/ebmbtree.h>
 
+#include <haproxy/acm-t.h>
+#include <haproxy/domtrie-t.h>
+#include <haproxy/rxset-t.h>
+#include <haproxy/mapimg-t.h>
 #include <haproxy/api-t.h>
+#include <haproxy/poptrie-t.h>
+#include <haproxy/qsbr-t.h>
 #include <haproxy/regex-t.h>
 #include <haproxy/sample_data-t.h>
 #include <haproxy/thread-t.h>
@@ -69,6 +75,7 @@ enum {
 /* possible flags for patterns storage */
 enum {
 	PAT_SF_TREE        = 1 << 0,       /* some patterns are arranged in a tree */
+	PAT_SF_IMG         = 1 << 1,       /* the pattern was found in a mapped image */
 };
 
 /* ACL match methods */
@@ -106,9 +113,38 @@ struct pat_ref {
 	char *display; /* String displayed to identify the pattern origin. */
 	struct list head; /* The head of the list of struct pat_ref_elt. */
 	struct list pat; /* The head of the list of struct pattern_expr. */
+	struct mapimg *img; /* Image the file was loaded from, its entries precede <head>, or NULL. */
+	struct pat_ref_ver *ver; /* Version being prepared, or NULL. */
+	struct pat_ref_ver *reload; /* Version being built by pat_ref_reload(), or NULL. */
+	unsigned int last_ver; /* Number of the last version prepared. */
+	unsigned int gen; /* Incremented each time a version is committed. */
+	struct pat_cache_ctr *cache_ctr; /* One per thread, or NULL if not counted. */
 	__decl_thread(HA_SPINLOCK_T lock); /* Lock used to protect pat ref elements */
 };
 
+/* Per-thread statistics of the lookup cache for the expressions of a pat_ref */
+struct pat_cache_ctr {
+	unsigned long long hit;   /* results found in the cache */
+	unsigned long long miss;  /* results which had to be computed */
+	unsigned long long evict; /* other results dropped to store them */
+} THREAD_ALIGNED(64);
+
+/* This is a version of the contents of a pat_ref, prepared out of sight of the
+ * lookups and published at once by pat_ref_commit(). It has one expression for
+ * each expression of the reference when it was prepared. Once committed, it
+ * holds the contents it replaced until no thread may be using them anymore.
+ */
+struct pat_ref_ver {
+	struct qsbr_node node; /* Used to release the replaced contents. */
+	unsigned int id; /* Version number. */
+	struct list head; /* The head of the list of struct pat_ref_elt. */
+	struct list added; /* Entries added to the reference while reloading it. */
+	int nb_expr; /* Number of expressions below. */
+	struct pattern_expr **expr; /* The expressions of this version. */
+	struct pattern_expr **repl; /* The expressions of the reference they replace. */
+	struct mapimg *img; /* Replaced image, or NULL. */
+};
+
 /* This is a part of struct pat_ref. Each entry contain one
  * pattern and one associated value as original string.
  */
@@ -190,7 +226,15 @@ struct pattern_expr {
 	struct list patterns;         /* list of acl_patterns */
 	struct eb_root pattern_tree;  /* may be used for lookup in large datasets */
 	struct eb_root pattern_tree_2;  /* may be used for different types */
+	struct acm *acm;                /* automaton built from <patterns> for sub/beg, or NULL */
+	struct acm *acm_rev;            /* same with reversed patterns for end, or NULL */
+	struct domtrie *domtrie;        /* label trie built from <patterns> for dom, or NULL */
+	struct rxset *rxset;            /* prefilter of the regexes of <patterns>, or NULL */
+	struct poptrie *iptrie;         /* compiled copy of <pattern_tree> for ip, or NULL */
+	struct poptrie *iptrie_2;       /* compiled copy of <pattern_tree_2> for ip, or NULL */
+	struct mapimg *img;             /* ref's image, looked up before the trees, or NULL */
 	int mflags;                     /* flags relative to the parsing or matching method. */
+	struct list users;              /* list of struct pattern_expr_list pointing here */
 	__decl_thread(HA_RWLOCK_T lock);               /* lock used to protect patterns */
 };
 
@@ -200,8 +244,9 @@ struct pattern_expr {
  */
 struct pattern_expr_list {
 	struct list list; /* Used for chaining pattern_expr in pattern_head. */
+	struct list by_expr; /* Used for chaining in the expr's users. */
 	int do_free;
-	struct pattern_expr *expr; /* The used expr. */
+	struct pattern_expr *expr; /* The used expr, replaced atomically on commit. */
 };
 
 
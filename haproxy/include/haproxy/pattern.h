@@ -196,8 +196,14 @@ int pat_ref_set_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt, const cha
 int pat_ref_delete(struct pat_ref *ref, const char *key);
 int pat_ref_delete_by_id(struct pat_ref *ref, struct pat_ref_elt *refelt);
 int pat_ref_prune(struct pat_ref *ref);
+int pat_ref_unpack(struct pat_ref *ref);
 int pat_ref_load(struct pat_ref *ref, struct pattern_expr *expr, int patflags, int soe, char **err);
 void pat_ref_reload(struct pat_ref *ref, struct pat_ref *replace);
+unsigned int pat_ref_prepare(struct pat_ref *ref);
+int pat_ref_add_ver(struct pat_ref *ref, unsigned int id, const char *pattern, const char *sample, char **err);
+int pat_ref_clear_ver(struct pat_ref *ref, unsigned int id, char **err);
+int pat_ref_commit(struct pat_ref *ref, unsigned int id, char **err);
+void pat_ref_cache_stats(const struct pat_ref *ref, struct pat_cache_ctr *sum);
 
 
 /*
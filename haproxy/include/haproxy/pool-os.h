@@ -108,6 +108,104 @@ static inline void pool_free_area(void *area, size_t size)
 
 #endif /* DEBUG_UAF */
 
+/************* large areas *************/
+
+#ifndef MAP_POPULATE
+/* pool_alloc_arena() touches the pages itself when this is not supported */
+#define MAP_POPULATE 0
+#endif
+
+/* Allocates an area of <size> bytes aligned on <align>, which must be a power
+ * of two multiple of the page size, directly from the system. Returns NULL on
+ * failure.
+ */
+static inline void *pool_alloc_aligned_area(size_t size, size_t align)
+{
+	char *ret, *end;
+	size_t head;
+
+	ret = mmap(NULL, size + align, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (ret == MAP_FAILED)
+		return NULL;
+
+	/* trim the unaligned head and the tail */
+	head = -(uintptr_t)ret & (align - 1);
+	end = ret + size + align;
+	if (head)
+		munmap(ret, head);
+	ret += head;
+	if (end > ret + size)
+		munmap(ret + size, end - (ret + size));
+	return ret;
+}
+
+/* Returns the pages covered by area <area> of size <size> to the system while
+ * keeping the area mapped. It will read as zeroes on next access.
+ */
+static inline void pool_release_area(void *area, size_t size)
+{
+	madvise(area, size, MADV_DONTNEED);
+}
+
+/* Asks the system to back area <area> of size <size> with transparent huge
+ * pages. Returns non-zero on success, zero if not supported.
+ */
+static inline int pool_advise_huge_area(void *area, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	return madvise(area, size, MADV_HUGEPAGE) == 0;
+#else
+	return 0;
+#endif
+}
+
+/* Touches all pages of area <area> of size <size> so that they are faulted in
+ * immediately instead of on first use.
+ */
+static inline void pool_touch_area(void *area, size_t size)
+{
+	size_t ofs;
+
+	for (ofs = 0; ofs < size; ofs += 4096)
+		((volatile char *)area)[ofs] = 0;
+}
+
+/* Allocates an area of <size> bytes directly from the system for objects
+ * which will not be released, and faults its pages in. If <*huge> is not
+ * POOL_ARENA_PAGES, <size> must be a multiple of POOL_HUGE_PAGE_SIZE and
+ * explicit huge pages are tried first, then transparent huge pages, and
+ * <*huge> is updated with what was obtained. Returns NULL on failure.
+ */
+static inline void *pool_alloc_arena(size_t size, int *huge)
+{
+	void *ret;
+
+	if (*huge == POOL_ARENA_PAGES) {
+		ret = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_POPULATE, -1, 0);
+		if (ret == MAP_FAILED)
+			return NULL;
+		if (!MAP_POPULATE)
+			pool_touch_area(ret, size);
+		return ret;
+	}
+
+#ifdef MAP_HUGETLB
+	ret = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB|MAP_POPULATE, -1, 0);
+	if (ret != MAP_FAILED) {
+		*huge = POOL_ARENA_HUGETLB;
+		return ret;
+	}
+#endif
+	/* no reserved huge pages, fall back to transparent ones */
+	ret = pool_alloc_aligned_area(size, POOL_HUGE_PAGE_SIZE);
+	if (!ret)
+		return NULL;
+
+	*huge = pool_advise_huge_area(ret, size) ? POOL_ARENA_THP : POOL_ARENA_PAGES;
+	pool_touch_area(ret, size);
+	return ret;
+}
+
 #endif /* _HAPROXY_POOL_OS_H */
 
 /*
@@ -40,8 +40,18 @@
 #define CONFIG_HAP_LOCAL_POOLS
 #endif
 
+/* When built with USE_POOL_SLAB, pools of small enough objects are backed by
+ * the slab allocator instead of having their own free lists and caches. This
+ * isn't supported for debugging modes.
+ */
+#if defined(USE_POOL_SLAB) && !defined(DEBUG_UAF) && !defined(DEBUG_MEMORY_POOLS) && !defined(DEBUG_FAIL_ALLOC)
+#define CONFIG_HAP_POOL_SLAB
+#endif
+
 #define MEM_F_SHARED	0x1
 #define MEM_F_EXACT	0x2
+#define MEM_F_SLAB	0x4	/* objects are allocated from the slab class <slab_class> */
+#define MEM_F_HUGE	0x8	/* pre-allocated objects are backed by huge pages */
 
 /* By default, free objects are linked by a pointer stored at the beginning of
  * the memory area. When DEBUG_MEMORY_POOLS is set, the allocated area is
@@ -69,6 +79,16 @@
 
 #define POOL_AVG_SAMPLES 1024
 
+/* size of the huge pages used to back pre-allocated objects */
+#ifndef POOL_HUGE_PAGE_SIZE
+#define POOL_HUGE_PAGE_SIZE (2UL << 20)
+#endif
+
+/* how the pre-allocated objects are backed */
+#define POOL_ARENA_PAGES	0	/* normal pages */
+#define POOL_ARENA_THP		1	/* transparent huge pages were requested */
+#define POOL_ARENA_HUGETLB	2	/* explicit huge pages */
+
 
 struct pool_cache_head {
 	struct list list;    /* head of objects in this pool */
@@ -93,7 +113,10 @@ struct pool_head {
 	unsigned int flags;	/* MEM_F_* */
 	unsigned int users;	/* number of pools sharing this zone */
 	unsigned int failed;	/* failed allocations */
-	/* 32-bit hole here */
+	int slab_class;		/* slab size class if MEM_F_SLAB is set */
+	unsigned int prealloc;	/* number of objects pre-allocated on startup */
+	void *arena;		/* area holding the pre-allocated objects, if any */
+	size_t arena_size;	/* size of this area */
 	struct list list;	/* list of all known pools */
 	char name[12];		/* name of the pool */
 } __attribute__((aligned(64)));
@@ -24,11 +24,13 @@
 
 #include <string.h>
 
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/freq_ctr.h>
 #include <haproxy/list.h>
 #include <haproxy/pool-os.h>
 #include <haproxy/pool-t.h>
+#include <haproxy/slab.h>
 #include <haproxy/thread.h>
 
 /* This registers a call to create_pool_callback(ptr, name, size) */
@@ -63,6 +65,45 @@ void *pool_destroy(struct pool_head *pool);
 void pool_destroy_all();
 
 
+#ifdef CONFIG_HAP_POOL_SLAB
+
+/****************** Slab-backed pools ******************/
+
+/* Allocates an object for slab-backed pool <pool>, making sure that <avail>
+ * more objects may still be allocated if the pool is limited. Such pools have
+ * no free objects of their own, so <allocated> always equals <used>. Returns
+ * NULL on failure.
+ */
+static inline void *pool_slab_alloc(struct pool_head *pool, unsigned int avail)
+{
+	void *p;
+
+	if (unlikely(pool->limit && pool->used + avail >= pool->limit)) {
+		activity[tid].pool_fail++;
+		return NULL;
+	}
+
+	p = slab_alloc(pool->slab_class);
+	if (unlikely(!p)) {
+		_HA_ATOMIC_ADD(&pool->failed, 1);
+		activity[tid].pool_fail++;
+		return NULL;
+	}
+	_HA_ATOMIC_ADD(&pool->used, 1);
+	_HA_ATOMIC_ADD(&pool->allocated, 1);
+	return p;
+}
+
+/* Releases object <ptr> to slab-backed pool <pool> */
+static inline void pool_slab_free(struct pool_head *pool, void *ptr)
+{
+	slab_free(ptr);
+	_HA_ATOMIC_SUB(&pool->allocated, 1);
+	_HA_ATOMIC_SUB(&pool->used, 1);
+}
+
+#endif /* CONFIG_HAP_POOL_SLAB */
+
 /* returns true if the pool is considered to have too many free objects */
 static inline int pool_is_crowded(const struct pool_head *pool)
 {
@@ -70,6 +111,14 @@ static inline int pool_is_crowded(const struct pool_head *pool)
 	       (int)(pool->allocated - pool->used) >= pool->minavail;
 }
 
+/* returns non-zero if object <ptr> was pre-allocated in the arena of pool
+ * <pool>, in which case it must never be released to the system.
+ */
+static inline int pool_in_arena(const struct pool_head *pool, const void *ptr)
+{
+	return (size_t)((const char *)ptr - (const char *)pool->arena) < pool->arena_size;
+}
+
 
 #ifdef CONFIG_HAP_LOCAL_POOLS
 
@@ -205,7 +254,7 @@ static inline void __pool_free(struct pool_head *pool, void *ptr)
 
 	_HA_ATOMIC_SUB(&pool->used, 1);
 
-	if (unlikely(pool_is_crowded(pool))) {
+	if (unlikely(pool_is_crowded(pool)) && !pool_in_arena(pool, ptr)) {
 		pool_free_area(ptr, pool->size + POOL_EXTRA);
 		_HA_ATOMIC_SUB(&pool->allocated, 1);
 	} else {
@@ -255,7 +304,7 @@ static inline void __pool_free(struct pool_head *pool, void *ptr)
 #ifndef DEBUG_UAF /* normal pool behaviour */
 	HA_SPIN_LOCK(POOL_LOCK, &pool->lock);
 	pool->used--;
-	if (pool_is_crowded(pool)) {
+	if (pool_is_crowded(pool) && !pool_in_arena(pool, ptr)) {
 		pool_free_area(ptr, pool->size + POOL_EXTRA);
 		pool->allocated--;
 	} else {
@@ -285,6 +334,11 @@ static inline void *pool_get_first(struct pool_head *pool)
 {
 	void *p;
 
+#ifdef CONFIG_HAP_POOL_SLAB
+	if (likely(pool->flags & MEM_F_SLAB))
+		return pool_slab_alloc(pool, 0);
+#endif
+
 #ifdef CONFIG_HAP_LOCAL_POOLS
 	if (likely(p = __pool_get_from_cache(pool)))
 		return p;
@@ -309,6 +363,11 @@ static inline void *pool_alloc_dirty(struct pool_head *pool)
 {
 	void *p;
 
+#ifdef CONFIG_HAP_POOL_SLAB
+	if (likely(pool->flags & MEM_F_SLAB))
+		return pool_slab_alloc(pool, 0);
+#endif
+
 #ifdef CONFIG_HAP_LOCAL_POOLS
 	if (likely(p = __pool_get_from_cache(pool)))
 		return p;
@@ -364,6 +423,13 @@ static inline void pool_free(struct pool_head *pool, void *ptr)
 		if (unlikely(mem_poison_byte >= 0))
 			memset(ptr, mem_poison_byte, pool->size);
 
+#ifdef CONFIG_HAP_POOL_SLAB
+		if (likely(pool->flags & MEM_F_SLAB)) {
+			pool_slab_free(pool, ptr);
+			return;
+		}
+#endif
+
 #ifdef CONFIG_HAP_LOCAL_POOLS
 		/* put the object back into the cache only if there are not too
 		 * many objects yet in this pool (no more than half of the cached
@@ -0,0 +1,78 @@
+/*
+ * include/haproxy/poptrie-t.h
+ * Compressed multibit trie for longest prefix matching - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_POPTRIE_T_H
+#define _HAPROXY_POPTRIE_T_H
+
+#include <inttypes.h>
+#include <haproxy/api-t.h>
+
+/* number of address bits consumed by each node */
+#define POPTRIE_STRIDE   6
+
+/* A node covers POPTRIE_STRIDE bits of the address, hence 64 slots. A slot
+ * either leads to a child node, or holds a leaf. Children of a node are
+ * stored contiguously starting at <base1>, and a slot's child is found by
+ * counting the bits set in <vector> before the slot. Consecutive leaf slots
+ * holding the same value share a single leaf: <leafvec> marks the slots
+ * starting a new value, and the leaves are stored contiguously from <base0>.
+ */
+struct poptrie_node {
+	uint64_t vector;          /* slots leading to a child node */
+	uint64_t leafvec;         /* leaf slots starting a new value */
+	unsigned int base1;       /* index of the first child in the nodes array */
+	unsigned int base0;       /* index of the first leaf in the leaves array */
+};
+
+/* a prefix waiting to be compiled, addresses are stored in host order */
+struct poptrie_pfx {
+	uint64_t hi, lo;          /* upper and lower 64 bits of the address */
+	unsigned int len;         /* prefix length in bits */
+	unsigned int idx;         /* 1 + index of the item */
+};
+
+/* A read-only longest prefix match structure for addresses of up to 128 bits.
+ * Prefixes are added with poptrie_add() then the trie is built by
+ * poptrie_compile(), after which it may be shared between threads. Leaves hold
+ * 1 + the index of the item of the longest matching prefix, or 0.
+ */
+struct poptrie {
+	unsigned int width;           /* address width in bits (32 or 128) */
+	unsigned int compiled;        /* non-zero once poptrie_compile() succeeded */
+	unsigned int nb_items;        /* number of prefixes added */
+	unsigned int alloc_items;     /* allocated entries in <items> and <pfx> */
+	void **items;                 /* items associated with the prefixes */
+	struct poptrie_pfx *pfx;      /* prefixes, released by poptrie_compile() */
+
+	struct poptrie_node *nodes;   /* root is nodes[0] */
+	unsigned int nb_nodes;
+	unsigned int alloc_nodes;
+	unsigned int *leaves;
+	unsigned int nb_leaves;
+	unsigned int alloc_leaves;
+};
+
+#endif /* _HAPROXY_POPTRIE_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,103 @@
+/*
+ * include/haproxy/poptrie.h
+ * Compressed multibit trie for longest prefix matching - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_POPTRIE_H
+#define _HAPROXY_POPTRIE_H
+
+#include <haproxy/api.h>
+#include <haproxy/net_helper.h>
+#include <haproxy/poptrie-t.h>
+
+struct poptrie *poptrie_new(unsigned int width);
+int poptrie_add(struct poptrie *pt, const void *addr, unsigned int len, void *item);
+int poptrie_compile(struct poptrie *pt);
+void poptrie_free(struct poptrie *pt);
+size_t poptrie_mem(const struct poptrie *pt);
+
+/* Returns the POPTRIE_STRIDE bits of the 128-bit address <hi>:<lo> which start
+ * at bit <d>, counted from the most significant one. Bits past the end of the
+ * address read as zero.
+ */
+static inline unsigned int poptrie_slot(uint64_t hi, uint64_t lo, unsigned int d)
+{
+	int s = 128 - POPTRIE_STRIDE - (int)d;
+
+	if (s >= 64)
+		return (hi >> (s - 64)) & ((1 << POPTRIE_STRIDE) - 1);
+	if (s > 0)
+		return ((hi << (64 - s)) | (lo >> s)) & ((1 << POPTRIE_STRIDE) - 1);
+	return (lo << -s) & ((1 << POPTRIE_STRIDE) - 1);
+}
+
+/* Looks up the 128-bit address <hi>:<lo> in compiled trie <pt>, addresses of
+ * narrower tries being left-aligned. Returns the leaf of the longest matching
+ * prefix, which is 1 + the index of its item in the order they were added, or
+ * 0 if none matches.
+ */
+static inline unsigned int poptrie_lookup_leaf(const struct poptrie *pt, uint64_t hi, uint64_t lo)
+{
+	const struct poptrie_node *n = pt->nodes;
+	unsigned int d = 0;
+	uint64_t bit;
+
+	while (1) {
+		bit = 1ULL << poptrie_slot(hi, lo, d);
+		if (!(n->vector & bit))
+			break;
+		n = &pt->nodes[n->base1 + __builtin_popcountll(n->vector & (bit - 1))];
+		d += POPTRIE_STRIDE;
+	}
+
+	return pt->leaves[n->base0 + __builtin_popcountll(n->leafvec & ((bit << 1) - 1)) - 1];
+}
+
+/* Same as poptrie_lookup_leaf() but returns the item of the longest matching
+ * prefix, or NULL if none matches.
+ */
+static inline void *poptrie_lookup(const struct poptrie *pt, uint64_t hi, uint64_t lo)
+{
+	unsigned int leaf = poptrie_lookup_leaf(pt, hi, lo);
+
+	return leaf ? pt->items[leaf - 1] : NULL;
+}
+
+/* Looks up the IPv4 address <addr> (network byte order) in compiled 32-bit
+ * trie <pt>. Returns the item of the longest matching prefix, or NULL.
+ */
+static inline void *poptrie_lookup4(const struct poptrie *pt, const void *addr)
+{
+	return poptrie_lookup(pt, (uint64_t)read_n32(addr) << 32, 0);
+}
+
+/* Looks up the IPv6 address <addr> (network byte order) in compiled 128-bit
+ * trie <pt>. Returns the item of the longest matching prefix, or NULL.
+ */
+static inline void *poptrie_lookup6(const struct poptrie *pt, const void *addr)
+{
+	return poptrie_lookup(pt, read_n64(addr), read_n64((const char *)addr + 8));
+}
+
+#endif /* _HAPROXY_POPTRIE_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -197,6 +197,12 @@ enum PR_SRV_STATE_FILE {
  */
 #define PR_RE_EARLY_ERROR         0x00010000 /* Retry if we failed at sending early data */
 #define PR_RE_JUNK_REQUEST        0x00020000 /* We received an incomplete or garbage response */
+
+/* Number of log-scale buckets of the response time histogram used to estimate
+ * the percentile-based hedge delay. Each power of two of milliseconds is split
+ * into 4 buckets, and the last one collects everything above 114 seconds.
+ */
+#define PX_HEDGE_BUCKETS          64
 struct stream;
 
 struct http_snapshot {
@@ -347,6 +353,10 @@ struct proxy {
 	int conn_retries;			/* maximum number of connect retries */
 	unsigned int retry_type;                /* Type of retry allowed */
 	int redispatch_after;			/* number of retries before redispatch */
+	unsigned int hedge_delay;		/* delay (ms) before hedging an idempotent request, 0=none */
+	unsigned int hedge_pct;			/* hedge after this percentile of the response times, 0=none */
+	unsigned int hedge_samples;		/* number of samples in <hedge_hist> */
+	unsigned int hedge_hist[PX_HEDGE_BUCKETS]; /* histogram of the servers' response times */
 	unsigned down_trans;			/* up-down transitions */
 	unsigned down_time;			/* total time the proxy was down */
 	unsigned int log_count;			/* number of logs produced by the frontend */
@@ -0,0 +1,52 @@
+/*
+ * include/haproxy/qsbr-t.h
+ * Quiescent-state based deferred reclamation - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_QSBR_T_H
+#define _HAPROXY_QSBR_T_H
+
+#include <haproxy/api-t.h>
+
+/* An object which was unlinked from a shared structure and which must not be
+ * released before all threads which might still be reading it are done. It is
+ * stamped with the epoch all threads must have reached for this to be true.
+ */
+struct qsbr_node {
+	struct qsbr_node *next;              /* next object retired by the same thread */
+	void (*free)(struct qsbr_node *);    /* function used to release the object */
+	unsigned int epoch;                  /* epoch ending the grace period */
+};
+
+/* per-thread context. <epoch> is the global epoch the thread observed when it
+ * last passed through a quiescent state. The retired objects are released by
+ * the thread which retired them, in the order they were retired.
+ */
+struct qsbr_thread {
+	unsigned int epoch;                  /* last epoch seen in a quiescent state */
+	struct qsbr_node *head;              /* oldest retired object */
+	struct qsbr_node *tail;              /* last retired object */
+} __attribute__((aligned(64)));
+
+#endif /* _HAPROXY_QSBR_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,54 @@
+/*
+ * include/haproxy/qsbr.h
+ * Quiescent-state based deferred reclamation - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_QSBR_H
+#define _HAPROXY_QSBR_H
+
+#include <haproxy/api.h>
+#include <haproxy/qsbr-t.h>
+#include <haproxy/thread.h>
+
+extern volatile unsigned int qsbr_epoch;
+extern struct qsbr_thread qsbr_ctx[MAX_THREADS];
+
+void qsbr_retire(struct qsbr_node *node, void (*fct)(struct qsbr_node *));
+void __qsbr_reclaim();
+void qsbr_release_all();
+
+/* Reports that the current thread holds no pointer obtained from a lock-free
+ * lookup anymore, and releases the objects it retired whose grace period is
+ * over. This is called once per polling loop.
+ */
+static inline void qsbr_quiescent()
+{
+	struct qsbr_thread *ctx = &qsbr_ctx[tid];
+
+	HA_ATOMIC_STORE(&ctx->epoch, qsbr_epoch);
+	if (ctx->head)
+		__qsbr_reclaim();
+}
+
+#endif /* _HAPROXY_QSBR_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,78 @@
+/*
+ * include/haproxy/rxset-t.h
+ * Literal prefilter for lists of regular expressions - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_RXSET_T_H
+#define _HAPROXY_RXSET_T_H
+
+#include <haproxy/api-t.h>
+
+/* flags passed to rxset_new() */
+#define RXSET_F_ICASE      0x00000001  /* the regexes are case-insensitive */
+#define RXSET_F_COMPILED   0x00000002  /* internal: rxset_compile() succeeded */
+
+/* Literals shorter than this are not worth looking for, they would make their
+ * regex a candidate for most strings. Longer literals are truncated, any part
+ * of a required literal being required as well.
+ */
+#define RXSET_MIN_FACTOR   3
+#define RXSET_MAX_FACTOR   32
+
+/* a literal found in a regex, used while regexes are being added */
+struct rxset_bfct {
+	char str[RXSET_MAX_FACTOR + 1];   /* literal, case-folded with RXSET_F_ICASE */
+	unsigned int rx;                  /* number of the regex it was found in */
+};
+
+/* A set of regexes prefiltered by literals. For each regex, a literal which
+ * appears in every string it matches is extracted from each of its top-level
+ * alternatives. All literals are then looked up at once in the tested string
+ * using an Aho-Corasick automaton, and the regexes of the literals found, plus
+ * the ones from which no literal could be extracted, are the candidates which
+ * may match and must be confirmed by the regex engine. The others cannot match
+ * and are skipped. Regexes are numbered in the order they were added, and are
+ * associated with an opaque item.
+ */
+struct rxset {
+	unsigned int flags;           /* RXSET_F_* */
+	unsigned int nb_items;        /* number of regexes added */
+	unsigned int alloc_items;     /* allocated entries in <items> */
+	void **items;                 /* items associated with the regexes */
+	unsigned long *always;        /* bitmap of the regexes without literals */
+	unsigned int map_longs;       /* size of a bitmap of regexes, in longs */
+
+	/* build-time literals, released by rxset_compile() */
+	struct rxset_bfct *bfct;
+	unsigned int nb_bfct;
+	unsigned int alloc_bfct;
+
+	/* compiled set */
+	struct acm *acm;              /* automaton of the distinct literals */
+	unsigned int nb_factors;      /* number of distinct literals */
+	unsigned int *fct_first;      /* per literal, first index in <fct_rx>, plus one last entry */
+	unsigned int *fct_rx;         /* regex numbers, grouped by literal */
+};
+
+#endif /* _HAPROXY_RXSET_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,45 @@
+/*
+ * include/haproxy/rxset.h
+ * Literal prefilter for lists of regular expressions - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_RXSET_H
+#define _HAPROXY_RXSET_H
+
+#include <haproxy/api.h>
+#include <haproxy/rxset-t.h>
+
+struct rxset *rxset_new(unsigned int flags);
+int rxset_add(struct rxset *rs, const char *regex, void *item);
+int rxset_compile(struct rxset *rs);
+void rxset_free(struct rxset *rs);
+unsigned long *rxset_candidates(const struct rxset *rs, const char *str, size_t len, unsigned long *area);
+
+/* Returns the number of bytes rxset_candidates() needs for its work area */
+static inline size_t rxset_area_size(const struct rxset *rs)
+{
+	return (rs->map_longs + (rs->nb_factors + LONGBITS - 1) / LONGBITS) * sizeof(long);
+}
+
+#endif /* _HAPROXY_RXSET_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -26,6 +26,7 @@
 #include <arpa/inet.h>
 
 #include <import/eb32tree.h>
+#include <import/eb64tree.h>
 #include <import/ebmbtree.h>
 
 #include <haproxy/api-t.h>
@@ -222,9 +223,9 @@ struct server {
 
 	struct eb_root pendconns;		/* pending connections */
 	struct list actconns;			/* active connections */
-	struct mt_list *idle_conns;		/* shareable idle connections*/
-	struct mt_list *safe_conns;		/* safe idle connections */
-	struct list *available_conns;           /* Connection in used, but with still new streams available */
+	struct eb_root *idle_conns_tree;        /* shareable idle connections, per thread, indexed by conn hash */
+	struct eb_root *safe_conns_tree;        /* safe idle connections, per thread, indexed by conn hash */
+	struct eb_root *available_conns_tree;   /* Connection in used, but with still new streams available, per thread */
 	unsigned int pool_purge_delay;          /* Delay before starting to purge the idle conns pool */
 	unsigned int low_idle_conns;            /* min idle connection count to start picking from other threads */
 	unsigned int max_idle_conns;            /* Max number of connection allowed in the orphan connections list */
@@ -237,6 +238,10 @@ struct server {
 	unsigned int *curr_idle_thr;            /* Current number of orphan idling connections per thread */
 	unsigned int next_takeover;             /* thread ID to try to steal connections from next time */
 	int max_reuse;                          /* Max number of requests on a same connection */
+	unsigned int warm_conns;                /* number of idle connections to establish in advance (pool-warm-conn) */
+	struct task **warm_tasks;               /* per-thread tasks keeping the warm connections established */
+	struct mt_list *warming_conns;          /* per-thread connections being established for the warm pool */
+	unsigned int *curr_warm_thr;            /* per-thread number of idle connections of the warm pool not used yet */
 	struct eb32_node idle_node;             /* When to next do cleanup in the idle connections */
 	struct task *warmup;                    /* the task dedicated to the warmup when slowstart is set */
 
@@ -38,6 +38,7 @@
 __decl_thread(extern HA_SPINLOCK_T idle_conn_srv_lock);
 extern struct eb_root idle_conn_srv;
 extern struct task *idle_conn_task;
+extern struct idle_conns idle_conns[MAX_THREADS];
 extern struct dict server_name_dict;
 
 int srv_downtime(const struct server *s);
@@ -241,6 +242,56 @@ static inline enum srv_initaddr srv_get_next_initaddr(unsigned int *list)
 	return ret;
 }
 
+/* This inserts connection <conn>, which must have no stream attached, into the
+ * safe or idle tree of server <srv> for the current thread, depending on
+ * <is_safe>, without checking whether it is worth keeping. It returns 1 on
+ * success or 0 if the server already has max_idle_conns idle connections.
+ */
+static inline int __srv_add_to_idle_list(struct server *srv, struct connection *conn, int is_safe)
+{
+	int retadd;
+
+	retadd = _HA_ATOMIC_ADD(&srv->curr_idle_conns, 1);
+	if (retadd > srv->max_idle_conns) {
+		_HA_ATOMIC_SUB(&srv->curr_idle_conns, 1);
+		return 0;
+	}
+	_HA_ATOMIC_SUB(&srv->curr_used_conns, 1);
+
+	HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
+	eb64_delete(&conn->hash_node);
+	conn->idle_time = now_ms;
+	if (is_safe) {
+		conn->flags = (conn->flags & ~CO_FL_LIST_MASK) | CO_FL_SAFE_LIST;
+		eb64_insert(&srv->safe_conns_tree[tid], &conn->hash_node);
+		_HA_ATOMIC_ADD(&srv->curr_safe_nb, 1);
+	} else {
+		conn->flags = (conn->flags & ~CO_FL_LIST_MASK) | CO_FL_IDLE_LIST;
+		eb64_insert(&srv->idle_conns_tree[tid], &conn->hash_node);
+		_HA_ATOMIC_ADD(&srv->curr_idle_nb, 1);
+	}
+	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
+	_HA_ATOMIC_ADD(&srv->curr_idle_thr[tid], 1);
+
+	__ha_barrier_full();
+	if ((volatile void *)srv->idle_node.node.leaf_p == NULL) {
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conn_srv_lock);
+		if ((volatile void *)srv->idle_node.node.leaf_p == NULL) {
+			srv->idle_node.key = tick_add(srv->pool_purge_delay,
+			                              now_ms);
+			eb32_insert(&idle_conn_srv, &srv->idle_node);
+			if (!task_in_wq(idle_conn_task) && !
+			    task_in_rq(idle_conn_task)) {
+				task_schedule(idle_conn_task,
+				              srv->idle_node.key);
+			}
+
+		}
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conn_srv_lock);
+	}
+	return 1;
+}
+
 /* This adds an idle connection to the server's list if the connection is
  * reusable, not held by any owner anymore, but still has available streams.
  */
@@ -257,51 +308,13 @@ static inline int srv_add_to_idle_list(struct server *srv, struct connection *co
 	    ((srv->proxy->options & PR_O_REUSE_MASK) != PR_O_REUSE_NEVR) &&
 	    ha_used_fds < global.tune.pool_high_count &&
 	    (srv->max_idle_conns == -1 || srv->max_idle_conns > srv->curr_idle_conns) &&
-	    ((MT_LIST_ISEMPTY(&srv->safe_conns[tid]) &&
-	      (is_safe || MT_LIST_ISEMPTY(&srv->idle_conns[tid]))) ||
+	    ((eb_is_empty(&srv->safe_conns_tree[tid]) &&
+	      (is_safe || eb_is_empty(&srv->idle_conns_tree[tid]))) ||
 	     (ha_used_fds < global.tune.pool_low_count &&
 	      (srv->curr_used_conns + srv->curr_idle_conns <=
 	       MAX(srv->curr_used_conns, srv->est_need_conns) + srv->low_idle_conns))) &&
-	    !conn->mux->used_streams(conn) && conn->mux->avail_streams(conn)) {
-		int retadd;
-
-		retadd = _HA_ATOMIC_ADD(&srv->curr_idle_conns, 1);
-		if (retadd > srv->max_idle_conns) {
-			_HA_ATOMIC_SUB(&srv->curr_idle_conns, 1);
-			return 0;
-		}
-		_HA_ATOMIC_SUB(&srv->curr_used_conns, 1);
-		MT_LIST_DEL(&conn->list);
-		conn->idle_time = now_ms;
-		if (is_safe) {
-			conn->flags = (conn->flags & ~CO_FL_LIST_MASK) | CO_FL_SAFE_LIST;
-			MT_LIST_ADDQ(&srv->safe_conns[tid], (struct mt_list *)&conn->list);
-			_HA_ATOMIC_ADD(&srv->curr_safe_nb, 1);
-		} else {
-			conn->flags = (conn->flags & ~CO_FL_LIST_MASK) | CO_FL_IDLE_LIST;
-			MT_LIST_ADDQ(&srv->idle_conns[tid], (struct mt_list *)&conn->list);
-			_HA_ATOMIC_ADD(&srv->curr_idle_nb, 1);
-		}
-		_HA_ATOMIC_ADD(&srv->curr_idle_thr[tid], 1);
-
-		__ha_barrier_full();
-		if ((volatile void *)srv->idle_node.node.leaf_p == NULL) {
-			HA_SPIN_LOCK(OTHER_LOCK, &idle_conn_srv_lock);
-			if ((volatile void *)srv->idle_node.node.leaf_p == NULL) {
-				srv->idle_node.key = tick_add(srv->pool_purge_delay,
-				                              now_ms);
-				eb32_insert(&idle_conn_srv, &srv->idle_node);
-				if (!task_in_wq(idle_conn_task) && !
-				    task_in_rq(idle_conn_task)) {
-					task_schedule(idle_conn_task,
-					              srv->idle_node.key);
-				}
-
-			}
-			HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conn_srv_lock);
-		}
-		return 1;
-	}
+	    !conn->mux->used_streams(conn) && conn->mux->avail_streams(conn))
+		return __srv_add_to_idle_list(srv, conn, is_safe);
 	return 0;
 }
 
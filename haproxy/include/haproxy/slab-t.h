@@ -0,0 +1,107 @@
+/*
+ * include/haproxy/slab-t.h
+ * Size-class slab allocator backing the memory pools - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SLAB_T_H
+#define _HAPROXY_SLAB_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/list-t.h>
+
+/* Memory is mapped by segments of SLAB_SEG_SIZE bytes aligned on their size,
+ * which are cut into slabs of SLAB_SIZE bytes. The first slab of a segment
+ * starts with the segment's header holding the descriptors of all its slabs,
+ * so that the descriptor of any object is found from its address. Each slab
+ * only contains objects of a single size class.
+ */
+#define SLAB_SEG_SIZE     (2U << 20)
+#define SLAB_SIZE         (64U << 10)
+#define SLAB_PER_SEG      (SLAB_SEG_SIZE / SLAB_SIZE)
+
+/* Size classes are 16 bytes apart up to 128 bytes, then there are 4 classes
+ * per power of two up to SLAB_MAX_SIZE. Larger pools are not slab-backed.
+ */
+#define SLAB_SMALL_STEP   16
+#define SLAB_SMALL_MAX    128
+#define SLAB_MAX_SIZE     16384
+#define SLAB_CLASSES      36
+
+/* maximum number of free slabs kept resident in addition to the reserved ones,
+ * beyond which they are returned to the system one at a time.
+ */
+#define SLAB_MAX_DIRTY    32
+
+/* number of full slabs checked for objects released by other threads when a
+ * thread runs out of free objects in a class.
+ */
+#define SLAB_SCAN_MAX     4
+
+/* slab states */
+#define SLAB_ST_FREE      0   /* not used by any class */
+#define SLAB_ST_CUR       1   /* current allocation slab of its owner */
+#define SLAB_ST_PARTIAL   2   /* in its owner's partial list */
+#define SLAB_ST_FULL      3   /* in its owner's full list */
+
+/* A slab descriptor. Only the owning thread allocates from a slab and puts
+ * objects back into its <free> list. Other threads push the objects they
+ * release to the <remote> list using a CAS, and the owner collects them when
+ * it runs out of free objects. Objects are carved on first use so that the
+ * pages of a new slab are not touched before being needed.
+ */
+struct slab {
+	struct list list;          /* owner's partial or full list, or free slabs list */
+	void *free;                /* objects released by the owner */
+	void *remote;              /* objects released by other threads */
+	char *area;                /* first object */
+	unsigned int size;         /* object size */
+	unsigned int nb_objs;      /* number of objects in the slab */
+	unsigned int next_new;     /* index of the first object never allocated */
+	unsigned int used;         /* objects not in <free>, including <remote> */
+	short cls;                 /* size class, -1 if free */
+	short owner;               /* owning thread, -1 if free */
+	unsigned char state;       /* SLAB_ST_* */
+} __attribute__((aligned(64)));
+
+/* the header placed at the beginning of each segment */
+struct slab_segment {
+	struct slab slabs[SLAB_PER_SEG];
+};
+
+/* per-thread, per-class allocation context */
+struct slab_cache {
+	struct slab *cur;          /* slab used for allocations */
+	struct list partial;       /* other slabs with free objects */
+	struct list full;          /* slabs without free objects */
+	unsigned int allocs;       /* objects allocated by this thread */
+	unsigned int frees;        /* objects released by this thread */
+};
+
+/* a size class */
+struct slab_class {
+	unsigned int size;         /* object size */
+	unsigned int slabs;        /* slabs currently assigned to this class */
+};
+
+#endif /* _HAPROXY_SLAB_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,131 @@
+/*
+ * include/haproxy/slab.h
+ * Size-class slab allocator backing the memory pools - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SLAB_H
+#define _HAPROXY_SLAB_H
+
+#include <haproxy/api.h>
+#include <haproxy/intops.h>
+#include <haproxy/slab-t.h>
+#include <haproxy/thread.h>
+
+extern struct slab_class slab_classes[SLAB_CLASSES];
+extern struct slab_cache slab_cache[MAX_THREADS][SLAB_CLASSES];
+extern unsigned int slab_segments;
+extern unsigned int slab_free_dirty;
+extern unsigned int slab_free_clean;
+extern unsigned int slab_reserved;
+extern unsigned int slab_segments_huge;
+
+void *__slab_alloc(int cls);
+void __slab_requeue(struct slab *s);
+void slab_gc();
+unsigned int slab_reserve(unsigned int count);
+
+/* Returns the size class for objects of <size> bytes, which must be between 1
+ * and SLAB_MAX_SIZE.
+ */
+static inline int slab_size_class(unsigned int size)
+{
+	unsigned int bits, quarter;
+
+	if (size <= SLAB_SMALL_MAX)
+		return (size + SLAB_SMALL_STEP - 1) / SLAB_SMALL_STEP - 1;
+
+	bits = my_flsl(size - 1) - 1;           // size is in ]2^bits, 2^(bits+1)]
+	quarter = 1U << (bits - 2);
+	return SLAB_SMALL_MAX / SLAB_SMALL_STEP +
+		(bits - my_flsl(SLAB_SMALL_MAX) + 1) * 4 +
+		(size - (1U << bits) + quarter - 1) / quarter - 1;
+}
+
+/* returns the descriptor of the slab holding object <ptr> */
+static inline struct slab *slab_of(const void *ptr)
+{
+	struct slab_segment *seg = (struct slab_segment *)((uintptr_t)ptr & -(uintptr_t)SLAB_SEG_SIZE);
+
+	return &seg->slabs[((uintptr_t)ptr & (SLAB_SEG_SIZE - 1)) / SLAB_SIZE];
+}
+
+/* Takes a free object from slab <s>, or returns NULL if there is none. The slab
+ * must be owned by the current thread.
+ */
+static inline void *__slab_pop(struct slab *s)
+{
+	void *p = s->free;
+
+	if (likely(p))
+		s->free = *(void **)p;
+	else if (s->next_new < s->nb_objs)
+		p = s->area + s->next_new++ * s->size;
+	else
+		return NULL;
+	s->used++;
+	return p;
+}
+
+/* Allocates an object of class <cls> for the current thread. Returns NULL if
+ * no more memory is available.
+ */
+static inline void *slab_alloc(int cls)
+{
+	struct slab_cache *sc = &slab_cache[tid][cls];
+	void *p;
+
+	if (likely(sc->cur) && likely((p = __slab_pop(sc->cur)) != NULL)) {
+		sc->allocs++;
+		return p;
+	}
+	return __slab_alloc(cls);
+}
+
+/* Releases object <ptr> allocated by slab_alloc(), possibly by another thread.
+ * Objects belonging to a slab owned by another thread are pushed to its remote
+ * list without locking.
+ */
+static inline void slab_free(void *ptr)
+{
+	struct slab *s = slab_of(ptr);
+	void *head;
+
+	slab_cache[tid][s->cls].frees++;
+	if (likely(s->owner == tid)) {
+		*(void **)ptr = s->free;
+		s->free = ptr;
+		s->used--;
+		if (unlikely(s->state == SLAB_ST_FULL || (!s->used && s->state != SLAB_ST_CUR)))
+			__slab_requeue(s);
+		return;
+	}
+
+	head = _HA_ATOMIC_LOAD(&s->remote);
+	do {
+		*(void **)ptr = head;
+		__ha_barrier_store();
+	} while (!_HA_ATOMIC_CAS(&s->remote, &head, ptr));
+}
+
+#endif /* _HAPROXY_SLAB_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,39 @@
+/*
+ * include/haproxy/ssl_ktls.h
+ * Kernel TLS transmit offload - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SSL_KTLS_H
+#define _HAPROXY_SSL_KTLS_H
+
+#ifdef USE_OPENSSL
+
+#include <haproxy/connection-t.h>
+#include <haproxy/openssl-compat.h>
+#include <haproxy/ssl_sock-t.h>
+
+#ifdef HAVE_SSL_KTLS
+
+void ssl_ktls_msg_cbk(struct connection *conn, int write_p, int version,
+                      int content_type, const void *buf, size_t len, SSL *ssl);
+void ssl_ktls_keylog(const SSL *ssl, const char *line);
+int ssl_ktls_start(struct ssl_sock_ctx *ctx);
+int ssl_ktls_close_notify(struct ssl_sock_ctx *ctx);
+
+#endif /* HAVE_SSL_KTLS */
+#endif /* USE_OPENSSL */
+#endif /* _HAPROXY_SSL_KTLS_H */
@@ -51,6 +51,9 @@
 #define SSL_SOCK_ST_FL_16K_WBFSIZE  0x00000002
 #define SSL_SOCK_SEND_UNLIMITED     0x00000004
 #define SSL_SOCK_RECV_HEARTBEAT     0x00000008
+#define SSL_SOCK_ST_FL_KTLS         0x00000010  /* kTLS wanted, not tried yet */
+#define SSL_SOCK_ST_FL_KTLS_SEQ     0x00000020  /* counting the application records sent */
+#define SSL_SOCK_ST_FL_KTLS_TX      0x00000040  /* records are now sent by the kernel */
 
 /* bits 0xFFFF0000 are reserved to store verify errors */
 
@@ -257,7 +260,11 @@ struct ssl_sock_ctx {
 	int xprt_st;                  /* transport layer state, initialized to zero */
 	struct buffer early_buf;      /* buffer to store the early data received */
 	int sent_early_data;          /* Amount of early data we sent so far */
-
+#ifdef HAVE_SSL_KTLS
+	unsigned long long ktls_seq;  /* sequence number of the next record we send */
+	unsigned char ktls_secret[48]; /* TLS 1.3 server application traffic secret */
+	unsigned char ktls_secret_len; /* its length, 0 if not known */
+#endif
 };
 
 struct global_ssl {
@@ -289,6 +296,9 @@ struct global_ssl {
 	int ctx_cache; /* max number of entries in the ssl_ctx cache. */
 	int capture_cipherlist; /* Size of the cipherlist buffer. */
 	int keylog; /* activate keylog  */
+#ifdef HAVE_SSL_KTLS
+	int ktls; /* at least one "bind" line uses kTLS */
+#endif
 	int extra_files; /* which files not defined in the configuration file are we looking for */
 };
 
@@ -429,6 +429,10 @@ enum stat_field {
 	ST_F_SAFE_CONN_CUR,
 	ST_F_USED_CONN_CUR,
 	ST_F_NEED_CONN_EST,
+	ST_F_WARM_HIT,
+	ST_F_WARM_MISS,
+	ST_F_HEDGE_SENT,
+	ST_F_HEDGE_RESP,
 
 	/* must always be the last one */
 	ST_F_TOTAL_FIELDS
@@ -32,6 +32,7 @@
 
 #include <haproxy/api-t.h>
 #include <haproxy/freq_ctr-t.h>
+#include <haproxy/qsbr-t.h>
 #include <haproxy/thread-t.h>
 
 
@@ -83,6 +84,9 @@ enum {
 /* stick table key type flags */
 #define STK_F_CUSTOM_KEYSIZE      0x00000001   /* this table's key size is configurable */
 
+/* maximum number of shards a table may be split into */
+#define STKTABLE_MAX_SHARDS       64
+
 /* WARNING: if new fields are added, they must be initialized in stream_accept()
  * and freed in stream_free() !
  *
@@ -155,13 +159,39 @@ struct stktable_type {
 struct stksess {
 	unsigned int expire;      /* session expiration date */
 	unsigned int ref_cnt;     /* reference count, can only purge when zero */
+	unsigned int shard;       /* index of the shard holding the entry */
+	unsigned int hash;        /* hash of the key */
 	__decl_thread(HA_RWLOCK_T lock); /* lock related to the table entry */
-	struct eb32_node exp;     /* ebtree node used to hold the session in expiration tree */
+	struct stksess *hnext;    /* next entry in the same lock-free lookup bucket */
+	union {
+		struct eb32_node exp;     /* ebtree node used to hold the session in expiration tree */
+		struct {
+			struct qsbr_node node;   /* waiting to be released */
+			struct stktable *table;  /* table the session belonged to */
+		} retired;                /* once removed from the table */
+	};
 	struct eb32_node upd;     /* ebtree node used to hold the update sequence tree */
 	struct ebmb_node key;     /* ebtree node used to hold the session in table */
 	/* WARNING! do not put anything after <keys>, it's used by the key */
 };
 
+/* A table's entries are spread over one or more shards depending on a hash of
+ * their key, each with its own trees and lock, so that threads working on
+ * different keys do not compete for the same lock. The shard's lock protects
+ * its trees and the acquisition of new references on its entries.
+ *
+ * The entries are also chained into hash buckets which may be walked without
+ * any lock by threads which only need to read an entry (see stktable_peek_key).
+ * They are only modified under the shard's lock and the entries removed from
+ * them are released after a grace period.
+ */
+struct stktable_shard {
+	struct eb_root keys;      /* head of sticky session tree */
+	struct eb_root exps;      /* head of sticky session expiration tree */
+	struct stksess **buckets; /* lock-free lookup index, by upper bits of the hash */
+	unsigned int bucket_shift;/* 32 - log2(number of buckets) */
+	__decl_thread(HA_SPINLOCK_T lock); /* lock related to the shard */
+} __attribute__((aligned(64)));
 
 /* stick table */
 struct stktable {
@@ -175,11 +205,11 @@ struct stktable {
 		int line;             /* The line in this <file> the stick-table is declared. */
 	} conf;
 	struct ebpt_node name;    /* Stick-table are lookup by name here. */
-	struct eb_root keys;      /* head of sticky session tree */
-	struct eb_root exps;      /* head of sticky session expiration tree */
+	struct stktable_shard *shards; /* shards holding the sticky sessions */
+	unsigned int nb_shards;   /* number of shards, at least 1 */
 	struct eb_root updates;   /* head of sticky updates sequence tree */
 	struct pool_head *pool;   /* pool used to allocate sticky sessions */
-	__decl_thread(HA_SPINLOCK_T lock); /* spin lock related to the table */
+	__decl_thread(HA_SPINLOCK_T lock); /* protects the updates tree and counters */
 	struct task *exp_task;    /* expiration task */
 	struct task *sync_task;   /* sync task */
 	unsigned int update;
@@ -198,7 +228,6 @@ struct stktable {
 	unsigned int size;        /* maximum number of sticky sessions in table */
 	unsigned int current;     /* number of sticky sessions currently in table */
 	int nopurge;              /* if non-zero, don't purge sticky sessions when full */
-	int exp_next;             /* next expiration date (ticks) */
 	int expire;               /* time to live for sticky sessions (milliseconds) */
 	int data_size;            /* the size of the data that is prepended *before* stksess */
 	int data_ofs[STKTABLE_DATA_TYPES]; /* negative offsets of present data types, or 0 if absent */
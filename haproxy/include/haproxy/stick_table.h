@@ -46,6 +46,7 @@ void stksess_free(struct stktable *t, struct stksess *ts);
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcount);
 
 int stktable_init(struct stktable *t);
+void stktable_deinit(struct stktable *t);
 int stktable_parse_type(char **args, int *idx, unsigned long *type, size_t *key_size);
 int parse_stick_table(const char *file, int linenum, char **args,
                       struct stktable *t, char *id, char *nid, struct peers *peers);
@@ -56,6 +57,8 @@ void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt
 void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefccount);
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts);
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key);
+struct stksess *stktable_peek_key(struct stktable *t, struct stktable_key *key);
+struct stksess *stktable_peek(struct stktable *t, struct stksess *ts);
 struct stksess *stktable_update_key(struct stktable *table, struct stktable_key *key);
 struct stktable_key *smp_to_stkey(struct sample *smp, struct stktable *t);
 struct stktable_key *stktable_fetch_key(struct stktable *t, struct proxy *px, struct session *sess,
@@ -151,7 +154,9 @@ static inline void *stktable_data_ptr(struct stktable *t, struct stksess *ts, in
 	return __stktable_data_ptr(t, ts, type);
 }
 
-/* kill an entry if it's expired and its ref_cnt is zero */
+/* kill an entry if it's expired and its ref_cnt is zero. The entry's shard
+ * must be locked.
+ */
 static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *ts)
 {
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms))
@@ -162,15 +167,17 @@ static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *
 
 static inline void stksess_kill_if_expired(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	struct stktable_shard *shard = &t->shards[ts->shard];
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
 
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms))
 		__stksess_kill_if_expired(t, ts);
 
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 }
 
 /* sets the stick counter's entry pointer */
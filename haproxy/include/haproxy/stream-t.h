@@ -89,6 +89,8 @@
 #define SF_IGNORE_PRST	0x00080000	/* ignore persistence */
 
 #define SF_SRV_REUSED   0x00100000	/* the server-side connection was reused */
+#define SF_HEDGED       0x00200000	/* the request was hedged to another server */
+#define SF_HEDGING      0x00400000	/* the server is being reassigned for a hedge */
 
 
 /* flags for the proxy of the master CLI */
@@ -29,6 +29,7 @@
 
 #include <haproxy/api-t.h>
 #include <haproxy/thread-t.h>
+#include <haproxy/twheel-t.h>
 
 /* values for task->state */
 #define TASK_SLEEPING     0x0000  /* task sleeping */
@@ -70,9 +71,31 @@ struct notification {
 	__decl_thread(HA_SPINLOCK_T lock);
 };
 
+/* The per-thread queue of runnable thread-agnostic tasks used in work stealing
+ * mode, its size must be a power of two. A thread with at least TASK_STEAL_MIN
+ * tasks in its queue advertises itself so that idle threads come and steal
+ * some of them.
+ */
+#define TASK_STEAL_QSIZE  256
+#define TASK_STEAL_MIN    2
+
+/* Single-producer, multiple-consumer ring of tasks. Only the owning thread
+ * adds tasks at <tail>, while any thread (including the owner) takes them at
+ * <head> using a CAS. Both indexes only grow and wrap.
+ */
+struct task_steal_queue {
+	unsigned int head;      /* next task to take */
+	unsigned int tail;      /* next free entry */
+	struct task *entry[TASK_STEAL_QSIZE];
+};
+
 /* force to split per-thread stuff into separate cache lines */
 struct task_per_thread {
+#ifdef USE_TIMER_WHEEL
+	struct twheel timers;   /* timing wheel constituting the per-thread wait queue */
+#else
 	struct eb_root timers;  /* tree constituting the per-thread wait queue */
+#endif
 	struct eb_root rqueue;  /* tree constituting the per-thread run queue */
 	struct mt_list shared_tasklet_list; /* Tasklet to be run, woken up by other threads */
 	struct list tasklets[TL_CLASSES]; /* tasklets (and/or tasks) to run, by class */
@@ -81,6 +104,8 @@ struct task_per_thread {
 	struct task *current;   /* current task (not tasklet) */
 	int current_queue;      /* points to current tasklet list being run, -1 if none */
 	uint8_t tl_class_mask;  /* bit mask of non-empty tasklets classes */
+	ALWAYS_ALIGN(64);
+	struct task_steal_queue stealq; /* thread-agnostic tasks that may be stolen */
 	__attribute__((aligned(64))) char end[0];
 };
 
@@ -100,7 +125,11 @@ struct task_per_thread {
 struct task {
 	TASK_COMMON;			/* must be at the beginning! */
 	struct eb32sc_node rq;		/* ebtree node used to hold the task in the run queue */
+#ifdef USE_TIMER_WHEEL
+	struct twheel_node wq;		/* timing wheel node used to hold the task in the wait queue */
+#else
 	struct eb32_node wq;		/* ebtree node used to hold the task in the wait queue */
+#endif
 	int expire;			/* next expiration date for this task, in ticks */
 	unsigned long thread_mask;	/* mask of thread IDs authorized to process the task */
 	uint64_t call_date;		/* date of the last task wakeup or call */
@@ -37,6 +37,7 @@
 #include <haproxy/task-t.h>
 #include <haproxy/thread.h>
 #include <haproxy/ticks.h>
+#include <haproxy/twheel.h>
 
 
 /* Principle of the wait queue.
@@ -75,6 +76,12 @@
  *   - timer is the real expiration date (possibly infinite)
  *   - node->key is always before or equal to timer
  *
+ * When built with USE_TIMER_WHEEL, the trees are replaced with hierarchical
+ * timing wheels (see twheel.c) which offer O(1) insertion and removal, and
+ * the same principles apply. The only difference is that the wait queue's next
+ * date may then be a minorant of the first node's key, which may occasionally
+ * cause an early wakeup when a far timer needs to be moved to a lower level.
+ *
  * The run queue works similarly to the wait queue except that the current date
  * is replaced by an insertion counter which can also wrap without any problem.
  */
@@ -89,6 +96,7 @@
 /* a few exported variables */
 extern unsigned int nb_tasks;     /* total number of tasks */
 extern volatile unsigned long global_tasks_mask; /* Mask of threads with tasks in the global runqueue */
+extern volatile unsigned long stealable_tasks_mask; /* Mask of threads with tasks to be stolen */
 extern unsigned int tasks_run_queue;    /* run queue size */
 extern unsigned int tasks_run_queue_cur;
 extern unsigned int nb_tasks_cur;
@@ -99,7 +107,11 @@ extern struct pool_head *pool_head_notification;
 extern THREAD_LOCAL struct task_per_thread *sched; /* current's thread scheduler context */
 
 #ifdef USE_THREAD
+#ifdef USE_TIMER_WHEEL
+extern struct twheel timers;       /* timing wheel, global */
+#else
 extern struct eb_root timers;      /* sorted timers tree, global */
+#endif
 extern struct eb_root rqueue;      /* tree constituting the run queue */
 extern int global_rqueue_size; /* Number of element sin the global runqueue */
 #endif
@@ -111,7 +123,11 @@ __decl_thread(extern HA_RWLOCK_T wq_lock);    /* RW lock related to the wait que
 
 void task_kill(struct task *t);
 void __task_wakeup(struct task *t, struct eb_root *);
+#ifdef USE_TIMER_WHEEL
+void __task_queue(struct task *task, struct twheel *wq);
+#else
 void __task_queue(struct task *task, struct eb_root *wq);
+#endif
 
 struct work_list *work_list_create(int nbthread,
                                    struct task *(*fct)(struct task *, void *, unsigned short),
@@ -159,21 +175,114 @@ static inline int task_in_rq(struct task *t)
 /* return 0 if task is in wait queue, otherwise non-zero */
 static inline int task_in_wq(struct task *t)
 {
+#ifdef USE_TIMER_WHEEL
+	return twheel_in(&t->wq);
+#else
 	return t->wq.node.leaf_p != NULL;
+#endif
+}
+
+#ifdef USE_TIMER_WHEEL
+
+/* returns non-zero if wait queue <wq> is empty */
+static inline int wq_is_empty(const struct twheel *wq)
+{
+	return twheel_is_empty(wq);
+}
+
+/* Returns the first task of wait queue <wq> which might have expired, or NULL
+ * if none is found.
+ */
+static inline struct task *wq_first(struct twheel *wq)
+{
+	struct twheel_node *n = twheel_first_expired(wq, now_ms);
+
+	return n ? container_of(n, struct task, wq) : NULL;
+}
+
+/* Returns the date of the next event in wait queue <wq>, or TICK_ETERNITY if
+ * the queue is empty. It may be in the past, and for the timing wheel it may
+ * be slightly earlier than the first task's date.
+ */
+static inline int wq_next_key(const struct twheel *wq)
+{
+	unsigned int key;
+
+	if (!twheel_next(wq, &key))
+		return TICK_ETERNITY;
+	return key ? key : 1;
+}
+
+/* returns any task from wait queue <wq>, or NULL if it's empty */
+static inline struct task *wq_pick(const struct twheel *wq)
+{
+	struct twheel_node *n = twheel_pick(wq);
+
+	return n ? container_of(n, struct task, wq) : NULL;
+}
+
+#else /* USE_TIMER_WHEEL */
+
+/* returns non-zero if wait queue <wq> is empty */
+static inline int wq_is_empty(const struct eb_root *wq)
+{
+	return eb_is_empty(wq);
+}
+
+/* Returns the first task of wait queue <wq> which might have expired, or NULL
+ * if none is found.
+ */
+static inline struct task *wq_first(struct eb_root *wq)
+{
+	struct eb32_node *eb;
+
+	eb = eb32_lookup_ge(wq, now_ms - TIMER_LOOK_BACK);
+	if (!eb) {
+		/* we might have reached the end of the tree, typically because
+		 * <now_ms> is in the first half and we're first scanning the last
+		 * half. Let's loop back to the beginning of the tree now.
+		 */
+		eb = eb32_first(wq);
+	}
+	return eb ? eb32_entry(eb, struct task, wq) : NULL;
+}
+
+/* Returns the date of the next event in wait queue <wq>, or TICK_ETERNITY if
+ * the queue is empty. It may be in the past.
+ */
+static inline int wq_next_key(struct eb_root *wq)
+{
+	struct task *t = wq_first(wq);
+
+	return t ? t->wq.key : TICK_ETERNITY;
+}
+
+/* returns any task from wait queue <wq>, or NULL if it's empty */
+static inline struct task *wq_pick(struct eb_root *wq)
+{
+	struct eb32_node *eb = eb32_first(wq);
+
+	return eb ? eb32_entry(eb, struct task, wq) : NULL;
 }
 
+#endif /* USE_TIMER_WHEEL */
+
 /* returns true if the current thread has some work to do */
 static inline int thread_has_tasks(void)
 {
 	return (!!(global_tasks_mask & tid_bit) |
 	        (sched->rqueue_size > 0) |
 	        !!sched->tl_class_mask |
-		!MT_LIST_ISEMPTY(&sched->shared_tasklet_list));
+		!MT_LIST_ISEMPTY(&sched->shared_tasklet_list) |
+		(sched->stealq.head != sched->stealq.tail) |
+		!!(stealable_tasks_mask & ~tid_bit));
 }
 
 /* puts the task <t> in run queue with reason flags <f>, and returns <t> */
 /* This will put the task in the local runqueue if the task is only runnable
- * by the current thread, in the global runqueue otherwies.
+ * by the current thread, in the global runqueue otherwies. In work stealing
+ * mode, tasks runnable by all threads are put into the current thread's steal
+ * queue instead of the global runqueue.
  */
 static inline void task_wakeup(struct task *t, unsigned int f)
 {
@@ -184,6 +293,9 @@ static inline void task_wakeup(struct task *t, unsigned int f)
 
 	if (t->thread_mask == tid_bit || global.nbthread == 1)
 		root = &sched->rqueue;
+	else if ((global.tune.options & GTUNE_SCHED_WORK_STEALING) &&
+	         (t->thread_mask & all_threads_mask) == all_threads_mask)
+		root = NULL;
 	else
 		root = &rqueue;
 #else
@@ -207,7 +319,11 @@ static inline void task_wakeup(struct task *t, unsigned int f)
  */
 static inline struct task *__task_unlink_wq(struct task *t)
 {
+#ifdef USE_TIMER_WHEEL
+	twheel_delete(&t->wq);
+#else
 	eb32_delete(&t->wq);
+#endif
 	return t;
 }
 
@@ -408,7 +524,11 @@ static inline void tasklet_remove_from_tasklet_list(struct tasklet *t)
  */
 static inline struct task *task_init(struct task *t, unsigned long thread_mask)
 {
+#ifdef USE_TIMER_WHEEL
+	t->wq.list.n = NULL;
+#else
 	t->wq.node.leaf_p = NULL;
+#endif
 	t->rq.node.leaf_p = NULL;
 	t->state = TASK_SLEEPING;
 	t->thread_mask = thread_mask;
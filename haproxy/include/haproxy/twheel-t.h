@@ -0,0 +1,64 @@
+/*
+ * include/haproxy/twheel-t.h
+ * Hierarchical timing wheel - types definitions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_TWHEEL_T_H
+#define _HAPROXY_TWHEEL_T_H
+
+#include <inttypes.h>
+#include <haproxy/list-t.h>
+
+/* The wheel is made of TWHEEL_LEVELS levels of TWHEEL_SLOTS slots each. Each
+ * level covers TWHEEL_BITS bits of the 32-bit dates, the last one only uses
+ * the 2 upper bits. A node is queued at the level corresponding to the highest
+ * bit which differs between its date and the wheel's current date, and is
+ * moved to a lower level ("cascaded") when the current date enters its slot.
+ * The extra slot at the end holds the nodes queued for a date already past.
+ */
+#define TWHEEL_BITS      6
+#define TWHEEL_SLOTS     (1 << TWHEEL_BITS)
+#define TWHEEL_LEVELS    6
+#define TWHEEL_LATE      (TWHEEL_LEVELS * TWHEEL_SLOTS)
+
+/* above this delay between the wheel's date and the current one, the wheel is
+ * moved forward on insertion so that the dates remain comparable.
+ */
+#define TWHEEL_MAX_LAG   (1U << 24)
+
+/* a node to be queued in a timing wheel */
+struct twheel_node {
+	struct list list;            /* attach point in the slot, n==NULL if not queued */
+	unsigned int key;            /* date the node was queued for */
+	unsigned int slot;           /* index of the slot in the wheel's slots[] */
+};
+
+/* a timing wheel. It must be initialized using twheel_init(). */
+struct twheel {
+	unsigned int cur;                           /* next date to be visited */
+	uint64_t used[TWHEEL_LEVELS];               /* per level bitmaps of non-empty slots */
+	struct list slots[TWHEEL_LATE + 1];         /* all slots, then the late one */
+};
+
+#endif /* _HAPROXY_TWHEEL_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
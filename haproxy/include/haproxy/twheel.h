@@ -0,0 +1,108 @@
+/*
+ * include/haproxy/twheel.h
+ * Hierarchical timing wheel - exported functions.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_TWHEEL_H
+#define _HAPROXY_TWHEEL_H
+
+#include <stddef.h>
+#include <haproxy/api.h>
+#include <haproxy/list.h>
+#include <haproxy/twheel-t.h>
+
+void twheel_init(struct twheel *w);
+void twheel_catchup(struct twheel *w, unsigned int now);
+int twheel_next(const struct twheel *w, unsigned int *next);
+struct twheel_node *twheel_first_expired(struct twheel *w, unsigned int now);
+struct twheel_node *twheel_pick(const struct twheel *w);
+
+/* returns non-zero if node <n> is queued in a wheel */
+static inline int twheel_in(const struct twheel_node *n)
+{
+	return n->list.n != NULL;
+}
+
+/* returns non-zero if wheel <w> is empty */
+static inline int twheel_is_empty(const struct twheel *w)
+{
+	return !(w->used[0] | w->used[1] | w->used[2] | w->used[3] | w->used[4] | w->used[5]) &&
+		LIST_ISEMPTY(&w->slots[TWHEEL_LATE]);
+}
+
+/* Queues node <n> into wheel <w> at the position corresponding to its key,
+ * relative to the wheel's current date. The node must not be queued.
+ */
+static inline void __twheel_insert(struct twheel *w, struct twheel_node *n)
+{
+	unsigned int diff = n->key ^ w->cur;
+	unsigned int level, slot;
+
+	if ((int)(n->key - w->cur) < 0)
+		slot = TWHEEL_LATE;
+	else {
+		level = diff ? (31 - __builtin_clz(diff)) / TWHEEL_BITS : 0;
+		slot = (n->key >> (level * TWHEEL_BITS)) & (TWHEEL_SLOTS - 1);
+		w->used[level] |= 1ULL << slot;
+		slot += level * TWHEEL_SLOTS;
+	}
+	n->slot = slot;
+	LIST_ADDQ(&w->slots[slot], &n->list);
+}
+
+/* Queues node <n> into wheel <w> for date <key>, <now> being the current date.
+ * The node must not be queued. The key must not be further than 2^31 from
+ * <now>.
+ */
+static inline void twheel_insert(struct twheel *w, struct twheel_node *n, unsigned int key, unsigned int now)
+{
+	/* the wheel's date is meaningless when it's empty, and may be far away
+	 * if it was not visited for a while.
+	 */
+	if (unlikely(twheel_is_empty(w)))
+		w->cur = now;
+	else if (unlikely(now - w->cur + TWHEEL_MAX_LAG > 2 * TWHEEL_MAX_LAG))
+		twheel_catchup(w, now);
+
+	n->key = key;
+	__twheel_insert(w, n);
+}
+
+/* Removes node <n> from the wheel it is queued in. There is no need to know
+ * the wheel: if the node is the last one of its slot, its neighbour is the
+ * slot's head, from which the wheel is found to update its bitmap.
+ */
+static inline void twheel_delete(struct twheel_node *n)
+{
+	if (n->list.n == n->list.p && n->slot < TWHEEL_LATE) {
+		struct twheel *w;
+
+		w = (struct twheel *)((char *)(n->list.n - n->slot) - offsetof(struct twheel, slots));
+		w->used[n->slot / TWHEEL_SLOTS] &= ~(1ULL << (n->slot % TWHEEL_SLOTS));
+	}
+	LIST_DEL(&n->list);
+	n->list.n = NULL;
+}
+
+#endif /* _HAPROXY_TWHEEL_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
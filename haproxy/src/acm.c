@@ -0,0 +1,351 @@
+/*
+ * Aho-Corasick multi-pattern string matching.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Patterns are first inserted into a trie whose nodes are allocated from a
+ * single array. acm_compile() then renumbers the nodes in breadth-first order,
+ * stores each state's edges contiguously and sorted, and computes the failure
+ * links. Each state also records the first pattern (in insertion order)
+ * ending there or at any of its suffixes, so that looking for the first
+ * pattern contained in a string only costs one comparison per character
+ * instead of following the output links.
+ *
+ * The same structure is used to match prefixes (only the trie's edges are
+ * followed) and suffixes when the patterns were stored reversed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/acm.h>
+#include <haproxy/api.h>
+#include <haproxy/intops.h>
+
+/* ASCII case folding, consistent with strncasecmp() in the C locale */
+static inline unsigned char acm_fold(unsigned int flags, unsigned char c)
+{
+	if ((flags & ACM_F_ICASE) && c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	return c;
+}
+
+/* Returns the state reached from state <s> of compiled automaton <acm> with
+ * character <c>, or 0 if there is no such edge.
+ */
+static inline unsigned int acm_next(const struct acm *acm, unsigned int s, unsigned char c)
+{
+	const struct acm_state *st;
+	const unsigned char *chr;
+	unsigned int l, r, m;
+
+	if (!s)
+		return acm->root[c];
+
+	st = &acm->states[s];
+	chr = acm->chr + st->edges;
+	l = 0;
+	r = st->nb_edges;
+	while (l < r) {
+		m = (l + r) / 2;
+		if (chr[m] == c)
+			return acm->dst[st->edges + m];
+		if (chr[m] < c)
+			l = m + 1;
+		else
+			r = m;
+	}
+	return 0;
+}
+
+/* Allocates an empty automaton. <flags> may contain ACM_F_ICASE, ACM_F_REV and
+ * ACM_F_ALL. Returns NULL if out of memory.
+ */
+struct acm *acm_new(unsigned int flags)
+{
+	struct acm *acm;
+
+	acm = calloc(1, sizeof(*acm));
+	if (!acm)
+		return NULL;
+
+	acm->flags = flags & (ACM_F_ICASE | ACM_F_REV | ACM_F_ALL);
+	acm->alloc_bnodes = 64;
+	acm->bnodes = calloc(acm->alloc_bnodes, sizeof(*acm->bnodes));
+	if (!acm->bnodes) {
+		free(acm);
+		return NULL;
+	}
+	acm->nb_bnodes = 1; /* the root */
+	return acm;
+}
+
+/* Adds the <len> bytes of <str> as a new pattern to automaton <acm>, which
+ * must not have been compiled yet. <item> is what lookups will return when
+ * this pattern is the first matching one. Returns 0 if out of memory,
+ * otherwise non-zero.
+ */
+int acm_add(struct acm *acm, const char *str, size_t len, void *item)
+{
+	struct acm_bnode *bnodes;
+	unsigned int node, n;
+	unsigned char c;
+	void **items;
+	size_t i;
+
+	if (acm->flags & ACM_F_COMPILED)
+		return 0;
+
+	if (acm->nb_items == acm->alloc_items) {
+		n = acm->alloc_items ? acm->alloc_items * 2 : 16;
+		items = realloc(acm->items, n * sizeof(*items));
+		if (!items)
+			return 0;
+		acm->items = items;
+		acm->alloc_items = n;
+	}
+
+	node = 0;
+	for (i = 0; i < len; i++) {
+		c = acm_fold(acm->flags, str[(acm->flags & ACM_F_REV) ? len - 1 - i : i]);
+
+		for (n = acm->bnodes[node].child; n; n = acm->bnodes[n].sibling)
+			if (acm->bnodes[n].c == c)
+				break;
+
+		if (!n) {
+			if (acm->nb_bnodes == acm->alloc_bnodes) {
+				bnodes = realloc(acm->bnodes, acm->alloc_bnodes * 2 * sizeof(*bnodes));
+				if (!bnodes)
+					return 0;
+				acm->bnodes = bnodes;
+				acm->alloc_bnodes *= 2;
+			}
+			n = acm->nb_bnodes++;
+			acm->bnodes[n].child = 0;
+			acm->bnodes[n].own = 0;
+			acm->bnodes[n].c = c;
+			acm->bnodes[n].sibling = acm->bnodes[node].child;
+			acm->bnodes[node].child = n;
+		}
+		node = n;
+	}
+
+	acm->items[acm->nb_items++] = item;
+	if (!acm->bnodes[node].own)
+		acm->bnodes[node].own = acm->nb_items;
+	return 1;
+}
+
+/* Builds the lookup structures of automaton <acm> from the patterns added so
+ * far and releases the trie. No pattern may be added anymore. Returns 0 if
+ * out of memory, in which case the automaton may only be freed, otherwise
+ * non-zero.
+ */
+int acm_compile(struct acm *acm)
+{
+	struct acm_state *states;
+	unsigned int kids[256];
+	unsigned int *order;
+	unsigned int k, e, count, nb, i, j;
+	unsigned int v, f, t, o;
+	unsigned char c;
+
+	if (acm->flags & ACM_F_COMPILED)
+		return 1;
+
+	acm->states = calloc(acm->nb_bnodes, sizeof(*acm->states));
+	acm->chr = malloc(acm->nb_bnodes);
+	acm->dst = malloc(acm->nb_bnodes * sizeof(*acm->dst));
+	order = malloc(acm->nb_bnodes * sizeof(*order));
+	if (acm->flags & ACM_F_ALL)
+		acm->dict = calloc(acm->nb_bnodes, sizeof(*acm->dict));
+	if (!acm->states || !acm->chr || !acm->dst || !order ||
+	    ((acm->flags & ACM_F_ALL) && !acm->dict)) {
+		free(order);
+		return 0;
+	}
+	states = acm->states;
+
+	/* renumber the nodes in breadth-first order, <order> maps the new
+	 * numbers to the trie's ones.
+	 */
+	order[0] = 0;
+	count = 1;
+	e = 0;
+	for (k = 0; k < count; k++) {
+		nb = 0;
+		for (i = acm->bnodes[order[k]].child; i; i = acm->bnodes[i].sibling) {
+			/* insertion sort on the character */
+			c = acm->bnodes[i].c;
+			for (j = nb; j > 0 && acm->bnodes[kids[j - 1]].c > c; j--)
+				kids[j] = kids[j - 1];
+			kids[j] = i;
+			nb++;
+		}
+
+		states[k].own = acm->bnodes[order[k]].own;
+		states[k].edges = e;
+		states[k].nb_edges = nb;
+		for (j = 0; j < nb; j++, e++) {
+			acm->chr[e] = acm->bnodes[kids[j]].c;
+			acm->dst[e] = count;
+			order[count++] = kids[j];
+		}
+	}
+	acm->nb_states = count;
+
+	for (j = 0; j < states[0].nb_edges; j++)
+		acm->root[acm->chr[j]] = acm->dst[j];
+
+	/* failure links and first outputs. A state's failure link is less deep
+	 * than the state itself, so it was already processed when walking in
+	 * breadth-first order.
+	 */
+	states[0].fail = 0;
+	states[0].out = states[0].own;
+	for (k = 0; k < count; k++) {
+		for (j = states[k].edges; j < states[k].edges + states[k].nb_edges; j++) {
+			v = acm->dst[j];
+			c = acm->chr[j];
+			t = 0;
+			if (k) {
+				f = states[k].fail;
+				while (1) {
+					t = acm_next(acm, f, c);
+					if (t || !f)
+						break;
+					f = states[f].fail;
+				}
+			}
+			states[v].fail = t;
+			states[v].out = states[v].own;
+			o = states[t].out;
+			if (o && (!states[v].out || o < states[v].out))
+				states[v].out = o;
+			if (acm->dict)
+				acm->dict[v] = states[t].own ? t : acm->dict[t];
+		}
+	}
+
+	free(order);
+	free(acm->bnodes);
+	acm->bnodes = NULL;
+	acm->nb_bnodes = acm->alloc_bnodes = 0;
+	acm->flags |= ACM_F_COMPILED;
+	return 1;
+}
+
+/* Releases automaton <acm>. NULL is supported. */
+void acm_free(struct acm *acm)
+{
+	if (!acm)
+		return;
+	free(acm->bnodes);
+	free(acm->states);
+	free(acm->chr);
+	free(acm->dst);
+	free(acm->dict);
+	free(acm->items);
+	free(acm);
+}
+
+/* Looks for the patterns of compiled automaton <acm> which appear anywhere in
+ * the <len> bytes of <str>. Returns the item of the first added one, or NULL
+ * if none matches.
+ */
+void *acm_find_sub(const struct acm *acm, const char *str, size_t len)
+{
+	const struct acm_state *states = acm->states;
+	unsigned int s, t, best;
+	size_t i;
+
+	best = states[0].out;
+	s = 0;
+	for (i = 0; i < len && best != 1; i++) {
+		unsigned char c = acm_fold(acm->flags, str[i]);
+
+		while (1) {
+			t = acm_next(acm, s, c);
+			if (t || !s)
+				break;
+			s = states[s].fail;
+		}
+		s = t;
+		if (states[s].out && (!best || states[s].out < best))
+			best = states[s].out;
+	}
+	return best ? acm->items[best - 1] : NULL;
+}
+
+/* Looks for the patterns of compiled automaton <acm> which start the <len>
+ * bytes of <str>, or end them if the patterns were added with ACM_F_REV.
+ * Returns the item of the first added one, or NULL if none matches.
+ */
+void *acm_find_pfx(const struct acm *acm, const char *str, size_t len)
+{
+	const struct acm_state *states = acm->states;
+	unsigned int s, best;
+	size_t i;
+
+	best = states[0].own;
+	s = 0;
+	for (i = 0; i < len && best != 1; i++) {
+		s = acm_next(acm, s, acm_fold(acm->flags, str[(acm->flags & ACM_F_REV) ? len - 1 - i : i]));
+		if (!s)
+			break;
+		if (states[s].own && (!best || states[s].own < best))
+			best = states[s].own;
+	}
+	return best ? acm->items[best - 1] : NULL;
+}
+
+/* Looks for all the patterns of compiled automaton <acm>, which must have been
+ * created with ACM_F_ALL, which appear anywhere in the <len> bytes of <str>.
+ * The bit of each of them is set in <map>, bit N standing for the pattern
+ * added at position N. When identical patterns were added, only the first one
+ * is reported. Returns the number of bits which were set by this call.
+ */
+unsigned int acm_mark_sub(const struct acm *acm, const char *str, size_t len, unsigned long *map)
+{
+	const struct acm_state *states = acm->states;
+	unsigned int s, t, o, found = 0;
+	size_t i;
+
+	if (states[0].own && !ha_bit_test(states[0].own - 1, (long *)map)) {
+		ha_bit_set(states[0].own - 1, (long *)map);
+		found++;
+	}
+
+	s = 0;
+	for (i = 0; i < len; i++) {
+		unsigned char c = acm_fold(acm->flags, str[i]);
+
+		while (1) {
+			t = acm_next(acm, s, c);
+			if (t || !s)
+				break;
+			s = states[s].fail;
+		}
+		s = t;
+
+		for (t = states[s].own ? s : acm->dict[s]; t; t = acm->dict[t]) {
+			o = states[t].own - 1;
+			if (!ha_bit_test(o, (long *)map)) {
+				ha_bit_set(o, (long *)map);
+				found++;
+			}
+		}
+	}
+	return found;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
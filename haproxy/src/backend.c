@@ -926,7 +926,14 @@ int assign_server_and_queue(struct stream *s)
 		struct server *prev_srv = objt_server(s->target);
 
 		err = assign_server(s);
-		if (prev_srv) {
+		if (prev_srv && (s->flags & SF_HEDGING)) {
+			/* a hedge is already counted in hedge_sent, it is
+			 * neither a redispatch nor a retry, and it doesn't
+			 * change the persistence status.
+			 */
+			s->flags &= ~SF_HEDGING;
+		}
+		else if (prev_srv) {
 			/* This stream was previously assigned to a server. We have to
 			 * update the stream's and the server's stats :
 			 *  - if the server changed :
@@ -1017,79 +1024,101 @@ int assign_server_and_queue(struct stream *s)
 
 /* If an explicit source binding is specified on the server and/or backend, and
  * this source makes use of the transparent proxy, then it is extracted now and
- * assigned to the stream's pending connection. This function assumes that an
- * outgoing connection has already been assigned to s->si[1].end.
+ * stored into <*ss>, which is allocated for this purpose. <*ss> is left NULL
+ * when there is no such binding. The address is computed before the outgoing
+ * connection is picked because it is one of the parameters a reused connection
+ * must match. <s> may be NULL for connections established without any stream,
+ * in which case the bindings depending on the client are left unset.
  */
-static void assign_tproxy_address(struct stream *s)
+static void alloc_bind_address(struct sockaddr_storage **ss, struct server *srv,
+                               struct proxy *be, struct stream *s)
 {
 #if defined(CONFIG_HAP_TRANSPARENT)
-	struct server *srv = objt_server(s->target);
 	struct conn_src *src;
 	struct connection *cli_conn;
-	struct connection *srv_conn;
 
-	if (objt_cs(s->si[1].end))
-		srv_conn = cs_conn(__objt_cs(s->si[1].end));
-	else
-		srv_conn = objt_conn(s->si[1].end);
+	*ss = NULL;
 
 	if (srv && srv->conn_src.opts & CO_SRC_BIND)
 		src = &srv->conn_src;
-	else if (s->be->conn_src.opts & CO_SRC_BIND)
-		src = &s->be->conn_src;
+	else if (be->conn_src.opts & CO_SRC_BIND)
+		src = &be->conn_src;
 	else
 		return;
 
-	if (!sockaddr_alloc(&srv_conn->src))
+	if (!sockaddr_alloc(ss))
 		return;
 
 	switch (src->opts & CO_SRC_TPROXY_MASK) {
 	case CO_SRC_TPROXY_ADDR:
-		*srv_conn->src = src->tproxy_addr;
+		**ss = src->tproxy_addr;
 		break;
 	case CO_SRC_TPROXY_CLI:
 	case CO_SRC_TPROXY_CIP:
 		/* FIXME: what can we do if the client connects in IPv6 or unix socket ? */
-		cli_conn = objt_conn(strm_orig(s));
+		cli_conn = s ? objt_conn(strm_orig(s)) : NULL;
 		if (cli_conn && conn_get_src(cli_conn))
-			*srv_conn->src = *cli_conn->src;
+			**ss = *cli_conn->src;
 		else {
-			sockaddr_free(&srv_conn->src);
+			sockaddr_free(ss);
 		}
 		break;
 	case CO_SRC_TPROXY_DYN:
-		if (src->bind_hdr_occ && IS_HTX_STRM(s)) {
+		if (s && src->bind_hdr_occ && IS_HTX_STRM(s)) {
 			char *vptr;
 			size_t vlen;
 
 			/* bind to the IP in a header */
-			((struct sockaddr_in *)srv_conn->src)->sin_family = AF_INET;
-			((struct sockaddr_in *)srv_conn->src)->sin_port = 0;
-			((struct sockaddr_in *)srv_conn->src)->sin_addr.s_addr = 0;
+			((struct sockaddr_in *)*ss)->sin_family = AF_INET;
+			((struct sockaddr_in *)*ss)->sin_port = 0;
+			((struct sockaddr_in *)*ss)->sin_addr.s_addr = 0;
 			if (http_get_htx_hdr(htxbuf(&s->req.buf),
 					     ist2(src->bind_hdr_name, src->bind_hdr_len),
 					     src->bind_hdr_occ, NULL, &vptr, &vlen)) {
-				((struct sockaddr_in *)srv_conn->src)->sin_addr.s_addr =
+				((struct sockaddr_in *)*ss)->sin_addr.s_addr =
 					htonl(inetaddr_host_lim(vptr, vptr + vlen));
 			}
 		}
 		break;
 	default:
-		sockaddr_free(&srv_conn->src);
+		sockaddr_free(ss);
 	}
+#else
+	*ss = NULL;
 #endif
 }
 
-/* Attempt to get a backend connection from the specified mt_list array
- * (safe or idle connections). The <is_safe> argument means what type of
- * connection the caller wants.
+/* Returns the first connection of tree <root> (one of the server's idle, safe
+ * or available trees) which follows <node> (or which starts the tree's list
+ * of duplicates of <hash> if <node> is NULL), has hash <hash> and was made
+ * with parameters <params>, or NULL if there is none. Hashes may collide, so
+ * the parameters are always compared. For the idle and safe trees, the caller
+ * must hold the takeover lock of the thread the tree belongs to.
  */
-static struct connection *conn_backend_get(struct server *srv, int is_safe)
+static inline struct connection *srv_lookup_conn(struct eb_root *root, struct eb64_node *node,
+                                                 uint64_t hash, const struct conn_hash_params *params)
 {
-	struct mt_list *mt_list = is_safe ? srv->safe_conns : srv->idle_conns;
 	struct connection *conn;
+
+	for (node = node ? eb64_next_dup(node) : eb64_lookup(root, hash); node; node = eb64_next_dup(node)) {
+		conn = eb64_entry(node, struct connection, hash_node);
+		if (conn_hash_match(conn, params))
+			return conn;
+	}
+	return NULL;
+}
+
+/* Attempt to get a backend connection whose hash is <hash> and made with
+ * parameters <params> from the specified server trees (safe or idle
+ * connections). The <is_safe> argument means what type of connection the
+ * caller wants.
+ */
+static struct connection *conn_backend_get(struct server *srv, int is_safe, uint64_t hash,
+                                           const struct conn_hash_params *params)
+{
+	struct eb_root *tree = is_safe ? srv->safe_conns_tree : srv->idle_conns_tree;
+	struct connection *conn, *next;
 	int i; // thread number
-	int found = 0;
 	int stop;
 
 	/* We need to lock even if this is our own list, because another
@@ -1098,16 +1127,19 @@ static struct connection *conn_backend_get(struct server *srv, int is_safe)
 	 */
 	i = tid;
 	HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
-	conn = MT_LIST_POP(&mt_list[tid], struct connection *, list);
+	conn = srv_lookup_conn(&tree[tid], NULL, hash, params);
+	if (conn)
+		conn_delete_from_tree(conn);
 
 	/* If we failed to pick a connection from the idle list, let's try again with
 	 * the safe list.
 	 */
 	if (!conn && !is_safe && srv->curr_safe_nb > 0) {
-		conn = MT_LIST_POP(&srv->safe_conns[tid], struct connection *, list);
+		conn = srv_lookup_conn(&srv->safe_conns_tree[tid], NULL, hash, params);
 		if (conn) {
+			conn_delete_from_tree(conn);
 			is_safe = 1;
-			mt_list = srv->safe_conns;
+			tree = srv->safe_conns_tree;
 		}
 	}
 	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
@@ -1132,7 +1164,9 @@ static struct connection *conn_backend_get(struct server *srv, int is_safe)
 		goto done;
 
 	/* Lookup all other threads for an idle connection, starting from last
-	 * unvisited thread.
+	 * unvisited thread. Only the connections with the same hash may be
+	 * taken over. A failed takeover may release the connection, so the
+	 * next one is retrieved first.
 	 */
 	stop = srv->next_takeover;
 	if (stop >= global.nbthread)
@@ -1140,38 +1174,34 @@ static struct connection *conn_backend_get(struct server *srv, int is_safe)
 
 	i = stop;
 	do {
-		struct mt_list *elt1, elt2;
-
 		if (!srv->curr_idle_thr[i] || i == tid)
 			continue;
 
 		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
-		mt_list_for_each_entry_safe(conn, &mt_list[i], list, elt1, elt2) {
+		for (conn = srv_lookup_conn(&tree[i], NULL, hash, params); conn; conn = next) {
+			next = srv_lookup_conn(&tree[i], &conn->hash_node, hash, params);
 			if (conn->mux->takeover && conn->mux->takeover(conn, i) == 0) {
-				MT_LIST_DEL_SAFE(elt1);
+				conn_delete_from_tree(conn);
 				_HA_ATOMIC_ADD(&activity[tid].fd_takeover, 1);
-				found = 1;
 				break;
 			}
 		}
 
-		if (!found && !is_safe && srv->curr_safe_nb > 0) {
-			mt_list_for_each_entry_safe(conn, &srv->safe_conns[i], list, elt1, elt2) {
+		if (!conn && !is_safe && srv->curr_safe_nb > 0) {
+			for (conn = srv_lookup_conn(&srv->safe_conns_tree[i], NULL, hash, params); conn; conn = next) {
+				next = srv_lookup_conn(&srv->safe_conns_tree[i], &conn->hash_node, hash, params);
 				if (conn->mux->takeover && conn->mux->takeover(conn, i) == 0) {
-					MT_LIST_DEL_SAFE(elt1);
+					conn_delete_from_tree(conn);
 					_HA_ATOMIC_ADD(&activity[tid].fd_takeover, 1);
-					found = 1;
 					is_safe = 1;
-					mt_list = srv->safe_conns;
+					tree = srv->safe_conns_tree;
 					break;
 				}
 			}
 		}
 		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
-	} while (!found && (i = (i + 1 == global.nbthread) ? 0 : i + 1) != stop);
+	} while (!conn && (i = (i + 1 == global.nbthread) ? 0 : i + 1) != stop);
 
-	if (!found)
-		conn = NULL;
  done:
 	if (conn) {
 		conn->idle_time = 0;
@@ -1180,11 +1210,176 @@ static struct connection *conn_backend_get(struct server *srv, int is_safe)
 		_HA_ATOMIC_SUB(&srv->curr_idle_thr[i], 1);
 		_HA_ATOMIC_SUB(is_safe ? &srv->curr_safe_nb : &srv->curr_idle_nb, 1);
 		__ha_barrier_atomic_store();
-		LIST_ADDQ(&srv->available_conns[tid], mt_list_to_list(&conn->list));
+		eb64_insert(&srv->available_conns_tree[tid], &conn->hash_node);
+
+		/* the pool of the thread it was taken from must be refilled */
+		if (conn->flags & CO_FL_WARM) {
+			conn->flags &= ~CO_FL_WARM;
+			_HA_ATOMIC_SUB(&srv->curr_warm_thr[i], 1);
+			_HA_ATOMIC_ADD(&srv->counters.warm_hit, 1);
+			task_wakeup(srv->warm_tasks[i], TASK_WOKEN_OTHER);
+		}
 	}
 	return conn;
 }
 
+/* Starts to establish a connection to server <srv> for the warm pool of the
+ * current thread, with the parameters <params>: bound to its source address
+ * if set and presenting its SNI if set. The connection has no stream, its mux is installed by
+ * conn_create_mux() once the transport layer is ready, then srv_warm_conns()
+ * moves it to the idle pool. Until then, the key of its hash node holds the
+ * date its establishment expires, and it is queued into the server's list of
+ * warming connections. Returns 0 on success, otherwise -1.
+ */
+static int srv_warm_conn_new(struct server *srv, const struct conn_hash_params *params)
+{
+	struct connection *conn;
+
+	conn = conn_new();
+	if (!conn)
+		return -1;
+
+	conn->flags |= CO_FL_WARM;
+	conn_hash_store(conn, params);
+	conn->hash_node.key = tick_add_ifset(now_ms, srv->proxy->timeout.connect);
+	if (!tick_isset(conn->hash_node.key))
+		conn->hash_node.key = tick_add(now_ms, MS_TO_TICKS(SRV_WARM_CONN_INTERVAL));
+
+	if (!sockaddr_alloc(&conn->dst))
+		goto fail;
+	*conn->dst = srv->addr;
+	set_host_port(conn->dst, srv->svc_port);
+
+	if (params->src_addr) {
+		if (!sockaddr_alloc(&conn->src))
+			goto fail;
+		*conn->src = *params->src_addr;
+	}
+
+	conn_prepare(conn, protocol_by_family(conn->dst->ss_family), srv->xprt);
+	if (!conn->ctrl || !conn->ctrl->connect)
+		goto fail;
+
+	/* conn_free() releases the server's reference from now on */
+	conn->target = &srv->obj_type;
+	_HA_ATOMIC_ADD(&srv->curr_used_conns, 1);
+	MT_LIST_ADDQ(&srv->warming_conns[tid], &conn->list);
+	_HA_ATOMIC_ADD(&srv->proxy->be_counters.connect, 1);
+	_HA_ATOMIC_ADD(&srv->counters.connect, 1);
+
+	if (conn->ctrl->connect(conn, 0) != SF_ERR_NONE) {
+		conn->flags |= CO_FL_ERROR;
+		return -1;
+	}
+
+#ifdef USE_OPENSSL
+	if (params->sni)
+		ssl_sock_set_servername(conn, params->sni);
+#endif
+
+	/* catch sync connect, the FD handler will not be called */
+	if (!(conn->flags & CO_FL_WAIT_XPRT))
+		conn_create_mux(conn);
+	return 0;
+
+ fail:
+	conn_free(conn);
+	return -1;
+}
+
+/* Task keeping server <context>'s share of the warm pool for the current thread
+ * established: the connections that are ready are moved to the safe idle
+ * tree, the failed ones are released, then new ones are started to reach the
+ * share of the thread. They have the hash of a request whose parameters do not
+ * depend on the client, so that connect_server() may pick them. It runs every
+ * SRV_WARM_CONN_INTERVAL ms, or when a connection is ready or was taken.
+ */
+struct task *srv_warm_conns(struct task *t, void *context, unsigned short state)
+{
+	struct server *srv = context;
+	struct conn_hash_params hash_params;
+	struct sockaddr_storage *bind_addr;
+	struct connection *conn;
+	struct mt_list warming;
+	uint64_t hash;
+	int share, missing;
+	int nb_warming = 0;
+
+	t->expire = tick_add(now_ms, MS_TO_TICKS(SRV_WARM_CONN_INTERVAL));
+
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = &srv->obj_type;
+
+	alloc_bind_address(&bind_addr, srv, srv->proxy, NULL);
+	hash_params.src_addr = bind_addr;
+
+#ifdef USE_OPENSSL
+	/* the SNI was checked not to depend on any stream */
+	if (srv->ssl_ctx.sni) {
+		struct sample *sni_smp;
+
+		sni_smp = sample_fetch_as_type(srv->proxy, NULL, NULL, SMP_OPT_DIR_REQ | SMP_OPT_FINAL,
+		                               srv->ssl_ctx.sni, SMP_T_STR);
+		if (smp_make_safe(sni_smp)) {
+			hash_params.sni = sni_smp->data.u.str.area;
+			hash_params.sni_len = sni_smp->data.u.str.data;
+		}
+	}
+#endif
+
+	hash = conn_calculate_hash(&hash_params);
+
+	/* first, deal with the connections being established */
+	MT_LIST_INIT(&warming);
+	while ((conn = MT_LIST_POP(&srv->warming_conns[tid], struct connection *, list)) != NULL) {
+		if (conn->mux) {
+			conn->hash_node.key = hash;
+			/* counted before another thread may take it */
+			_HA_ATOMIC_ADD(&srv->curr_warm_thr[tid], 1);
+			if ((conn->flags & CO_FL_ERROR) || !conn->mux->avail_streams(conn) ||
+			    !__srv_add_to_idle_list(srv, conn, 1)) {
+				_HA_ATOMIC_SUB(&srv->curr_warm_thr[tid], 1);
+				conn->mux->destroy(conn->ctx);
+			}
+		}
+		else if ((conn->flags & CO_FL_ERROR) || tick_is_expired(conn->hash_node.key, now_ms)) {
+			conn_stop_tracking(conn);
+			conn_full_close(conn);
+			conn_free(conn);
+		}
+		else {
+			t->expire = tick_first(t->expire, conn->hash_node.key);
+			MT_LIST_ADDQ(&warming, &conn->list);
+			nb_warming++;
+		}
+	}
+
+	while ((conn = MT_LIST_POP(&warming, struct connection *, list)) != NULL)
+		MT_LIST_ADDQ(&srv->warming_conns[tid], &conn->list);
+
+	/* then complete the share of this thread, the other idle connections
+	 * are not counted since they may not be usable by a first request.
+	 */
+	if (srv->cur_state == SRV_ST_STOPPED || (srv->cur_admin & SRV_ADMF_MAINT) ||
+	    !is_addr(&srv->addr) || ha_used_fds >= global.tune.pool_low_count)
+		goto out;
+
+	share = srv->warm_conns / global.nbthread + (tid < srv->warm_conns % global.nbthread);
+	missing = share - srv->curr_warm_thr[tid] - nb_warming;
+	while (missing-- > 0) {
+		if (srv->max_idle_conns != -1 &&
+		    srv->curr_idle_conns + nb_warming >= srv->max_idle_conns)
+			break;
+		if (srv_warm_conn_new(srv, &hash_params) < 0)
+			break;
+		nb_warming++;
+	}
+
+ out:
+	sockaddr_free(&bind_addr);
+	return t;
+}
+
 /*
  * This function initiates a connection to the server assigned to this stream
  * (s->target, s->si[1].addr.to). It will assign a server if none
@@ -1207,6 +1402,13 @@ int connect_server(struct stream *s)
 	struct conn_stream *srv_cs = NULL;
 	struct sess_srv_list *srv_list;
 	struct server *srv;
+	struct conn_hash_params hash_params;
+	struct sockaddr_storage *bind_addr;
+	struct buffer *proxy_line = NULL;
+#ifdef USE_OPENSSL
+	struct sample *sni_smp = NULL;
+#endif
+	uint64_t hash;
 	int reuse = 0;
 	int reuse_orphan = 0;
 	int init_mux = 0;
@@ -1219,11 +1421,64 @@ int connect_server(struct stream *s)
 	 */
 	si_release_endpoint(&s->si[1]);
 
+	srv = objt_server(s->target);
+
+	if (!(s->flags & SF_ADDR_SET)) {
+		err = assign_server_address(s);
+		if (err != SRV_STATUS_OK)
+			return SF_ERR_INTERNAL;
+	}
+
+	/* Compute the hash of the parameters a reused connection must match:
+	 * the target, the destination when it is not fixed by the server, the
+	 * source the connection is bound to, the PROXY protocol header and the
+	 * SNI. The ALPN offered is a server setting, it is covered by the
+	 * target.
+	 */
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = s->target;
+
+	if (srv && (!is_addr(&srv->addr) || srv->flags & SRV_F_MAPPORTS))
+		hash_params.dst_addr = s->target_addr;
+
+	alloc_bind_address(&bind_addr, srv, s->be, s);
+	hash_params.src_addr = bind_addr;
+
+	/* the PROXY header is kept until the connection is picked or created,
+	 * as reused connections are compared with it.
+	 */
+	if (srv && srv->pp_opts && (proxy_line = alloc_trash_chunk()) != NULL) {
+		if (cli_conn)
+			conn_get_dst(cli_conn);
+		proxy_line->data = make_proxy_line(proxy_line->area, proxy_line->size, srv, cli_conn, s);
+		if (proxy_line->data) {
+			hash_params.proxy = proxy_line->area;
+			hash_params.proxy_len = proxy_line->data;
+		}
+	}
+
+#ifdef USE_OPENSSL
+	/* the SNI is retrieved last as the PROXY header may use trash chunks */
+	if (srv && srv->ssl_ctx.sni) {
+		sni_smp = sample_fetch_as_type(s->be, s->sess, s, SMP_OPT_DIR_REQ | SMP_OPT_FINAL,
+		                               srv->ssl_ctx.sni, SMP_T_STR);
+		if (smp_make_safe(sni_smp)) {
+			hash_params.sni = sni_smp->data.u.str.area;
+			hash_params.sni_len = sni_smp->data.u.str.data;
+		}
+		else
+			sni_smp = NULL;
+	}
+#endif
+
+	hash = conn_calculate_hash(&hash_params);
+
 	/* first, search for a matching connection in the session's idle conns */
 	list_for_each_entry(srv_list, &s->sess->srv_list, srv_list) {
 		if (srv_list->target == s->target) {
 			list_for_each_entry(srv_conn, &srv_list->conn_list, session_list) {
-				if (conn_xprt_ready(srv_conn) &&
+				if (srv_conn->hash_node.key == hash && conn_hash_match(srv_conn, &hash_params) &&
+				    conn_xprt_ready(srv_conn) &&
 				    srv_conn->mux && (srv_conn->mux->avail_streams(srv_conn) > 0)) {
 					reuse = 1;
 					break;
@@ -1236,8 +1491,6 @@ int connect_server(struct stream *s)
 	if (!reuse)
 		srv_conn = NULL;
 
-	srv = objt_server(s->target);
-
 	if (srv && !reuse) {
 		srv_conn = NULL;
 
@@ -1257,36 +1510,41 @@ int connect_server(struct stream *s)
 		 *  ----+-----+-----+    ----+-----+-----+   ----+-----+-----+
 		 *
 		 * Idle conns are necessarily looked up on the same thread so
-		 * that there is no concurrency issues.
+		 * that there is no concurrency issues. Only the connections
+		 * whose hash matches the request's one may be used.
 		 */
-		if (srv->available_conns && !LIST_ISEMPTY(&srv->available_conns[tid]) &&
-		    ((s->be->options & PR_O_REUSE_MASK) != PR_O_REUSE_NEVR)) {
-			    srv_conn = LIST_ELEM(srv->available_conns[tid].n, struct connection *, list);
+		if (srv->available_conns_tree &&
+		    ((s->be->options & PR_O_REUSE_MASK) != PR_O_REUSE_NEVR) &&
+		    (srv_conn = srv_lookup_conn(&srv->available_conns_tree[tid], NULL, hash, &hash_params)) != NULL) {
 			    reuse = 1;
 		}
 		else if (!srv_conn && srv->curr_idle_conns > 0) {
-			if (srv->idle_conns && srv->safe_conns &&
+			if (srv->idle_conns_tree && srv->safe_conns_tree &&
 			    ((s->be->options & PR_O_REUSE_MASK) != PR_O_REUSE_NEVR &&
 			     s->txn && (s->txn->flags & TX_NOT_FIRST)) &&
 			    srv->curr_idle_nb + srv->curr_safe_nb > 0) {
 				/* we're on the second column of the tables above, let's
 				 * try idle then safe.
 				 */
-				srv_conn = conn_backend_get(srv, 0);
-				was_unused = 1;
-			}
-			else if (srv->safe_conns &&
-			         ((s->txn && (s->txn->flags & TX_NOT_FIRST)) ||
-				  (s->be->options & PR_O_REUSE_MASK) >= PR_O_REUSE_AGGR) &&
-				 srv->curr_safe_nb > 0) {
-				srv_conn = conn_backend_get(srv, 1);
+				srv_conn = conn_backend_get(srv, 0, hash, &hash_params);
 				was_unused = 1;
 			}
-			else if (srv->idle_conns &&
-			         ((s->be->options & PR_O_REUSE_MASK) == PR_O_REUSE_ALWS) &&
-				 srv->curr_idle_nb > 0) {
-				srv_conn = conn_backend_get(srv, 0);
-				was_unused = 1;
+			else {
+				if (srv->safe_conns_tree &&
+				    ((s->txn && (s->txn->flags & TX_NOT_FIRST)) ||
+				     (s->be->options & PR_O_REUSE_MASK) >= PR_O_REUSE_AGGR) &&
+				    srv->curr_safe_nb > 0) {
+					srv_conn = conn_backend_get(srv, 1, hash, &hash_params);
+					was_unused = 1;
+				}
+
+				/* the safe connections may all have another hash */
+				if (!srv_conn && srv->idle_conns_tree &&
+				    ((s->be->options & PR_O_REUSE_MASK) == PR_O_REUSE_ALWS) &&
+				    srv->curr_idle_nb > 0) {
+					srv_conn = conn_backend_get(srv, 0, hash, &hash_params);
+					was_unused = 1;
+				}
 			}
 			/* If we've picked a connection from the pool, we now have to
 			 * detach it. We may have to get rid of the previous idle
@@ -1303,34 +1561,22 @@ int connect_server(struct stream *s)
 	}
 
 
-	/* here reuse might have been set above, indicating srv_conn finally
-	 * is OK.
-	 */
-	if (reuse) {
-		/* Disable connection reuse if a dynamic source is used.
-		 * As long as we don't share connections between servers,
-		 * we don't need to disable connection reuse on no-idempotent
-		 * requests nor when PROXY protocol is used.
-		 */
-		if (srv && srv->conn_src.opts & CO_SRC_BIND) {
-			if ((srv->conn_src.opts & CO_SRC_TPROXY_MASK) == CO_SRC_TPROXY_DYN)
-				reuse = 0;
-		}
-		else if (s->be->conn_src.opts & CO_SRC_BIND) {
-			if ((s->be->conn_src.opts & CO_SRC_TPROXY_MASK) == CO_SRC_TPROXY_DYN)
-				reuse = 0;
-		}
-	}
-
-	if (ha_used_fds > global.tune.pool_high_count && srv && srv->idle_conns) {
-		struct connection *tokill_conn;
+	if (ha_used_fds > global.tune.pool_high_count && srv && srv->idle_conns_tree) {
+		struct connection *tokill_conn = NULL;
+		struct eb64_node *node;
 
 		/* We can't reuse a connection, and e have more FDs than deemd
 		 * acceptable, attempt to kill an idling connection
 		 */
 		/* First, try from our own idle list */
-		tokill_conn = MT_LIST_POP(&srv->idle_conns[tid],
-		    struct connection *, list);
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
+		node = eb64_first(&srv->idle_conns_tree[tid]);
+		if (node) {
+			tokill_conn = eb64_entry(node, struct connection, hash_node);
+			conn_delete_from_tree(tokill_conn);
+		}
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
+
 		if (tokill_conn)
 			tokill_conn->mux->destroy(tokill_conn->ctx);
 		/* If not, iterate over other thread's idling pool, and try to grab one */
@@ -1345,14 +1591,14 @@ int connect_server(struct stream *s)
 				ALREADY_CHECKED(i);
 
 				HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
-				tokill_conn = MT_LIST_POP(&srv->idle_conns[i],
-				    struct connection *, list);
-				if (!tokill_conn)
-					tokill_conn = MT_LIST_POP(&srv->safe_conns[i],
-					    struct connection *, list);
+				node = eb64_first(&srv->idle_conns_tree[i]);
+				if (!node)
+					node = eb64_first(&srv->safe_conns_tree[i]);
 
-				if (tokill_conn) {
+				if (node) {
 					/* We got one, put it into the concerned thread's to kill list, and wake it's kill task */
+					tokill_conn = eb64_entry(node, struct connection, hash_node);
+					eb64_delete(node);
 
 					MT_LIST_ADDQ(&idle_conns[i].toremove_conns,
 					    (struct mt_list *)&tokill_conn->list);
@@ -1384,8 +1630,8 @@ int connect_server(struct stream *s)
 			int avail = srv_conn->mux->avail_streams(srv_conn);
 
 			if (avail <= 1) {
-				/* No more streams available, remove it from the list */
-				MT_LIST_DEL(&srv_conn->list);
+				/* No more streams available, remove it from the tree */
+				eb64_delete(&srv_conn->hash_node);
 			}
 
 			if (avail >= 1) {
@@ -1407,10 +1653,19 @@ int connect_server(struct stream *s)
 	if (!srv_conn) {
 		srv_conn = conn_new();
 		was_unused = 1;
-		if (srv_conn)
+		if (srv && srv->warm_conns)
+			_HA_ATOMIC_ADD(&srv->counters.warm_miss, 1);
+		if (srv_conn) {
 			srv_conn->target = s->target;
+			srv_conn->hash_node.key = hash;
+			conn_hash_store(srv_conn, &hash_params);
+			srv_conn->src = bind_addr;
+			bind_addr = NULL;
+		}
 		srv_cs = NULL;
 	}
+	sockaddr_free(&bind_addr);
+	free_trash_chunk(proxy_line);
 
 	if (srv_conn && srv && was_unused) {
 		_HA_ATOMIC_ADD(&srv->curr_used_conns, 1);
@@ -1429,14 +1684,6 @@ int connect_server(struct stream *s)
 		return SF_ERR_RESOURCE;
 	}
 
-	if (!(s->flags & SF_ADDR_SET)) {
-		err = assign_server_address(s);
-		if (err != SRV_STATUS_OK) {
-			conn_free(srv_conn);
-			return SF_ERR_INTERNAL;
-		}
-	}
-
 	/* copy the target address into the connection */
 	*srv_conn->dst = *s->target_addr;
 
@@ -1480,15 +1727,10 @@ int connect_server(struct stream *s)
 		srv_conn->send_proxy_ofs = 0;
 
 		if (srv && srv->pp_opts) {
-			srv_conn->flags |= CO_FL_PRIVATE;
 			srv_conn->flags |= CO_FL_SEND_PROXY;
 			srv_conn->send_proxy_ofs = 1; /* must compute size */
-			if (cli_conn)
-				conn_get_dst(cli_conn);
 		}
 
-		assign_tproxy_address(s);
-
 		if (srv && (srv->flags & SRV_F_SOCKS4_PROXY)) {
 			srv_conn->send_proxy_ofs = 1;
 			srv_conn->flags |= CO_FL_SOCKS4;
@@ -1554,7 +1796,7 @@ int connect_server(struct stream *s)
 		 */
 		if (srv && ((s->be->options & PR_O_REUSE_MASK) == PR_O_REUSE_ALWS) &&
 		    !(srv_conn->flags & CO_FL_PRIVATE) && srv_conn->mux->avail_streams(srv_conn) > 0)
-			LIST_ADDQ(&srv->available_conns[tid], mt_list_to_list(&srv_conn->list));
+			eb64_insert(&srv->available_conns_tree[tid], &srv_conn->hash_node);
 	}
 
 #if USE_OPENSSL && (defined(OPENSSL_IS_BORINGSSL) || (HA_OPENSSL_VERSION_NUMBER >= 0x10101000L))
@@ -1590,17 +1832,8 @@ int connect_server(struct stream *s)
 		}
 
 #ifdef USE_OPENSSL
-		if (srv->ssl_ctx.sni) {
-			struct sample *smp;
-
-			smp = sample_fetch_as_type(s->be, s->sess, s, SMP_OPT_DIR_REQ | SMP_OPT_FINAL,
-						   srv->ssl_ctx.sni, SMP_T_STR);
-			if (smp_make_safe(smp)) {
-				ssl_sock_set_servername(srv_conn,
-							smp->data.u.str.area);
-				srv_conn->flags |= CO_FL_PRIVATE;
-			}
-		}
+		if (sni_smp)
+			ssl_sock_set_servername(srv_conn, sni_smp->data.u.str.area);
 #endif /* USE_OPENSSL */
 
 	}
@@ -0,0 +1,120 @@
+/*
+ * Built-in micro-benchmarks runner.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Benchmarks are registered by the files of tests/bench/, which are only
+ * linked into the "haproxy-bench" executable built by "make bench", so that
+ * they call the functions of the real objects without weighing on haproxy.
+ * "haproxy-bench -B" runs them and reports the results as CSV on the standard
+ * output. The number of operations of each benchmark is raised until it lasts
+ * long enough to be measured reliably.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/list.h>
+
+volatile unsigned long long bench_sink;
+
+/* the list of registered benchmarks */
+static struct list benchmarks = LIST_HEAD_INIT(benchmarks);
+
+/* registers benchmark <bench>, keeping the list sorted by name */
+void bench_register(struct bench *bench)
+{
+	struct bench *cur;
+
+	list_for_each_entry(cur, &benchmarks, list) {
+		if (strcmp(cur->name, bench->name) > 0)
+			break;
+	}
+	LIST_ADDQ(&cur->list, &bench->list);
+}
+
+/* Runs benchmark <bench> for at least <min_ns> nanoseconds and reports its
+ * results on the standard output. Returns 0 on failure, otherwise non-zero.
+ */
+static int bench_run_one(struct bench *bench, unsigned long long min_ns)
+{
+	struct bench_run run;
+	unsigned long long next;
+
+	memset(&run, 0, sizeof(run));
+	run.iters = 1;
+	while (1) {
+		run.elapsed = 0;
+		run.bytes = 0;
+		run.syscalls = 0;
+		bench->fct(&run);
+		if (run.failed) {
+			printf("%s,0,,,\n", bench->name);
+			return 0;
+		}
+		if (run.elapsed >= min_ns || run.iters >= (1ULL << 40))
+			break;
+
+		/* aim at 20% above the minimal time, at most 100 times more */
+		next = run.elapsed ? run.iters * min_ns / run.elapsed * 6 / 5 : run.iters * 100;
+		if (next > run.iters * 100)
+			next = run.iters * 100;
+		if (next < run.iters * 2)
+			next = run.iters * 2;
+		run.iters = next;
+	}
+
+	printf("%s,%llu,%.2f,%llu,%.2f\n", bench->name, run.iters,
+	       (double)run.elapsed / run.iters, run.bytes,
+	       run.bytes ? (double)run.bytes * run.iters * 1000.0 / run.elapsed : 0.0);
+	if (run.syscalls)
+		printf("# %s: %.3f syscalls per operation\n", bench->name,
+		       (double)run.syscalls / run.iters);
+	return 1;
+}
+
+/* Runs the registered benchmarks whose name starts with one of the words of
+ * <argv>, or all of them if there are none. "-t <ms>" sets the minimal
+ * duration of each benchmark (200 ms by default). Returns the process' exit
+ * status.
+ */
+int bench_run_all(int argc, char **argv)
+{
+	struct bench *bench;
+	unsigned long long min_ns = 200000000ULL;
+	int i, match, ret = 0;
+
+	if (argc >= 2 && strcmp(argv[0], "-t") == 0) {
+		min_ns = strtoull(argv[1], NULL, 10) * 1000000ULL;
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (LIST_ISEMPTY(&benchmarks)) {
+		fprintf(stderr, "No benchmark was built in, please use 'make bench'.\n");
+		return 1;
+	}
+
+	printf("# name,iterations,ns_per_op,bytes_per_op,mb_per_s\n");
+	list_for_each_entry(bench, &benchmarks, list) {
+		match = !argc;
+		for (i = 0; i < argc && !match; i++)
+			match = strncmp(bench->name, argv[i], strlen(argv[i])) == 0;
+		if (match && !bench_run_one(bench, min_ns))
+			ret = 1;
+	}
+	return ret;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -3351,6 +3351,13 @@ int check_config_validity()
 				curproxy->options &= ~PR_O_ORGTO;
 			}
 
+			if (curproxy->hedge_delay || curproxy->hedge_pct) {
+				ha_warning("config : 'hedge-delay' ignored for %s '%s' as it requires HTTP mode.\n",
+					   proxy_type_str(curproxy), curproxy->id);
+				err_code |= ERR_WARN;
+				curproxy->hedge_delay = curproxy->hedge_pct = 0;
+			}
+
 			for (optnum = 0; cfg_opts[optnum].name; optnum++) {
 				if (cfg_opts[optnum].mode == PR_MODE_HTTP &&
 				    (curproxy->cap & cfg_opts[optnum].cap) &&
@@ -3543,9 +3550,9 @@ int check_config_validity()
 		for (newsrv = curproxy->srv; newsrv; newsrv = newsrv->next) {
 			int i;
 
-			newsrv->available_conns = calloc(global.nbthread, sizeof(*newsrv->available_conns));
+			newsrv->available_conns_tree = calloc(global.nbthread, sizeof(*newsrv->available_conns_tree));
 
-			if (!newsrv->available_conns) {
+			if (!newsrv->available_conns_tree) {
 				ha_alert("parsing [%s:%d] : failed to allocate idle connections for server '%s'.\n",
 				    newsrv->conf.file, newsrv->conf.line, newsrv->id);
 				cfgerr++;
@@ -3553,7 +3560,48 @@ int check_config_validity()
 			}
 
 			for (i = 0; i < global.nbthread; i++)
-				LIST_INIT(&newsrv->available_conns[i]);
+				newsrv->available_conns_tree[i] = EB_ROOT;
+
+			if (newsrv->warm_conns) {
+				const struct conn_src *src;
+				const char *why = NULL;
+
+				/* the warm connections must match requests
+				 * whose parameters do not depend on the client.
+				 */
+				src = (newsrv->conn_src.opts & CO_SRC_BIND) ? &newsrv->conn_src : &curproxy->conn_src;
+				if (curproxy->mode != PR_MODE_HTTP)
+					why = "the backend is not in HTTP mode";
+				else if ((curproxy->options & PR_O_REUSE_MASK) == PR_O_REUSE_NEVR)
+					why = "connection reuse is disabled";
+				else if (!newsrv->max_idle_conns || !newsrv->pool_purge_delay)
+					why = "idle connections are disabled";
+				else if (newsrv->pp_opts)
+					why = "the PROXY protocol header depends on the client";
+				else if (newsrv->flags & SRV_F_MAPPORTS)
+					why = "the destination port depends on the client";
+				else if ((src->opts & CO_SRC_BIND) && (src->opts & CO_SRC_TPROXY_MASK) > CO_SRC_TPROXY_ADDR)
+					why = "the source address depends on the client";
+#ifdef USE_OPENSSL
+				else if (newsrv->ssl_ctx.sni &&
+				         ((newsrv->ssl_ctx.sni->fetch->use & ~SMP_USE_INTRN) ||
+				          !LIST_ISEMPTY(&newsrv->ssl_ctx.sni->conv_exprs)))
+					why = "the SNI depends on the request";
+#endif
+
+				if (why) {
+					ha_warning("config : %s '%s' : 'pool-warm-conn' ignored for server '%s' because %s.\n",
+						   proxy_type_str(curproxy), curproxy->id, newsrv->id, why);
+					err_code |= ERR_WARN;
+					newsrv->warm_conns = 0;
+				}
+				else if (newsrv->max_idle_conns != -1 && newsrv->warm_conns > newsrv->max_idle_conns) {
+					ha_warning("config : %s '%s' : 'pool-warm-conn' reduced to %d for server '%s' to match 'pool-max-conn'.\n",
+						   proxy_type_str(curproxy), curproxy->id, newsrv->max_idle_conns, newsrv->id);
+					err_code |= ERR_WARN;
+					newsrv->warm_conns = newsrv->max_idle_conns;
+				}
+			}
 
 			if (newsrv->max_idle_conns != 0) {
 				if (idle_conn_task == NULL) {
@@ -3575,8 +3623,8 @@ int check_config_validity()
 					}
 				}
 
-				newsrv->idle_conns = calloc((unsigned short)global.nbthread, sizeof(*newsrv->idle_conns));
-				if (!newsrv->idle_conns) {
+				newsrv->idle_conns_tree = calloc((unsigned short)global.nbthread, sizeof(*newsrv->idle_conns_tree));
+				if (!newsrv->idle_conns_tree) {
 					ha_alert("parsing [%s:%d] : failed to allocate idle connections for server '%s'.\n",
 					    newsrv->conf.file, newsrv->conf.line, newsrv->id);
 					cfgerr++;
@@ -3584,10 +3632,10 @@ int check_config_validity()
 				}
 
 				for (i = 0; i < global.nbthread; i++)
-					MT_LIST_INIT(&newsrv->idle_conns[i]);
+					newsrv->idle_conns_tree[i] = EB_ROOT;
 
-				newsrv->safe_conns = calloc(global.nbthread, sizeof(*newsrv->safe_conns));
-				if (!newsrv->safe_conns) {
+				newsrv->safe_conns_tree = calloc(global.nbthread, sizeof(*newsrv->safe_conns_tree));
+				if (!newsrv->safe_conns_tree) {
 					ha_alert("parsing [%s:%d] : failed to allocate idle connections for server '%s'.\n",
 					    newsrv->conf.file, newsrv->conf.line, newsrv->id);
 					cfgerr++;
@@ -3595,11 +3643,29 @@ int check_config_validity()
 				}
 
 				for (i = 0; i < global.nbthread; i++)
-					MT_LIST_INIT(&newsrv->safe_conns[i]);
+					newsrv->safe_conns_tree[i] = EB_ROOT;
 
 				newsrv->curr_idle_thr = calloc(global.nbthread, sizeof(*newsrv->curr_idle_thr));
 				if (!newsrv->curr_idle_thr)
 					goto err;
+
+				if (newsrv->warm_conns) {
+					newsrv->warm_tasks = calloc(global.nbthread, sizeof(*newsrv->warm_tasks));
+					newsrv->warming_conns = calloc(global.nbthread, sizeof(*newsrv->warming_conns));
+					newsrv->curr_warm_thr = calloc(global.nbthread, sizeof(*newsrv->curr_warm_thr));
+					if (!newsrv->warm_tasks || !newsrv->warming_conns || !newsrv->curr_warm_thr)
+						goto err;
+
+					for (i = 0; i < global.nbthread; i++) {
+						MT_LIST_INIT(&newsrv->warming_conns[i]);
+						newsrv->warm_tasks[i] = task_new(1UL << i);
+						if (!newsrv->warm_tasks[i])
+							goto err;
+						newsrv->warm_tasks[i]->process = srv_warm_conns;
+						newsrv->warm_tasks[i]->context = newsrv;
+						task_wakeup(newsrv->warm_tasks[i], TASK_WOKEN_INIT);
+					}
+				}
 				continue;
 			err:
 				ha_alert("parsing [%s:%d] : failed to allocate idle connection tasks for server '%s'.\n",
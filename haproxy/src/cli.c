@@ -1277,9 +1277,15 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 	chunk_appendf(&trash, "accepted:");     SHOW_TOT(thr, activity[thr].accepted);
 	chunk_appendf(&trash, "accq_pushed:");  SHOW_TOT(thr, activity[thr].accq_pushed);
 	chunk_appendf(&trash, "accq_full:");    SHOW_TOT(thr, activity[thr].accq_full);
+	chunk_appendf(&trash, "rx_lookups:");   SHOW_TOT(thr, activity[thr].rx_lookups);
+	chunk_appendf(&trash, "rx_cand:");      SHOW_TOT(thr, activity[thr].rx_cand);
+	chunk_appendf(&trash, "rx_match:");     SHOW_TOT(thr, activity[thr].rx_match);
+	chunk_appendf(&trash, "rx_skip:");      SHOW_TOT(thr, activity[thr].rx_skip);
 #ifdef USE_THREAD
 	chunk_appendf(&trash, "accq_ring:");    SHOW_TOT(thr, (accept_queue_rings[thr].tail - accept_queue_rings[thr].head + ACCEPT_QUEUE_SIZE) % ACCEPT_QUEUE_SIZE);
 	chunk_appendf(&trash, "fd_takeover:");  SHOW_TOT(thr, activity[thr].fd_takeover);
+	chunk_appendf(&trash, "stolen:");       SHOW_TOT(thr, activity[thr].stolen);
+	chunk_appendf(&trash, "stealq:");       SHOW_TOT(thr, task_per_thread[thr].stealq.tail - task_per_thread[thr].stealq.head);
 #endif
 
 #if defined(DEBUG_DEV)
@@ -12,6 +12,8 @@
 
 #include <errno.h>
 
+#include <import/xxhash.h>
+
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/connection.h>
@@ -60,11 +62,26 @@ int conn_create_mux(struct connection *conn)
 		else if (conn_install_mux_be(conn, conn->ctx, conn->owner) < 0)
 			goto fail;
 		srv = objt_server(conn->target);
+
+		/* a connection established for the warm pool has no stream,
+		 * the server's task moves it to the idle pool.
+		 */
+		if (conn->flags & CO_FL_WARM) {
+			task_wakeup(__objt_server(conn->target)->warm_tasks[tid], TASK_WOKEN_IO);
+			return 0;
+		}
+
 		if (srv && ((srv->proxy->options & PR_O_REUSE_MASK) == PR_O_REUSE_ALWS) &&
 		    !(conn->flags & CO_FL_PRIVATE) && conn->mux->avail_streams(conn) > 0)
-			LIST_ADDQ(&srv->available_conns[tid], mt_list_to_list(&conn->list));
+			eb64_insert(&srv->available_conns_tree[tid], &conn->hash_node);
 		return 0;
 fail:
+		if (conn->flags & CO_FL_WARM) {
+			/* nobody waits for it, the server's task releases it */
+			conn->flags |= CO_FL_ERROR;
+			task_wakeup(__objt_server(conn->target)->warm_tasks[tid], TASK_WOKEN_IO);
+			return -1;
+		}
 		/* let the upper layer know the connection failed */
 		cs->data_cb->wake(cs);
 		return -1;
@@ -73,6 +90,149 @@ int conn_create_mux(struct connection *conn)
 
 }
 
+/* Appends to <buf> at offset <*len> the significant part of address <addr>,
+ * which is its family, address and port, so that the padding and unused
+ * bytes of the sockaddr_storage do not affect the hash. At most
+ * CONN_HASH_ADDR_LEN bytes are appended.
+ */
+static void conn_hash_addr(char *buf, size_t *len, const struct sockaddr_storage *addr)
+{
+	buf[(*len)++] = addr->ss_family;
+	switch (addr->ss_family) {
+	case AF_INET:
+		memcpy(buf + *len, &((struct sockaddr_in *)addr)->sin_addr, 4);
+		memcpy(buf + *len + 4, &((struct sockaddr_in *)addr)->sin_port, 2);
+		*len += 6;
+		break;
+	case AF_INET6:
+		memcpy(buf + *len, &((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+		memcpy(buf + *len + 16, &((struct sockaddr_in6 *)addr)->sin6_port, 2);
+		*len += 18;
+		break;
+	}
+}
+
+/* Fills the CONN_HASH_ADDR_LEN bytes of <buf> with the significant part of
+ * address <addr>, or with zeroes if <addr> is NULL.
+ */
+static void conn_hash_ext_addr(char *buf, const struct sockaddr_storage *addr)
+{
+	size_t len = 0;
+
+	memset(buf, 0, CONN_HASH_ADDR_LEN);
+	if (addr)
+		conn_hash_addr(buf, &len, addr);
+}
+
+/* Returns the hash of the connection parameters <params>, which is used as
+ * the key of backend connections in the servers' idle, safe and available
+ * trees. Each set parameter is preceded by a tag so that an unset parameter
+ * cannot produce the same input as a set one. Connections with the same
+ * parameters always share a hash. Connections with different parameters
+ * almost never do, and since two hashes of 64 bits may still collide, the
+ * lookups compare the parameters with conn_hash_match() before reusing a
+ * connection.
+ */
+uint64_t conn_calculate_hash(const struct conn_hash_params *params)
+{
+	char buf[1 + sizeof(void *) + 2 * (1 + 8) + 2 * (1 + CONN_HASH_ADDR_LEN)];
+	uint64_t prehash;
+	size_t len = 0;
+
+	buf[len++] = 'T';
+	memcpy(buf + len, &params->target, sizeof(params->target));
+	len += sizeof(params->target);
+
+	if (params->sni) {
+		prehash = XXH64(params->sni, params->sni_len, 0);
+		buf[len++] = 'S';
+		memcpy(buf + len, &prehash, 8);
+		len += 8;
+	}
+
+	if (params->proxy) {
+		prehash = XXH64(params->proxy, params->proxy_len, 0);
+		buf[len++] = 'P';
+		memcpy(buf + len, &prehash, 8);
+		len += 8;
+	}
+
+	if (params->src_addr) {
+		buf[len++] = 's';
+		conn_hash_addr(buf, &len, params->src_addr);
+	}
+
+	if (params->dst_addr) {
+		buf[len++] = 'd';
+		conn_hash_addr(buf, &len, params->dst_addr);
+	}
+
+	return XXH64(buf, len, 0);
+}
+
+/* Stores into <conn> a copy of the parameters <params> other than the target,
+ * for conn_hash_match(). Nothing is stored if none is set. If the copy cannot
+ * be allocated, the connection will simply never match a set of parameters.
+ */
+void conn_hash_store(struct connection *conn, const struct conn_hash_params *params)
+{
+	struct conn_hash_ext *ext;
+	size_t sni_len = params->sni ? params->sni_len : 0;
+	size_t proxy_len = params->proxy ? params->proxy_len : 0;
+
+	free(conn->hash_ext);
+	conn->hash_ext = NULL;
+	if (!params->sni && !params->proxy && !params->src_addr && !params->dst_addr)
+		return;
+
+	ext = malloc(sizeof(*ext) + sni_len + proxy_len);
+	if (!ext)
+		return;
+
+	conn_hash_ext_addr(ext->src, params->src_addr);
+	conn_hash_ext_addr(ext->dst, params->dst_addr);
+	ext->sni_len = params->sni ? sni_len : -1;
+	ext->proxy_len = params->proxy ? proxy_len : -1;
+	memcpy(ext->data, params->sni, sni_len);
+	memcpy(ext->data + sni_len, params->proxy, proxy_len);
+	conn->hash_ext = ext;
+}
+
+/* Returns non-zero if connection <conn> was made with the parameters <params>,
+ * as stored by conn_hash_store(), otherwise zero.
+ */
+int conn_hash_match(const struct connection *conn, const struct conn_hash_params *params)
+{
+	const struct conn_hash_ext *ext = conn->hash_ext;
+	char addr[CONN_HASH_ADDR_LEN];
+
+	if (conn->target != params->target)
+		return 0;
+
+	if (!ext)
+		return !params->sni && !params->proxy && !params->src_addr && !params->dst_addr;
+
+	if (!params->sni != (ext->sni_len < 0) || !params->proxy != (ext->proxy_len < 0))
+		return 0;
+
+	if (params->sni &&
+	    ((size_t)ext->sni_len != params->sni_len ||
+	     memcmp(ext->data, params->sni, params->sni_len) != 0))
+		return 0;
+
+	if (params->proxy &&
+	    ((size_t)ext->proxy_len != params->proxy_len ||
+	     memcmp(ext->data + (params->sni ? params->sni_len : 0), params->proxy, params->proxy_len) != 0))
+		return 0;
+
+	conn_hash_ext_addr(addr, params->src_addr);
+	if (memcmp(ext->src, addr, CONN_HASH_ADDR_LEN) != 0)
+		return 0;
+
+	conn_hash_ext_addr(addr, params->dst_addr);
+	return memcmp(ext->dst, addr, CONN_HASH_ADDR_LEN) == 0;
+}
+
 /* I/O callback for fd-based connections. It calls the read/write handlers
  * provided by the connection's sock_ops, which must be valid.
  */
@@ -63,7 +63,7 @@ void ha_thread_dump(struct buffer *buf, int thr, int calling_tid)
 		      ha_get_pthread_id(thr),
 		      thread_has_tasks(),
 	              !!(global_tasks_mask & thr_bit),
-	              !eb_is_empty(&task_per_thread[thr].timers),
+	              !wq_is_empty(&task_per_thread[thr].timers),
 	              !eb_is_empty(&task_per_thread[thr].rqueue),
 	              !(LIST_ISEMPTY(&task_per_thread[thr].tasklets[TL_URGENT]) &&
 			LIST_ISEMPTY(&task_per_thread[thr].tasklets[TL_NORMAL]) &&
@@ -0,0 +1,299 @@
+/*
+ * Reversed-label trie for domain-like word matching.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Patterns are split into labels on the delimiters and inserted from their
+ * last label to their first one. A string is matched by considering each
+ * position where a pattern may end (the end of the string or a delimiter
+ * following a word) and by walking the trie backwards from there, one hash
+ * lookup per label. The walk stops at the first missing label, so its cost is
+ * bounded by the number of labels of the longest pattern. Each node records
+ * the first pattern (in insertion order) ending there, and the lowest one met
+ * over all walks is returned, which gives the same result as testing the
+ * patterns one at a time in insertion order.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/domtrie.h>
+
+/* ASCII case folding, consistent with strncasecmp() in the C locale */
+static inline unsigned char domtrie_fold(unsigned int flags, unsigned char c)
+{
+	if ((flags & DOMTRIE_F_ICASE) && c >= 'A' && c <= 'Z')
+		c += 'a' - 'A';
+	return c;
+}
+
+static inline int domtrie_is_delim(const struct domtrie *dt, unsigned char c)
+{
+	return (dt->delim[c >> 6] >> (c & 63)) & 1;
+}
+
+/* Returns the start of the label of <str> which ends at <end>. The first label
+ * of a walk is a word, the next ones are a word followed by the delimiter
+ * found at <end> - 1. Labels never start on a delimiter.
+ */
+static inline size_t domtrie_label(const struct domtrie *dt, const char *str, size_t end, int first)
+{
+	size_t beg = first ? end : end - 1;
+
+	while (beg > 0 && !domtrie_is_delim(dt, str[beg - 1]))
+		beg--;
+	return beg;
+}
+
+/* FNV-1a of the <len> case-folded bytes of <str>, seeded with <parent> */
+static inline unsigned int domtrie_hash(const struct domtrie *dt, unsigned int parent,
+                                        const char *str, size_t len)
+{
+	unsigned int h = 2166136261U ^ (parent * 2654435761U);
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ domtrie_fold(dt->flags, str[i])) * 16777619U;
+	return h ^ (h >> 15);
+}
+
+/* Returns the slot of the edge leaving <parent> with label <str> of length
+ * <len> and hash <hash>, or the free slot where it would be inserted.
+ */
+static inline unsigned int domtrie_slot(const struct domtrie *dt, unsigned int parent,
+                                        const char *str, size_t len, unsigned int hash)
+{
+	const struct domtrie_edge *e;
+	unsigned int slot = hash & dt->mask;
+	size_t i;
+
+	while (1) {
+		e = &dt->edges[slot];
+		if (!e->child)
+			return slot;
+		if (e->hash == hash && e->parent == parent && e->len == len) {
+			for (i = 0; i < len; i++)
+				if (dt->text[e->key + i] != domtrie_fold(dt->flags, str[i]))
+					break;
+			if (i == len)
+				return slot;
+		}
+		slot = (slot + 1) & dt->mask;
+	}
+}
+
+/* Doubles the size of the hash table of <dt>. Returns 0 if out of memory. */
+static int domtrie_grow(struct domtrie *dt)
+{
+	struct domtrie_edge *old = dt->edges, *edges;
+	unsigned int old_slots = dt->mask + 1, i, slot;
+
+	edges = calloc(old_slots * 2, sizeof(*edges));
+	if (!edges)
+		return 0;
+
+	dt->edges = edges;
+	dt->mask = old_slots * 2 - 1;
+	for (i = 0; i < old_slots; i++) {
+		if (!old[i].child)
+			continue;
+		slot = old[i].hash & dt->mask;
+		while (edges[slot].child)
+			slot = (slot + 1) & dt->mask;
+		edges[slot] = old[i];
+	}
+	free(old);
+	return 1;
+}
+
+/* Allocates an empty trie splitting words on the characters of <delims>.
+ * <flags> may contain DOMTRIE_F_ICASE. Returns NULL if out of memory.
+ */
+struct domtrie *domtrie_new(unsigned int flags, const char *delims)
+{
+	struct domtrie *dt;
+
+	dt = calloc(1, sizeof(*dt));
+	if (!dt)
+		return NULL;
+
+	dt->flags = flags & DOMTRIE_F_ICASE;
+	for (; *delims; delims++)
+		dt->delim[(unsigned char)*delims >> 6] |= 1ULL << ((unsigned char)*delims & 63);
+
+	dt->mask = 63;
+	dt->edges = calloc(dt->mask + 1, sizeof(*dt->edges));
+	dt->alloc_nodes = 64;
+	dt->out = calloc(dt->alloc_nodes, sizeof(*dt->out));
+	if (!dt->edges || !dt->out) {
+		domtrie_free(dt);
+		return NULL;
+	}
+	dt->nb_nodes = 1; /* the root */
+	return dt;
+}
+
+/* Adds the <len> bytes of <str> as a new pattern to trie <dt>. Delimiters at
+ * the beginning and at the end of the pattern are ignored, and a pattern made
+ * only of delimiters never matches. <item> is what lookups will return when
+ * this pattern is the first matching one. Returns 0 if out of memory,
+ * otherwise non-zero.
+ */
+int domtrie_add(struct domtrie *dt, const char *str, size_t len, void *item)
+{
+	unsigned int node, slot, hash, n, *out;
+	size_t ofs, beg, end, i;
+	void **items;
+	char *text;
+	int created = 0;
+
+	if (dt->nb_items == dt->alloc_items) {
+		n = dt->alloc_items ? dt->alloc_items * 2 : 16;
+		items = realloc(dt->items, n * sizeof(*items));
+		if (!items)
+			return 0;
+		dt->items = items;
+		dt->alloc_items = n;
+	}
+	dt->items[dt->nb_items++] = item;
+
+	while (len && domtrie_is_delim(dt, *str)) {
+		str++;
+		len--;
+	}
+	while (len && domtrie_is_delim(dt, str[len - 1]))
+		len--;
+	if (!len)
+		return 1;
+
+	if (dt->text_len + len > dt->text_alloc) {
+		i = dt->text_alloc ? dt->text_alloc * 2 : 4096;
+		while (dt->text_len + len > i)
+			i *= 2;
+		text = realloc(dt->text, i);
+		if (!text)
+			goto fail;
+		dt->text = text;
+		dt->text_alloc = i;
+	}
+	ofs = dt->text_len;
+	for (i = 0; i < len; i++)
+		dt->text[ofs + i] = domtrie_fold(dt->flags, str[i]);
+	dt->text_len += len;
+	str = dt->text + ofs;
+
+	node = 0;
+	end = len;
+	beg = domtrie_label(dt, str, end, 1);
+	while (1) {
+		hash = domtrie_hash(dt, node, str + beg, end - beg);
+		slot = domtrie_slot(dt, node, str + beg, end - beg, hash);
+		if (!dt->edges[slot].child) {
+			if ((dt->nb_edges + 1) * 2 > dt->mask + 1) {
+				if (!domtrie_grow(dt))
+					goto fail;
+				slot = domtrie_slot(dt, node, str + beg, end - beg, hash);
+			}
+			if (dt->nb_nodes == dt->alloc_nodes) {
+				out = realloc(dt->out, dt->alloc_nodes * 2 * sizeof(*out));
+				if (!out)
+					goto fail;
+				dt->out = out;
+				dt->alloc_nodes *= 2;
+			}
+			dt->out[dt->nb_nodes] = 0;
+			dt->edges[slot].parent = node;
+			dt->edges[slot].child = dt->nb_nodes++;
+			dt->edges[slot].hash = hash;
+			dt->edges[slot].len = end - beg;
+			dt->edges[slot].key = ofs + beg;
+			dt->nb_edges++;
+			created = 1;
+		}
+		node = dt->edges[slot].child;
+		if (!beg)
+			break;
+		end = beg;
+		beg = domtrie_label(dt, str, end, 0);
+	}
+
+	if (!dt->out[node])
+		dt->out[node] = dt->nb_items;
+
+	/* the labels are already known, their copy is not needed */
+	if (!created)
+		dt->text_len = ofs;
+	return 1;
+
+ fail:
+	/* the edges created so far are harmless, they lead to no pattern */
+	dt->nb_items--;
+	return 0;
+}
+
+/* Releases trie <dt>. NULL is supported. */
+void domtrie_free(struct domtrie *dt)
+{
+	if (!dt)
+		return;
+	free(dt->items);
+	free(dt->out);
+	free(dt->edges);
+	free(dt->text);
+	free(dt);
+}
+
+/* Looks for the patterns of trie <dt> which appear in the <len> bytes of <str>
+ * as a sequence of whole words, that is, starting at the beginning of <str> or
+ * after a delimiter, and ending at the end of <str> or before a delimiter.
+ * Returns the item of the first added one, or NULL if none matches.
+ */
+void *domtrie_find(const struct domtrie *dt, const char *str, size_t len)
+{
+	unsigned int node, slot, best = 0;
+	size_t e, beg, end;
+
+	if (!dt->nb_edges)
+		return NULL;
+
+	for (e = len; e > 0; e--) {
+		/* a pattern may only end after a word and before a delimiter */
+		if (e < len && !domtrie_is_delim(dt, str[e]))
+			continue;
+		if (domtrie_is_delim(dt, str[e - 1]))
+			continue;
+
+		node = 0;
+		end = e;
+		beg = domtrie_label(dt, str, end, 1);
+		while (1) {
+			slot = domtrie_slot(dt, node, str + beg, end - beg,
+			                    domtrie_hash(dt, node, str + beg, end - beg));
+			node = dt->edges[slot].child;
+			if (!node)
+				break;
+			if (dt->out[node] && (!best || dt->out[node] < best)) {
+				best = dt->out[node];
+				if (best == 1)
+					goto done;
+			}
+			if (!beg)
+				break;
+			end = beg;
+			beg = domtrie_label(dt, str, end, 0);
+		}
+	}
+ done:
+	return best ? dt->items[best - 1] : NULL;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
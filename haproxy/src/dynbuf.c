@@ -111,6 +111,12 @@ void __offer_buffer(void *from, unsigned int threshold)
 	 * buffers.
 	 */
 	avail = pool_head_buffer->allocated - pool_head_buffer->used - global.tune.reserved_bufs / 2;
+#ifdef CONFIG_HAP_POOL_SLAB
+	/* slab-backed pools have no free objects but may allocate up to their limit */
+	if (pool_head_buffer->flags & MEM_F_SLAB)
+		avail = (pool_head_buffer->limit ? (int)(pool_head_buffer->limit - pool_head_buffer->used) : INT_MAX / 2) -
+			global.tune.reserved_bufs / 2;
+#endif
 
 	mt_list_for_each_entry_safe(wait, &buffer_wq, list, elt1, elt2) {
 		if (avail <= threshold)
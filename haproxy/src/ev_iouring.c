@@ -0,0 +1,1146 @@
+/*
+ * FD polling functions for Linux io_uring
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This poller only relies on the kernel's UAPI header and on raw syscalls so
+ * that no external library is needed. Each thread owns its own ring. Polling
+ * changes collected from the update lists are turned into POLL_ADD/POLL_REMOVE
+ * submissions which are all sent with the wait in a single io_uring_enter()
+ * call. FDs which support edge-triggered polling (see "tune.fd.edge-triggered")
+ * are registered once with a multi-shot POLL_ADD, exactly like EPOLLET is used
+ * by the epoll poller. Other FDs use one-shot POLL_ADD requests which are
+ * re-armed after each report so that the level-triggered semantics expected by
+ * the upper layers are preserved.
+ *
+ * When "tune.iouring.socket-io" is enabled, the raw_sock transport layer may
+ * also post its recv() and send() calls to the ring (see iou_sock_*() below),
+ * so that the I/Os of a whole polling loop are performed in a single syscall.
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/cfgparse.h>
+#include <haproxy/dynbuf.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/iouring.h>
+#include <haproxy/pool.h>
+#include <haproxy/signal.h>
+#include <haproxy/thread.h>
+#include <haproxy/ticks.h>
+#include <haproxy/time.h>
+#include <haproxy/tools.h>
+
+#ifndef POLLRDHUP
+/* POLLRDHUP was defined late in libc, and it appeared in kernel 2.6.17 */
+#define POLLRDHUP 0x2000
+#endif
+
+/* A request's user_data holds the FD in the lower 32 bits. Poll requests
+ * carry a 31-bit non-zero sequence number in the upper bits, while socket
+ * I/O requests have IOU_UD_SOCK set, the operation in bits 56-59 and the
+ * iou_sock's 24-bit sequence number in bits 32-55. Zero is used for requests
+ * whose completion must be ignored.
+ */
+#define IOU_UD_IGNORE   0ULL
+#define IOU_UD_SOCK     (1ULL << 63)
+
+/* a submission/completion ring pair as mapped from the kernel */
+struct iou_ring {
+	int fd;                        /* ring's fd, -1 if not initialized */
+	unsigned int sq_entries;       /* number of SQEs */
+	unsigned int *sq_head;         /* kernel-owned SQ head */
+	unsigned int *sq_tail;         /* user-owned SQ tail */
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_local_tail;    /* last prepared SQE, not yet published */
+	struct io_uring_sqe *sqes;
+	unsigned int *cq_head;         /* user-owned CQ head */
+	unsigned int *cq_tail;         /* kernel-owned CQ tail */
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;         /* mapped areas */
+	size_t sq_len, cq_len, sqes_len;
+};
+
+/* list of poll requests a thread still has to remove from its ring, either on
+ * behalf of other threads or because its ring was full when it tried. Such a
+ * request holds a reference to its file, so it must never be forgotten. The
+ * list is preallocated with one entry per FD and only grows in the unlikely
+ * case it happens to be full.
+ */
+struct iou_cancel_list {
+	__decl_thread(HA_SPINLOCK_T lock);
+	unsigned int count;
+	unsigned int size;
+	uint64_t *ud;
+};
+
+/* private data */
+static struct iou_ring iou_rings[MAX_THREADS];      // per-thread rings
+static uint64_t *iou_armed[MAX_THREADS];            // per-thread, per-fd armed request's user_data
+static struct iou_cancel_list iou_cancel[MAX_THREADS];
+static THREAD_LOCAL unsigned int iou_seq;           // sequence used to build unique user_data
+static struct iou_sock **iou_socks;                 // per-fd socket I/O contexts
+static THREAD_LOCAL int iou_sock_posted;            // socket I/O requests posted by the poller
+
+DECLARE_STATIC_POOL(pool_head_iou_sock, "iou_sock", sizeof(struct iou_sock));
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+                                     unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* Unmaps and closes ring <r>. It's safe to call it on a closed ring. */
+static void iou_ring_close(struct iou_ring *r)
+{
+	if (r->sqes && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr && r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_len);
+	if (r->sq_ptr && r->sq_ptr != MAP_FAILED)
+		munmap(r->sq_ptr, r->sq_len);
+	if (r->fd >= 0)
+		close(r->fd);
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+/* Creates a ring of at least <entries> SQEs into <r> and maps it. <feat> must
+ * contain the IORING_FEAT_* bits the caller requires. Returns 1 on success or 0
+ * on failure, in which case the ring is left closed.
+ */
+static int iou_ring_open(struct iou_ring *r, unsigned int entries, unsigned int feat)
+{
+	struct io_uring_params p;
+	unsigned int i;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+
+	r->fd = sys_io_uring_setup(entries, &p);
+	if (r->fd < 0)
+		goto fail;
+
+	if ((p.features & feat) != feat)
+		goto fail;
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_len > r->sq_len)
+			r->sq_len = r->cq_len;
+		r->cq_len = r->sq_len;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+	                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ptr = r->sq_ptr;
+	else {
+		r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+		                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+
+	r->sq_entries = p.sq_entries;
+	r->sq_head    = r->sq_ptr + p.sq_off.head;
+	r->sq_tail    = r->sq_ptr + p.sq_off.tail;
+	r->sq_mask    = r->sq_ptr + p.sq_off.ring_mask;
+	r->sq_array   = r->sq_ptr + p.sq_off.array;
+	r->cq_head    = r->cq_ptr + p.cq_off.head;
+	r->cq_tail    = r->cq_ptr + p.cq_off.tail;
+	r->cq_mask    = r->cq_ptr + p.cq_off.ring_mask;
+	r->cqes       = r->cq_ptr + p.cq_off.cqes;
+
+	/* SQEs are always used in ring order, so the indirection array is
+	 * an identity that we set once for all.
+	 */
+	for (i = 0; i < p.sq_entries; i++)
+		r->sq_array[i] = i;
+	r->sq_local_tail = *r->sq_tail;
+	return 1;
+
+ fail:
+	iou_ring_close(r);
+	return 0;
+}
+
+/* Returns the number of prepared SQEs which were not consumed yet by the kernel */
+static inline unsigned int iou_sq_pending(const struct iou_ring *r)
+{
+	return r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+}
+
+/* Returns the number of CQEs waiting to be processed */
+static inline unsigned int iou_cq_ready(const struct iou_ring *r)
+{
+	return __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) - *r->cq_head;
+}
+
+/* Publishes all prepared SQEs to the kernel and calls io_uring_enter(), waiting
+ * for <min_complete> events for at most <timeout> milliseconds if non-zero.
+ * Returns the syscall's return value.
+ */
+static int iou_enter(struct iou_ring *r, unsigned int min_complete, int timeout)
+{
+	struct io_uring_getevents_arg arg = { };
+	struct __kernel_timespec ts;
+	unsigned int flags = 0;
+
+	__atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+
+	if (min_complete) {
+		flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+		ts.tv_sec  = timeout / 1000;
+		ts.tv_nsec = (timeout % 1000) * 1000000;
+		arg.ts = (unsigned long)&ts;
+	}
+	return sys_io_uring_enter(r->fd, iou_sq_pending(r), min_complete, flags,
+	                          min_complete ? &arg : NULL, min_complete ? sizeof(arg) : 0);
+}
+
+/* Returns a cleared SQE from ring <r>, or NULL if none could be found even after
+ * flushing pending submissions.
+ */
+static struct io_uring_sqe *iou_get_sqe(struct iou_ring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	if (unlikely(iou_sq_pending(r) >= r->sq_entries)) {
+		/* the SQ is full, push what we have so far */
+		iou_enter(r, 0, 0);
+		if (iou_sq_pending(r) >= r->sq_entries)
+			return NULL;
+	}
+
+	sqe = &r->sqes[r->sq_local_tail & *r->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_local_tail++;
+	return sqe;
+}
+
+/* Prepares a POLL_ADD request for <fd> on the current thread's ring, watching
+ * for poll events <events>, in multi-shot mode if <multi> is set. Returns the
+ * user_data that will identify its completions, or 0 on failure.
+ */
+static uint64_t iou_arm(int fd, unsigned int events, int multi)
+{
+	struct io_uring_sqe *sqe;
+	uint64_t ud;
+
+	sqe = iou_get_sqe(&iou_rings[tid]);
+	if (!sqe)
+		return 0;
+
+	/* never produce IOU_UD_IGNORE nor IOU_UD_SOCK */
+	if (unlikely(++iou_seq >= 0x80000000U))
+		iou_seq = 1;
+	ud = ((uint64_t)iou_seq << 32) | (unsigned int)fd;
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->opcode       = IORING_OP_POLL_ADD;
+	sqe->fd           = fd;
+	sqe->poll32_events = events;
+	sqe->len          = multi ? IORING_POLL_ADD_MULTI : 0;
+	sqe->user_data    = ud;
+	_HA_ATOMIC_STORE(&iou_armed[tid][fd], ud);
+	return ud;
+}
+
+/* Prepares the removal of the poll request identified by <ud> on the current
+ * thread's ring. Its completion will be ignored. Returns 0 if no SQE was
+ * available, otherwise non-zero.
+ */
+static int iou_prep_remove(uint64_t ud)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = iou_get_sqe(&iou_rings[tid]);
+	if (!sqe)
+		return 0;
+
+	sqe->opcode    = IORING_OP_POLL_REMOVE;
+	sqe->fd        = -1;
+	sqe->addr      = ud;
+	sqe->user_data = IOU_UD_IGNORE;
+	return 1;
+}
+
+/* Prepares the removal of the requests queued in the current thread's cancel
+ * list. Those which cannot be prepared yet stay there for the next call.
+ */
+static void iou_flush_cancel_list()
+{
+	struct iou_cancel_list *cl = &iou_cancel[tid];
+	unsigned int i;
+
+	if (!cl->count)
+		return;
+
+	HA_SPIN_LOCK(OTHER_LOCK, &cl->lock);
+	for (i = 0; i < cl->count; i++) {
+		if (!iou_prep_remove(cl->ud[i]))
+			break;
+	}
+	memmove(cl->ud, cl->ud + i, (cl->count - i) * sizeof(*cl->ud));
+	cl->count -= i;
+	HA_SPIN_UNLOCK(OTHER_LOCK, &cl->lock);
+}
+
+/* Queues the removal of poll request <ud> into thread <thr>'s cancel list and
+ * wakes it up if needed. If the list is full and cannot grow, we wait for its
+ * owner to flush it, while flushing ours so that two threads waiting for each
+ * other still make progress.
+ */
+static void iou_cancel_queue(int thr, uint64_t ud)
+{
+	struct iou_cancel_list *cl = &iou_cancel[thr];
+
+	while (1) {
+		HA_SPIN_LOCK(OTHER_LOCK, &cl->lock);
+		if (cl->count == cl->size) {
+			unsigned int size = cl->size ? cl->size * 2 : 16;
+			uint64_t *new_ud = realloc(cl->ud, size * sizeof(*new_ud));
+
+			if (new_ud) {
+				cl->ud = new_ud;
+				cl->size = size;
+			}
+		}
+		if (cl->count < cl->size) {
+			cl->ud[cl->count++] = ud;
+			HA_SPIN_UNLOCK(OTHER_LOCK, &cl->lock);
+			break;
+		}
+		HA_SPIN_UNLOCK(OTHER_LOCK, &cl->lock);
+
+		if (thr != tid)
+			wake_thread(thr);
+		iou_flush_cancel_list();
+		ha_thread_relax();
+	}
+
+	if (thr != tid)
+		wake_thread(thr);
+}
+
+/* Removes the poll request identified by <ud> from the current thread's ring.
+ * If no SQE is available, the removal is retried on the next polling loop.
+ */
+static void iou_remove(uint64_t ud)
+{
+	if (!iou_prep_remove(ud))
+		iou_cancel_queue(tid, ud);
+}
+
+/* Removes the current thread's poll request for <fd> if any */
+static void iou_disarm(int fd)
+{
+	uint64_t ud = _HA_ATOMIC_XCHG(&iou_armed[tid][fd], 0);
+
+	if (ud)
+		iou_remove(ud);
+}
+
+/*
+ * Immediately remove file descriptor from all rings upon close. Contrary to
+ * epoll, a pending poll request holds a reference to the file, so leaving it
+ * there would prevent the socket from being really closed. Rings belonging
+ * to other threads are only touched by their owners, so these ones are asked
+ * to do it.
+ */
+static void __fd_clo(int fd)
+{
+	unsigned long m = polled_mask[fd].poll_recv | polled_mask[fd].poll_send;
+	struct iou_sock *s;
+	uint64_t ud;
+	int i;
+
+	s = iou_socks ? iou_socks[fd] : NULL;
+	if (s) {
+		/* the transport layer was not closed first, queued requests
+		 * must not reach the next user of this FD number.
+		 */
+		if ((s->flags & (IOU_SOCK_RX_POSTED | IOU_SOCK_TX_POSTED)) &&
+		    iou_sq_pending(&iou_rings[tid]))
+			iou_enter(&iou_rings[tid], 0, 0);
+		iou_socks[fd] = NULL;
+		s->fd = -1;
+	}
+
+	for (i = global.nbthread - 1; i >= 0; i--) {
+		if (!(m & (1UL << i)) || !iou_armed[i])
+			continue;
+
+		ud = _HA_ATOMIC_XCHG(&iou_armed[i][fd], 0);
+		if (!ud)
+			continue;
+
+		if (i == tid)
+			iou_remove(ud);
+		else
+			iou_cancel_queue(i, ud);
+	}
+}
+
+/* Marks <fd> as no longer polled by the current thread after its one-shot poll
+ * request completed, and schedules an update so that it gets re-armed if still
+ * needed.
+ */
+static inline void iou_rearm_later(int fd)
+{
+	_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~tid_bit);
+	_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~tid_bit);
+	if (!HA_ATOMIC_BTS(&fdtab[fd].update_mask, tid))
+		fd_updt[fd_nbupdt++] = fd;
+}
+
+/* Returns the user_data to use for operation <op> on socket context <s> */
+static inline uint64_t iou_sock_ud(const struct iou_sock *s, unsigned int op)
+{
+	return IOU_UD_SOCK | ((uint64_t)op << 56) | ((uint64_t)(s->seq & 0xffffff) << 32) | (unsigned int)s->fd;
+}
+
+/* Allocates a socket I/O context for <fd> and registers it so that its I/Os
+ * are posted to the current thread's ring. Returns NULL if socket I/O through
+ * io_uring is not enabled, if the io_uring poller is not in use, or if memory
+ * is missing, in which case the caller must perform its I/Os itself.
+ */
+struct iou_sock *iou_sock_new(int fd)
+{
+	struct iou_sock *s;
+
+	if (!(global.tune.options & GTUNE_IOURING_SOCKIO) || !iou_socks ||
+	    iou_rings[tid].fd < 0 || fd < 0 || fd >= global.maxsock)
+		return NULL;
+
+	s = pool_alloc(pool_head_iou_sock);
+	if (!s)
+		return NULL;
+
+	s->fd = fd;
+	s->flags = 0;
+	if (unlikely(++iou_seq >= 0x80000000U))
+		iou_seq = 1;
+	s->seq = iou_seq;
+	s->rx_err = s->tx_err = 0;
+	s->tx_acked = 0;
+	s->rx = BUF_NULL;
+	s->tx = BUF_NULL;
+	iou_socks[fd] = s;
+	return s;
+}
+
+/* Unregisters and releases socket context <s>. Requests still queued for it
+ * are submitted first since they designate the FD by its number, which may be
+ * reused as soon as it's closed. Their completions will be ignored.
+ */
+void iou_sock_free(struct iou_sock *s)
+{
+	if (!s)
+		return;
+
+	if ((s->flags & (IOU_SOCK_RX_POSTED | IOU_SOCK_TX_POSTED)) &&
+	    iou_sq_pending(&iou_rings[tid]))
+		iou_enter(&iou_rings[tid], 0, 0);
+
+	if (iou_socks && s->fd >= 0 && iou_socks[s->fd] == s)
+		iou_socks[s->fd] = NULL;
+	b_free(&s->rx);
+	b_free(&s->tx);
+	pool_free(pool_head_iou_sock, s);
+}
+
+/* Posts a send() of the data present in <s->tx> with flags <msg_flags>. The
+ * data must be contiguous. MSG_DONTWAIT is always set so that the request is
+ * performed during the submission and never remains in flight. Returns 1 on
+ * success or 0 if the request could not be queued.
+ */
+int iou_sock_post_send(struct iou_sock *s, int msg_flags)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = iou_get_sqe(&iou_rings[tid]);
+	if (!sqe)
+		return 0;
+
+	sqe->opcode    = IORING_OP_SEND;
+	sqe->fd        = s->fd;
+	sqe->addr      = (unsigned long)b_head(&s->tx);
+	sqe->len       = b_data(&s->tx);
+	sqe->msg_flags = msg_flags | MSG_DONTWAIT | MSG_NOSIGNAL;
+	sqe->user_data = iou_sock_ud(s, IOU_OP_SEND);
+	s->flags |= IOU_SOCK_TX_POSTED;
+	return 1;
+}
+
+/* Posts a recv() into <s->rx>, which is allocated if needed. Returns 1 on
+ * success or 0 if the request could not be queued.
+ */
+static int iou_sock_post_recv(struct iou_sock *s)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!b_size(&s->rx) && !b_alloc_margin(&s->rx, 0))
+		return 0;
+
+	sqe = iou_get_sqe(&iou_rings[tid]);
+	if (!sqe) {
+		b_free(&s->rx);
+		return 0;
+	}
+
+	b_reset(&s->rx);
+	sqe->opcode    = IORING_OP_RECV;
+	sqe->fd        = s->fd;
+	sqe->addr      = (unsigned long)b_tail(&s->rx);
+	sqe->len       = b_size(&s->rx);
+	sqe->msg_flags = MSG_DONTWAIT;
+	sqe->user_data = iou_sock_ud(s, IOU_OP_RECV);
+	s->flags |= IOU_SOCK_RX_POSTED;
+	s->flags &= ~IOU_SOCK_RX_DRAINED;
+	return 1;
+}
+
+/* Called by the poller when events <n> (FD_EV_*) are reported for the FD of
+ * socket context <s>. When the FD is readable, the transport layer allows it
+ * and nothing was received yet, a recv() is posted and the read event is only reported once it completes.
+ * Write events are held while a send() is pending since its completion will
+ * report them. Returns the events to report immediately.
+ */
+static unsigned int iou_sock_defer(struct iou_sock *s, unsigned int n)
+{
+	if ((n & FD_EV_READY_R) && !(n & FD_EV_ERR_RW) && fd_recv_active(s->fd) &&
+	    (s->flags & (IOU_SOCK_RX_ENABLED | IOU_SOCK_RX_POSTED | IOU_SOCK_RX_SHUT)) == IOU_SOCK_RX_ENABLED &&
+	    !b_data(&s->rx) && !s->rx_err) {
+		if (iou_sock_post_recv(s)) {
+			iou_sock_posted++;
+			n &= ~(FD_EV_READY_R | FD_EV_SHUT_R);
+		}
+	}
+
+	if ((n & FD_EV_READY_W) && (s->flags & IOU_SOCK_TX_POSTED))
+		n &= ~FD_EV_READY_W;
+
+	return n;
+}
+
+/* Processes the completion of the socket I/O request <ud> which returned
+ * <res>, and reports the resulting events on the FD.
+ */
+static void iou_sock_complete(uint64_t ud, int res)
+{
+	unsigned int op = (ud >> 56) & 0xf;
+	unsigned int seq = (ud >> 32) & 0xffffff;
+	int fd = (unsigned int)ud;
+	struct iou_sock *s;
+	unsigned int n = 0;
+
+	if (fd >= global.maxsock)
+		return;
+
+	s = iou_socks[fd];
+	if (!s || (s->seq & 0xffffff) != seq || !(fdtab[fd].thread_mask & tid_bit)) {
+		/* context released or connection taken over in the mean time */
+		return;
+	}
+
+	if (op == IOU_OP_RECV) {
+		s->flags &= ~IOU_SOCK_RX_POSTED;
+		if (res > 0) {
+			b_add(&s->rx, res);
+			if (res < b_size(&s->rx))
+				s->flags |= IOU_SOCK_RX_DRAINED;
+			n = FD_EV_READY_R;
+		}
+		else if (res == 0) {
+			s->flags |= IOU_SOCK_RX_SHUT;
+			n = FD_EV_READY_R | FD_EV_SHUT_R;
+		}
+		else if (res != -EAGAIN && res != -EINTR) {
+			s->rx_err = -res;
+			n = FD_EV_READY_R | FD_EV_ERR_RW;
+		}
+		if (!b_data(&s->rx))
+			b_free(&s->rx);
+	}
+	else if (op == IOU_OP_SEND) {
+		s->flags &= ~IOU_SOCK_TX_POSTED;
+		if (res > 0) {
+			s->tx_acked += res;
+			n = FD_EV_READY_W;
+		}
+		else if (res != -EAGAIN && res != -EINTR) {
+			s->tx_err = -res;
+			n = FD_EV_ERR_RW;
+		}
+		/* the data not sent are still in the upper layer's buffer */
+		b_free(&s->tx);
+	}
+
+	if (n && fdtab[fd].owner)
+		fd_update_events(fd, n);
+}
+
+/* Updates the current thread's poll request for <fd> according to its state.
+ * Returns 0 if the request could not be armed because the ring is full, in
+ * which case <fd> is marked as not polled and the caller must retry later.
+ */
+static int _update_fd(int fd)
+{
+	int en, events;
+
+	en = fdtab[fd].state;
+
+	/* Edge-triggered FDs are registered once in multi-shot mode */
+	if (fdtab[fd].et_possible) {
+		/* already done ? */
+		if (polled_mask[fd].poll_recv & polled_mask[fd].poll_send & tid_bit)
+			return 1;
+
+		/* enable ET polling in both directions */
+		_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, tid_bit);
+		_HA_ATOMIC_OR(&polled_mask[fd].poll_send, tid_bit);
+		iou_disarm(fd);
+		events = POLLIN | POLLRDHUP | POLLOUT;
+		goto arm;
+	}
+
+	/* if we're already polling or are going to poll for this FD and it's
+	 * neither active nor ready, force it to be active so that we don't
+	 * needlessly unsubscribe then re-subscribe it.
+	 */
+	if (!(en & FD_EV_READY_R) &&
+	    ((en & FD_EV_ACTIVE_W) ||
+	     ((polled_mask[fd].poll_send | polled_mask[fd].poll_recv) & tid_bit)))
+		en |= FD_EV_ACTIVE_R;
+
+	if ((polled_mask[fd].poll_send | polled_mask[fd].poll_recv) & tid_bit) {
+		if (!(fdtab[fd].thread_mask & tid_bit) || !(en & FD_EV_ACTIVE_RW)) {
+			/* fd removed from poll list */
+			if (polled_mask[fd].poll_recv & tid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~tid_bit);
+			if (polled_mask[fd].poll_send & tid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~tid_bit);
+			iou_disarm(fd);
+			return 1;
+		}
+
+		if (((en & FD_EV_ACTIVE_R) != 0) ==
+		    ((polled_mask[fd].poll_recv & tid_bit) != 0) &&
+		    ((en & FD_EV_ACTIVE_W) != 0) ==
+		    ((polled_mask[fd].poll_send & tid_bit) != 0))
+			return 1;
+		if (en & FD_EV_ACTIVE_R) {
+			if (!(polled_mask[fd].poll_recv & tid_bit))
+				_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, tid_bit);
+		} else {
+			if (polled_mask[fd].poll_recv & tid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~tid_bit);
+		}
+		if (en & FD_EV_ACTIVE_W) {
+			if (!(polled_mask[fd].poll_send & tid_bit))
+				_HA_ATOMIC_OR(&polled_mask[fd].poll_send, tid_bit);
+		} else {
+			if (polled_mask[fd].poll_send & tid_bit)
+				_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~tid_bit);
+		}
+		/* fd status changed, the request must be replaced */
+		iou_disarm(fd);
+	}
+	else if ((fdtab[fd].thread_mask & tid_bit) && (en & FD_EV_ACTIVE_RW)) {
+		/* new fd in the poll list */
+		if (en & FD_EV_ACTIVE_R)
+			_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, tid_bit);
+		if (en & FD_EV_ACTIVE_W)
+			_HA_ATOMIC_OR(&polled_mask[fd].poll_send, tid_bit);
+	}
+	else {
+		return 1;
+	}
+
+	/* construct the poll events based on new state */
+	events = 0;
+	if (en & FD_EV_ACTIVE_R)
+		events |= POLLIN | POLLRDHUP;
+
+	if (en & FD_EV_ACTIVE_W)
+		events |= POLLOUT;
+
+ arm:
+	if (iou_arm(fd, events, fdtab[fd].et_possible))
+		return 1;
+
+	/* no request is in flight, so the FD must not be seen as polled */
+	_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~tid_bit);
+	_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~tid_bit);
+	return 0;
+}
+
+/* Processes at most <max> completions from ring <r> */
+static void iou_process_cqes(struct iou_ring *r, unsigned int max)
+{
+	unsigned int head, tail;
+	int fd;
+
+	head = *r->cq_head;
+	tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	if (tail - head > max)
+		tail = head + max;
+
+	for (; head != tail; head++) {
+		const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+		uint64_t ud = cqe->user_data;
+		unsigned int n, e;
+		int res = cqe->res;
+		int more = !!(cqe->flags & IORING_CQE_F_MORE);
+
+		if (ud == IOU_UD_IGNORE)
+			continue;
+
+		if (ud & IOU_UD_SOCK) {
+			iou_sock_complete(ud, res);
+			continue;
+		}
+
+		fd = (unsigned int)ud;
+		if (fd >= global.maxsock || iou_armed[tid][fd] != ud) {
+			/* completion of an old request, replaced or removed */
+			continue;
+		}
+
+		if (!more)
+			_HA_ATOMIC_STORE(&iou_armed[tid][fd], 0);
+
+#ifdef DEBUG_FD
+		_HA_ATOMIC_ADD(&fdtab[fd].event_count, 1);
+#endif
+		if (!fdtab[fd].owner) {
+			activity[tid].poll_dead_fd++;
+			continue;
+		}
+
+		if (!(fdtab[fd].thread_mask & tid_bit)) {
+			/* FD has been migrated */
+			activity[tid].poll_skip_fd++;
+			iou_disarm(fd);
+			_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~tid_bit);
+			_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~tid_bit);
+			continue;
+		}
+
+		if (!more) {
+			/* the request is over, either because it was a one-shot
+			 * one or because the kernel had to stop it, it must be
+			 * re-armed if still needed.
+			 */
+			iou_rearm_later(fd);
+		}
+
+		if (res < 0) {
+			/* the request could not be performed on this FD */
+			if (res == -ECANCELED)
+				continue;
+			e = POLLERR;
+		}
+		else
+			e = res;
+
+		n = ((e & POLLIN)    ? FD_EV_READY_R : 0) |
+		    ((e & POLLOUT)   ? FD_EV_READY_W : 0) |
+		    ((e & POLLRDHUP) ? FD_EV_SHUT_R  : 0) |
+		    ((e & POLLHUP)   ? FD_EV_SHUT_RW : 0) |
+		    ((e & POLLERR)   ? FD_EV_ERR_RW  : 0);
+
+		if ((e & POLLRDHUP) && !(cur_poller.flags & HAP_POLL_F_RDHUP))
+			_HA_ATOMIC_OR(&cur_poller.flags, HAP_POLL_F_RDHUP);
+
+		if (iou_socks[fd]) {
+			n = iou_sock_defer(iou_socks[fd], n);
+			if (!n)
+				continue;
+		}
+
+		fd_update_events(fd, n);
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Linux io_uring() poller
+ */
+static void _do_poll(struct poller *p, int exp, int wake)
+{
+	struct iou_ring *r = &iou_rings[tid];
+	int status;
+	int fd;
+	int updt_idx;
+	int wait_time;
+	int old_fd;
+	int retry = 0;
+
+	/* first, scan the update list to find polling changes. FDs which
+	 * could not be armed because the ring is full are kept in the list
+	 * for the next loop.
+	 */
+	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
+		fd = fd_updt[updt_idx];
+
+		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~tid_bit);
+		if (!fdtab[fd].owner) {
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		if (!_update_fd(fd)) {
+			_HA_ATOMIC_OR(&fdtab[fd].update_mask, tid_bit);
+			fd_updt[retry++] = fd;
+		}
+	}
+	fd_nbupdt = retry;
+	/* Scan the global update list */
+	for (old_fd = fd = update_list.first; fd != -1; fd = fdtab[fd].update.next) {
+		if (fd == -2) {
+			fd = old_fd;
+			continue;
+		}
+		else if (fd <= -3)
+			fd = -fd -4;
+		if (fd == -1)
+			break;
+		if (fdtab[fd].update_mask & tid_bit)
+			done_update_polling(fd);
+		else
+			continue;
+		if (!fdtab[fd].owner)
+			continue;
+		if (!_update_fd(fd) && !HA_ATOMIC_BTS(&fdtab[fd].update_mask, tid))
+			fd_updt[fd_nbupdt++] = fd;
+	}
+
+	iou_flush_cancel_list();
+
+	thread_harmless_now();
+
+	/* now let's wait for polled events. All the changes prepared above
+	 * are submitted in the same call.
+	 */
+	wait_time = wake ? 0 : compute_poll_timeout(exp);
+	tv_entering_poll();
+	activity_count_runtime();
+	do {
+		int timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+
+		if (iou_cq_ready(r))
+			timeout = 0;
+
+		if (timeout)
+			status = iou_enter(r, 1, timeout);
+		else if (iou_sq_pending(r))
+			status = iou_enter(r, 0, 0);
+		else
+			status = 0;
+
+		/* errors such as ETIME (timeout), EINTR or EBUSY (CQ overflow)
+		 * only matter through the completions they leave us.
+		 */
+		status = iou_cq_ready(r);
+		tv_update_date(timeout, status);
+
+		if (status) {
+			activity[tid].poll_io++;
+			break;
+		}
+		if (timeout || !wait_time)
+			break;
+		if (signal_queue_len || wake)
+			break;
+		if (tick_isset(exp) && tick_is_expired(exp, now_ms))
+			break;
+	} while (1);
+
+	tv_leaving_poll(wait_time, status);
+
+	thread_harmless_end();
+	if (sleeping_thread_mask & tid_bit)
+		_HA_ATOMIC_AND(&sleeping_thread_mask, ~tid_bit);
+
+	/* process polled events. Socket I/O requests posted while doing so
+	 * are performed at once, and their completions are processed as well.
+	 */
+	iou_sock_posted = 0;
+	iou_process_cqes(r, global.tune.maxpollevents);
+	if (iou_sock_posted) {
+		iou_enter(r, 0, 0);
+		iou_process_cqes(r, global.tune.maxpollevents);
+	}
+	/* the caller will take care of cached events */
+}
+
+/* Returns the number of SQEs to allocate per ring */
+static unsigned int iou_ring_size()
+{
+	unsigned int entries = global.tune.maxpollevents;
+
+	if (entries < 256)
+		entries = 256;
+	return entries;
+}
+
+static int init_iouring_per_thread()
+{
+	int fd;
+
+	iou_cancel[tid].ud = calloc(global.maxsock, sizeof(*iou_cancel[tid].ud));
+	if (iou_cancel[tid].ud == NULL)
+		goto fail_cancel;
+	iou_cancel[tid].size = global.maxsock;
+
+	iou_armed[tid] = calloc(global.maxsock, sizeof(*iou_armed[tid]));
+	if (iou_armed[tid] == NULL)
+		goto fail_alloc;
+
+	if (MAX_THREADS > 1 && tid) {
+		if (!iou_ring_open(&iou_rings[tid], iou_ring_size(),
+		                   IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG))
+			goto fail_ring;
+	}
+
+	/* we may have to unregister some events initially registered on the
+	 * original ring when it was alone, and/or to register events on the
+	 * new ring for this thread. Let's just mark them as updated, the poller
+	 * will do the rest.
+	 */
+	for (fd = 0; fd < global.maxsock; fd++)
+		updt_fd_polling(fd);
+
+	return 1;
+ fail_ring:
+	free(iou_armed[tid]);
+	iou_armed[tid] = NULL;
+ fail_alloc:
+	free(iou_cancel[tid].ud);
+	iou_cancel[tid].ud = NULL;
+	iou_cancel[tid].size = 0;
+ fail_cancel:
+	return 0;
+}
+
+static void deinit_iouring_per_thread()
+{
+	if (MAX_THREADS > 1 && tid)
+		iou_ring_close(&iou_rings[tid]);
+
+	free(iou_armed[tid]);
+	iou_armed[tid] = NULL;
+	free(iou_cancel[tid].ud);
+	iou_cancel[tid].ud = NULL;
+	iou_cancel[tid].count = iou_cancel[tid].size = 0;
+}
+
+/*
+ * Initialization of the io_uring() poller.
+ * Returns 0 in case of failure, non-zero in case of success. If it fails, it
+ * disables the poller by setting its pref to 0.
+ */
+static int _do_init(struct poller *p)
+{
+	int i;
+
+	p->private = NULL;
+
+	for (i = 0; i < MAX_THREADS; i++)
+		HA_SPIN_INIT(&iou_cancel[i].lock);
+
+	iou_socks = calloc(global.maxsock, sizeof(*iou_socks));
+	if (!iou_socks)
+		goto fail_socks;
+
+	if (!iou_ring_open(&iou_rings[tid], iou_ring_size(),
+	                   IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG))
+		goto fail_ring;
+
+	hap_register_per_thread_init(init_iouring_per_thread);
+	hap_register_per_thread_deinit(deinit_iouring_per_thread);
+
+	return 1;
+
+ fail_ring:
+	free(iou_socks);
+	iou_socks = NULL;
+ fail_socks:
+	p->pref = 0;
+	return 0;
+}
+
+/*
+ * Termination of the io_uring() poller.
+ * Memory is released and the poller is marked as unselectable.
+ */
+static void _do_term(struct poller *p)
+{
+	iou_ring_close(&iou_rings[tid]);
+	free(iou_socks);
+	iou_socks = NULL;
+
+	p->private = NULL;
+	p->pref = 0;
+}
+
+/*
+ * Check that the poller works. Multi-shot poll requests appeared after the
+ * extended arguments to io_uring_enter(), so the only reliable way to check
+ * them is to try to use one on a pipe.
+ * Returns 1 if OK, otherwise 0.
+ */
+static int _do_test(struct poller *p)
+{
+	struct iou_ring r;
+	struct io_uring_sqe *sqe;
+	const struct io_uring_cqe *cqe;
+	int pfd[2];
+	int ret = 0;
+
+	if (!iou_ring_open(&r, 4, IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG))
+		return 0;
+
+	if (pipe(pfd) < 0)
+		goto out;
+
+	if (write(pfd[1], "", 1) != 1)
+		goto out_pipe;
+
+	sqe = iou_get_sqe(&r);
+	sqe->opcode        = IORING_OP_POLL_ADD;
+	sqe->fd            = pfd[0];
+	sqe->poll32_events = POLLIN;
+	sqe->len           = IORING_POLL_ADD_MULTI;
+	sqe->user_data     = 1;
+
+	if (iou_enter(&r, 1, 100) < 0 || !iou_cq_ready(&r))
+		goto out_pipe;
+
+	cqe = &r.cqes[*r.cq_head & *r.cq_mask];
+	if (cqe->user_data == 1 && cqe->res > 0 && (cqe->flags & IORING_CQE_F_MORE))
+		ret = 1;
+
+ out_pipe:
+	close(pfd[0]);
+	close(pfd[1]);
+ out:
+	iou_ring_close(&r);
+	return ret;
+}
+
+/*
+ * Recreate the ring after a fork(). Returns 1 if OK, otherwise 0. Rings must
+ * never be shared between processes since their completions would randomly
+ * be delivered to either of them.
+ */
+static int _do_fork(struct poller *p)
+{
+	iou_ring_close(&iou_rings[tid]);
+	return iou_ring_open(&iou_rings[tid], iou_ring_size(),
+	                     IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG);
+}
+
+/* config parser for global "tune.iouring.socket-io", accepts "on" or "off" */
+static int cfg_parse_tune_iouring_socket_io(char **args, int section_type, struct proxy *curpx,
+                                            struct proxy *defpx, const char *file, int line,
+                                            char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_IOURING_SOCKIO;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_IOURING_SOCKIO;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.iouring.socket-io", cfg_parse_tune_iouring_socket_io },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
+/*
+ * It is a constructor, which means that it will automatically be called before
+ * main(). This is GCC-specific but it works at least since 2.95.
+ * Special care must be taken so that it does not need any uninitialized data.
+ */
+__attribute__((constructor))
+static void _do_register(void)
+{
+	struct poller *p;
+	int i;
+
+	if (nbpollers >= MAX_POLLERS)
+		return;
+
+	for (i = 0; i < MAX_THREADS; i++)
+		iou_rings[i].fd = -1;
+
+	p = &pollers[nbpollers++];
+
+	p->name = "io_uring";
+	p->pref = 250;
+	p->flags = HAP_POLL_F_ERRHUP; // note: RDHUP might be dynamically added
+	p->private = NULL;
+
+	p->clo  = __fd_clo;
+	p->test = _do_test;
+	p->init = _do_init;
+	p->term = _do_term;
+	p->poll = _do_poll;
+	p->fork = _do_fork;
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
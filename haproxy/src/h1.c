@@ -13,6 +13,7 @@
 #include <ctype.h>
 #include <haproxy/api.h>
 #include <haproxy/h1.h>
+#include <haproxy/h1_scan.h>
 #include <haproxy/http-hdr.h>
 
 /* Parse the Content-Length header field of an HTTP/1 request. The function
@@ -384,6 +385,7 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 
 	case H1_MSG_RQURI:
 	http_msg_rquri:
+		ptr = h1_scan_uri(ptr, end);
 #ifdef HA_UNALIGNED_LE
 		/* speedup: skip bytes not between 0x21 and 0x7e inclusive */
 		while (ptr <= end - sizeof(int)) {
@@ -658,13 +660,21 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 	case H1_MSG_HDR_NAME:
 	http_msg_hdr_name:
 		/* assumes sol points to the first char */
+
+		/* speedup: skip the most common token chars at once */
+		ptr = h1_scan_hdr_name(ptr, end, !skip_update && (h1m->flags & H1_MF_TOLOWER));
+		if (ptr >= end) {
+			state = H1_MSG_HDR_NAME;
+			goto http_msg_ood;
+		}
+	http_msg_hdr_name2:
 		if (likely(HTTP_IS_TOKEN(*ptr))) {
 			if (!skip_update) {
 				/* turn it to lower case if needed */
 				if (isupper((unsigned char)*ptr) && h1m->flags & H1_MF_TOLOWER)
 					*ptr = tolower((unsigned char)*ptr);
 			}
-			EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name, http_msg_ood, state, H1_MSG_HDR_NAME);
+			EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name2, http_msg_ood, state, H1_MSG_HDR_NAME);
 		}
 
 		if (likely(*ptr == ':')) {
@@ -681,7 +691,7 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 			h1m->err_pos = ptr - start + skip; /* >= 0 now */
 
 		/* and we still accept this non-token character */
-		EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name, http_msg_ood, state, H1_MSG_HDR_NAME);
+		EAT_AND_JUMP_OR_RETURN(ptr, end, http_msg_hdr_name2, http_msg_ood, state, H1_MSG_HDR_NAME);
 
 	case H1_MSG_HDR_L1_SP:
 	http_msg_hdr_l1_sp:
@@ -729,7 +739,9 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 		 * and lower. In fact since most of the time is spent in the loop, we
 		 * also remove the sign bit test so that bytes 0x8e..0x0d break the
 		 * loop, but we don't care since they're very rare in header values.
+		 * The vector scanner, when available, goes straight to the CR/LF.
 		 */
+		ptr = h1_scan_hdr_val(ptr, end);
 #ifdef HA_UNALIGNED_LE64
 		while (ptr <= end - sizeof(long)) {
 			if ((*(long *)ptr - 0x0e0e0e0e0e0e0e0eULL) & 0x8080808080808080ULL)
@@ -0,0 +1,227 @@
+/*
+ * Vector scanners for the HTTP/1 parser.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Most of the bytes of a message's headers are parts of the request URI, of
+ * header names or of header values, on which the parser's state machine only
+ * checks that they remain within a given class. The scanners below perform
+ * these checks on 16 (SSE2) or 32 (AVX2) bytes at once, and stop on the first
+ * byte out of the class, from which the state machine takes over. They never
+ * decide whether a byte is valid or not, they only skip the bytes which are
+ * known to be, so that the parser's behaviour remains unchanged. The best set
+ * supported by the CPU is selected at boot. On other architectures, only the
+ * word-at-a-time loops of the parser are used.
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/h1_scan.h>
+
+#ifdef H1_SCAN_X86
+#include <immintrin.h>
+#endif
+
+const struct h1_scan_ops h1_scan_scalar = {
+	.name = "scalar",
+};
+
+#ifdef H1_SCAN_X86
+
+/* returns a mask of the bytes of <x> which are lower than or equal to <n>,
+ * unsigned.
+ */
+static inline __m128i h1_sse2_le(__m128i x, __m128i n)
+{
+	return _mm_cmpeq_epi8(_mm_max_epu8(x, n), n);
+}
+
+static char *h1_sse2_uri(char *ptr, const char *end)
+{
+	const __m128i bias = _mm_set1_epi8(0x21);
+	const __m128i lim = _mm_set1_epi8(0x7e - 0x21);
+	unsigned int m;
+
+	while (ptr <= end - 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)ptr);
+
+		m = _mm_movemask_epi8(h1_sse2_le(_mm_sub_epi8(v, bias), lim));
+		if (m != 0xffff)
+			return ptr + __builtin_ctz(~m);
+		ptr += 16;
+	}
+	return ptr;
+}
+
+static char *h1_sse2_val(char *ptr, const char *end)
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	unsigned int m;
+
+	while (ptr <= end - 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)ptr);
+
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+		if (m)
+			return ptr + __builtin_ctz(m);
+		ptr += 16;
+	}
+	return ptr;
+}
+
+static char *h1_sse2_name(char *ptr, const char *end, int lower)
+{
+	const __m128i idx = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i n25 = _mm_set1_epi8(25);
+	const __m128i n9 = _mm_set1_epi8(9);
+	const __m128i dash = _mm_set1_epi8('-');
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	unsigned int m;
+
+	while (ptr <= end - 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)ptr);
+		__m128i up = h1_sse2_le(_mm_sub_epi8(v, _mm_set1_epi8('A')), n25);
+		__m128i ok;
+
+		ok = _mm_or_si128(up, h1_sse2_le(_mm_sub_epi8(v, _mm_set1_epi8('a')), n25));
+		ok = _mm_or_si128(ok, h1_sse2_le(_mm_sub_epi8(v, _mm_set1_epi8('0')), n9));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, dash));
+		m = _mm_movemask_epi8(ok);
+
+		if (lower) {
+			/* only the letters before the first stop may be changed */
+			if (m != 0xffff)
+				up = _mm_and_si128(up, _mm_cmplt_epi8(idx, _mm_set1_epi8(__builtin_ctz(~m))));
+			if (_mm_movemask_epi8(up))
+				_mm_storeu_si128((__m128i *)ptr, _mm_add_epi8(v, _mm_and_si128(up, case_bit)));
+		}
+
+		if (m != 0xffff)
+			return ptr + __builtin_ctz(~m);
+		ptr += 16;
+	}
+	return ptr;
+}
+
+const struct h1_scan_ops h1_scan_sse2 = {
+	.name     = "sse2",
+	.uri      = h1_sse2_uri,
+	.hdr_val  = h1_sse2_val,
+	.hdr_name = h1_sse2_name,
+};
+
+/* same as h1_sse2_le() on 32 bytes */
+__attribute__((target("avx2")))
+static inline __m256i h1_avx2_le(__m256i x, __m256i n)
+{
+	return _mm256_cmpeq_epi8(_mm256_max_epu8(x, n), n);
+}
+
+/* The AVX2 scanners leave the last 16 to 31 bytes to the SSE2 ones */
+__attribute__((target("avx2")))
+static char *h1_avx2_uri(char *ptr, const char *end)
+{
+	const __m256i bias = _mm256_set1_epi8(0x21);
+	const __m256i lim = _mm256_set1_epi8(0x7e - 0x21);
+	unsigned int m;
+
+	while (ptr <= end - 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+
+		m = _mm256_movemask_epi8(h1_avx2_le(_mm256_sub_epi8(v, bias), lim));
+		if (m != 0xffffffff)
+			return ptr + __builtin_ctz(~m);
+		ptr += 32;
+	}
+	return h1_sse2_uri(ptr, end);
+}
+
+__attribute__((target("avx2")))
+static char *h1_avx2_val(char *ptr, const char *end)
+{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	unsigned int m;
+
+	while (ptr <= end - 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+
+		m = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+		if (m)
+			return ptr + __builtin_ctz(m);
+		ptr += 32;
+	}
+	return h1_sse2_val(ptr, end);
+}
+
+__attribute__((target("avx2")))
+static char *h1_avx2_name(char *ptr, const char *end, int lower)
+{
+	const __m256i idx = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	                                     16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+	const __m256i n25 = _mm256_set1_epi8(25);
+	const __m256i n9 = _mm256_set1_epi8(9);
+	const __m256i dash = _mm256_set1_epi8('-');
+	const __m256i case_bit = _mm256_set1_epi8(0x20);
+	unsigned int m;
+
+	while (ptr <= end - 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+		__m256i up = h1_avx2_le(_mm256_sub_epi8(v, _mm256_set1_epi8('A')), n25);
+		__m256i ok;
+
+		ok = _mm256_or_si256(up, h1_avx2_le(_mm256_sub_epi8(v, _mm256_set1_epi8('a')), n25));
+		ok = _mm256_or_si256(ok, h1_avx2_le(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), n9));
+		ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(v, dash));
+		m = _mm256_movemask_epi8(ok);
+
+		if (lower) {
+			if (m != 0xffffffff)
+				up = _mm256_and_si256(up, _mm256_cmpgt_epi8(_mm256_set1_epi8(__builtin_ctz(~m)), idx));
+			if (_mm256_movemask_epi8(up))
+				_mm256_storeu_si256((__m256i *)ptr, _mm256_add_epi8(v, _mm256_and_si256(up, case_bit)));
+		}
+
+		if (m != 0xffffffff)
+			return ptr + __builtin_ctz(~m);
+		ptr += 32;
+	}
+	return h1_sse2_name(ptr, end, lower);
+}
+
+const struct h1_scan_ops h1_scan_avx2 = {
+	.name     = "avx2",
+	.uri      = h1_avx2_uri,
+	.hdr_val  = h1_avx2_val,
+	.hdr_name = h1_avx2_name,
+};
+
+const struct h1_scan_ops *h1_scan = &h1_scan_sse2;
+
+#else /* !H1_SCAN_X86 */
+
+const struct h1_scan_ops *h1_scan = &h1_scan_scalar;
+
+#endif
+
+/* Selects the best scanners supported by the CPU */
+void h1_scan_init(void)
+{
+#ifdef H1_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		h1_scan = &h1_scan_avx2;
+#endif
+}
+
+INITCALL0(STG_PREPARE, h1_scan_init);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
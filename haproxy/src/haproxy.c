@@ -86,6 +86,9 @@
 #include <haproxy/arg.h>
 #include <haproxy/auth.h>
 #include <haproxy/base64.h>
+#ifdef HAPROXY_BENCH
+#include <haproxy/bench.h>
+#endif
 #include <haproxy/capture-t.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/chunk.h>
@@ -111,12 +114,14 @@
 #include <haproxy/pool.h>
 #include <haproxy/protocol.h>
 #include <haproxy/proxy.h>
+#include <haproxy/qsbr.h>
 #include <haproxy/regex.h>
 #include <haproxy/sample.h>
 #include <haproxy/server.h>
 #include <haproxy/session.h>
 #include <haproxy/signal.h>
 #include <haproxy/ssl_sock.h>
+#include <haproxy/stick_table.h>
 #include <haproxy/stream.h>
 #include <haproxy/task.h>
 #include <haproxy/thread.h>
@@ -158,7 +163,7 @@ struct global global = {
 		 }
 	},
 	.tune = {
-		.options = GTUNE_LISTENER_MQ,
+		.options = GTUNE_LISTENER_MQ | GTUNE_PATTERN_CACHE_IDX,
 		.bufsize = (BUFSIZE + 2*sizeof(void *) - 1) & -(2*sizeof(void *)),
 		.maxrewrite = MAXREWRITE,
 		.reserved_bufs = RESERVED_BUFS,
@@ -620,6 +625,9 @@ static void usage(char *name)
 		"D ] [ -n <maxconn> ] [ -N <maxpconn> ]\n"
 		"        [ -p <pidfile> ] [ -m <max megs> ] [ -C <dir> ] [-- <cfgfile>*]\n"
 		"        -v displays version ; -vv shows known build options.\n"
+#ifdef HAPROXY_BENCH
+		"        -B [-t <ms>] [<name>*] runs the benchmarks built by 'make bench'.\n"
+#endif
 		"        -d enters debug mode ; -db only disables background mode.\n"
 		"        -dM[<byte>] poisons memory with <byte> (defaults to 0x50)\n"
 		"        -V enters verbose mode (disables quiet mode)\n"
@@ -644,6 +652,9 @@ static void usage(char *name)
 #if defined(USE_EVPORTS)
 		"        -dv disables event ports usage even when available\n"
 #endif
+#if defined(USE_IOURING)
+		"        -du disables io_uring usage even when available\n"
+#endif
 #if defined(USE_POLL)
 		"        -dp disables poll() usage even when available\n"
 #endif
@@ -1789,6 +1800,9 @@ static void init(int argc, char **argv)
 #if defined(USE_EVPORTS)
 	global.tune.options |= GTUNE_USE_EVPORTS;
 #endif
+#if defined(USE_IOURING)
+	global.tune.options |= GTUNE_USE_IOURING;
+#endif
 #if defined(USE_LINUX_SPLICE)
 	global.tune.options |= GTUNE_USE_SPLICE;
 #endif
@@ -1829,6 +1843,12 @@ static void init(int argc, char **argv)
 					display_build_opts();
 				exit(0);
 			}
+#ifdef HAPROXY_BENCH
+			else if (*flag == 'B') {
+				/* the benchmarks take all remaining arguments */
+				exit(bench_run_all(argc - 1, argv + 1));
+			}
+#endif
 #if defined(USE_EPOLL)
 			else if (*flag == 'd' && flag[1] == 'e')
 				global.tune.options &= ~GTUNE_USE_EPOLL;
@@ -1845,6 +1865,10 @@ static void init(int argc, char **argv)
 			else if (*flag == 'd' && flag[1] == 'v')
 				global.tune.options &= ~GTUNE_USE_EVPORTS;
 #endif
+#if defined(USE_IOURING)
+			else if (*flag == 'd' && flag[1] == 'u')
+				global.tune.options &= ~GTUNE_USE_IOURING;
+#endif
 #if defined(USE_LINUX_SPLICE)
 			else if (*flag == 'd' && flag[1] == 'S')
 				global.tune.options &= ~GTUNE_USE_SPLICE;
@@ -2530,6 +2554,9 @@ static void init(int argc, char **argv)
 	if (!(global.tune.options & GTUNE_USE_EVPORTS))
 		disable_poller("evports");
 
+	if (!(global.tune.options & GTUNE_USE_IOURING))
+		disable_poller("io_uring");
+
 	if (!(global.tune.options & GTUNE_USE_EPOLL))
 		disable_poller("epoll");
 
@@ -2638,6 +2665,7 @@ void deinit(void)
 	struct post_deinit_fct *pdf;
 	struct proxy_deinit_fct *pxdf;
 	struct server_deinit_fct *srvdf;
+	int i;
 
 	deinit_signals();
 	while (p) {
@@ -2790,10 +2818,17 @@ void deinit(void)
 			free(s->cookie);
 			free(s->hostname_dn);
 			free((char*)s->conf.file);
-			free(s->idle_conns);
-			free(s->safe_conns);
-			free(s->available_conns);
+			free(s->idle_conns_tree);
+			free(s->safe_conns_tree);
+			free(s->available_conns_tree);
 			free(s->curr_idle_thr);
+			if (s->warm_tasks) {
+				for (i = 0; i < global.nbthread; i++)
+					task_destroy(s->warm_tasks[i]);
+				free(s->warm_tasks);
+			}
+			free(s->warming_conns);
+			free(s->curr_warm_thr);
 			free(s->lb_nodes);
 
 			if (s->use_ssl == 1 || s->check.use_ssl == 1 || (s->proxy->options & PR_O_TCPCHK_SSL)) {
@@ -2851,7 +2886,7 @@ void deinit(void)
 		pool_destroy(p->req_cap_pool);
 		pool_destroy(p->rsp_cap_pool);
 		if (p->table)
-			pool_destroy(p->table->pool);
+			stktable_deinit(p->table);
 
 		p0 = p;
 		p = p->next;
@@ -2934,6 +2969,9 @@ void run_poll_loop()
 
 	tv_update_date(0,1);
 	while (1) {
+		/* no pointer obtained from a lock-free lookup is held here */
+		qsbr_quiescent();
+
 		wake_expired_tasks();
 
 		/* check if we caught some signals and process them in the
@@ -1,5 +1,5 @@
 /*
- * HPACK decompressor (RFC7541)
+ * HPACK compressor (RFC7541)
  *
  * Copyright (C) 2014-2017 Willy Tarreau <willy@haproxy.org>
  * Copyright (C) 2017 HAProxy Technologies
@@ -31,7 +31,10 @@
 #include <string.h>
 
 #include <import/ist.h>
+#include <import/xxhash.h>
 #include <haproxy/hpack-enc.h>
+#include <haproxy/hpack-huff.h>
+#include <haproxy/hpack-tbl.h>
 #include <haproxy/http-hdr-t.h>
 
 /*
@@ -138,22 +141,15 @@ const signed short hpack_pos_len[32] = {
          /*   24: */   -1,  609,   -1,  636,   -1,   -1,   -1,   -1,
 };
 
-/* Tries to encode header whose name is <n> and value <v> into the chunk <out>.
- * Returns non-zero on success, 0 on failure (buffer full).
+/* Returns the index of the first entry of the static table having name <n>,
+ * or 0 if there is none.
  */
-int hpack_encode_header(struct buffer *out, const struct ist n,
-			const struct ist v)
+static inline int hpack_sht_name_idx(const struct ist n)
 {
-	int len = out->data;
-	int size = out->size;
 	int pos;
 
-	if (len >= size)
-		return 0;
-
-	/* look for the header field <n> in the static table */
 	if (n.len >= sizeof(hpack_pos_len) / sizeof(hpack_pos_len[0]))
-		goto make_literal;
+		return 0;
 
 	pos = hpack_pos_len[n.len];
 	if (pos >= 0) {
@@ -164,17 +160,36 @@ int hpack_encode_header(struct buffer *out, const struct ist n,
 			pos++;
 			idx = hpack_enc_stream[pos++];
 			pos += n.len;
-			if (isteq(ist2(&hpack_enc_stream[pos - n.len], n.len), n)) {
-				/* emit literal with indexing (7541#6.2.1) :
-				 * [ 0 | 1 | Index (6+) ]
-				 */
-				out->area[len++] = idx | 0x40;
-				goto emit_value;
-			}
+			if (isteq(ist2(&hpack_enc_stream[pos - n.len], n.len), n))
+				return idx;
 		} while ((unsigned char)hpack_enc_stream[pos] == n.len);
 	}
+	return 0;
+}
+
+/* Tries to encode header whose name is <n> and value <v> into the chunk <out>.
+ * Returns non-zero on success, 0 on failure (buffer full).
+ */
+int hpack_encode_header(struct buffer *out, const struct ist n,
+			const struct ist v)
+{
+	int len = out->data;
+	int size = out->size;
+	int idx;
+
+	if (len >= size)
+		return 0;
+
+	/* look for the header field <n> in the static table */
+	idx = hpack_sht_name_idx(n);
+	if (idx) {
+		/* emit literal with indexing (7541#6.2.1) :
+		 * [ 0 | 1 | Index (6+) ]
+		 */
+		out->area[len++] = idx | 0x40;
+		goto emit_value;
+	}
 
- make_literal:
 	if (likely(n.len < 127 && len + 2 + n.len <= size)) {
 		out->area[len++] = 0x00;      /* literal without indexing -- new name */
 		out->area[len++] = n.len;     /* single-byte length encoding */
@@ -208,3 +223,415 @@ int hpack_encode_header(struct buffer *out, const struct ist n,
 	out->data = len;
 	return 1;
 }
+
+/*
+ * Encoder's dynamic table (see hpack-enc-t.h)
+ */
+
+/* how a header field is represented (7541#6.2) */
+enum {
+	HPACK_EDT_INDEX = 0, /* literal with incremental indexing */
+	HPACK_EDT_NOINDEX,   /* literal without indexing */
+	HPACK_EDT_NEVER,     /* literal never indexed */
+};
+
+/* Returns the number of slots of a table of <cap> bytes, which can hold
+ * twice as many entries as fit in the table.
+ */
+static inline uint32_t hpack_edt_slots(uint32_t cap)
+{
+	uint32_t slots = 2;
+
+	while (slots < 2 * (cap / 32))
+		slots *= 2;
+	return slots;
+}
+
+/* Returns the number of bytes needed to allocate an encoder's dynamic table
+ * of up to <cap> bytes.
+ */
+size_t hpack_edt_size(uint32_t cap)
+{
+	uint32_t slots = hpack_edt_slots(cap);
+
+	return sizeof(struct hpack_edt) + slots * sizeof(struct hpack_edte) +
+	       2 * (slots / 2) * sizeof(uint32_t) + 2 * cap;
+}
+
+/* Initializes the encoder's dynamic table of up to <cap> bytes in <area>, of
+ * hpack_edt_size(<cap>) bytes, with a max size of <max> bytes, and returns it.
+ * Since the peer's table may contain entries we don't know about, the first
+ * header block will empty it.
+ */
+struct hpack_edt *hpack_edt_init(void *area, uint32_t cap, uint32_t max)
+{
+	struct hpack_edt *edt = area;
+
+	memset(edt, 0, sizeof(*edt));
+	edt->cap     = cap;
+	edt->max     = max < cap ? max : cap;
+	edt->slots   = hpack_edt_slots(cap);
+	edt->buckets = edt->slots / 2;
+	edt->dsize   = 2 * cap;
+	edt->dte     = (struct hpack_edte *)(edt + 1);
+	edt->head_nv = (uint32_t *)(edt->dte + edt->slots);
+	edt->head_n  = edt->head_nv + edt->buckets;
+	edt->data    = (char *)(edt->head_n + edt->buckets);
+	memset(edt->head_nv, 0, 2 * edt->buckets * sizeof(uint32_t));
+	edt->upd     = 1;
+	edt->upd_min = 0;
+	return edt;
+}
+
+/* returns non-zero if entry <id> is in the table */
+static inline int hpack_edt_present(const struct hpack_edt *edt, uint32_t id)
+{
+	return (uint32_t)(edt->cur.head - id) < edt->cur.used;
+}
+
+static inline struct hpack_edte *hpack_edt_get(const struct hpack_edt *edt, uint32_t id)
+{
+	return &edt->dte[id & (edt->slots - 1)];
+}
+
+/* returns the position of <ofs> bytes after <pos> in the data ring */
+static inline uint32_t hpack_edt_ofs(const struct hpack_edt *edt, uint32_t pos, uint32_t ofs)
+{
+	pos += ofs;
+	return pos >= edt->dsize ? pos - edt->dsize : pos;
+}
+
+/* returns non-zero if the data ring contains <s> at <pos> */
+static inline int hpack_edt_eq(const struct hpack_edt *edt, uint32_t pos, const struct ist s)
+{
+	uint32_t room = edt->dsize - pos;
+
+	if (room >= s.len)
+		return memcmp(edt->data + pos, s.ptr, s.len) == 0;
+	return memcmp(edt->data + pos, s.ptr, room) == 0 &&
+	       memcmp(edt->data, s.ptr + room, s.len - room) == 0;
+}
+
+/* copies <s> into the data ring at <pos> and returns the next position */
+static inline uint32_t hpack_edt_put(struct hpack_edt *edt, uint32_t pos, const struct ist s)
+{
+	uint32_t room = edt->dsize - pos;
+
+	if (room >= s.len) {
+		memcpy(edt->data + pos, s.ptr, s.len);
+		return hpack_edt_ofs(edt, pos, s.len);
+	}
+	memcpy(edt->data + pos, s.ptr, room);
+	memcpy(edt->data, s.ptr + room, s.len - room);
+	return s.len - room;
+}
+
+/* evicts the oldest entries until the table's size is <max> or less */
+static void hpack_edt_evict(struct hpack_edt *edt, uint32_t max)
+{
+	const struct hpack_edte *dte;
+
+	while (edt->cur.total > max) {
+		dte = hpack_edt_get(edt, edt->cur.head - edt->cur.used + 1);
+		edt->cur.total -= dte->nlen + dte->vlen + 32;
+		edt->cur.used--;
+	}
+}
+
+/* Inserts <n>:<v> in front of the table, whose hash buckets are <bn> and
+ * <bnv>. The caller must have checked that it fits in the budget.
+ */
+static void hpack_edt_insert(struct hpack_edt *edt, const struct ist n, const struct ist v,
+                             uint32_t bn, uint32_t bnv)
+{
+	uint32_t size = n.len + v.len + 32;
+	struct hpack_edte *dte;
+	uint32_t id;
+
+	hpack_edt_evict(edt, edt->max - size);
+
+	id = ++edt->cur.head;
+	dte = hpack_edt_get(edt, id);
+	dte->nlen = n.len;
+	dte->vlen = v.len;
+	dte->pos  = edt->cur.dpos;
+	edt->cur.dpos = hpack_edt_put(edt, edt->cur.dpos, n);
+	edt->cur.dpos = hpack_edt_put(edt, edt->cur.dpos, v);
+
+	dte->next_nv = edt->head_nv[bnv];
+	edt->head_nv[bnv] = id;
+	dte->next_n = edt->head_n[bn];
+	edt->head_n[bn] = id;
+
+	edt->cur.used++;
+	edt->cur.total += size;
+	edt->budget -= size;
+}
+
+/* Cancels the current transaction, bringing back the table as it was when it
+ * started. The chains are restored by unlinking from the buckets' heads the
+ * entries which were inserted since.
+ */
+static void hpack_edt_rollback(struct hpack_edt *edt)
+{
+	uint32_t inserted = edt->cur.head - edt->txn.head;
+	uint32_t b;
+
+	for (b = 0; inserted && b < edt->buckets; b++) {
+		while (edt->head_nv[b] - edt->txn.head - 1 < inserted)
+			edt->head_nv[b] = hpack_edt_get(edt, edt->head_nv[b])->next_nv;
+		while (edt->head_n[b] - edt->txn.head - 1 < inserted)
+			edt->head_n[b] = hpack_edt_get(edt, edt->head_n[b])->next_n;
+	}
+	edt->cur = edt->txn;
+	edt->in_txn = 0;
+}
+
+/* Sets the max size of the table to <max>, or to its capacity if lower, for
+ * instance after the peer changed SETTINGS_HEADER_TABLE_SIZE. The next header
+ * block will notify the peer.
+ */
+void hpack_edt_set_max(struct hpack_edt *edt, uint32_t max)
+{
+	if (max > edt->cap)
+		max = edt->cap;
+	if (edt->in_txn)
+		hpack_edt_rollback(edt);
+	hpack_edt_evict(edt, max);
+	edt->max = max;
+	if (max < edt->upd_min)
+		edt->upd_min = max;
+	edt->upd = 1;
+}
+
+/* Emits integer <val> with a prefix of <bits> bits into <out> at <pos>, the
+ * first byte being or'ed with <flags> (7541#5.1). Returns the next position,
+ * or 0 if <out> of size <size> is full.
+ */
+static inline int hpack_edt_emit_int(char *out, int pos, int size, uint8_t flags, int bits, uint32_t val)
+{
+	uint32_t lim = (1U << bits) - 1;
+
+	if (pos >= size)
+		return 0;
+	if (val < lim) {
+		out[pos++] = flags | val;
+		return pos;
+	}
+	out[pos++] = flags | lim;
+	for (val -= lim; val >= 128; val >>= 7) {
+		if (pos >= size)
+			return 0;
+		out[pos++] = (val & 127) | 128;
+	}
+	if (pos >= size)
+		return 0;
+	out[pos++] = val;
+	return pos;
+}
+
+/* Emits string <s> into <out> at <pos>, Huffman-encoded if this is shorter
+ * (7541#5.2). Returns the next position, or 0 if <out> of size <size> is full.
+ */
+static inline int hpack_edt_emit_str(char *out, int pos, int size, const struct ist s)
+{
+	int hlen = huff_enc_len(s.ptr, s.len);
+
+	if (hlen < s.len) {
+		if (!hpack_len_to_bytes(hlen) || pos + hpack_len_to_bytes(hlen) + hlen > size)
+			return 0;
+		pos = hpack_encode_len(out, pos, hlen);
+		out[pos - hpack_len_to_bytes(hlen)] |= 0x80;
+		huff_enc(s.ptr, s.len, out + pos, hlen);
+		return pos + hlen;
+	}
+
+	if (!hpack_len_to_bytes(s.len) || pos + hpack_len_to_bytes(s.len) + s.len > size)
+		return 0;
+	pos = hpack_encode_len(out, pos, s.len);
+	memcpy(out + pos, s.ptr, s.len);
+	return pos + s.len;
+}
+
+/* Starts a header block in <out>, emitting the pending table size updates.
+ * If the previous block was not committed, it is rolled back first since it
+ * was not sent. Returns non-zero on success, 0 on failure (buffer full).
+ */
+int hpack_edt_begin(struct hpack_edt *edt, struct buffer *out)
+{
+	int pos = out->data;
+
+	if (edt->in_txn)
+		hpack_edt_rollback(edt);
+
+	edt->txn = edt->cur;
+	edt->in_txn = 1;
+	edt->budget = edt->max;
+
+	/* dynamic table size update (7541#6.3) : [ 0 | 0 | 1 | Max size (5+) ].
+	 * When the size was lowered then raised, the lowest value must be
+	 * sent first (7541#4.2).
+	 */
+	if (edt->upd) {
+		if (edt->upd_min < edt->max) {
+			pos = hpack_edt_emit_int(out->area, pos, out->size, 0x20, 5, edt->upd_min);
+			if (!pos)
+				return 0;
+		}
+		pos = hpack_edt_emit_int(out->area, pos, out->size, 0x20, 5, edt->max);
+		if (!pos)
+			return 0;
+	}
+	edt->cur.enc += pos - out->data;
+	out->data = pos;
+	return 1;
+}
+
+/* Validates the header block started by hpack_edt_begin(), once it is sent */
+void hpack_edt_commit(struct hpack_edt *edt)
+{
+	edt->in_txn = 0;
+	edt->upd = 0;
+	edt->upd_min = edt->max;
+}
+
+/* Returns how header field <n>:<v> should be represented. Values which are
+ * unlikely to be repeated are not indexed so that they do not evict useful
+ * ones, and credentials are never indexed, as well as short cookies which
+ * could be guessed by probing the table (7541#7.1.3).
+ */
+static inline int hpack_edt_policy(const struct ist n, const struct ist v)
+{
+	switch (n.len) {
+	case 4:
+		if (isteq(n, ist("etag")))
+			return HPACK_EDT_NOINDEX;
+		break;
+	case 5:
+		if (isteq(n, ist(":path")))
+			return HPACK_EDT_NOINDEX;
+		break;
+	case 6:
+		if (v.len < 20 && isteq(n, ist("cookie")))
+			return HPACK_EDT_NEVER;
+		break;
+	case 8:
+		if (isteq(n, ist("location")))
+			return HPACK_EDT_NOINDEX;
+		break;
+	case 10:
+		if (isteq(n, ist("set-cookie")))
+			return HPACK_EDT_NOINDEX;
+		break;
+	case 13:
+		if (isteq(n, ist("authorization")))
+			return HPACK_EDT_NEVER;
+		if (isteq(n, ist("last-modified")) || isteq(n, ist("content-range")))
+			return HPACK_EDT_NOINDEX;
+		break;
+	case 14:
+		if (isteq(n, ist("content-length")))
+			return HPACK_EDT_NOINDEX;
+		break;
+	case 19:
+		if (isteq(n, ist("proxy-authorization")))
+			return HPACK_EDT_NEVER;
+		break;
+	}
+	return HPACK_EDT_INDEX;
+}
+
+/* Tries to encode header whose name is <n> and value <v> into the chunk <out>
+ * within the header block started by hpack_edt_begin() on table <edt>. Fields
+ * present in the static or dynamic tables are emitted as an index, others as
+ * literals referencing the name when it is known, and are added to the
+ * dynamic table depending on hpack_edt_policy(). Strings are Huffman-encoded
+ * when this makes them shorter. Returns non-zero on success, 0 on failure
+ * (buffer full), in which case the table must not be used before the next
+ * hpack_edt_begin().
+ */
+int hpack_encode_header_edt(struct hpack_edt *edt, struct buffer *out, const struct ist n,
+                            const struct ist v)
+{
+	const struct hpack_edte *dte;
+	uint32_t bn = 0, bnv = 0, id, steps;
+	int size = out->size;
+	int pos = out->data;
+	int idx, sidx, policy;
+	uint64_t hash;
+
+	sidx = hpack_sht_name_idx(n);
+
+	/* only the first 16 static entries have a value */
+	if (sidx && sidx <= 16) {
+		for (idx = sidx; idx <= 16 && isteq(hpack_sht[idx].n, n); idx++) {
+			if (isteq(hpack_sht[idx].v, v)) {
+				/* indexed header field (7541#6.1) : [ 1 | Index (7+) ] */
+				if (pos >= size)
+					return 0;
+				out->area[pos++] = 0x80 | idx;
+				goto done;
+			}
+		}
+	}
+
+	policy = hpack_edt_policy(n, v);
+	if (policy == HPACK_EDT_INDEX &&
+	    (n.len + v.len + 32 > edt->budget || n.len + v.len + 32 > edt->max / 4 * 3))
+		policy = HPACK_EDT_NOINDEX;
+
+	idx = sidx;
+	if (policy == HPACK_EDT_INDEX || (edt->cur.used && policy != HPACK_EDT_NEVER)) {
+		hash = XXH64(n.ptr, n.len, 0);
+		bn = hash & (edt->buckets - 1);
+		bnv = XXH64(v.ptr, v.len, hash) & (edt->buckets - 1);
+
+		/* look for the whole field, then for its name */
+		steps = edt->cur.used;
+		for (id = edt->head_nv[bnv]; steps-- && hpack_edt_present(edt, id); id = dte->next_nv) {
+			dte = hpack_edt_get(edt, id);
+			if (dte->nlen == n.len && dte->vlen == v.len &&
+			    hpack_edt_eq(edt, dte->pos, n) &&
+			    hpack_edt_eq(edt, hpack_edt_ofs(edt, dte->pos, n.len), v)) {
+				pos = hpack_edt_emit_int(out->area, pos, size, 0x80, 7,
+				                         HPACK_SHT_SIZE + edt->cur.head - id);
+				if (!pos)
+					return 0;
+				goto done;
+			}
+		}
+
+		steps = edt->cur.used;
+		for (id = edt->head_n[bn]; !idx && steps-- && hpack_edt_present(edt, id); id = dte->next_n) {
+			dte = hpack_edt_get(edt, id);
+			if (dte->nlen == n.len && hpack_edt_eq(edt, dte->pos, n))
+				idx = HPACK_SHT_SIZE + edt->cur.head - id;
+		}
+	}
+
+	/* literal header field (7541#6.2) :
+	 *   with incremental indexing : [ 0 | 1 | Index (6+) ]
+	 *   without indexing :          [ 0 | 0 | 0 | 0 | Index (4+) ]
+	 *   never indexed :             [ 0 | 0 | 0 | 1 | Index (4+) ]
+	 * followed by the name if the index is zero, then by the value.
+	 */
+	if (policy == HPACK_EDT_INDEX)
+		pos = hpack_edt_emit_int(out->area, pos, size, 0x40, 6, idx);
+	else
+		pos = hpack_edt_emit_int(out->area, pos, size, policy == HPACK_EDT_NEVER ? 0x10 : 0x00, 4, idx);
+
+	if (pos && !idx)
+		pos = hpack_edt_emit_str(out->area, pos, size, n);
+	if (pos)
+		pos = hpack_edt_emit_str(out->area, pos, size, v);
+	if (!pos)
+		return 0;
+
+	if (policy == HPACK_EDT_INDEX)
+		hpack_edt_insert(edt, n, v, bn, bnv);
+ done:
+	edt->cur.raw += n.len + v.len;
+	edt->cur.enc += pos - out->data;
+	out->data = pos;
+	return 1;
+}
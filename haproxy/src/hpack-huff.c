@@ -1386,25 +1386,51 @@ struct rht rht_bit11_4[256] = {
 	/* Note, when l==30, bits 2..3 give 00:0x0a, 01:0x0d, 10:0x16, 11:EOS */
 };
 
-/* huffman-encode string <s> into the huff_tmp buffer and returns the amount
- * of output bytes. The caller must ensure the output is large enough (ie at
- * least 4 times as long as s).
- *
- * FIXME: bits are only counted for now, no code is emitted!
+/* Returns the number of bytes needed to huffman-encode the <len> bytes of
+ * string <s>.
  */
-int huff_enc(const char *s, char *out)
+int huff_enc_len(const char *s, int len)
 {
+	const uint8_t *p = (const uint8_t *)s;
 	int bits = 0;
 
-	while (*s) {
-		bits += ht[(uint8_t)*s].b;
-		s++;
+	while (len--)
+		bits += ht[*p++].b;
+	return (bits + 7) / 8;
+}
+
+/* huffman-encode the <len> bytes of string <s> into <out> which may hold
+ * <olen> bytes, and return the number of output bytes, or -1 if the output
+ * does not fit. The last byte is padded with the most significant bits of
+ * EOS (ie: ones) as required by RFC7541#5.2. Since the longest code is 30
+ * bits, no more than 37 bits are ever pending in the 64-bit accumulator.
+ */
+int huff_enc(const char *s, int len, char *out, int olen)
+{
+	const uint8_t *p = (const uint8_t *)s;
+	char *out_start = out;
+	char *out_end = out + olen;
+	uint64_t acc = 0;
+	int bits = 0;
+
+	while (len--) {
+		acc = (acc << ht[*p].b) | ht[*p].c;
+		bits += ht[*p].b;
+		p++;
+		while (bits >= 8) {
+			if (out >= out_end)
+				return -1;
+			bits -= 8;
+			*out++ = acc >> bits;
+		}
 	}
-	bits += 7;
 
-	/*  FIXME: huffman code is not emitted yet. */
-	//memset(out, 'H', bits / 8);
-	return bits / 8;
+	if (bits) {
+		if (out >= out_end)
+			return -1;
+		*out++ = (acc << (8 - bits)) | (0xff >> bits);
+	}
+	return out - out_start;
 }
 
 /* pass a huffman string, it will decode it and return the new output size or
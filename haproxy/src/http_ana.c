@@ -1410,25 +1410,19 @@ int http_request_forward_body(struct stream *s, struct channel *req, int an_bit)
 	return 0;
 }
 
-/* Reset the stream and the backend stream_interface to a situation suitable for attemption connection */
-/* Returns 0 if we can attempt to retry, -1 otherwise */
-static __inline int do_l7_retry(struct stream *s, struct stream_interface *si)
+/* Reset the stream and the backend stream_interface to a situation suitable
+ * for sending the request stored in the L7 buffer again, over a new connection.
+ * The caller is responsible for setting the stream_interface's state.
+ */
+static void http_reset_l7_resend(struct stream *s, struct stream_interface *si)
 {
 	struct channel *req, *res;
 	int co_data;
 
-	si->conn_retries--;
-	if (si->conn_retries < 0)
-		return -1;
-
-	if (objt_server(s->target)) {
-		if (s->flags & SF_CURR_SESS) {
-			s->flags &= ~SF_CURR_SESS;
-			_HA_ATOMIC_SUB(&__objt_server(s->target)->cur_sess, 1);
-		}
-		_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.retries, 1);
+	if (objt_server(s->target) && (s->flags & SF_CURR_SESS)) {
+		s->flags &= ~SF_CURR_SESS;
+		_HA_ATOMIC_SUB(&__objt_server(s->target)->cur_sess, 1);
 	}
-	_HA_ATOMIC_ADD(&s->be->be_counters.retries, 1);
 
 	req = &s->req;
 	res = &s->res;
@@ -1439,7 +1433,6 @@ static __inline int do_l7_retry(struct stream *s, struct stream_interface *si)
 	si->flags &= ~(SI_FL_ERR | SI_FL_EXP | SI_FL_RXBLK_SHUT);
 	si->err_type = SI_ET_NONE;
 	s->flags &= ~(SF_ERR_MASK | SF_FINST_MASK);
-	stream_choose_redispatch(s);
 	si->exp = TICK_ETERNITY;
 	res->rex = TICK_ETERNITY;
 	res->to_forward = 0;
@@ -1456,9 +1449,65 @@ static __inline int do_l7_retry(struct stream *s, struct stream_interface *si)
 	co_set_data(req, co_data);
 	b_reset(&res->buf);
 	co_set_data(res, 0);
+}
+
+/* Reset the stream and the backend stream_interface to a situation suitable for attemption connection */
+/* Returns 0 if we can attempt to retry, -1 otherwise */
+static __inline int do_l7_retry(struct stream *s, struct stream_interface *si)
+{
+	si->conn_retries--;
+	if (si->conn_retries < 0)
+		return -1;
+
+	if (objt_server(s->target))
+		_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.retries, 1);
+	_HA_ATOMIC_ADD(&s->be->be_counters.retries, 1);
+
+	stream_choose_redispatch(s);
+	http_reset_l7_resend(s, si);
 	return 0;
 }
 
+/* Returns non-zero if the request of stream <s>, which is still waiting for
+ * its response, may be hedged to another server: it must be idempotent
+ * (GET or HEAD), fully stored in the L7 buffer, not hedged yet, not sent to
+ * its server because of persistence, and the backend must have another active
+ * server to pick.
+ */
+static inline int http_may_hedge(const struct stream *s)
+{
+	const struct stream_interface *si = &s->si[1];
+
+	return ((si->flags & SI_FL_L7_RETRY) && b_data(&si->l7_buffer) &&
+		!(s->flags & (SF_HEDGED | SF_FORCE_PRST | SF_DIRECT)) &&
+		(s->txn->meth == HTTP_METH_GET || s->txn->meth == HTTP_METH_HEAD) &&
+		objt_server(s->target) && s->be->srv_act > 1);
+}
+
+/* Abandons the server connection of stream <s> which did not deliver any
+ * response in time, and sends the request again from the L7 buffer to a server
+ * picked by the load balancing algorithm. The previous server is left as the
+ * stream's target so that the algorithm avoids it, and SF_HEDGING prevents
+ * assign_server_and_queue() from reporting a redispatch. No retry is consumed.
+ */
+static void do_l7_hedge(struct stream *s, struct stream_interface *si)
+{
+	struct server *srv = __objt_server(s->target);
+
+	_HA_ATOMIC_ADD(&srv->counters.hedge_sent, 1);
+	_HA_ATOMIC_ADD(&s->be->be_counters.hedge_sent, 1);
+	s->flags |= SF_HEDGED | SF_HEDGING;
+
+	sess_change_server(s, NULL);
+	if (may_dequeue_tasks(srv, s->be))
+		process_srv_queue(srv, 0);
+
+	s->flags &= ~(SF_DIRECT | SF_ASSIGNED | SF_ADDR_SET);
+	si->state = SI_ST_REQ;
+	s->res.flags &= ~CF_ANA_TIMEOUT;
+	http_reset_l7_resend(s, si);
+}
+
 /* This stream analyser waits for a complete HTTP response. It returns 1 if the
  * processing can continue on next analysers, or zero if it either needs more
  * data or wants to immediately abort the response (eg: timeout, error, ...). It
@@ -1516,6 +1565,7 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 				conn = objt_cs(s->si[1].end)->conn;
 
 			if (si_b->flags & SI_FL_L7_RETRY &&
+			    (s->be->retry_type &~ PR_RE_CONN_FAILED) &&
 			    (!conn || conn->err_code != CO_ER_SSL_EARLY_FAILED)) {
 				/* If we arrive here, then CF_READ_ERROR was
 				 * set by si_cs_recv() because we matched a
@@ -1674,6 +1724,27 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 			return 0;
 		}
 
+		/* 6: no response yet, the request may be sent to another
+		 * server if this one takes too long to respond.
+		 */
+		else if (s->be->hedge_delay || s->be->hedge_pct) {
+			if (tick_is_expired(rep->analyse_exp, now_ms)) {
+				rep->analyse_exp = TICK_ETERNITY;
+				if (http_may_hedge(s) && !co_data(rep)) {
+					do_l7_hedge(s, si_b);
+					DBG_TRACE_DEVEL("leaving on L7 hedge",
+							STRM_EV_STRM_ANA|STRM_EV_HTTP_ANA, s, txn);
+					return 0;
+				}
+			}
+			else if (!tick_isset(rep->analyse_exp) && http_may_hedge(s)) {
+				unsigned int delay = proxy_hedge_delay(s->be);
+
+				if (delay)
+					rep->analyse_exp = tick_add(now_ms, delay);
+			}
+		}
+
 		channel_dont_close(rep);
 		rep->flags |= CF_READ_DONTWAIT; /* try to get back here ASAP */
 		DBG_TRACE_DEVEL("waiting for more data",
@@ -1859,6 +1930,15 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 	/* we want to have the response time before we start processing it */
 	s->logs.t_data = tv_ms_elapsed(&s->logs.tv_accept, &now);
 
+	if (s->be->hedge_pct && s->logs.t_connect >= 0)
+		proxy_hedge_add_sample(s->be, s->logs.t_data - s->logs.t_connect);
+
+	if (s->flags & SF_HEDGED) {
+		_HA_ATOMIC_ADD(&s->be->be_counters.hedge_resp, 1);
+		if (objt_server(s->target))
+			_HA_ATOMIC_ADD(&__objt_server(s->target)->counters.hedge_resp, 1);
+	}
+
 	/* end of job, return OK */
 	rep->analysers &= ~an_bit;
 	rep->analyse_exp = TICK_ETERNITY;
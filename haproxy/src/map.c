@@ -10,13 +10,16 @@
  *
  */
 
+#include <ctype.h>
 #include <stdio.h>
 
 #include <haproxy/api.h>
 #include <haproxy/applet-t.h>
 #include <haproxy/arg.h>
 #include <haproxy/cli.h>
+#include <haproxy/log.h>
 #include <haproxy/map.h>
+#include <haproxy/mapimg.h>
 #include <haproxy/pattern.h>
 #include <haproxy/regex.h>
 #include <haproxy/sample.h>
@@ -324,6 +327,7 @@ static int cli_io_handler_pat_list(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
 	struct pat_ref_elt *elt;
+	struct mapimg *img;
 
 	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW))) {
 		/* If we're forced to shut down, we might have to remove our
@@ -351,6 +355,7 @@ static int cli_io_handler_pat_list(struct appctx *appctx)
 		HA_SPIN_LOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
 		LIST_INIT(&appctx->ctx.map.bref.users);
 		appctx->ctx.map.bref.ref = appctx->ctx.map.ref->head.n;
+		appctx->ctx.map.img_idx = 0;
 		HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
 		appctx->st2 = STAT_ST_LIST;
 		/* fall through */
@@ -364,6 +369,31 @@ static int cli_io_handler_pat_list(struct appctx *appctx)
 			LIST_INIT(&appctx->ctx.map.bref.users);
 		}
 
+		/* the entries of the image come first, they have no identifier */
+		while ((img = appctx->ctx.map.ref->img) && appctx->ctx.map.img_idx < img->nb_entries) {
+			chunk_reset(&trash);
+
+			if (mapimg_val(img, appctx->ctx.map.img_idx))
+				chunk_appendf(&trash, "- %s %s\n",
+				              mapimg_key(img, appctx->ctx.map.img_idx),
+				              mapimg_val(img, appctx->ctx.map.img_idx));
+			else
+				chunk_appendf(&trash, "- %s\n",
+				              mapimg_key(img, appctx->ctx.map.img_idx));
+
+			if (ci_putchk(si_ic(si), &trash) == -1) {
+				/* track the first entry, which may be deleted meanwhile */
+				if (appctx->ctx.map.bref.ref != &appctx->ctx.map.ref->head) {
+					elt = LIST_ELEM(appctx->ctx.map.bref.ref, struct pat_ref_elt *, list);
+					LIST_ADDQ(&elt->back_refs, &appctx->ctx.map.bref.users);
+				}
+				HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
+				si_rx_room_blk(si);
+				return 0;
+			}
+			appctx->ctx.map.img_idx++;
+		}
+
 		while (appctx->ctx.map.bref.ref != &appctx->ctx.map.ref->head) {
 			chunk_reset(&trash);
 
@@ -435,10 +465,19 @@ static int cli_io_handler_pats_list(struct appctx *appctx)
 			/* Build messages. If the reference is used by another category than
 			 * the listed categories, display the information in the message.
 			 */
-			chunk_appendf(&trash, "%d (%s) %s\n", appctx->ctx.map.ref->unique_id,
+			chunk_appendf(&trash, "%d (%s) %s", appctx->ctx.map.ref->unique_id,
 			              appctx->ctx.map.ref->reference ? appctx->ctx.map.ref->reference : "",
 			              appctx->ctx.map.ref->display);
 
+			if (appctx->ctx.map.ref->cache_ctr) {
+				struct pat_cache_ctr ctr;
+
+				pat_ref_cache_stats(appctx->ctx.map.ref, &ctr);
+				chunk_appendf(&trash, ". cache_hit=%llu cache_miss=%llu cache_evict=%llu",
+				              ctr.hit, ctr.miss, ctr.evict);
+			}
+			chunk_appendf(&trash, "\n");
+
 			if (ci_putchk(si_ic(si), &trash) == -1) {
 				/* let's try again later from this stream. We add ourselves into
 				 * this stream's users so that it can remove us upon termination.
@@ -466,18 +505,37 @@ static int cli_io_handler_map_lookup(struct appctx *appctx)
 	struct stream_interface *si = appctx->owner;
 	struct sample sample;
 	struct pattern *pat;
+	struct pattern_expr *expr;
+	unsigned int idx;
 	int match_method;
 
 	switch (appctx->st2) {
 	case STAT_ST_INIT:
-		/* Init to the first entry. The list cannot be change */
+		/* Init to the first entry. The list cannot be change, but its
+		 * expressions may be replaced by a commit.
+		 */
+		HA_SPIN_LOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
 		appctx->ctx.map.expr = LIST_ELEM(&appctx->ctx.map.ref->pat, struct pattern_expr *, list);
 		appctx->ctx.map.expr = pat_expr_get_next(appctx->ctx.map.expr, &appctx->ctx.map.ref->pat);
+		appctx->ctx.map.gen = appctx->ctx.map.ref->gen;
+		appctx->ctx.map.expr_idx = 0;
+		HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
 		appctx->st2 = STAT_ST_LIST;
 		/* fall through */
 
 	case STAT_ST_LIST:
 		HA_SPIN_LOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
+		/* a commit replaced the expressions, continue with the one which
+		 * replaced ours, at the same position.
+		 */
+		if (appctx->ctx.map.expr && appctx->ctx.map.gen != appctx->ctx.map.ref->gen) {
+			idx = 0;
+			list_for_each_entry(expr, &appctx->ctx.map.ref->pat, list)
+				if (idx++ == appctx->ctx.map.expr_idx)
+					break;
+			appctx->ctx.map.expr = (&expr->list == &appctx->ctx.map.ref->pat) ? NULL : expr;
+			appctx->ctx.map.gen = appctx->ctx.map.ref->gen;
+		}
 		/* for each lookup type */
 		while (appctx->ctx.map.expr) {
 			/* initialise chunk to build new message */
@@ -527,7 +585,9 @@ static int cli_io_handler_map_lookup(struct appctx *appctx)
 					chunk_appendf(&trash, ", match=yes");
 
 				/* display index mode */
-				if (pat->sflags & PAT_SF_TREE)
+				if (pat->sflags & PAT_SF_IMG)
+					chunk_appendf(&trash, ", idx=image");
+				else if (pat->sflags & PAT_SF_TREE)
 					chunk_appendf(&trash, ", idx=tree");
 				else
 					chunk_appendf(&trash, ", idx=list");
@@ -571,6 +631,7 @@ static int cli_io_handler_map_lookup(struct appctx *appctx)
 			/* get next entry */
 			appctx->ctx.map.expr = pat_expr_get_next(appctx->ctx.map.expr,
 			                                         &appctx->ctx.map.ref->pat);
+			appctx->ctx.map.expr_idx++;
 		}
 		HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
 		/* fall through */
@@ -743,15 +804,31 @@ static int cli_parse_set_map(char **args, char *payload, struct appctx *appctx,
 	return 1;
 }
 
+/* Parses a version number in the form "@<ver>" from <arg> into <ver>. Returns
+ * 0 if <arg> is not a valid version, otherwise non-zero.
+ */
+static int map_parse_ver(const char *arg, unsigned int *ver)
+{
+	char *error;
+
+	if (*arg != '@' || !isdigit((unsigned char)arg[1]))
+		return 0;
+	*ver = strtoul(arg + 1, &error, 10);
+	return *error == '\0' && *ver;
+}
+
 static int map_add_key_value(struct appctx *appctx, const char *key, const char *value, char **err)
 {
 	int ret;
 
+	if (appctx->ctx.map.display_flags != PAT_REF_MAP)
+		value = NULL;
+
 	HA_SPIN_LOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
-	if (appctx->ctx.map.display_flags == PAT_REF_MAP)
-		ret = pat_ref_add(appctx->ctx.map.ref, key, value, err);
+	if (appctx->ctx.map.ver)
+		ret = pat_ref_add_ver(appctx->ctx.map.ref, appctx->ctx.map.ver, key, value, err);
 	else
-		ret = pat_ref_add(appctx->ctx.map.ref, key, NULL, err);
+		ret = pat_ref_add(appctx->ctx.map.ref, key, value, err);
 	HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
 
 	return ret;
@@ -770,6 +847,14 @@ static int cli_parse_add_map(char **args, char *payload, struct appctx *appctx,
 		else
 			appctx->ctx.map.display_flags = PAT_REF_ACL;
 
+		/* an optional version to add the entries to comes first */
+		appctx->ctx.map.ver = 0;
+		if (*args[2] == '@') {
+			if (!map_parse_ver(args[2], &appctx->ctx.map.ver))
+				return cli_err(appctx, "Malformed version. Please use @<ver>.\n");
+			args++;
+		}
+
 		/* If the keyword is "map", we expect:
 		 *   - three parameters if there is no payload
 		 *   - one parameter if there is a payload
@@ -953,6 +1038,14 @@ static int cli_parse_clear_map(char **args, char *payload, struct appctx *appctx
 		else
 			appctx->ctx.map.display_flags = PAT_REF_ACL;
 
+		/* an optional version to clear comes first */
+		appctx->ctx.map.ver = 0;
+		if (*args[2] == '@') {
+			if (!map_parse_ver(args[2], &appctx->ctx.map.ver))
+				return cli_err(appctx, "Malformed version. Please use @<ver>.\n");
+			args++;
+		}
+
 		/* no parameter */
 		if (!*args[2]) {
 			if (appctx->ctx.map.display_flags == PAT_REF_MAP)
@@ -971,24 +1064,127 @@ static int cli_parse_clear_map(char **args, char *payload, struct appctx *appctx
 				return cli_err(appctx, "Unknown ACL identifier. Please use #<id> or <file>.\n");
 		}
 
+		/* a version being prepared is not visible, it is cleared at once */
+		if (appctx->ctx.map.ver) {
+			char *err = NULL;
+			int ret;
+
+			HA_SPIN_LOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
+			ret = pat_ref_clear_ver(appctx->ctx.map.ref, appctx->ctx.map.ver, &err);
+			HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
+			if (!ret)
+				return cli_dynerr(appctx, memprintf(&err, "%s.\n", err));
+			appctx->st0 = CLI_ST_PROMPT;
+			return 1;
+		}
+
 		/* delegate the clearing to the I/O handler which can yield */
 		return 0;
 	}
 	return 1;
 }
 
+/* Prepares a new version of a map or an ACL, which is filled with "add map"
+ * or "add acl" and published at once with "commit map" or "commit acl".
+ */
+static int cli_parse_prepare_map(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	unsigned int ver;
+	char *msg = NULL;
+
+	if (strcmp(args[1], "map") != 0 && strcmp(args[1], "acl") != 0)
+		return 1;
+
+	if (args[1][0] == 'm')
+		appctx->ctx.map.display_flags = PAT_REF_MAP;
+	else
+		appctx->ctx.map.display_flags = PAT_REF_ACL;
+
+	if (!*args[2]) {
+		if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+			return cli_err(appctx, "Missing map identifier.\n");
+		else
+			return cli_err(appctx, "Missing ACL identifier.\n");
+	}
+
+	appctx->ctx.map.ref = pat_ref_lookup_ref(args[2]);
+	if (!appctx->ctx.map.ref ||
+	    !(appctx->ctx.map.ref->flags & appctx->ctx.map.display_flags)) {
+		if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+			return cli_err(appctx, "Unknown map identifier. Please use #<id> or <file>.\n");
+		else
+			return cli_err(appctx, "Unknown ACL identifier. Please use #<id> or <file>.\n");
+	}
+
+	HA_SPIN_LOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
+	ver = pat_ref_prepare(appctx->ctx.map.ref);
+	HA_SPIN_UNLOCK(PATREF_LOCK, &appctx->ctx.map.ref->lock);
+
+	if (!ver)
+		return cli_err(appctx, "Out of memory error.\n");
+	return cli_dynmsg(appctx, LOG_INFO, memprintf(&msg, "New version created: %u\n", ver));
+}
+
+/* Publishes a version of a map or an ACL prepared with "prepare map" or
+ * "prepare acl". Lookups performed afterwards use the entries of this version.
+ */
+static int cli_parse_commit_map(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	unsigned int ver;
+	char *err = NULL;
+	int ret;
+
+	if (strcmp(args[1], "map") != 0 && strcmp(args[1], "acl") != 0)
+		return 1;
+
+	if (args[1][0] == 'm')
+		appctx->ctx.map.display_flags = PAT_REF_MAP;
+	else
+		appctx->ctx.map.display_flags = PAT_REF_ACL;
+
+	if (!*args[2] || !*args[3]) {
+		if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+			return cli_err(appctx, "'commit map' expects two parameters: version and map identifier.\n");
+		else
+			return cli_err(appctx, "'commit acl' expects two parameters: version and ACL identifier.\n");
+	}
+
+	if (!map_parse_ver(args[2], &ver))
+		return cli_err(appctx, "Malformed version. Please use @<ver>.\n");
+
+	appctx->ctx.map.ref = pat_ref_lookup_ref(args[3]);
+	if (!appctx->ctx.map.ref ||
+	    !(appctx->ctx.map.ref->flags & appctx->ctx.map.display_flags)) {
+		if (appctx->ctx.map.display_flags == PAT_REF_MAP)
+			return cli_err(appctx, "Unknown map identifier. Please use #<id> or <file>.\n");
+		else
+			return cli_err(appctx, "Unknown ACL identifier. Please use #<id> or <file>.\n");
+	}
+
+	ret = pat_ref_commit(appctx->ctx.map.ref, ver, &err);
+
+	if (!ret)
+		return cli_dynerr(appctx, memprintf(&err, "%s.\n", err));
+	appctx->st0 = CLI_ST_PROMPT;
+	return 1;
+}
+
 /* register cli keywords */
 
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "add",   "acl", NULL }, "add acl        : add acl entry", cli_parse_add_map, NULL },
 	{ { "clear", "acl", NULL }, "clear acl <id> : clear the content of this acl", cli_parse_clear_map, cli_io_handler_clear_map, NULL },
+	{ { "commit", "acl", NULL }, "commit acl     : publish a prepared version of an acl", cli_parse_commit_map, NULL },
 	{ { "del",   "acl", NULL }, "del acl        : delete acl entry", cli_parse_del_map, NULL },
 	{ { "get",   "acl", NULL }, "get acl        : report the patterns matching a sample for an ACL", cli_parse_get_map, cli_io_handler_map_lookup, cli_release_mlook },
+	{ { "prepare", "acl", NULL }, "prepare acl    : prepare a new version of an acl for an atomic update", cli_parse_prepare_map, NULL },
 	{ { "show",  "acl", NULL }, "show acl [id]  : report available acls or dump an acl's contents", cli_parse_show_map, NULL },
 	{ { "add",   "map", NULL }, "add map        : add map entry", cli_parse_add_map, NULL },
 	{ { "clear", "map", NULL }, "clear map <id> : clear the content of this map", cli_parse_clear_map, cli_io_handler_clear_map, NULL },
+	{ { "commit", "map", NULL }, "commit map     : publish a prepared version of a map", cli_parse_commit_map, NULL },
 	{ { "del",   "map", NULL }, "del map        : delete map entry", cli_parse_del_map, NULL },
 	{ { "get",   "map", NULL }, "get map        : report the keys and values matching a sample for a map", cli_parse_get_map, cli_io_handler_map_lookup, cli_release_mlook },
+	{ { "prepare", "map", NULL }, "prepare map    : prepare a new version of a map for an atomic update", cli_parse_prepare_map, NULL },
 	{ { "set",   "map", NULL }, "set map        : modify map entry", cli_parse_set_map, NULL },
 	{ { "show",  "map", NULL }, "show map [id]  : report available maps or dump a map's contents", cli_parse_show_map, NULL },
 	{ { NULL }, NULL, NULL, NULL }
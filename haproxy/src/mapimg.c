@@ -0,0 +1,259 @@
+/*
+ * Precompiled map and ACL file images.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Images are produced by contrib/mapc from regular map or ACL files and are
+ * mapped read-only, so that all processes share the same pages and loading
+ * does not cost anything but the validation of the image. See mapimg-t.h for
+ * the format.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <haproxy/api.h>
+#include <haproxy/mapimg.h>
+#include <haproxy/tools.h>
+
+
+/* Returns non-zero if the <count> elements of <size> bytes at offset <ofs>
+ * are 8-byte aligned and fit in an image of <total> bytes.
+ */
+static int mapimg_check_area(uint64_t ofs, uint64_t count, size_t size, uint64_t total)
+{
+	if (ofs & 7)
+		return 0;
+	if (ofs > total || count > (total - ofs) / size)
+		return 0;
+	return 1;
+}
+
+/* Makes trie <pt> use the <nb_nodes> nodes and <nb_leaves> leaves found in
+ * image <img>, and checks that lookups cannot escape them : children and
+ * leaves must be within the arrays, children must follow their parent, the
+ * depth must not exceed the address width, the first leaf slot of each node
+ * must start a leaf, and leaves must designate valid entries. Returns 0 if the
+ * trie is invalid.
+ */
+static int mapimg_init_trie(struct mapimg *img, struct poptrie *pt, unsigned int width,
+                            const struct poptrie_node *nodes, unsigned int nb_nodes,
+                            const unsigned int *leaves, unsigned int nb_leaves)
+{
+	unsigned char *depth;
+	unsigned int i, c, nbc, maxdepth;
+	uint64_t free_slots;
+	int ret = 0;
+
+	if (!nb_nodes)
+		return 0;
+
+	for (i = 0; i < nb_leaves; i++)
+		if (leaves[i] > img->nb_entries)
+			return 0;
+
+	depth = calloc(nb_nodes, 1);
+	if (!depth)
+		return 0;
+
+	/* the root node reads bits 0..5, the last node must start before <width> */
+	maxdepth = (width - 1) / POPTRIE_STRIDE;
+	for (i = 0; i < nb_nodes; i++) {
+		nbc = __builtin_popcountll(nodes[i].vector);
+		if (nodes[i].base1 > nb_nodes || nbc > nb_nodes - nodes[i].base1)
+			goto out;
+		if (nbc && nodes[i].base1 <= i)
+			goto out;
+		if (nbc && depth[i] >= maxdepth)
+			goto out;
+		for (c = 0; c < nbc; c++)
+			depth[nodes[i].base1 + c] = depth[i] + 1;
+
+		if (nodes[i].base0 > nb_leaves ||
+		    __builtin_popcountll(nodes[i].leafvec) > nb_leaves - nodes[i].base0)
+			goto out;
+		free_slots = ~nodes[i].vector;
+		if (free_slots && !(nodes[i].leafvec & free_slots & -free_slots))
+			goto out;
+	}
+
+	pt->width = width;
+	pt->compiled = 1;
+	pt->nodes = (struct poptrie_node *)nodes;
+	pt->nb_nodes = nb_nodes;
+	pt->leaves = (unsigned int *)leaves;
+	pt->nb_leaves = nb_leaves;
+	ret = 1;
+ out:
+	free(depth);
+	return ret;
+}
+
+/* Checks the header and the sections of image <img> of which only <area> and
+ * <size> are set, and sets up the other fields. Returns 0 if it is invalid.
+ */
+static int mapimg_init(struct mapimg *img)
+{
+	const struct mapimg_hdr *hdr = (const struct mapimg_hdr *)img->area;
+	unsigned int i;
+
+	if (img->size < sizeof(*hdr) || hdr->byteorder != MAPIMG_BYTEORDER || hdr->size != img->size)
+		return 0;
+
+	if (!mapimg_check_area(hdr->ent_ofs, hdr->nb_entries, sizeof(*img->ent), img->size) ||
+	    !mapimg_check_area(hdr->sorted_ofs, hdr->nb_entries, sizeof(*img->sorted), img->size) ||
+	    !mapimg_check_area(hdr->text_ofs, hdr->text_len, 1, img->size))
+		return 0;
+
+	img->flags = hdr->flags;
+	img->nb_entries = hdr->nb_entries;
+	img->ent = (const struct mapimg_ent *)(img->area + hdr->ent_ofs);
+	img->sorted = (const uint32_t *)(img->area + hdr->sorted_ofs);
+	img->text = img->area + hdr->text_ofs;
+
+	/* all strings must be terminated within the text area */
+	if (hdr->text_len && img->text[hdr->text_len - 1])
+		return 0;
+
+	for (i = 0; i < img->nb_entries; i++) {
+		if (img->ent[i].key >= hdr->text_len ||
+		    img->ent[i].key_len >= hdr->text_len - img->ent[i].key ||
+		    img->text[img->ent[i].key + img->ent[i].key_len] != 0)
+			return 0;
+		if ((img->ent[i].val != MAPIMG_NO_VAL) != !!(img->flags & MAPIMG_F_SMP))
+			return 0;
+		if (img->ent[i].val != MAPIMG_NO_VAL && img->ent[i].val >= hdr->text_len)
+			return 0;
+		if (img->sorted[i] >= img->nb_entries)
+			return 0;
+	}
+
+	if (!(img->flags & MAPIMG_F_IP))
+		return 1;
+
+	if (!mapimg_check_area(hdr->v4_nodes_ofs, hdr->nb_v4_nodes, sizeof(struct poptrie_node), img->size) ||
+	    !mapimg_check_area(hdr->v4_leaves_ofs, hdr->nb_v4_leaves, sizeof(unsigned int), img->size) ||
+	    !mapimg_check_area(hdr->v6_nodes_ofs, hdr->nb_v6_nodes, sizeof(struct poptrie_node), img->size) ||
+	    !mapimg_check_area(hdr->v6_leaves_ofs, hdr->nb_v6_leaves, sizeof(unsigned int), img->size))
+		return 0;
+
+	if (!mapimg_init_trie(img, &img->v4, 32,
+	                      (const struct poptrie_node *)(img->area + hdr->v4_nodes_ofs), hdr->nb_v4_nodes,
+	                      (const unsigned int *)(img->area + hdr->v4_leaves_ofs), hdr->nb_v4_leaves) ||
+	    !mapimg_init_trie(img, &img->v6, 128,
+	                      (const struct poptrie_node *)(img->area + hdr->v6_nodes_ofs), hdr->nb_v6_nodes,
+	                      (const unsigned int *)(img->area + hdr->v6_leaves_ofs), hdr->nb_v6_leaves))
+		return 0;
+
+	return 1;
+}
+
+/* Maps the image found in file <path> into <*img>. Returns 1 on success, 0 if
+ * the file is not an image (it does not start with MAPIMG_MAGIC) in which case
+ * it must be parsed as a regular text file, or -1 on error with <err> filled.
+ * The file must not be modified while it is mapped, images must be replaced by
+ * renaming a new file over them.
+ */
+int mapimg_open(const char *path, struct mapimg **img, char **err)
+{
+	char magic[sizeof(((struct mapimg_hdr *)0)->magic)];
+	struct stat st;
+	void *area;
+	int fd, ret;
+
+	*img = NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		memprintf(err, "failed to open pattern file <%s>", path);
+		return -1;
+	}
+
+	ret = read(fd, magic, sizeof(magic));
+	if (ret != sizeof(magic) || memcmp(magic, MAPIMG_MAGIC, sizeof(magic)) != 0) {
+		close(fd);
+		return 0;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		memprintf(err, "failed to stat pattern image <%s> : %s", path, strerror(errno));
+		goto fail_close;
+	}
+
+	area = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		memprintf(err, "failed to map pattern image <%s> : %s", path, strerror(errno));
+		goto fail_close;
+	}
+	close(fd);
+
+	*img = calloc(1, sizeof(**img));
+	if (!*img) {
+		memprintf(err, "out of memory");
+		munmap(area, st.st_size);
+		return -1;
+	}
+	(*img)->area = area;
+	(*img)->size = st.st_size;
+
+	if (!mapimg_init(*img)) {
+		memprintf(err, "pattern image <%s> is corrupted or was built on another architecture", path);
+		mapimg_close(*img);
+		*img = NULL;
+		return -1;
+	}
+	return 1;
+
+ fail_close:
+	close(fd);
+	return -1;
+}
+
+/* Unmaps and releases image <img>. NULL is supported. */
+void mapimg_close(struct mapimg *img)
+{
+	if (!img)
+		return;
+	munmap((void *)img->area, img->size);
+	free(img);
+}
+
+/* Looks up key <key> of length <len> in image <img>. Returns the index of the
+ * first entry in file order holding this key, or -1 if none does.
+ */
+int mapimg_find(const struct mapimg *img, const char *key, size_t len)
+{
+	const struct mapimg_ent *ent;
+	unsigned int lo = 0, hi = img->nb_entries, mid;
+
+	/* find the first sorted entry not lower than the key */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		ent = &img->ent[img->sorted[mid]];
+		if (mapimg_cmp(img->text + ent->key, ent->key_len, key, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == img->nb_entries)
+		return -1;
+	ent = &img->ent[img->sorted[lo]];
+	if (mapimg_cmp(img->text + ent->key, ent->key_len, key, len) != 0)
+		return -1;
+	return img->sorted[lo];
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
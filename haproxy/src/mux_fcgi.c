@@ -771,11 +771,14 @@ static int fcgi_init(struct connection *conn, struct proxy *px, struct session *
 	/* FIXME: this is temporary, for outgoing connections we need to
 	 * immediately allocate a stream until the code is modified so that the
 	 * caller calls ->attach(). For now the outgoing cs is stored as
-	 * conn->ctx by the caller and saved in conn_ctx.
+	 * conn->ctx by the caller and saved in conn_ctx. Connections
+	 * established in advance have none.
 	 */
-	fstrm = fcgi_conn_stream_new(fconn, conn_ctx, sess);
-	if (!fstrm)
-		goto fail;
+	if (conn_ctx) {
+		fstrm = fcgi_conn_stream_new(fconn, conn_ctx, sess);
+		if (!fstrm)
+			goto fail;
+	}
 
 
 	/* Repare to read something */
@@ -2970,7 +2973,7 @@ struct task *fcgi_io_cb(struct task *t, void *ctx, unsigned short status)
 
 	conn_in_list = conn->flags & CO_FL_LIST_MASK;
 	if (conn_in_list)
-		MT_LIST_DEL(&conn->list);
+		conn_delete_from_tree(conn);
 
 	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 
@@ -2989,10 +2992,12 @@ struct task *fcgi_io_cb(struct task *t, void *ctx, unsigned short status)
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
 
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 		if (conn_in_list == CO_FL_SAFE_LIST)
-			MT_LIST_ADDQ(&srv->safe_conns[tid], &conn->list);
+			eb64_insert(&srv->safe_conns_tree[tid], &conn->hash_node);
 		else
-			MT_LIST_ADDQ(&srv->idle_conns[tid], &conn->list);
+			eb64_insert(&srv->idle_conns_tree[tid], &conn->hash_node);
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
 	return NULL;
 }
@@ -3140,7 +3145,7 @@ static struct task *fcgi_timeout_task(struct task *t, void *context, unsigned sh
 		 * to steal it from us.
 		 */
 		if (fconn->conn->flags & CO_FL_LIST_MASK)
-			MT_LIST_DEL(&fconn->conn->list);
+			conn_delete_from_tree(fconn->conn);
 
 		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
@@ -3598,9 +3603,8 @@ static void fcgi_detach(struct conn_stream *cs)
 				}
 			}
 
-			/* Be sure to remove the connection from the available_conns list */
-			if (!MT_LIST_ISEMPTY(&fconn->conn->list))
-				MT_LIST_DEL(&fconn->conn->list);
+			/* Be sure to remove the connection from the available_conns tree */
+			eb64_delete(&fconn->conn->hash_node);
 		}
 		else {
 			if (eb_is_empty(&fconn->streams_by_id)) {
@@ -3617,9 +3621,9 @@ static void fcgi_detach(struct conn_stream *cs)
 				TRACE_DEVEL("reusable idle connection", FCGI_EV_STRM_END, fconn->conn);
 				return;
 			}
-			else if (MT_LIST_ISEMPTY(&fconn->conn->list) &&
+			else if (!fconn->conn->hash_node.node.leaf_p &&
 				 fcgi_avail_streams(fconn->conn) > 0 && objt_server(fconn->conn->target)) {
-				LIST_ADD(&__objt_server(fconn->conn->target)->available_conns[tid], mt_list_to_list(&fconn->conn->list));
+				eb64_insert(&__objt_server(fconn->conn->target)->available_conns_tree[tid], &fconn->conn->hash_node);
 			}
 		}
 	}
@@ -85,6 +85,7 @@ struct h1c {
 
 	struct buffer ibuf;              /* Input buffer to store data before parsing */
 	struct buffer obuf;              /* Output buffer to store data after reformatting */
+	struct buffer zbuf;              /* Message data sent in place after obuf */
 
 	struct buffer_wait buf_wait;     /* Wait list for buffer allocation */
 	struct wait_event wait_event;    /* To be used if we're waiting for I/Os */
@@ -127,6 +128,9 @@ struct h1_hdr_entry  {
 /* Declare the headers map */
 static struct h1_hdrs_map hdrs_map = { .name = NULL, .map  = EB_ROOT };
 
+/* 0 = message data always copied into the output buffer */
+static int h1_scatter_gather = 1;
+
 
 /* trace source and events */
 static void h1_trace(enum trace_level level, uint64_t mask,
@@ -319,10 +323,15 @@ static void h1_trace(enum trace_level level, uint64_t mask, const struct trace_s
 				      (unsigned int)b_data(&h1c->ibuf), b_orig(&h1c->ibuf),
 				      (unsigned int)b_head_ofs(&h1c->ibuf), (unsigned int)b_size(&h1c->ibuf));
 		if (src->verbosity == H1_VERB_COMPLETE ||
-		    (src->verbosity == H1_VERB_ADVANCED && (mask & (H1_EV_H1C_SEND|H1_EV_STRM_SEND))))
+		    (src->verbosity == H1_VERB_ADVANCED && (mask & (H1_EV_H1C_SEND|H1_EV_STRM_SEND)))) {
 			chunk_appendf(&trace_buf, " obuf=%u@%p+%u/%u",
 				      (unsigned int)b_data(&h1c->obuf), b_orig(&h1c->obuf),
 				      (unsigned int)b_head_ofs(&h1c->obuf), (unsigned int)b_size(&h1c->obuf));
+			if (b_data(&h1c->zbuf))
+				chunk_appendf(&trace_buf, " zbuf=%u@%p+%u/%u",
+					      (unsigned int)b_data(&h1c->zbuf), b_orig(&h1c->zbuf),
+					      (unsigned int)b_head_ofs(&h1c->zbuf), (unsigned int)b_size(&h1c->zbuf));
+		}
 	}
 
 	/* Display htx info if defined (level > USER) */
@@ -433,6 +442,12 @@ static inline void h1_release_buf(struct h1c *h1c, struct buffer *bptr)
 	}
 }
 
+/* Returns the number of bytes waiting to be sent on <h1c> */
+static inline size_t h1c_out_data(const struct h1c *h1c)
+{
+	return b_data(&h1c->obuf) + b_data(&h1c->zbuf);
+}
+
 /* returns the number of streams in use on a connection to figure if it's idle
  * or not. We rely on H1C_F_CS_IDLE to know if the connection is in-use or
  * not. This flag is only set when no H1S is attached and when the previous
@@ -464,7 +479,7 @@ static void h1_refresh_timeout(struct h1c *h1c)
 			h1c->task->expire = tick_add(now_ms, h1c->shut_timeout);
 			task_queue(h1c->task);
 			TRACE_DEVEL("refreshing connection's timeout (half-closed)", H1_EV_H1C_SEND, h1c->conn);
-		} else if (b_data(&h1c->obuf)) {
+		} else if (h1c_out_data(h1c)) {
 			/* any connection with pending data, need a timeout (server or client).
 			 */
 			h1c->task->expire = tick_add(now_ms, ((h1c->flags & H1C_F_CS_SHUTW_NOW)
@@ -690,6 +705,7 @@ static int h1_init(struct connection *conn, struct proxy *proxy, struct session
 	h1c->flags = H1C_F_CS_IDLE;
 	h1c->ibuf  = *input;
 	h1c->obuf  = BUF_NULL;
+	h1c->zbuf  = BUF_NULL;
 	h1c->h1s   = NULL;
 	h1c->task  = NULL;
 
@@ -723,8 +739,10 @@ static int h1_init(struct connection *conn, struct proxy *proxy, struct session
 
 	conn->ctx = h1c;
 
-	/* Always Create a new H1S */
-	if (!h1s_create(h1c, conn_ctx, sess))
+	/* Always Create a new H1S, except for outgoing connections established
+	 * in advance without a stream (see pool-warm-conn), which start idle.
+	 */
+	if ((conn_ctx || !conn_is_back(conn)) && !h1s_create(h1c, conn_ctx, sess))
 		goto fail;
 
 	if (t)
@@ -786,6 +804,7 @@ static void h1_release(struct h1c *h1c)
 
 		h1_release_buf(h1c, &h1c->ibuf);
 		h1_release_buf(h1c, &h1c->obuf);
+		h1_release_buf(h1c, &h1c->zbuf);
 
 		if (h1c->task) {
 			h1c->task->context = NULL;
@@ -1145,6 +1164,36 @@ static void h1_emit_chunk_crlf(struct buffer *buf)
 	b_add(buf, 2);
 }
 
+/* Returns non-zero if the DATA block <blk> of the HTX message <htx> stored in
+ * <buf> may be left where it is and sent after the output buffer of <h1c>,
+ * the whole buffer being handed over to the mux. This requires the transport
+ * layer to support scattered sends, and the block to be the last one of the
+ * message, or only to be followed by the EOM block, so that no more than
+ * <count> bytes empty the message. For chunked messages, the chunk envelope and
+ * the last chunk are written around the block's payload, there is always
+ * enough room before it but this must be checked after it. Small blocks are not
+ * worth it and are copied.
+ */
+static int h1_data_in_place(const struct h1c *h1c, const struct h1m *h1m, const struct buffer *buf,
+			    const struct htx *htx, const struct htx_blk *blk, size_t count)
+{
+	const struct htx_blk *next;
+	uint32_t sz = htx_get_blksz(blk);
+
+	if (!h1_scatter_gather || !h1c->conn->xprt->snd_iov || sz <= b_size(buf) / 16 || sz > count)
+		return 0;
+
+	next = htx_get_next_blk(htx, blk);
+	if (next && (htx_get_blk_type(next) != HTX_BLK_EOM || htx_get_next_blk(htx, next) ||
+		     sz + htx_get_blksz(next) > count))
+		return 0;
+
+	/* CRLF + "0\r\n\r\n" */
+	if ((h1m->flags & H1_MF_CHNK) && sizeof(struct htx) + blk->addr + sz + 7 > b_size(buf))
+		return 0;
+	return 1;
+}
+
 /*
  * Switch the request to tunnel mode. This function must only be called for
  * CONNECT requests. On the client side, if the response is not finished, the
@@ -1583,7 +1632,8 @@ static size_t h1_process_output(struct h1c *h1c, struct buffer *buf, size_t coun
 	struct htx_blk *blk;
 	struct buffer tmp;
 	size_t total = 0;
-	int errflag;
+	uint32_t zaddr = 0, zlen = 0;
+	int errflag, zeom = 0;
 
 	if (!count)
 		goto end;
@@ -1594,6 +1644,13 @@ static size_t h1_process_output(struct h1c *h1c, struct buffer *buf, size_t coun
 	if (htx_is_empty(chn_htx))
 		goto end;
 
+	/* data left in place must be sent before anything else */
+	if (b_data(&h1c->zbuf)) {
+		h1c->flags |= H1C_F_OUT_FULL;
+		TRACE_STATE("h1c zbuf not sent yet", H1_EV_TX_DATA|H1_EV_H1S_BLK, h1c->conn, h1s);
+		goto end;
+	}
+
 	if (!h1_get_buf(h1c, &h1c->obuf)) {
 		h1c->flags |= H1C_F_OUT_ALLOC;
 		TRACE_STATE("waiting for h1c obuf allocation", H1_EV_TX_DATA|H1_EV_H1S_BLK, h1c->conn, h1s);
@@ -1865,7 +1922,9 @@ static size_t h1_process_output(struct h1c *h1c, struct buffer *buf, size_t coun
 				if (type == HTX_BLK_EOM) {
 					/* Chunked message without explicit trailers */
 					if (h1m->flags & H1_MF_CHNK) {
-						if (!chunk_memcat(&tmp, "0\r\n\r\n", 5))
+						if (zlen)
+							zeom = 1; /* emitted after the data left in place */
+						else if (!chunk_memcat(&tmp, "0\r\n\r\n", 5))
 							goto full;
 					}
 					goto done;
@@ -1889,6 +1948,21 @@ static size_t h1_process_output(struct h1c *h1c, struct buffer *buf, size_t coun
 					vlen = count;
 				}
 
+				/* The last block of a message is copied once the
+				 * headers or the previous data were emitted, so the
+				 * output buffer is rarely empty at this point. Instead,
+				 * its payload may be left in place to be sent with a
+				 * scattered write after the output buffer, the caller
+				 * getting an empty buffer in exchange of its own.
+				 */
+				if (h1_data_in_place(h1c, h1m, buf, chn_htx, blk, count) &&
+				    b_alloc_margin(&h1c->zbuf, 0)) {
+					zaddr = blk->addr;
+					zlen = sz;
+					TRACE_PROTO("sending message data (in place)", H1_EV_TX_DATA|H1_EV_TX_BODY, h1c->conn, h1s, chn_htx, (size_t[]){sz});
+					break;
+				}
+
 				chklen = 0;
 				if (h1m->flags & H1_MF_CHNK) {
 					chklen = b_room(&tmp);
@@ -2004,6 +2078,24 @@ static size_t h1_process_output(struct h1c *h1c, struct buffer *buf, size_t coun
 	else
 		b_putblk(&h1c->obuf, tmp.area, tmp.data);
 
+	if (zlen) {
+		/* the message is now empty, its buffer only carries the data
+		 * left in place, and is exchanged with zbuf's empty one.
+		 */
+		struct buffer area = h1c->zbuf;
+
+		h1c->zbuf = b_make(buf->area, buf->size, sizeof(struct htx) + zaddr, zlen);
+		*buf = b_make(area.area, area.size, 0, 0);
+		chn_htx = htxbuf(buf);
+
+		if (h1m->flags & H1_MF_CHNK) {
+			h1_emit_chunk_size(&h1c->zbuf, zlen);
+			h1_emit_chunk_crlf(&h1c->zbuf);
+			if (zeom)
+				b_putblk(&h1c->zbuf, "0\r\n\r\n", 5);
+		}
+	}
+
 	htx_to_buf(chn_htx, buf);
   out:
 	/* Both the request and the response reached the DONE state. So set EOI
@@ -2157,6 +2249,31 @@ static int h1_recv(struct h1c *h1c)
 }
 
 
+/* Sends the output buffer of <h1c> followed by the data left in place in its
+ * zbuf, using a single scattered send. Returns the number of bytes sent.
+ */
+static size_t h1_snd_iov(struct h1c *h1c, unsigned int flags)
+{
+	struct connection *conn = h1c->conn;
+	struct iovec iov[3];
+	size_t len;
+	int n = 0;
+
+	len = b_contig_data(&h1c->obuf, 0);
+	if (len) {
+		iov[n].iov_base = b_head(&h1c->obuf);
+		iov[n++].iov_len = len;
+		if (len < b_data(&h1c->obuf)) {
+			iov[n].iov_base = b_orig(&h1c->obuf);
+			iov[n++].iov_len = b_data(&h1c->obuf) - len;
+		}
+	}
+	iov[n].iov_base = b_head(&h1c->zbuf);
+	iov[n++].iov_len = b_data(&h1c->zbuf);
+
+	return conn->xprt->snd_iov(conn, conn->xprt_ctx, iov, n, flags);
+}
+
 /*
  * Try to send data if possible
  */
@@ -2174,7 +2291,7 @@ static int h1_send(struct h1c *h1c)
 		return 0;
 	}
 
-	if (!b_data(&h1c->obuf))
+	if (!h1c_out_data(h1c))
 		goto end;
 
 	if (h1c->flags & H1C_F_CO_MSG_MORE)
@@ -2182,14 +2299,20 @@ static int h1_send(struct h1c *h1c)
 	if (h1c->flags & H1C_F_CO_STREAMER)
 		flags |= CO_SFL_STREAMER;
 
-	ret = conn->xprt->snd_buf(conn, conn->xprt_ctx, &h1c->obuf, b_data(&h1c->obuf), flags);
+	if (b_data(&h1c->zbuf))
+		ret = h1_snd_iov(h1c, flags);
+	else
+		ret = conn->xprt->snd_buf(conn, conn->xprt_ctx, &h1c->obuf, b_data(&h1c->obuf), flags);
 	if (ret > 0) {
+		size_t len = MIN(ret, b_data(&h1c->obuf));
+
 		TRACE_DATA("data sent", H1_EV_H1C_SEND, h1c->conn,,, (size_t[]){ret});
 		if (h1c->flags & H1C_F_OUT_FULL) {
 			h1c->flags &= ~H1C_F_OUT_FULL;
 			TRACE_STATE("h1c obuf not full anymore", H1_EV_STRM_SEND|H1_EV_H1S_BLK, h1c->conn);
 		}
-		b_del(&h1c->obuf, ret);
+		b_del(&h1c->obuf, len);
+		b_del(&h1c->zbuf, ret - len);
 		sent = 1;
 	}
 
@@ -2197,14 +2320,18 @@ static int h1_send(struct h1c *h1c)
 		TRACE_DEVEL("connection error or output closed", H1_EV_H1C_SEND, h1c->conn);
 		/* error or output closed, nothing to send, clear the buffer to release it */
 		b_reset(&h1c->obuf);
+		b_reset(&h1c->zbuf);
 	}
 
   end:
 	if (!(h1c->flags & H1C_F_OUT_FULL))
 		h1_wake_stream_for_send(h1c->h1s);
 
+	if (!b_data(&h1c->zbuf))
+		h1_release_buf(h1c, &h1c->zbuf);
+
 	/* We're done, no more to send */
-	if (!b_data(&h1c->obuf)) {
+	if (!h1c_out_data(h1c)) {
 		TRACE_DEVEL("leaving with everything sent", H1_EV_H1C_SEND, h1c->conn);
 		h1_release_buf(h1c, &h1c->obuf);
 		if (h1c->flags & H1C_F_CS_SHUTW_NOW) {
@@ -2308,7 +2435,7 @@ struct task *h1_io_cb(struct task *t, void *ctx, unsigned short status)
 	 */
 	conn_in_list = conn->flags & CO_FL_LIST_MASK;
 	if (conn_in_list)
-		MT_LIST_DEL(&conn->list);
+		conn_delete_from_tree(conn);
 
 	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 
@@ -2326,10 +2453,12 @@ struct task *h1_io_cb(struct task *t, void *ctx, unsigned short status)
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
 
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 		if (conn_in_list == CO_FL_SAFE_LIST)
-			MT_LIST_ADDQ(&srv->safe_conns[tid], &conn->list);
+			eb64_insert(&srv->safe_conns_tree[tid], &conn->hash_node);
 		else
-			MT_LIST_ADDQ(&srv->idle_conns[tid], &conn->list);
+			eb64_insert(&srv->idle_conns_tree[tid], &conn->hash_node);
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
 	return NULL;
 }
@@ -2386,7 +2515,7 @@ static struct task *h1_timeout_task(struct task *t, void *context, unsigned shor
 		if (!t->context)
 			h1c = NULL;
 		else if (h1c->conn->flags & CO_FL_LIST_MASK)
-			MT_LIST_DEL(&h1c->conn->list);
+			conn_delete_from_tree(h1c->conn);
 
 		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
@@ -2554,7 +2683,7 @@ static void h1_detach(struct conn_stream *cs)
 	/* We don't want to close right now unless the connection is in error or shut down for writes */
 	if ((h1c->flags & (H1C_F_CS_ERROR|H1C_F_CS_SHUTDOWN|H1C_F_UPG_H2C)) ||
 	    (h1c->conn->flags & (CO_FL_ERROR|CO_FL_SOCK_WR_SH)) ||
-	    ((h1c->flags & H1C_F_CS_SHUTW_NOW) && !b_data(&h1c->obuf)) ||
+	    ((h1c->flags & H1C_F_CS_SHUTW_NOW) && !h1c_out_data(h1c)) ||
 	    !h1c->conn->owner) {
 		TRACE_DEVEL("killing dead connection", H1_EV_STRM_END, h1c->conn);
 		h1_release(h1c);
@@ -2638,7 +2767,7 @@ static void h1_shutw(struct conn_stream *cs, enum cs_shw_mode mode)
 
   do_shutw:
 	h1c->flags |= H1C_F_CS_SHUTW_NOW;
-	if ((cs->flags & CS_FL_SHW) || b_data(&h1c->obuf))
+	if ((cs->flags & CS_FL_SHW) || h1c_out_data(h1c))
 		goto end;
 	h1_shutw_conn(cs->conn, mode);
   end:
@@ -2898,7 +3027,7 @@ static int h1_snd_pipe(struct conn_stream *cs, struct pipe *pipe)
 
 	TRACE_ENTER(H1_EV_STRM_SEND, cs->conn, h1s,, (size_t[]){pipe->data});
 
-	if (b_data(&h1s->h1c->obuf))
+	if (h1c_out_data(h1s->h1c))
 		goto end;
 
 	ret = cs->conn->xprt->snd_pipe(cs->conn, cs->conn->xprt_ctx, pipe);
@@ -2935,12 +3064,14 @@ static int h1_show_fd(struct buffer *msg, struct connection *conn)
 	struct h1s *h1s = h1c->h1s;
 	int ret = 0;
 
-	chunk_appendf(msg, " h1c.flg=0x%x .sub=%d .ibuf=%u@%p+%u/%u .obuf=%u@%p+%u/%u",
+	chunk_appendf(msg, " h1c.flg=0x%x .sub=%d .ibuf=%u@%p+%u/%u .obuf=%u@%p+%u/%u .zbuf=%u@%p+%u/%u",
 		      h1c->flags,  h1c->wait_event.events,
 		      (unsigned int)b_data(&h1c->ibuf), b_orig(&h1c->ibuf),
 		      (unsigned int)b_head_ofs(&h1c->ibuf), (unsigned int)b_size(&h1c->ibuf),
 		       (unsigned int)b_data(&h1c->obuf), b_orig(&h1c->obuf),
-		      (unsigned int)b_head_ofs(&h1c->obuf), (unsigned int)b_size(&h1c->obuf));
+		      (unsigned int)b_head_ofs(&h1c->obuf), (unsigned int)b_size(&h1c->obuf),
+		      (unsigned int)b_data(&h1c->zbuf), b_orig(&h1c->zbuf),
+		      (unsigned int)b_head_ofs(&h1c->zbuf), (unsigned int)b_size(&h1c->zbuf));
 
 	if (h1s) {
 		char *method;
@@ -3210,11 +3341,31 @@ static int cfg_parse_h1_headers_case_adjust_file(char **args, int section_type,
         return 0;
 }
 
+/* config parser for global "tune.h1.scatter-gather" */
+static int cfg_parse_h1_scatter_gather(char **args, int section_type, struct proxy *curpx,
+				       struct proxy *defpx, const char *file, int line,
+				       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		h1_scatter_gather = 1;
+	else if (strcmp(args[1], "off") == 0)
+		h1_scatter_gather = 0;
+	else {
+		memprintf(err, "'%s' expects 'on' or 'off'.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {{ }, {
 		{ CFG_GLOBAL, "h1-case-adjust", cfg_parse_h1_header_case_adjust },
 		{ CFG_GLOBAL, "h1-case-adjust-file", cfg_parse_h1_headers_case_adjust_file },
+		{ CFG_GLOBAL, "tune.h1.scatter-gather", cfg_parse_h1_scatter_gather },
 		{ 0, NULL, NULL },
 	}
 };
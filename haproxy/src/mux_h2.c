@@ -110,7 +110,7 @@ struct h2c {
 	int8_t  dft; /* demux frame type   (if dsi >= 0) */
 	int8_t  dff; /* demux frame flags  (if dsi >= 0) */
 	uint8_t dpl; /* demux pad length (part of dfl), init to 0 */
-	/* 8 bit hole here */
+	uint8_t dpw; /* demux priority weight minus one, from the last HEADERS frame */
 	int32_t last_sid; /* last processed stream ID for GOAWAY, <0 before preface */
 
 	/* states for the mux direction */
@@ -123,6 +123,12 @@ struct h2c {
 	int32_t miw; /* mux initial window size for all new streams */
 	int32_t mws; /* mux window size. Can be negative. */
 	int32_t mfs; /* mux's max frame size */
+	uint32_t mhts; /* peer's max header table size */
+	uint32_t mzc;  /* mbuf ring indexes holding zero-copy DATA payloads, as 1<<idx */
+	struct hpack_edt *edt; /* mux encoder's dynamic table, allocated on first use */
+	uint64_t vclock; /* scheduler's virtual time: tag of the last stream served */
+	unsigned int sched_ahead; /* number of streams queued ahead of other ones */
+	unsigned int sched_defer; /* number of DATA frames deferred to leave room to others */
 
 	int timeout;        /* idle timeout duration in ticks */
 	int shut_timeout;   /* idle timeout duration in ticks after GOAWAY was sent */
@@ -140,6 +146,21 @@ struct h2c {
 	struct wait_event wait_event;  /* To be used if we're waiting for I/Os */
 };
 
+/* Descriptor of a mux buffer holding the payload of DATA frames taken as-is
+ * from an HTX DATA block (see h2s_frt_make_resp_data()). It is stored at the
+ * beginning of the buffer's area, in place of the HTX header which is not used
+ * anymore, and the buffer's index is set in h2c->mzc. The buffer only contains
+ * the payload, the headers of the frames are built when sending, and all
+ * frames but the last one are <mfs> bytes long.
+ */
+struct h2_zcd {
+	uint32_t sid;    /* stream ID of the frames */
+	uint32_t mfs;    /* max frame size when the buffer was filled */
+	uint32_t fleft;  /* payload bytes left to send in the current frame */
+	uint8_t  hsent;  /* bytes of the current frame's header already sent */
+	uint8_t  flags;  /* flags of the last frame */
+};
+
 /* H2 stream state, in h2s->st */
 enum h2_ss {
 	H2_SS_IDLE = 0, // idle
@@ -180,7 +201,10 @@ enum h2_ss {
 
 /* stream flags indicating how data is supposed to be sent */
 #define H2_SF_DATA_CLEN         0x00000100 // data sent using content-length
-/* unused flags: 0x00000200, 0x00000400 */
+
+/* stream flags indicating how the stream is scheduled */
+#define H2_SF_PRIO_HDR          0x00000200 // priorities set by a "priority" header (RFC9218)
+#define H2_SF_PRIO_SEQ          0x00000400 // not incremental: sent in full before lower tags (RFC9218)
 
 #define H2_SF_NOTIFIED          0x00000800  // a paused stream was notified to try to send again
 #define H2_SF_HEADERS_SENT      0x00001000  // a HEADERS frame was sent for this stream
@@ -211,6 +235,9 @@ struct h2s {
 	struct buffer rxbuf; /* receive buffer, always valid (buf_empty or real buffer) */
 	struct wait_event *subs;      /* recv wait_event the conn_stream associated is waiting on (via h2_subscribe) */
 	struct list list; /* To be used when adding in h2c->send_list or h2c->fctl_lsit */
+	uint64_t vtag;       /* virtual time of the next DATA frame, for the scheduler */
+	uint16_t weight;     /* 1 to 256, from RFC7540 priorities, default 16 */
+	uint8_t urgency;     /* 0 (highest) to 7, from RFC9218 priorities, default 3 */
 	struct tasklet *shut_tl;  /* deferred shutdown tasklet, to retry to send an RST after we failed to,
 				   * in case there's no other subscription to do it */
 };
@@ -400,6 +427,22 @@ static int h2_settings_header_table_size      =  4096; /* initial value */
 static int h2_settings_initial_window_size    = 65535; /* initial value */
 static unsigned int h2_settings_max_concurrent_streams = 100;
 static int h2_settings_max_frame_size         = 0;     /* unset */
+static int h2_settings_encoder_table_size     =  4096; /* 0 = disabled */
+static int h2_sched_weighted                  = 0;     /* 0 = FIFO */
+static int h2_scatter_gather                  = 1;     /* 0 = no zero-copy DATA buffers */
+
+/* Number of mux buffers a stream may fill with DATA frames. Past this, it
+ * waits for the buffers to be sent and for the scheduler to elect it again,
+ * so that a stream which appears later does not have to wait for a deep
+ * queue of another one's data.
+ */
+#define H2_SCHED_MBUF 2
+
+/* Maximum number of vectors passed at once to the transport layer's snd_iov() */
+#define H2_SND_IOV 64
+
+/* pool of encoder's dynamic tables, NULL if disabled */
+static struct pool_head *pool_head_hpack_edt = NULL;
 
 /* a dmumy closed stream */
 static const struct h2s *h2_closed_stream = &(const struct h2s){
@@ -721,10 +764,160 @@ static inline void h2_release_mbuf(struct h2c *h2c)
 		b_free(buf);
 		count++;
 	}
+	h2c->mzc = 0;
 	if (count)
 		offer_buffers(NULL, tasks_run_queue);
 }
 
+/* Queues stream <h2s> into <list>, which is the send_list or the fctl_list of
+ * <h2c>. With the weighted scheduler, streams are sorted by urgency then by
+ * virtual time, so that the most urgent ones are woken first when there is
+ * room again, and streams of the same urgency share the bandwidth according
+ * to their weight (see h2s_sched_charge()). Equal streams remain in FIFO
+ * order. Streams are mostly queued in order, so the list is walked from its
+ * tail.
+ */
+static void h2s_sched_queue(struct h2c *h2c, struct list *list, struct h2s *h2s)
+{
+	struct h2s *prev;
+
+	if (!h2_sched_weighted) {
+		LIST_ADDQ(list, &h2s->list);
+		return;
+	}
+
+	list_for_each_entry_rev(prev, list, list) {
+		if (prev->urgency < h2s->urgency ||
+		    (prev->urgency == h2s->urgency && prev->vtag <= h2s->vtag))
+			break;
+	}
+
+	if (&prev->list != list->p)
+		h2c->sched_ahead++;
+	LIST_ADD(&prev->list, &h2s->list);
+}
+
+/* Charges stream <h2s> of <h2c> for <bytes> of DATA it is sending. This is a
+ * start-time fair queuing: the stream's tag starts at the connection's
+ * virtual time if it lags behind, so that idle streams do not accumulate
+ * credit, and advances inversely to its weight. Non-incremental streams keep
+ * their tag so that they are sent in full in their arrival order.
+ */
+static inline void h2s_sched_charge(struct h2c *h2c, struct h2s *h2s, int bytes)
+{
+	if (h2s->vtag < h2c->vclock)
+		h2s->vtag = h2c->vclock;
+	h2c->vclock = h2s->vtag;
+	if (!(h2s->flags & H2_SF_PRIO_SEQ))
+		h2s->vtag += (uint64_t)bytes * 256 / h2s->weight;
+}
+
+/* Returns non-zero if streams of <h2c> must stop emitting DATA frames to leave
+ * the mux buffers to the streams the scheduler will elect next.
+ */
+static inline int h2s_sched_defer(const struct h2c *h2c)
+{
+	return h2_sched_weighted && br_count(h2c->mbuf) > H2_SCHED_MBUF;
+}
+
+/* Applies to stream <h2s> the RFC9218 priority parameters found in header
+ * value <v>, which may come from the request or override them from the
+ * response. Unknown or invalid members are ignored (RFC9218#4).
+ */
+static void h2s_parse_priority(struct h2s *h2s, const struct ist v)
+{
+	const char *p = v.ptr, *end = v.ptr + v.len;
+	const char *m;
+	int len;
+
+	while (p < end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == ','))
+			p++;
+		for (m = p; p < end && *p != ','; p++)
+			;
+		for (len = p - m; len && (m[len - 1] == ' ' || m[len - 1] == '\t'); len--)
+			;
+
+		if (len == 3 && m[0] == 'u' && m[1] == '=' && m[2] >= '0' && m[2] <= '7')
+			h2s->urgency = m[2] - '0';
+		else if ((len == 1 && m[0] == 'i') ||
+		         (len == 4 && memcmp(m, "i=?1", 4) == 0))
+			h2s->flags &= ~H2_SF_PRIO_SEQ;
+		else if (len == 4 && memcmp(m, "i=?0", 4) == 0)
+			h2s->flags |= H2_SF_PRIO_SEQ;
+	}
+}
+
+/* Starts a header block in <out> for connection <h2c>. Its encoder's dynamic
+ * table is allocated the first time, and if this fails, header fields are
+ * encoded without it. Returns non-zero on success, 0 if <out> is full.
+ */
+static inline int h2c_hdr_begin(struct h2c *h2c, struct buffer *out)
+{
+	if (unlikely(!h2c->edt) && pool_head_hpack_edt) {
+		h2c->edt = pool_alloc(pool_head_hpack_edt);
+		if (h2c->edt)
+			hpack_edt_init(h2c->edt, h2_settings_encoder_table_size, h2c->mhts);
+	}
+	return !h2c->edt || hpack_edt_begin(h2c->edt, out);
+}
+
+/* Validates the header block started by h2c_hdr_begin(), once it is committed
+ * into the mux buffer.
+ */
+static inline void h2c_hdr_commit(struct h2c *h2c)
+{
+	if (h2c->edt)
+		hpack_edt_commit(h2c->edt);
+}
+
+/* Encodes header field <n>:<v> into <out> for connection <h2c>. Returns
+ * non-zero on success, 0 if <out> is full.
+ */
+static inline int h2c_encode_header(struct h2c *h2c, struct buffer *out, const struct ist n, const struct ist v)
+{
+	if (h2c->edt)
+		return hpack_encode_header_edt(h2c->edt, out, n, v);
+	return hpack_encode_header(out, n, v);
+}
+
+/* Same as above for the :status pseudo-header. Note that the stateless
+ * encoders may not be used with a dynamic table since they index some fields.
+ */
+static inline int h2c_encode_status(struct h2c *h2c, struct buffer *out, unsigned int status)
+{
+	char str[12];
+
+	if (h2c->edt)
+		return hpack_encode_header_edt(h2c->edt, out, ist(":status"),
+		                               ist(ultoa_r(status, str, sizeof(str))));
+	return hpack_encode_int_status(out, status);
+}
+
+/* Same as above for the :method pseudo-header */
+static inline int h2c_encode_method(struct h2c *h2c, struct buffer *out, enum http_meth_t meth, const struct ist str)
+{
+	if (h2c->edt)
+		return hpack_encode_header_edt(h2c->edt, out, ist(":method"), str);
+	return hpack_encode_method(out, meth, str);
+}
+
+/* Same as above for the :scheme pseudo-header */
+static inline int h2c_encode_scheme(struct h2c *h2c, struct buffer *out, const struct ist scheme)
+{
+	if (h2c->edt)
+		return hpack_encode_header_edt(h2c->edt, out, ist(":scheme"), scheme);
+	return hpack_encode_scheme(out, scheme);
+}
+
+/* Same as above for the :path pseudo-header */
+static inline int h2c_encode_path(struct h2c *h2c, struct buffer *out, const struct ist path)
+{
+	if (h2c->edt)
+		return hpack_encode_header_edt(h2c->edt, out, ist(":path"), path);
+	return hpack_encode_path(out, path);
+}
+
 /* returns the number of allocatable outgoing streams for the connection taking
  * the last_sid and the reserved ones into account.
  */
@@ -866,6 +1059,12 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	h2c->miw = 65535; /* mux initial window size */
 	h2c->mws = 65535; /* mux window size */
 	h2c->mfs = 16384; /* initial max frame size */
+	h2c->mhts = 4096; /* initial header table size */
+	h2c->edt = NULL;
+	h2c->mzc = 0;
+	h2c->vclock = 0;
+	h2c->sched_ahead = 0;
+	h2c->sched_defer = 0;
 	h2c->streams_by_id = EB_ROOT;
 	LIST_INIT(&h2c->send_list);
 	LIST_INIT(&h2c->fctl_list);
@@ -877,11 +1076,12 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	if (t)
 		task_queue(t);
 
-	if (h2c->flags & H2_CF_IS_BACK) {
+	if ((h2c->flags & H2_CF_IS_BACK) && conn_ctx) {
 		/* FIXME: this is temporary, for outgoing connections we need
 		 * to immediately allocate a stream until the code is modified
 		 * so that the caller calls ->attach(). For now the outgoing cs
 		 * is stored as conn->ctx by the caller and saved in conn_ctx.
+		 * Connections established in advance have none.
 		 */
 		struct h2s *h2s;
 
@@ -953,6 +1153,7 @@ static void h2_release(struct h2c *h2c)
 
 		TRACE_DEVEL("freeing h2c", H2_EV_H2C_END, conn);
 		hpack_dht_free(h2c->ddht);
+		pool_free(pool_head_hpack_edt, h2c->edt);
 
 		if (MT_LIST_ADDED(&h2c->buf_wait.list))
 			MT_LIST_DEL(&h2c->buf_wait.list);
@@ -1106,6 +1307,196 @@ static inline __maybe_unused void h2_set_frame_size(void *frame, uint32_t len)
 	write_n16(out + 1, len);
 }
 
+/* Returns non-zero if DATA payloads may be left in place in mux buffers of
+ * <h2c>, the frame headers being built when sending. This requires the
+ * transport layer to support scattered sends, and the connection not to be
+ * waiting for a handshake, which may involve another transport layer.
+ */
+static inline int h2c_zc_usable(const struct h2c *h2c)
+{
+	return h2_scatter_gather && h2c->conn->xprt->snd_iov &&
+	       !(h2c->conn->flags & CO_FL_WAIT_XPRT);
+}
+
+/* Writes into <hdr> the header of a DATA frame of <flen> bytes described by
+ * <zcd>. <last> indicates whether it is the last frame of the buffer.
+ */
+static inline void h2_zcd_frame_hdr(const struct h2_zcd *zcd, size_t flen, int last, char *hdr)
+{
+	h2_set_frame_size(hdr, flen);
+	hdr[3] = H2_FT_DATA;
+	hdr[4] = last ? zcd->flags : 0;
+	write_n32(hdr + 5, zcd->sid);
+}
+
+/* Describes into the <max> vectors of <iov> the frames left to send from the
+ * zero-copy mux buffer <buf>, with their frame headers written into <hdr>,
+ * which must have as many entries as <iov>. Returns the number of vectors
+ * used.
+ */
+static int h2_zcd_iov(const struct buffer *buf, struct iovec *iov, char (*hdr)[9], int max)
+{
+	const struct h2_zcd *zcd = (const struct h2_zcd *)b_orig(buf);
+	size_t ofs = 0, left = b_data(buf), flen = zcd->fleft;
+	int hsent = zcd->hsent;
+	int n = 0;
+
+	while (left && n + 2 <= max) {
+		if (hsent < 9) {
+			h2_zcd_frame_hdr(zcd, flen, flen == left, hdr[n]);
+			iov[n].iov_base = hdr[n] + hsent;
+			iov[n].iov_len  = 9 - hsent;
+			n++;
+		}
+		iov[n].iov_base = b_peek(buf, ofs);
+		iov[n].iov_len  = flen;
+		n++;
+		ofs  += flen;
+		left -= flen;
+		flen  = MIN(left, zcd->mfs);
+		hsent = 0;
+	}
+	return n;
+}
+
+/* Consumes up to <count> bytes sent from the zero-copy mux buffer <buf>,
+ * frame headers included. Returns the number of bytes consumed, which is
+ * lower than <count> once the buffer is empty.
+ */
+static size_t h2_zcd_consume(struct buffer *buf, size_t count)
+{
+	struct h2_zcd *zcd = (struct h2_zcd *)b_orig(buf);
+	size_t done = 0, try;
+
+	while (done < count && b_data(buf)) {
+		if (zcd->hsent < 9) {
+			try = MIN(9 - zcd->hsent, count - done);
+			zcd->hsent += try;
+		}
+		else {
+			try = MIN(zcd->fleft, count - done);
+			b_del(buf, try);
+			zcd->fleft -= try;
+			if (!zcd->fleft) {
+				zcd->hsent = 0;
+				zcd->fleft = MIN(b_data(buf), zcd->mfs);
+			}
+		}
+		done += try;
+	}
+	return done;
+}
+
+/* Sends the contents of the mux buffers of <h2c> through the transport layer,
+ * passing it <flags>, and releases the buffers which were completely sent.
+ * When the transport layer supports it, all buffers are sent at once using
+ * snd_iov(), which is required by zero-copy buffers. Returns the number of
+ * bytes sent. Data are left if br_data() is not null upon return.
+ */
+static size_t h2c_snd_mbufs(struct h2c *h2c, int flags)
+{
+	struct connection *conn = h2c->conn;
+	struct iovec iov[H2_SND_IOV];
+	char hdr[H2_SND_IOV][9];
+	struct buffer *buf;
+	unsigned int released = 0;
+	unsigned int idx;
+	size_t total = 0;
+	size_t ret, try, left;
+	int n, i, more;
+
+	if (!conn->xprt->snd_iov) {
+		for (buf = br_head(h2c->mbuf); b_size(buf); buf = br_del_head(h2c->mbuf)) {
+			if (b_data(buf)) {
+				ret = conn->xprt->snd_buf(conn, conn->xprt_ctx, buf, b_data(buf), flags);
+				if (!ret)
+					break;
+				TRACE_DATA("sent data", H2_EV_H2C_SEND, h2c->conn,, buf, (void*)(long)ret);
+				total += ret;
+				b_del(buf, ret);
+				if (b_data(buf))
+					break;
+			}
+			b_free(buf);
+			released++;
+		}
+		goto end;
+	}
+
+	do {
+		/* describe the buffers from the head to the tail */
+		n = more = 0;
+		idx = br_head_idx(h2c->mbuf);
+		while (1) {
+			buf = &h2c->mbuf[idx];
+			if (!b_data(buf))
+				;
+			else if (h2c->mzc & (1U << idx)) {
+				n += h2_zcd_iov(buf, iov + n, hdr + n, H2_SND_IOV - n);
+				if (n > H2_SND_IOV - 2) {
+					more = 1;
+					break;
+				}
+			}
+			else {
+				if (n > H2_SND_IOV - 2) {
+					more = 1;
+					break;
+				}
+				try = b_contig_data(buf, 0);
+				iov[n].iov_base = b_head(buf);
+				iov[n].iov_len  = try;
+				n++;
+				if (try < b_data(buf)) {
+					iov[n].iov_base = b_orig(buf);
+					iov[n].iov_len  = b_data(buf) - try;
+					n++;
+				}
+			}
+			if (idx == br_tail_idx(h2c->mbuf))
+				break;
+			if (++idx >= br_size(h2c->mbuf))
+				idx = 1;
+		}
+
+		if (!n)
+			break;
+
+		for (try = 0, i = 0; i < n; i++)
+			try += iov[i].iov_len;
+
+		ret = conn->xprt->snd_iov(conn, conn->xprt_ctx, iov, n, flags | (more ? CO_SFL_MSG_MORE : 0));
+		if (!ret)
+			break;
+
+		TRACE_DATA("sent data", H2_EV_H2C_SEND, h2c->conn,, br_head(h2c->mbuf), (void*)(long)ret);
+		total += ret;
+
+		/* consume what was sent and release the empty buffers */
+		left = ret;
+		for (buf = br_head(h2c->mbuf); b_size(buf); buf = br_del_head(h2c->mbuf)) {
+			idx = buf - h2c->mbuf;
+			if (h2c->mzc & (1U << idx))
+				left -= h2_zcd_consume(buf, left);
+			else {
+				try = MIN(left, b_data(buf));
+				b_del(buf, try);
+				left -= try;
+			}
+			if (b_data(buf))
+				break;
+			h2c->mzc &= ~(1U << idx);
+			b_free(buf);
+			released++;
+		}
+	} while (more && ret == try);
+
+ end:
+	if (released)
+		offer_buffers(NULL, tasks_run_queue);
+	return total;
+}
+
 /* reads <bytes> bytes from buffer <b> starting at relative offset <o> from the
  * current pointer, dealing with wrapping, and stores the result in <dst>. It's
  * the caller's responsibility to verify that there are at least <bytes> bytes
@@ -1322,6 +1713,9 @@ static struct h2s *h2s_new(struct h2c *h2c, int id)
 	h2s->status    = 0;
 	h2s->body_len  = 0;
 	h2s->rxbuf     = BUF_NULL;
+	h2s->vtag      = h2c->vclock;
+	h2s->weight    = 16;
+	h2s->urgency   = 3;
 
 	h2s->by_id.key = h2s->id = id;
 	if (id > 0)
@@ -1981,7 +2375,7 @@ static void h2c_unblock_sfctl(struct h2c *h2c)
 			LIST_DEL_INIT(&h2s->list);
 			if ((h2s->subs && h2s->subs->events & SUB_RETRY_SEND) ||
 			    h2s->flags & (H2_SF_WANT_SHUTR|H2_SF_WANT_SHUTW))
-				LIST_ADDQ(&h2c->send_list, &h2s->list);
+				h2s_sched_queue(h2c, &h2c->send_list, h2s);
 		}
 		node = eb32_next(node);
 	}
@@ -2044,6 +2438,14 @@ static int h2c_handle_settings(struct h2c *h2c)
 				goto fail;
 			}
 			break;
+		case H2_SETTINGS_HEADER_TABLE_SIZE:
+			/* the next header block will announce the new size
+			 * of our table, once the peer gets our ACK.
+			 */
+			h2c->mhts = arg;
+			if (h2c->edt)
+				hpack_edt_set_max(h2c->edt, arg);
+			break;
 		case H2_SETTINGS_MAX_CONCURRENT_STREAMS:
 			if (h2c->flags & H2_CF_IS_BACK) {
 				/* the limit is only for the backend; for the frontend it is our limit */
@@ -2326,7 +2728,7 @@ static int h2c_handle_window_update(struct h2c *h2c, struct h2s *h2s)
 			LIST_DEL_INIT(&h2s->list);
 			if ((h2s->subs && h2s->subs->events & SUB_RETRY_SEND) ||
 			    h2s->flags & (H2_SF_WANT_SHUTR|H2_SF_WANT_SHUTW))
-				LIST_ADDQ(&h2c->send_list, &h2s->list);
+				h2s_sched_queue(h2c, &h2c->send_list, h2s);
 		}
 	}
 	else {
@@ -2394,6 +2796,8 @@ static int h2c_handle_goaway(struct h2c *h2c)
  */
 static int h2c_handle_priority(struct h2c *h2c)
 {
+	struct h2s *h2s;
+
 	TRACE_ENTER(H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
 
 	/* process full frame only */
@@ -2409,6 +2813,12 @@ static int h2c_handle_priority(struct h2c *h2c)
 		TRACE_DEVEL("leaving on error", H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
 		return 0;
 	}
+
+	/* only the weight is used, and a "priority" header takes precedence */
+	h2s = h2c_st_by_id(h2c, h2c->dsi);
+	if (h2s->st != H2_SS_IDLE && h2s->st != H2_SS_CLOSED && !(h2s->flags & H2_SF_PRIO_HDR))
+		h2s->weight = *(uint8_t *)b_peek(&h2c->dbuf, 4) + 1;
+
 	TRACE_LEAVE(H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
 	return 1;
 }
@@ -2542,6 +2952,17 @@ static struct h2s *h2c_frt_handle_headers(struct h2c *h2c, struct h2s *h2s)
 	h2s->rxbuf = rxbuf;
 	h2s->flags |= flags;
 	h2s->body_len = body_len;
+	h2s->weight = h2c->dpw + 1;
+
+	if (h2_sched_weighted) {
+		struct http_hdr_ctx ctx = { .blk = NULL };
+
+		if (http_find_header(htx_from_buf(&h2s->rxbuf), ist("priority"), &ctx, 1)) {
+			/* RFC9218#4: defaults are u=3 and non-incremental */
+			h2s->flags |= H2_SF_PRIO_HDR | H2_SF_PRIO_SEQ;
+			h2s_parse_priority(h2s, ctx.value);
+		}
+	}
 
  done:
 	if (h2c->dff & H2_F_HEADERS_END_STREAM)
@@ -3498,8 +3919,6 @@ static int h2_send(struct h2c *h2c)
 	done = 0;
 	while (!done) {
 		unsigned int flags = 0;
-		unsigned int released = 0;
-		struct buffer *buf;
 
 		/* fill as much as we can into the current buffer */
 		while (((h2c->flags & (H2_CF_MUX_MFULL|H2_CF_MUX_MALLOC)) == 0) && !done)
@@ -3515,27 +3934,11 @@ static int h2_send(struct h2c *h2c)
 		if (h2c->flags & (H2_CF_MUX_MFULL | H2_CF_DEM_MBUSY | H2_CF_DEM_MROOM))
 			flags |= CO_SFL_MSG_MORE;
 
-		for (buf = br_head(h2c->mbuf); b_size(buf); buf = br_del_head(h2c->mbuf)) {
-			if (b_data(buf)) {
-				int ret = conn->xprt->snd_buf(conn, conn->xprt_ctx, buf, b_data(buf), flags);
-				if (!ret) {
-					done = 1;
-					break;
-				}
-				sent = 1;
-				TRACE_DATA("sent data", H2_EV_H2C_SEND, h2c->conn,, buf, (void*)(long)ret);
-				b_del(buf, ret);
-				if (b_data(buf)) {
-					done = 1;
-					break;
-				}
-			}
-			b_free(buf);
-			released++;
-		}
+		if (h2c_snd_mbufs(h2c, flags))
+			sent = 1;
 
-		if (released)
-			offer_buffers(NULL, tasks_run_queue);
+		if (br_data(h2c->mbuf))
+			done = 1;
 
 		/* wrote at least one byte, the buffer is not full anymore */
 		if (sent)
@@ -3598,7 +4001,7 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned short status)
 	 * to use it while we handle the I/O events
 	 */
 	if (conn_in_list)
-		MT_LIST_DEL(&conn->list);
+		conn_delete_from_tree(conn);
 
 	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 
@@ -3617,10 +4020,12 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned short status)
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
 
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 		if (conn_in_list == CO_FL_SAFE_LIST)
-			MT_LIST_ADDQ(&srv->safe_conns[tid], &conn->list);
+			eb64_insert(&srv->safe_conns_tree[tid], &conn->hash_node);
 		else
-			MT_LIST_ADDQ(&srv->idle_conns[tid], &conn->list);
+			eb64_insert(&srv->idle_conns_tree[tid], &conn->hash_node);
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
 
 leave:
@@ -3698,13 +4103,13 @@ static int h2_process(struct h2c *h2c)
 
 		/* connections in error must be removed from the idle lists */
 		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
-		MT_LIST_DEL((struct mt_list *)&conn->list);
+		conn_delete_from_tree(conn);
 		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
 	else if (h2c->st0 == H2_CS_ERROR) {
 		/* connections in error must be removed from the idle lists */
 		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
-		MT_LIST_DEL((struct mt_list *)&conn->list);
+		conn_delete_from_tree(conn);
 		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
 
@@ -3792,7 +4197,7 @@ static struct task *h2_timeout_task(struct task *t, void *context, unsigned shor
 		 * to steal it from us.
 		 */
 		if (h2c->conn->flags & CO_FL_LIST_MASK)
-			MT_LIST_DEL(&h2c->conn->list);
+			conn_delete_from_tree(h2c->conn);
 
 		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
@@ -3820,30 +4225,12 @@ static struct task *h2_timeout_task(struct task *t, void *context, unsigned shor
 	if (h2c_send_goaway_error(h2c, NULL) <= 0)
 		h2c->flags |= H2_CF_GOAWAY_FAILED;
 
-	if (br_data(h2c->mbuf) && !(h2c->flags & H2_CF_GOAWAY_FAILED) && conn_xprt_ready(h2c->conn)) {
-		unsigned int released = 0;
-		struct buffer *buf;
-
-		for (buf = br_head(h2c->mbuf); b_size(buf); buf = br_del_head(h2c->mbuf)) {
-			if (b_data(buf)) {
-				int ret = h2c->conn->xprt->snd_buf(h2c->conn, h2c->conn->xprt_ctx, buf, b_data(buf), 0);
-				if (!ret)
-					break;
-				b_del(buf, ret);
-				if (b_data(buf))
-					break;
-				b_free(buf);
-				released++;
-			}
-		}
-
-		if (released)
-			offer_buffers(NULL, tasks_run_queue);
-	}
+	if (br_data(h2c->mbuf) && !(h2c->flags & H2_CF_GOAWAY_FAILED) && conn_xprt_ready(h2c->conn))
+		h2c_snd_mbufs(h2c, 0);
 
 	/* in any case this connection must not be considered idle anymore */
 	HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
-	MT_LIST_DEL((struct mt_list *)&h2c->conn->list);
+	conn_delete_from_tree(h2c->conn);
 	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 
 	/* either we can release everything now or it will be done later once
@@ -4019,9 +4406,8 @@ static void h2_detach(struct conn_stream *cs)
 					}
 				}
 
-				/* Be sure to remove the connection from the available_conns list */
-				if (!MT_LIST_ISEMPTY(&h2c->conn->list))
-					MT_LIST_DEL(&h2c->conn->list);
+				/* Be sure to remove the connection from the available_conns tree */
+				eb64_delete(&h2c->conn->hash_node);
 			}
 			else {
 				if (eb_is_empty(&h2c->streams_by_id)) {
@@ -4039,9 +4425,9 @@ static void h2_detach(struct conn_stream *cs)
 					return;
 
 				}
-				else if (MT_LIST_ISEMPTY(&h2c->conn->list) &&
+				else if (!h2c->conn->hash_node.node.leaf_p &&
 					 h2_avail_streams(h2c->conn) > 0 && objt_server(h2c->conn->target)) {
-					LIST_ADD(&__objt_server(h2c->conn->target)->available_conns[tid], mt_list_to_list(&h2c->conn->list));
+					eb64_insert(&__objt_server(h2c->conn->target)->available_conns_tree[tid], &h2c->conn->hash_node);
 				}
 			}
 		}
@@ -4127,9 +4513,9 @@ static void h2_do_shutr(struct h2s *h2s)
 	h2s->flags |= H2_SF_WANT_SHUTR;
 	if (!LIST_ADDED(&h2s->list)) {
 		if (h2s->flags & H2_SF_BLK_MFCTL)
-			LIST_ADDQ(&h2c->fctl_list, &h2s->list);
+			h2s_sched_queue(h2c, &h2c->fctl_list, h2s);
 		else if (h2s->flags & (H2_SF_BLK_MBUSY|H2_SF_BLK_MROOM))
-			LIST_ADDQ(&h2c->send_list, &h2s->list);
+			h2s_sched_queue(h2c, &h2c->send_list, h2s);
 	}
 	TRACE_LEAVE(H2_EV_STRM_SHUT, h2c->conn, h2s);
 	return;
@@ -4202,9 +4588,9 @@ static void h2_do_shutw(struct h2s *h2s)
 	h2s->flags |= H2_SF_WANT_SHUTW;
 	if (!LIST_ADDED(&h2s->list)) {
 		if (h2s->flags & H2_SF_BLK_MFCTL)
-			LIST_ADDQ(&h2c->fctl_list, &h2s->list);
+			h2s_sched_queue(h2c, &h2c->fctl_list, h2s);
 		else if (h2s->flags & (H2_SF_BLK_MBUSY|H2_SF_BLK_MROOM))
-			LIST_ADDQ(&h2c->send_list, &h2s->list);
+			h2s_sched_queue(h2c, &h2c->send_list, h2s);
 	}
 	TRACE_LEAVE(H2_EV_STRM_SHUT, h2c->conn, h2s);
 	return;
@@ -4425,7 +4811,10 @@ static int h2c_decode_headers(struct h2c *h2c, struct buffer *rxbuf, uint32_t *f
 		hdrs = (uint8_t *) copy->area;
 	}
 
-	/* Skip StreamDep and weight for now (we don't support PRIORITY) */
+	/* Skip StreamDep and keep the weight for the scheduler. Dependencies
+	 * are ignored, as they were deprecated by RFC9113.
+	 */
+	h2c->dpw = 15;
 	if (h2c->dff & H2_F_HEADERS_PRIORITY) {
 		if (read_n32(hdrs) == h2c->dsi) {
 			/* RFC7540#5.3.1 : stream dep may not depend on itself */
@@ -4440,6 +4829,7 @@ static int h2c_decode_headers(struct h2c *h2c, struct buffer *rxbuf, uint32_t *f
 			goto fail;
 		}
 
+		h2c->dpw = hdrs[4];
 		hdrs += 5; // stream dep = 4, weight = 1
 		flen -= 5;
 	}
@@ -4791,8 +5181,14 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!h2c_hdr_begin(h2c, &outbuf)) {
+		if (b_space_wraps(mbuf))
+			goto realign_again;
+		goto full;
+	}
+
 	/* encode status, which necessarily is the first one */
-	if (!hpack_encode_int_status(&outbuf, h2s->status)) {
+	if (!h2c_encode_status(h2c, &outbuf, h2s->status)) {
 		if (b_space_wraps(mbuf))
 			goto realign_again;
 		goto full;
@@ -4815,7 +5211,11 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 		if (isteq(list[hdr].n, ist("")))
 			break; // end
 
-		if (!hpack_encode_header(&outbuf, list[hdr].n, list[hdr].v)) {
+		/* RFC9218#5: the server may override the client's priorities */
+		if (h2_sched_weighted && isteq(list[hdr].n, ist("priority")))
+			h2s_parse_priority(h2s, list[hdr].v);
+
+		if (!h2c_encode_header(h2c, &outbuf, list[hdr].n, list[hdr].v)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -4852,6 +5252,7 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 	/* commit the H2 response */
 	TRACE_USER("sent H2 response", H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s, htx);
 	b_add(mbuf, outbuf.data);
+	h2c_hdr_commit(h2c);
 
 	/* indicates the HEADERS frame was sent, except for 1xx responses. For
 	 * 1xx responses, another HEADERS frame is expected.
@@ -5039,8 +5440,14 @@ static size_t h2s_bck_make_req_headers(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!h2c_hdr_begin(h2c, &outbuf)) {
+		if (b_space_wraps(mbuf))
+			goto realign_again;
+		goto full;
+	}
+
 	/* encode the method, which necessarily is the first one */
-	if (!hpack_encode_method(&outbuf, sl->info.req.meth, meth)) {
+	if (!h2c_encode_method(h2c, &outbuf, sl->info.req.meth, meth)) {
 		if (b_space_wraps(mbuf))
 			goto realign_again;
 		goto full;
@@ -5056,7 +5463,7 @@ static size_t h2s_bck_make_req_headers(struct h2s *h2s, struct htx *htx)
 	if (unlikely(sl->info.req.meth == HTTP_METH_CONNECT)) {
 		auth = uri;
 
-		if (!hpack_encode_header(&outbuf, ist(":authority"), auth)) {
+		if (!h2c_encode_header(h2c, &outbuf, ist(":authority"), auth)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -5108,14 +5515,14 @@ static size_t h2s_bck_make_req_headers(struct h2s *h2s, struct htx *htx)
 				scheme = ist("https");
 		}
 
-		if (!hpack_encode_scheme(&outbuf, scheme)) {
+		if (!h2c_encode_scheme(h2c, &outbuf, scheme)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
 			goto full;
 		}
 
-		if (auth.len && !hpack_encode_header(&outbuf, ist(":authority"), auth)) {
+		if (auth.len && !h2c_encode_header(h2c, &outbuf, ist(":authority"), auth)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -5132,7 +5539,7 @@ static size_t h2s_bck_make_req_headers(struct h2s *h2s, struct htx *htx)
 				uri = ist("/");
 		}
 
-		if (!hpack_encode_path(&outbuf, uri)) {
+		if (!h2c_encode_path(h2c, &outbuf, uri)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -5173,7 +5580,7 @@ static size_t h2s_bck_make_req_headers(struct h2s *h2s, struct htx *htx)
 		if (isteq(n, ist("")))
 			break; // end
 
-		if (!hpack_encode_header(&outbuf, n, v)) {
+		if (!h2c_encode_header(h2c, &outbuf, n, v)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -5214,6 +5621,7 @@ static size_t h2s_bck_make_req_headers(struct h2s *h2s, struct htx *htx)
 	/* commit the H2 response */
 	TRACE_USER("sent H2 request", H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s, htx);
 	b_add(mbuf, outbuf.data);
+	h2c_hdr_commit(h2c);
 	h2s->flags |= H2_SF_HEADERS_SENT;
 	h2s->st = H2_SS_OPEN;
 
@@ -5281,6 +5689,8 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 	enum htx_blk_type type;
 	int idx;
 	int trunc_out; /* non-zero if truncated on out buf */
+	int zc;  /* non-zero if the payload may be left in place */
+	int eom; /* non-zero if the DATA block is followed by the EOM */
 
 	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_DATA, h2c->conn, h2s);
 
@@ -5321,8 +5731,20 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 	else if (type != HTX_BLK_DATA)
 		goto end;
 
+	zc  = fsize && h2c_zc_usable(h2c);
+	eom = zc && type == HTX_BLK_DATA && fsize + 1 == count && htx_nbblks(htx) == 2 &&
+	      htx_get_blk_type(htx_get_blk(htx, htx_get_tail(htx))) == HTX_BLK_EOM;
+
 	mbuf = br_tail(h2c->mbuf);
  retry:
+	if (type == HTX_BLK_DATA && h2s_sched_defer(h2c)) {
+		h2c->flags |= H2_CF_MUX_MFULL;
+		h2s->flags |= H2_SF_BLK_MROOM;
+		h2c->sched_defer++;
+		TRACE_STATE("leaving output buffers to other streams", H2_EV_TX_FRAME|H2_EV_TX_DATA|H2_EV_H2S_BLK, h2c->conn, h2s);
+		goto end;
+	}
+
 	if (!h2_get_buf(h2c, mbuf)) {
 		h2c->flags |= H2_CF_MUX_MALLOC;
 		h2s->flags |= H2_SF_BLK_MROOM;
@@ -5346,10 +5768,16 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 	 * copies remain aligned and that this operation remains possible all
 	 * the time. This goes for headers, data blocks and any data extracted
 	 * from the HTX blocks.
+	 *
+	 * When the transport layer supports scattered sends, the swapped area
+	 * is kept as a payload-only buffer and the frame headers are only built
+	 * when sending (see h2c_snd_mbufs()). The block may then be larger than
+	 * the frame size, and a trailing EOM is merged as the ES flag of the
+	 * last frame.
 	 */
-	if (unlikely(fsize == count &&
-	             htx_nbblks(htx) == 1 && type == HTX_BLK_DATA &&
-	             fsize <= h2s_mws(h2s) && fsize <= h2c->mws && fsize <= h2c->mfs)) {
+	if (unlikely(type == HTX_BLK_DATA &&
+	             (fsize == count ? htx_nbblks(htx) == 1 : eom) &&
+	             fsize <= h2s_mws(h2s) && fsize <= h2c->mws && (zc || fsize <= h2c->mfs))) {
 		void *old_area = mbuf->area;
 
 		if (b_data(mbuf)) {
@@ -5358,10 +5786,12 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 			 * frame into a buffer containing few data if it needs to be realigned,
 			 * and that it's also OK to copy few data without realigning. Otherwise
 			 * we'll pretend the mbuf is full and wait for it to become empty.
+			 * With zero-copy buffers, only really small data are worth a copy.
 			 */
 			if (fsize + 9 <= b_room(mbuf) &&
-			    (b_data(mbuf) <= b_size(mbuf) / 4 ||
-			     (fsize <= b_size(mbuf) / 4 && fsize + 9 <= b_contig_space(mbuf)))) {
+			    (zc ? fsize <= b_size(mbuf) / 16 :
+			     (b_data(mbuf) <= b_size(mbuf) / 4 ||
+			      (fsize <= b_size(mbuf) / 4 && fsize + 9 <= b_contig_space(mbuf))))) {
 				TRACE_STATE("small data present in output buffer, appending", H2_EV_TX_FRAME|H2_EV_TX_DATA, h2c->conn, h2s);
 				goto copy;
 			}
@@ -5375,6 +5805,46 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 			goto end;
 		}
 
+		if (zc && br_full(h2c->mbuf)) {
+			/* no room for the empty tail buffer which must follow */
+			zc = 0;
+			if (eom || fsize > h2c->mfs)
+				goto copy;
+		}
+
+		if (zc) {
+			struct h2_zcd *zcd;
+
+			/* leave the payload in place, describe the frames at the
+			 * beginning of the area, and add an empty tail buffer so
+			 * that other frames are not appended there.
+			 */
+			*mbuf = b_make(buf->area, buf->size, sizeof(struct htx) + blk->addr, fsize);
+			zcd = (struct h2_zcd *)b_orig(mbuf);
+			zcd->sid   = h2s->id;
+			zcd->mfs   = h2c->mfs;
+			zcd->fleft = MIN(fsize, h2c->mfs);
+			zcd->hsent = 0;
+			zcd->flags = eom ? H2_F_DATA_END_STREAM : 0;
+			h2c->mzc |= 1U << (mbuf - h2c->mbuf);
+			br_tail_add(h2c->mbuf);
+
+			h2s->sws -= fsize;
+			h2c->mws -= fsize;
+			h2s_sched_charge(h2c, h2s, fsize);
+
+			buf->area = old_area;
+			buf->data = buf->head = 0;
+			total += fsize;
+			if (eom) {
+				total++; // EOM counts as one byte
+				es_now = 1;
+			}
+
+			TRACE_PROTO("sent H2 DATA frames (zero-copy)", H2_EV_TX_FRAME|H2_EV_TX_DATA, h2c->conn, h2s);
+			goto done;
+		}
+
 		/* map an H2 frame to the HTX block so that we can put the
 		 * frame header there.
 		 */
@@ -5389,6 +5859,7 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 		/* update windows */
 		h2s->sws -= fsize;
 		h2c->mws -= fsize;
+		h2s_sched_charge(h2c, h2s, fsize);
 
 		/* and exchange with our old area */
 		buf->area = old_area;
@@ -5497,6 +5968,7 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 	h2s->sws -= fsize;
 	h2c->mws -= fsize;
 	count    -= fsize;
+	h2s_sched_charge(h2c, h2s, fsize);
 
  send_empty:
 	/* update the frame's size */
@@ -5532,6 +6004,7 @@ static size_t h2s_frt_make_resp_data(struct h2s *h2s, struct buffer *buf, size_t
 			goto new_frame;
 	}
 
+ done:
 	if (es_now) {
 		if (h2s->st == H2_SS_OPEN)
 			h2s->st = H2_SS_HLOC;
@@ -5568,6 +6041,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	int ret = 0;
 	int hdr;
 	int idx;
+	int hstart;
 
 	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s);
 
@@ -5640,6 +6114,13 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!h2c_hdr_begin(h2c, &outbuf)) {
+		if (b_space_wraps(mbuf))
+			goto realign_again;
+		goto full;
+	}
+	hstart = outbuf.data;
+
 	/* encode all headers */
 	for (idx = 0; idx < hdr; idx++) {
 		/* these ones do not exist in H2 or must not appear in
@@ -5659,7 +6140,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 		if (*(list[idx].n.ptr) == ':')
 			continue;
 
-		if (!hpack_encode_header(&outbuf, list[idx].n, list[idx].v)) {
+		if (!h2c_encode_header(h2c, &outbuf, list[idx].n, list[idx].v)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -5667,13 +6148,15 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 		}
 	}
 
-	if (outbuf.data == 9) {
+	if (outbuf.data == hstart) {
 		/* here we have a problem, we have nothing to emit (either we
 		 * received an empty trailers block followed or we removed its
 		 * contents above). Because of this we can't send a HEADERS
 		 * frame, so we have to cheat and instead send an empty DATA
-		 * frame conveying the ES flag.
+		 * frame conveying the ES flag. A table size update must then
+		 * wait for the next header block.
 		 */
+		outbuf.data = 9;
 		outbuf.area[3] = H2_FT_DATA;
 		outbuf.area[4] = H2_F_DATA_END_STREAM;
 	}
@@ -5693,6 +6176,8 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	/* commit the H2 response */
 	TRACE_PROTO("sent H2 trailers HEADERS frame", H2_EV_TX_FRAME|H2_EV_TX_HDR|H2_EV_TX_EOI, h2c->conn, h2s);
 	b_add(mbuf, outbuf.data);
+	if (outbuf.area[3] == H2_FT_HEADERS)
+		h2c_hdr_commit(h2c);
 	h2s->flags |= H2_SF_ES_SENT;
 
 	if (h2s->st == H2_SS_OPEN)
@@ -5762,9 +6247,9 @@ static int h2_subscribe(struct conn_stream *cs, int event_type, struct wait_even
 		if (!(h2s->flags & H2_SF_BLK_SFCTL) &&
 		    !LIST_ADDED(&h2s->list)) {
 			if (h2s->flags & H2_SF_BLK_MFCTL)
-				LIST_ADDQ(&h2c->fctl_list, &h2s->list);
+				h2s_sched_queue(h2c, &h2c->fctl_list, h2s);
 			else
-				LIST_ADDQ(&h2c->send_list, &h2s->list);
+				h2s_sched_queue(h2c, &h2c->send_list, h2s);
 		}
 	}
 	TRACE_LEAVE(H2_EV_STRM_SEND|H2_EV_STRM_RECV, h2c->conn, h2s);
@@ -6094,24 +6579,36 @@ static int h2_show_fd(struct buffer *msg, struct connection *conn)
 	chunk_appendf(msg, " h2c.st0=%s .err=%d .maxid=%d .lastid=%d .flg=0x%04x"
 		      " .nbst=%u .nbcs=%u .fctl_cnt=%d .send_cnt=%d .tree_cnt=%d"
 		      " .orph_cnt=%d .sub=%d .dsi=%d .dbuf=%u@%p+%u/%u .msi=%d"
-		      " .mbuf=[%u..%u|%u],h=[%u@%p+%u/%u],t=[%u@%p+%u/%u]",
+		      " .mbuf=[%u..%u|%u],zc=%#x,h=[%u@%p+%u/%u],t=[%u@%p+%u/%u]",
 		      h2c_st_to_str(h2c->st0), h2c->errcode, h2c->max_id, h2c->last_sid, h2c->flags,
 		      h2c->nb_streams, h2c->nb_cs, fctl_cnt, send_cnt, tree_cnt, orph_cnt,
 		      h2c->wait_event.events, h2c->dsi,
 		      (unsigned int)b_data(&h2c->dbuf), b_orig(&h2c->dbuf),
 		      (unsigned int)b_head_ofs(&h2c->dbuf), (unsigned int)b_size(&h2c->dbuf),
 		      h2c->msi,
-		      br_head_idx(h2c->mbuf), br_tail_idx(h2c->mbuf), br_size(h2c->mbuf),
+		      br_head_idx(h2c->mbuf), br_tail_idx(h2c->mbuf), br_size(h2c->mbuf), h2c->mzc,
 		      (unsigned int)b_data(hmbuf), b_orig(hmbuf),
 		      (unsigned int)b_head_ofs(hmbuf), (unsigned int)b_size(hmbuf),
 		      (unsigned int)b_data(tmbuf), b_orig(tmbuf),
 		      (unsigned int)b_head_ofs(tmbuf), (unsigned int)b_size(tmbuf));
 
+	chunk_appendf(msg, " .sched=%s,vclk=%llu,ahead=%u,defer=%u",
+	              h2_sched_weighted ? "weighted" : "fifo", (unsigned long long)h2c->vclock,
+	              h2c->sched_ahead, h2c->sched_defer);
+
+	if (h2c->edt)
+		chunk_appendf(msg, " .edt=[%u/%u|%u],raw=%llu,enc=%llu",
+		              h2c->edt->cur.total, h2c->edt->max, h2c->edt->cur.used,
+		              (unsigned long long)h2c->edt->cur.raw,
+		              (unsigned long long)h2c->edt->cur.enc);
+
 	if (h2s) {
-		chunk_appendf(msg, " last_h2s=%p .id=%d .st=%s .flg=0x%04x .rxbuf=%u@%p+%u/%u .cs=%p",
+		chunk_appendf(msg, " last_h2s=%p .id=%d .st=%s .flg=0x%04x .rxbuf=%u@%p+%u/%u"
+			      " .u=%d .w=%d .vtag=%llu .cs=%p",
 			      h2s, h2s->id, h2s_st_to_str(h2s->st), h2s->flags,
 			      (unsigned int)b_data(&h2s->rxbuf), b_orig(&h2s->rxbuf),
 			      (unsigned int)b_head_ofs(&h2s->rxbuf), (unsigned int)b_size(&h2s->rxbuf),
+			      h2s->urgency, h2s->weight, (unsigned long long)h2s->vtag,
 			      h2s->cs);
 		if (h2s->cs)
 			chunk_appendf(msg, "(.flg=0x%08x .data=%p)",
@@ -6212,6 +6709,60 @@ static int h2_parse_header_table_size(char **args, int section_type, struct prox
 	return 0;
 }
 
+/* config parser for global "tune.h2.encoder-table-size" */
+static int h2_parse_encoder_table_size(char **args, int section_type, struct proxy *curpx,
+                                       struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	h2_settings_encoder_table_size = atoi(args[1]);
+	if (h2_settings_encoder_table_size < 0 || h2_settings_encoder_table_size > 65536) {
+		memprintf(err, "'%s' expects a numeric value between 0 and 65536.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.h2.stream-scheduler" */
+static int h2_parse_stream_scheduler(char **args, int section_type, struct proxy *curpx,
+                                     struct proxy *defpx, const char *file, int line,
+                                     char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "weighted") == 0)
+		h2_sched_weighted = 1;
+	else if (strcmp(args[1], "fifo") == 0)
+		h2_sched_weighted = 0;
+	else {
+		memprintf(err, "'%s' expects 'weighted' or 'fifo'.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.h2.scatter-gather" */
+static int h2_parse_scatter_gather(char **args, int section_type, struct proxy *curpx,
+                                   struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		h2_scatter_gather = 1;
+	else if (strcmp(args[1], "off") == 0)
+		h2_scatter_gather = 0;
+	else {
+		memprintf(err, "'%s' expects 'on' or 'off'.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.h2.initial-window-size" */
 static int h2_parse_initial_window_size(char **args, int section_type, struct proxy *curpx,
                                         struct proxy *defpx, const char *file, int line,
@@ -6295,10 +6846,13 @@ INITCALL1(STG_REGISTER, register_mux_proto, &mux_proto_h2);
 
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.h2.encoder-table-size",     h2_parse_encoder_table_size     },
 	{ CFG_GLOBAL, "tune.h2.header-table-size",      h2_parse_header_table_size      },
 	{ CFG_GLOBAL, "tune.h2.initial-window-size",    h2_parse_initial_window_size    },
 	{ CFG_GLOBAL, "tune.h2.max-concurrent-streams", h2_parse_max_concurrent_streams },
 	{ CFG_GLOBAL, "tune.h2.max-frame-size",         h2_parse_max_frame_size         },
+	{ CFG_GLOBAL, "tune.h2.scatter-gather",         h2_parse_scatter_gather         },
+	{ CFG_GLOBAL, "tune.h2.stream-scheduler",       h2_parse_stream_scheduler       },
 	{ 0, NULL, NULL }
 }};
 
@@ -6316,6 +6870,16 @@ static int init_h2()
 		ha_alert("failed to allocate hpack_tbl memory pool\n");
 		return (ERR_ALERT | ERR_FATAL);
 	}
+
+	if (h2_settings_encoder_table_size) {
+		pool_head_hpack_edt = create_pool("hpack_edt",
+		                                  hpack_edt_size(h2_settings_encoder_table_size),
+		                                  MEM_F_SHARED|MEM_F_EXACT);
+		if (!pool_head_hpack_edt) {
+			ha_alert("failed to allocate hpack_edt memory pool\n");
+			return (ERR_ALERT | ERR_FATAL);
+		}
+	}
 	return ERR_NONE;
 }
 
@@ -0,0 +1,85 @@
+/*
+ * Set-associative cache of pattern lookup results.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The cache is an array of cache-line sized sets of PATCACHE_WAYS entries,
+ * each holding a 64-bit key and a result. The set of a key only depends on the
+ * key and on its domain (the pattern expression), so that a lookup touches a
+ * single cache line and needs no allocation nor tree walk. A domain only uses
+ * a window of consecutive sets starting at a position derived from its
+ * address, which limits the number of entries a single busy expression may
+ * take from the other ones. Entries are kept ordered from the most to the least
+ * recently used within their set, the last one being replaced on insertion.
+ */
+
+#include <stdlib.h>
+
+#include <haproxy/api.h>
+#include <haproxy/patcache.h>
+
+/* Rounds <v> down to a power of two, returns 0 for 0 */
+static inline unsigned int patcache_pow2_floor(unsigned int v)
+{
+	while (v & (v - 1))
+		v &= v - 1;
+	return v;
+}
+
+/* Allocates an empty cache of at least <entries> entries, of which at most
+ * <budget> (rounded down to a multiple of the associativity) may be used by
+ * a single domain. 0 means no limit. Returns NULL if out of memory or if
+ * <entries> is zero.
+ */
+struct patcache *patcache_new(unsigned int entries, unsigned int budget)
+{
+	struct patcache *pc;
+	unsigned int sets, bsets;
+
+	if (!entries)
+		return NULL;
+
+	sets = patcache_pow2_floor((entries + PATCACHE_WAYS - 1) / PATCACHE_WAYS);
+	if (sets * PATCACHE_WAYS < entries)
+		sets *= 2;
+
+	bsets = patcache_pow2_floor(budget / PATCACHE_WAYS);
+	if (!budget || bsets > sets)
+		bsets = sets;
+	else if (!bsets)
+		bsets = 1;
+
+	pc = calloc(1, sizeof(*pc));
+	if (!pc)
+		return NULL;
+
+	pc->area = calloc(1, (size_t)sets * sizeof(*pc->sets) + sizeof(*pc->sets) - 1);
+	if (!pc->area) {
+		free(pc);
+		return NULL;
+	}
+	pc->sets = (struct patcache_set *)(((unsigned long)pc->area + sizeof(*pc->sets) - 1) &
+	                                   ~((unsigned long)sizeof(*pc->sets) - 1));
+	pc->mask = sets - 1;
+	pc->budget_mask = bsets - 1;
+	return pc;
+}
+
+/* Releases cache <pc>. NULL is supported. */
+void patcache_free(struct patcache *pc)
+{
+	if (!pc)
+		return;
+	free(pc->area);
+	free(pc);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
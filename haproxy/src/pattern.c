@@ -15,15 +15,23 @@
 #include <errno.h>
 
 #include <import/ebsttree.h>
-#include <import/lru.h>
 #include <import/xxhash.h>
 
+#include <haproxy/acm.h>
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
+#include <haproxy/cfgparse.h>
+#include <haproxy/domtrie.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
+#include <haproxy/mapimg.h>
 #include <haproxy/net_helper.h>
+#include <haproxy/patcache.h>
 #include <haproxy/pattern.h>
+#include <haproxy/poptrie.h>
+#include <haproxy/qsbr.h>
 #include <haproxy/regex.h>
+#include <haproxy/rxset.h>
 #include <haproxy/sample.h>
 #include <haproxy/tools.h>
 
@@ -151,12 +159,104 @@ int pat_match_types[PAT_MATCH_NUM] = {
 /* this struct is used to return information */
 static THREAD_LOCAL struct pattern static_pattern;
 static THREAD_LOCAL struct sample_data static_sample_data;
+static THREAD_LOCAL struct sample_data static_img_data; /* value parsed from an image */
+static THREAD_LOCAL unsigned long *pat_rx_area;          /* work area of the regex prefilter */
+static THREAD_LOCAL size_t pat_rx_area_size;
 
 /* This is the root of the list of all pattern_ref avalaibles. */
 struct list pattern_reference = LIST_HEAD_INIT(pattern_reference);
 
-static THREAD_LOCAL struct lru64_head *pat_lru_tree;
-static unsigned long long pat_lru_seed;
+static THREAD_LOCAL struct patcache *pat_cache;
+static unsigned long long pat_cache_seed;
+
+/* The hash of the sample is only computed once for all the expressions
+ * pattern_exec_match() looks it up in. It is valid when the state is
+ * PAT_HASH_READY. Out of pattern_exec_match(), the state is PAT_HASH_NONE and
+ * the hash is computed for each lookup.
+ */
+#define PAT_HASH_NONE    0
+#define PAT_HASH_PENDING 1
+#define PAT_HASH_READY   2
+
+static THREAD_LOCAL unsigned long long pat_smp_hash;
+static THREAD_LOCAL int pat_smp_hash_state;
+
+/* Returns the hash of the string of sample <smp> */
+static inline unsigned long long pat_smp_get_hash(const struct sample *smp)
+{
+	unsigned long long hash;
+
+	if (pat_smp_hash_state == PAT_HASH_READY)
+		return pat_smp_hash;
+
+	hash = XXH64(smp->data.u.str.area, smp->data.u.str.data, pat_cache_seed);
+	if (pat_smp_hash_state == PAT_HASH_PENDING) {
+		pat_smp_hash = hash;
+		pat_smp_hash_state = PAT_HASH_READY;
+	}
+	return hash;
+}
+
+/* Returns the cache counters of the current thread for <expr>, or NULL */
+static inline struct pat_cache_ctr *pat_cache_ctr(const struct pattern_expr *expr)
+{
+	if (!expr->ref || !expr->ref->cache_ctr)
+		return NULL;
+	return &expr->ref->cache_ctr[tid];
+}
+
+/* Looks up the string of sample <smp> in the cache of results of <expr>. On a
+ * hit, the cached result is stored into <ret> and 1 is returned. Otherwise 0
+ * is returned and, if the result may be cached, its key is stored into <key>
+ * for pat_cache_store(), which must otherwise be left to zero.
+ */
+static inline int pat_cache_lookup(const struct sample *smp, struct pattern_expr *expr,
+                                   unsigned long long *key, struct pattern **ret)
+{
+	struct pat_cache_ctr *ctr;
+	void *data;
+
+	/* there is nothing to save on an empty list */
+	if (!pat_cache || LIST_ISEMPTY(&expr->patterns))
+		return 0;
+
+	*key = patcache_key(pat_smp_get_hash(smp), expr, expr->revision);
+	ctr = pat_cache_ctr(expr);
+	if (patcache_get(pat_cache, expr, *key, &data)) {
+		if (ctr)
+			ctr->hit++;
+		*ret = data;
+		return 1;
+	}
+	if (ctr)
+		ctr->miss++;
+	return 0;
+}
+
+/* Tells whether lookups in an expression indexed by <idx> (or not indexed if
+ * NULL) should go through the cache.
+ */
+static inline int pat_cache_wanted(const void *idx)
+{
+	return !idx || (global.tune.options & GTUNE_PATTERN_CACHE_IDX);
+}
+
+/* Stores <ret> as the result of the lookup of key <key> in <expr>, if <key> is
+ * not null.
+ */
+static inline void pat_cache_store(struct pattern_expr *expr, unsigned long long key,
+                                   struct pattern *ret)
+{
+	struct pat_cache_ctr *ctr;
+
+	if (!key)
+		return;
+	if (patcache_put(pat_cache, expr, key, ret)) {
+		ctr = pat_cache_ctr(expr);
+		if (ctr)
+			ctr->evict++;
+	}
+}
 
 /*
  *
@@ -431,6 +531,373 @@ int pat_parse_ip(const char *text, struct pattern *pattern, int mflags, char **e
  *
  */
 
+/* Returns the automaton indexing the list of string patterns of <expr>,
+ * reversed if <flags> contains ACM_F_REV, building it if needed. An expression
+ * may be shared by several match methods, hence the two automatons. Matching
+ * only holds the expression's read lock, so concurrent builders race to
+ * install their automaton and the losers release theirs. Modifications of the
+ * list happen under the write lock and drop the automatons (pat_acm_drop()).
+ * Returns NULL if out of memory, in which case the list must be walked.
+ */
+static struct acm *pat_acm_get(struct pattern_expr *expr, unsigned int flags)
+{
+	struct acm **slot = (flags & ACM_F_REV) ? &expr->acm_rev : &expr->acm;
+	struct pattern_list *lst;
+	struct acm *acm, *old = NULL;
+
+	acm = HA_ATOMIC_LOAD(slot);
+	if (likely(acm))
+		return acm;
+
+	if (expr->mflags & PAT_MF_IGNORE_CASE)
+		flags |= ACM_F_ICASE;
+
+	acm = acm_new(flags);
+	if (!acm)
+		return NULL;
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		if (!acm_add(acm, lst->pat.ptr.str, lst->pat.len, &lst->pat))
+			goto fail;
+	}
+
+	if (!acm_compile(acm))
+		goto fail;
+
+	if (!HA_ATOMIC_CAS(slot, &old, acm)) {
+		acm_free(acm);
+		acm = old;
+	}
+	return acm;
+ fail:
+	acm_free(acm);
+	return NULL;
+}
+
+/* Releases the automatons of <expr> after its list of patterns changed. The
+ * expression must be write-locked.
+ */
+static inline void pat_acm_drop(struct pattern_expr *expr)
+{
+	acm_free(expr->acm);
+	acm_free(expr->acm_rev);
+	expr->acm = expr->acm_rev = NULL;
+}
+
+/* Returns the trie indexing the list of domain patterns of <expr>, building it
+ * if needed. Concurrency is handled as for the automatons above, and
+ * modifications of the list drop the trie (pat_domtrie_drop()). Returns NULL
+ * if out of memory, in which case the list must be walked.
+ */
+static struct domtrie *pat_domtrie_get(struct pattern_expr *expr)
+{
+	struct pattern_list *lst;
+	struct domtrie *dt, *old = NULL;
+
+	dt = HA_ATOMIC_LOAD(&expr->domtrie);
+	if (likely(dt))
+		return dt;
+
+	dt = domtrie_new((expr->mflags & PAT_MF_IGNORE_CASE) ? DOMTRIE_F_ICASE : 0, "/?.:");
+	if (!dt)
+		return NULL;
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		if (!domtrie_add(dt, lst->pat.ptr.str, lst->pat.len, &lst->pat)) {
+			domtrie_free(dt);
+			return NULL;
+		}
+	}
+
+	if (!HA_ATOMIC_CAS(&expr->domtrie, &old, dt)) {
+		domtrie_free(dt);
+		dt = old;
+	}
+	return dt;
+}
+
+/* Releases the domain trie of <expr> after its list of patterns changed. The
+ * expression must be write-locked.
+ */
+static inline void pat_domtrie_drop(struct pattern_expr *expr)
+{
+	domtrie_free(expr->domtrie);
+	expr->domtrie = NULL;
+}
+
+/* Returns the literal prefilter of the list of regexes of <expr>, building it
+ * if needed. It is only used with "tune.pattern.regex-prefilter on". The
+ * regexes' source is taken from their reference element, those without one
+ * are always run. Concurrency is handled as for the automatons above, and
+ * modifications of the list drop the prefilter (pat_rxset_drop()). Returns
+ * NULL if disabled or out of memory, in which case all regexes must be run.
+ */
+static struct rxset *pat_rxset_get(struct pattern_expr *expr)
+{
+	struct pattern_list *lst;
+	struct rxset *rs, *old = NULL;
+	unsigned int flags = 0;
+
+	if (!(global.tune.options & GTUNE_PATTERN_RXSET))
+		return NULL;
+
+	rs = HA_ATOMIC_LOAD(&expr->rxset);
+	if (likely(rs))
+		return rs;
+
+	/* regex_comp() always uses the extended syntax, even with libc's regex */
+	if (expr->mflags & PAT_MF_IGNORE_CASE)
+		flags |= RXSET_F_ICASE;
+	rs = rxset_new(flags);
+	if (!rs)
+		return NULL;
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		if (!rxset_add(rs, lst->pat.ref ? lst->pat.ref->pattern : "", &lst->pat))
+			goto fail;
+	}
+
+	if (!rxset_compile(rs))
+		goto fail;
+
+	if (!HA_ATOMIC_CAS(&expr->rxset, &old, rs)) {
+		rxset_free(rs);
+		rs = old;
+	}
+	return rs;
+ fail:
+	rxset_free(rs);
+	return NULL;
+}
+
+/* Releases the regex prefilter of <expr> after its list of patterns changed.
+ * The expression must be write-locked.
+ */
+static inline void pat_rxset_drop(struct pattern_expr *expr)
+{
+	rxset_free(expr->rxset);
+	expr->rxset = NULL;
+}
+
+/* Runs the regexes of prefilter <rs> which may match sample <smp>, in list
+ * order, capturing the sub-matches if <cap> is set. <*found> is set to the
+ * first matching pattern, or NULL if none matches. Returns 0 if the thread's
+ * work area could not be allocated, in which case all regexes must be run.
+ */
+static int pat_rxset_exec(const struct rxset *rs, struct sample *smp, int cap, struct pattern **found)
+{
+	size_t size = rxset_area_size(rs);
+	struct pattern *pattern;
+	unsigned long *cand, bits;
+	unsigned int w, i, nb_cand = 0, seen = rs->nb_items;
+	void *area;
+
+	if (unlikely(size > pat_rx_area_size)) {
+		area = realloc(pat_rx_area, size);
+		if (!area)
+			return 0;
+		pat_rx_area = area;
+		pat_rx_area_size = size;
+	}
+
+	*found = NULL;
+	activity[tid].rx_lookups++;
+	cand = rxset_candidates(rs, smp->data.u.str.area, smp->data.u.str.data, pat_rx_area);
+	for (w = 0; w < rs->map_longs; w++) {
+		for (bits = cand[w]; bits; bits &= bits - 1) {
+			i = w * LONGBITS + __builtin_ctzl(bits);
+			pattern = rs->items[i];
+			nb_cand++;
+			if (cap ? regex_exec_match2(pattern->ptr.reg, smp->data.u.str.area, smp->data.u.str.data,
+			                            MAX_MATCH, pmatch, 0)
+			        : regex_exec2(pattern->ptr.reg, smp->data.u.str.area, smp->data.u.str.data)) {
+				*found = pattern;
+				seen = i + 1;
+				activity[tid].rx_match++;
+				goto done;
+			}
+		}
+	}
+ done:
+	activity[tid].rx_cand += nb_cand;
+	activity[tid].rx_skip += seen - nb_cand;
+	return 1;
+}
+
+/* Returns the compiled trie mirroring the IPv4 tree of <expr>, or its IPv6
+ * tree if <v6> is set, building it if needed. It is only used with
+ * "tune.pattern.ip-trie on". Concurrency is handled as for the automatons
+ * above, and modifications of the trees drop the tries (pat_iptrie_drop()).
+ * Returns NULL if disabled or out of memory, in which case the tree must be
+ * used.
+ */
+static struct poptrie *pat_iptrie_get(struct pattern_expr *expr, int v6)
+{
+	struct poptrie **slot = v6 ? &expr->iptrie_2 : &expr->iptrie;
+	struct eb_root *root = v6 ? &expr->pattern_tree_2 : &expr->pattern_tree;
+	struct ebmb_node *node;
+	struct poptrie *pt, *old = NULL;
+
+	if (!(global.tune.options & GTUNE_PATTERN_IPTRIE))
+		return NULL;
+
+	pt = HA_ATOMIC_LOAD(slot);
+	if (likely(pt))
+		return pt;
+
+	pt = poptrie_new(v6 ? 128 : 32);
+	if (!pt)
+		return NULL;
+
+	for (node = ebmb_first(root); node; node = ebmb_next(node)) {
+		if (!poptrie_add(pt, node->key, node->node.pfx, node))
+			goto fail;
+	}
+
+	if (!poptrie_compile(pt))
+		goto fail;
+
+	if (!HA_ATOMIC_CAS(slot, &old, pt)) {
+		poptrie_free(pt);
+		pt = old;
+	}
+	return pt;
+ fail:
+	poptrie_free(pt);
+	return NULL;
+}
+
+/* Releases the tries of <expr> after its trees changed. The expression must
+ * be write-locked.
+ */
+static inline void pat_iptrie_drop(struct pattern_expr *expr)
+{
+	poptrie_free(expr->iptrie);
+	poptrie_free(expr->iptrie_2);
+	expr->iptrie = expr->iptrie_2 = NULL;
+}
+
+/* Builds the tries of <expr> once its patterns are loaded so that the first
+ * lookups do not have to, if it indexes IP addresses.
+ */
+static inline void pat_iptrie_build(struct pattern_expr *expr)
+{
+	if (expr->pat_head->index != pat_idx_tree_ip)
+		return;
+	pat_iptrie_get(expr, 0);
+	pat_iptrie_get(expr, 1);
+}
+
+/* Builds the indexes derived from the patterns of <expr> which its lookups
+ * would otherwise build on first use, so that the lookups following the commit
+ * of a new version do not have to. Indexes which fail to build are simply left
+ * to the lookups.
+ */
+static void pat_prebuild(struct pattern_expr *expr)
+{
+	struct pattern *(*match)(struct sample *, struct pattern_expr *, int) = expr->pat_head->match;
+
+	pat_iptrie_build(expr);
+	if (match == pat_match_sub || match == pat_match_beg)
+		pat_acm_get(expr, 0);
+	else if (match == pat_match_end)
+		pat_acm_get(expr, ACM_F_REV);
+	else if (match == pat_match_dom)
+		pat_domtrie_get(expr);
+	else if (match == pat_match_reg || match == pat_match_regm)
+		pat_rxset_get(expr);
+}
+
+/* Looks up the longest prefix matching IPv4 address <addr> in <expr>, or IPv6
+ * address <addr> if <v6> is set. Returns the tree node or NULL.
+ */
+static inline struct ebmb_node *pat_lookup_ip(struct pattern_expr *expr, int v6, const void *addr)
+{
+	struct poptrie *pt = pat_iptrie_get(expr, v6);
+
+	if (pt)
+		return v6 ? poptrie_lookup6(pt, addr) : poptrie_lookup4(pt, addr);
+	return ebmb_lookup_longest(v6 ? &expr->pattern_tree_2 : &expr->pattern_tree, addr);
+}
+
+/* Returns non-zero if lookups in <expr> may be answered by image <img>, which
+ * is only indexed for exact strings and networks. Other match methods need the
+ * image's entries to be loaded (pat_ref_unpack()).
+ */
+static int pat_img_usable(const struct mapimg *img, const struct pattern_expr *expr)
+{
+	const struct pattern_head *head = expr->pat_head;
+
+	if (head->match == pat_match_str && head->parse == pat_parse_str &&
+	    head->index == pat_idx_tree_str && !(expr->mflags & PAT_MF_IGNORE_CASE))
+		return 1;
+	if (head->match == pat_match_ip && head->parse == pat_parse_ip &&
+	    head->index == pat_idx_tree_ip && (img->flags & MAPIMG_F_IP))
+		return 1;
+	return 0;
+}
+
+/* Returns the value of entry <idx> of the image of <expr> parsed in a thread
+ * local sample, or NULL if there is no value. pattern_exec_match() copies it
+ * since the image may be released once the lock is dropped.
+ */
+static struct sample_data *pat_img_data(struct pattern_expr *expr, int idx)
+{
+	const char *val = mapimg_val(expr->img, idx);
+
+	if (!val || !expr->pat_head->parse_smp)
+		return NULL;
+	if (!expr->pat_head->parse_smp(val, &static_img_data))
+		return NULL;
+	return &static_img_data;
+}
+
+/* Looks up address <addr> (IPv6 if <v6> is set) in the image of <expr> if it
+ * has one. Returns non-zero if it holds a network at least as specific as the
+ * one found in the expression's tree at <node> if any, after filling
+ * static_pattern if <fill> is set. Entries of the image come first in the
+ * file, so they win over identical networks added at run time.
+ */
+static int pat_img_match_ip(struct pattern_expr *expr, int v6, const void *addr,
+                            struct ebmb_node *node, int fill)
+{
+	unsigned char key[16];
+	unsigned int len;
+	int idx, is_v6;
+
+	if (!expr->img)
+		return 0;
+
+	idx = mapimg_lookup_ip(expr->img, v6, addr);
+	if (idx < 0)
+		return 0;
+
+	if (!node && !fill)
+		return 1;
+
+	if (!mapimg_parse_ip(mapimg_key(expr->img, idx), &is_v6, key, &len))
+		return 0;
+	if (node && len < node->node.pfx)
+		return 0;
+
+	if (fill) {
+		static_pattern.data = pat_img_data(expr, idx);
+		static_pattern.ref = NULL;
+		static_pattern.sflags = PAT_SF_TREE | PAT_SF_IMG;
+		if (is_v6) {
+			static_pattern.type = SMP_T_IPV6;
+			memcpy(&static_pattern.val.ipv6.addr, key, 16);
+			static_pattern.val.ipv6.mask = len;
+		}
+		else {
+			static_pattern.type = SMP_T_IPV4;
+			static_pattern.val.ipv4.addr.s_addr = read_u32(key);
+			cidr2dotted(len, &static_pattern.val.ipv4.mask);
+		}
+	}
+	return 1;
+}
+
 /* always return false */
 struct pattern *pat_match_nothing(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -457,7 +924,23 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
-	struct lru64 *lru = NULL;
+	unsigned long long key = 0;
+	int idx;
+
+	/* Lookup a string in the image, it precedes the tree. */
+	if (expr->img) {
+		idx = mapimg_find(expr->img, smp->data.u.str.area, smp->data.u.str.data);
+		if (idx >= 0) {
+			if (fill) {
+				static_pattern.data = pat_img_data(expr, idx);
+				static_pattern.ref = NULL;
+				static_pattern.sflags = PAT_SF_TREE | PAT_SF_IMG;
+				static_pattern.type = SMP_T_STR;
+				static_pattern.ptr.str = (char *)mapimg_key(expr->img, idx);
+			}
+			return &static_pattern;
+		}
+	}
 
 	/* Lookup a string in the expression's pattern tree. */
 	if (!eb_is_empty(&expr->pattern_tree)) {
@@ -503,17 +986,8 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	/* look in the list */
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH64(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
-	}
-
+	if (pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -529,8 +1003,7 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
-	if (lru)
-		lru64_commit(lru, ret, expr, expr->revision, NULL);
+	pat_cache_store(expr, key, ret);
 
 	return ret;
 }
@@ -541,18 +1014,10 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
-	struct lru64 *lru = NULL;
-
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	unsigned long long key = 0;
 
-		lru = lru64_get(XXH64(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
-	}
+	if (pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -566,8 +1031,7 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
-	if (lru)
-		lru64_commit(lru, ret, expr, expr->revision, NULL);
+	pat_cache_store(expr, key, ret);
 
 	return ret;
 }
@@ -581,6 +1045,14 @@ struct pattern *pat_match_regm(struct sample *smp, struct pattern_expr *expr, in
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
+	struct rxset *rs;
+
+	rs = pat_rxset_get(expr);
+	if (rs && pat_rxset_exec(rs, smp, 1, &ret)) {
+		if (ret)
+			smp->ctx.a[0] = pmatch;
+		return ret;
+	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -597,25 +1069,23 @@ struct pattern *pat_match_regm(struct sample *smp, struct pattern_expr *expr, in
 }
 
 /* Executes a regex. It temporarily changes the data to add a trailing zero,
- * and restores the previous character when leaving.
+ * and restores the previous character when leaving. With the prefilter, only
+ * the regexes which may match are run.
  */
 struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
-	struct lru64 *lru = NULL;
+	unsigned long long key = 0;
+	struct rxset *rs;
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	rs = pat_rxset_get(expr);
+	if (pat_cache_wanted(rs) && pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
 
-		lru = lru64_get(XXH64(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
-	}
+	if (rs && pat_rxset_exec(rs, smp, 0, &ret))
+		goto leave;
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -626,8 +1096,8 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
-	if (lru)
-		lru64_commit(lru, ret, expr, expr->revision, NULL);
+ leave:
+	pat_cache_store(expr, key, ret);
 
 	return ret;
 }
@@ -641,7 +1111,8 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
-	struct lru64 *lru = NULL;
+	unsigned long long key = 0;
+	struct acm *acm;
 
 	/* Lookup a string in the expression's pattern tree. */
 	if (!eb_is_empty(&expr->pattern_tree)) {
@@ -682,15 +1153,16 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	/* look in the list */
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	if (LIST_ISEMPTY(&expr->patterns))
+		return NULL;
 
-		lru = lru64_get(XXH64(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	acm = pat_acm_get(expr, 0);
+	if (pat_cache_wanted(acm) && pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
+
+	if (likely(acm)) {
+		ret = acm_find_pfx(acm, smp->data.u.str.area, smp->data.u.str.data);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -707,9 +1179,8 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 		ret = pattern;
 		break;
 	}
-
-	if (lru)
-		lru64_commit(lru, ret, expr, expr->revision, NULL);
+ leave:
+	pat_cache_store(expr, key, ret);
 
 	return ret;
 }
@@ -721,17 +1192,16 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
-	struct lru64 *lru = NULL;
+	unsigned long long key = 0;
+	struct acm *acm;
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	acm = pat_acm_get(expr, ACM_F_REV);
+	if (pat_cache_wanted(acm) && pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
 
-		lru = lru64_get(XXH64(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	if (likely(acm)) {
+		ret = acm_find_pfx(acm, smp->data.u.str.area, smp->data.u.str.data);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -748,15 +1218,15 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 		ret = pattern;
 		break;
 	}
-
-	if (lru)
-		lru64_commit(lru, ret, expr, expr->revision, NULL);
+ leave:
+	pat_cache_store(expr, key, ret);
 
 	return ret;
 }
 
-/* Checks that the pattern is included inside the tested string.
- * NB: Suboptimal, should be rewritten using a Boyer-Moore method.
+/* Checks that the pattern is included inside the tested string. All patterns
+ * are looked up at once using an Aho-Corasick automaton, the list is only
+ * walked if it could not be built.
  */
 struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -766,17 +1236,16 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
-	struct lru64 *lru = NULL;
+	unsigned long long key = 0;
+	struct acm *acm;
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	acm = pat_acm_get(expr, 0);
+	if (pat_cache_wanted(acm) && pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
 
-		lru = lru64_get(XXH64(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	if (likely(acm)) {
+		ret = acm_find_sub(acm, smp->data.u.str.area, smp->data.u.str.data);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -808,8 +1277,7 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
  leave:
-	if (lru)
-		lru64_commit(lru, ret, expr, expr->revision, NULL);
+	pat_cache_store(expr, key, ret);
 
 	return ret;
 }
@@ -889,18 +1357,37 @@ struct pattern *pat_match_dir(struct sample *smp, struct pattern_expr *expr, int
 /* Checks that the pattern is included inside the tested string, but enclosed
  * between the delmiters '/', '?', '.' or ":" or at the beginning or end of
  * the string. Delimiters at the beginning or end of the pattern are ignored.
+ * All patterns are looked up at once using a trie of their labels, the list
+ * is only walked if it could not be built.
  */
 struct pattern *pat_match_dom(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	struct pattern_list *lst;
 	struct pattern *pattern;
+	struct pattern *ret = NULL;
+	unsigned long long key = 0;
+	struct domtrie *dt;
+
+	dt = pat_domtrie_get(expr);
+	if (pat_cache_wanted(dt) && pat_cache_lookup(smp, expr, &key, &ret))
+		return ret;
+
+	if (likely(dt)) {
+		ret = domtrie_find(dt, smp->data.u.str.area, smp->data.u.str.data);
+		goto leave;
+	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
-		if (match_word(smp, pattern, expr->mflags, make_4delim('/', '?', '.', ':')))
-			return pattern;
+		if (match_word(smp, pattern, expr->mflags, make_4delim('/', '?', '.', ':'))) {
+			ret = pattern;
+			break;
+		}
 	}
-	return NULL;
+ leave:
+	pat_cache_store(expr, key, ret);
+
+	return ret;
 }
 
 /* Checks that the integer in <test> is included between min and max */
@@ -943,13 +1430,20 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern_list *lst;
 	struct pattern *pattern;
 
+	/* The trees and their trie are never looked up through the cache, as
+	 * their results are returned in the thread-local static_pattern, and
+	 * the cache is only keyed on strings.
+	 */
+
 	/* The input sample is IPv4. Try to match in the trees. */
 	if (smp->data.type == SMP_T_IPV4) {
 		/* Lookup an IPv4 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
 		s = &smp->data.u.ipv4;
-		node = ebmb_lookup_longest(&expr->pattern_tree, &s->s_addr);
+		node = pat_lookup_ip(expr, 0, &s->s_addr);
+		if (pat_img_match_ip(expr, 0, &s->s_addr, node, fill))
+			return &static_pattern;
 		if (node) {
 			if (fill) {
 				elt = ebmb_entry(node, struct pattern_tree, node);
@@ -971,7 +1465,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		memset(&tmp6, 0, 10);
 		write_u16(&tmp6.s6_addr[10], htons(0xffff));
 		write_u32(&tmp6.s6_addr[12], smp->data.u.ipv4.s_addr);
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &tmp6);
+		node = pat_lookup_ip(expr, 1, &tmp6);
+		if (pat_img_match_ip(expr, 1, &tmp6, node, fill))
+			return &static_pattern;
 		if (node) {
 			if (fill) {
 				elt = ebmb_entry(node, struct pattern_tree, node);
@@ -991,7 +1487,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		/* Lookup an IPv6 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &smp->data.u.ipv6);
+		node = pat_lookup_ip(expr, 1, &smp->data.u.ipv6);
+		if (pat_img_match_ip(expr, 1, &smp->data.u.ipv6, node, fill))
+			return &static_pattern;
 		if (node) {
 			if (fill) {
 				elt = ebmb_entry(node, struct pattern_tree, node);
@@ -1024,7 +1522,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 			/* Lookup an IPv4 address in the expression's pattern tree using the longest
 			 * match method.
 			 */
-			node = ebmb_lookup_longest(&expr->pattern_tree, &v4);
+			node = pat_lookup_ip(expr, 0, &v4);
+			if (pat_img_match_ip(expr, 0, &v4, node, fill))
+				return &static_pattern;
 			if (node) {
 				if (fill) {
 					elt = ebmb_entry(node, struct pattern_tree, node);
@@ -1108,6 +1608,7 @@ void pat_prune_val(struct pattern_expr *expr)
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
+	pat_iptrie_drop(expr);
 	expr->revision = rdtsc();
 }
 
@@ -1125,6 +1626,8 @@ void pat_prune_ptr(struct pattern_expr *expr)
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
+	pat_acm_drop(expr);
+	pat_domtrie_drop(expr);
 	expr->revision = rdtsc();
 }
 
@@ -1142,6 +1645,7 @@ void pat_prune_reg(struct pattern_expr *expr)
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
+	pat_rxset_drop(expr);
 	expr->revision = rdtsc();
 }
 
@@ -1226,6 +1730,8 @@ int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 	/* chain pattern in the expression */
 	LIST_ADDQ(&expr->patterns, &patl->list);
+	pat_acm_drop(expr);
+	pat_domtrie_drop(expr);
 	expr->revision = rdtsc();
 
 	/* that's ok */
@@ -1255,6 +1761,7 @@ int pat_idx_list_reg_cap(struct pattern_expr *expr, struct pattern *pat, int cap
 
 	/* chain pattern in the expression */
 	LIST_ADDQ(&expr->patterns, &patl->list);
+	pat_rxset_drop(expr);
 	expr->revision = rdtsc();
 
 	/* that's ok */
@@ -1304,6 +1811,7 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 			/* Insert the entry. */
 			ebmb_insert_prefix(&expr->pattern_tree, &node->node, 4);
+			pat_iptrie_drop(expr);
 			expr->revision = rdtsc();
 
 			/* that's ok */
@@ -1332,6 +1840,7 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 
 		/* Insert the entry. */
 		ebmb_insert_prefix(&expr->pattern_tree_2, &node->node, 16);
+		pat_iptrie_drop(expr);
 		expr->revision = rdtsc();
 
 		/* that's ok */
@@ -1483,6 +1992,7 @@ void pat_del_tree_ip(struct pattern_expr *expr, struct pat_ref_elt *ref)
 		free(elt->data);
 		free(elt);
 	}
+	pat_iptrie_drop(expr);
 	expr->revision = rdtsc();
 }
 
@@ -1502,6 +2012,8 @@ void pat_del_list_ptr(struct pattern_expr *expr, struct pat_ref_elt *ref)
 		free(pat->pat.data);
 		free(pat);
 	}
+	pat_acm_drop(expr);
+	pat_domtrie_drop(expr);
 	expr->revision = rdtsc();
 }
 
@@ -1549,6 +2061,7 @@ void pat_del_list_reg(struct pattern_expr *expr, struct pat_ref_elt *ref)
 		free(pat->pat.data);
 		free(pat);
 	}
+	pat_rxset_drop(expr);
 	expr->revision = rdtsc();
 }
 
@@ -1558,6 +2071,12 @@ void pattern_init_expr(struct pattern_expr *expr)
 	expr->revision = 0;
 	expr->pattern_tree = EB_ROOT;
 	expr->pattern_tree_2 = EB_ROOT;
+	expr->acm = expr->acm_rev = NULL;
+	expr->domtrie = NULL;
+	expr->rxset = NULL;
+	expr->iptrie = expr->iptrie_2 = NULL;
+	expr->img = NULL;
+	LIST_INIT(&expr->users);
 }
 
 void pattern_init_head(struct pattern_head *head)
@@ -1666,6 +2185,9 @@ int pat_ref_delete(struct pat_ref *ref, const char *key)
 	struct bref *bref, *back;
 	int found = 0;
 
+	if (ref->img && mapimg_find(ref->img, key, strlen(key)) >= 0 && !pat_ref_unpack(ref))
+		return 0;
+
 	/* delete pattern from reference */
 	list_for_each_entry_safe(elt, safe, &ref->head, list) {
 		if (strcmp(key, elt->pattern) == 0) {
@@ -1707,6 +2229,9 @@ struct pat_ref_elt *pat_ref_find_elt(struct pat_ref *ref, const char *key)
 {
 	struct pat_ref_elt *elt;
 
+	if (ref->img && mapimg_find(ref->img, key, strlen(key)) >= 0 && !pat_ref_unpack(ref))
+		return NULL;
+
 	list_for_each_entry(elt, &ref->head, list) {
 		if (strcmp(key, elt->pattern) == 0)
 			return elt;
@@ -1797,6 +2322,11 @@ int pat_ref_set(struct pat_ref *ref, const char *key, const char *value, char **
 	else
 		merr = NULL;
 
+	if (ref->img && mapimg_find(ref->img, key, strlen(key)) >= 0 && !pat_ref_unpack(ref)) {
+		memprintf(err, "out of memory error");
+		return 0;
+	}
+
 	/* Look for pattern in the reference. */
 	list_for_each_entry(elt, &ref->head, list) {
 		if (strcmp(key, elt->pattern) == 0) {
@@ -1858,6 +2388,12 @@ struct pat_ref *pat_ref_new(const char *reference, const char *display, unsigned
 
 	LIST_INIT(&ref->head);
 	LIST_INIT(&ref->pat);
+	ref->img = NULL;
+	ref->ver = NULL;
+	ref->reload = NULL;
+	ref->last_ver = 0;
+	ref->gen = 0;
+	ref->cache_ctr = NULL;
 	HA_SPIN_INIT(&ref->lock);
 	LIST_ADDQ(&pattern_reference, &ref->list);
 
@@ -1894,29 +2430,35 @@ struct pat_ref *pat_ref_newid(int unique_id, const char *display, unsigned int f
 	ref->unique_id = unique_id;
 	LIST_INIT(&ref->head);
 	LIST_INIT(&ref->pat);
+	ref->img = NULL;
+	ref->ver = NULL;
+	ref->reload = NULL;
+	ref->last_ver = 0;
+	ref->gen = 0;
+	ref->cache_ctr = NULL;
 	HA_SPIN_INIT(&ref->lock);
 	LIST_ADDQ(&pattern_reference, &ref->list);
 
 	return ref;
 }
 
-/* This function adds entry to <ref>. It can failed with memory error.
- * If the function fails, it returns 0.
+/* This function allocates a new entry for <pattern> and <sample> found at
+ * line <line>. It returns NULL on memory error.
  */
-int pat_ref_append(struct pat_ref *ref, char *pattern, char *sample, int line)
+static struct pat_ref_elt *pat_ref_new_elt(const char *pattern, const char *sample, int line)
 {
 	struct pat_ref_elt *elt;
 
 	elt = malloc(sizeof(*elt));
 	if (!elt)
-		return 0;
+		return NULL;
 
 	elt->line = line;
 
 	elt->pattern = strdup(pattern);
 	if (!elt->pattern) {
 		free(elt);
-		return 0;
+		return NULL;
 	}
 
 	if (sample) {
@@ -1924,29 +2466,41 @@ int pat_ref_append(struct pat_ref *ref, char *pattern, char *sample, int line)
 		if (!elt->sample) {
 			free(elt->pattern);
 			free(elt);
-			return 0;
+			return NULL;
 		}
 	}
 	else
 		elt->sample = NULL;
 
 	LIST_INIT(&elt->back_refs);
-	LIST_ADDQ(&ref->head, &elt->list);
+	return elt;
+}
 
+/* This function adds entry to <ref>. It can failed with memory error.
+ * If the function fails, it returns 0.
+ */
+int pat_ref_append(struct pat_ref *ref, char *pattern, char *sample, int line)
+{
+	struct pat_ref_elt *elt;
+
+	elt = pat_ref_new_elt(pattern, sample, line);
+	if (!elt)
+		return 0;
+
+	LIST_ADDQ(&ref->head, &elt->list);
 	return 1;
 }
 
-/* This function create sample found in <elt>, parse the pattern also
- * found in <elt> and insert it in <expr>. The function copy <patflags>
- * in <expr>. If the function fails, it returns0 and <err> is filled.
- * In success case, the function returns 1.
+/* This function creates the sample found in <elt> and parses the pattern
+ * also found in <elt> into <pattern> for <expr>, without indexing it. If the
+ * function fails, it returns 0 and <err> is filled, otherwise it returns 1
+ * and the caller is responsible for pattern->data.
  */
 static inline
-int pat_ref_push(struct pat_ref_elt *elt, struct pattern_expr *expr,
-                 int patflags, char **err)
+int pat_ref_parse_elt(struct pat_ref_elt *elt, struct pattern_expr *expr,
+                      struct pattern *pattern, char **err)
 {
 	struct sample_data *data;
-	struct pattern pattern;
 
 	/* Create sample */
 	if (elt->sample && expr->pat_head->parse_smp) {
@@ -1967,21 +2521,38 @@ int pat_ref_push(struct pat_ref_elt *elt, struct pattern_expr *expr,
 		data = NULL;
 
 	/* initialise pattern */
-	memset(&pattern, 0, sizeof(pattern));
-	pattern.data = data;
-	pattern.ref = elt;
+	memset(pattern, 0, sizeof(*pattern));
+	pattern->data = data;
+	pattern->ref = elt;
 
 	/* parse pattern */
-	if (!expr->pat_head->parse(elt->pattern, &pattern, expr->mflags, err)) {
+	if (!expr->pat_head->parse(elt->pattern, pattern, expr->mflags, err)) {
 		free(data);
 		return 0;
 	}
 
+	return 1;
+}
+
+/* This function create sample found in <elt>, parse the pattern also
+ * found in <elt> and insert it in <expr>. The function copy <patflags>
+ * in <expr>. If the function fails, it returns0 and <err> is filled.
+ * In success case, the function returns 1.
+ */
+static inline
+int pat_ref_push(struct pat_ref_elt *elt, struct pattern_expr *expr,
+                 int patflags, char **err)
+{
+	struct pattern pattern;
+
+	if (!pat_ref_parse_elt(elt, expr, &pattern, err))
+		return 0;
+
 	HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
 	/* index pattern */
 	if (!expr->pat_head->index(expr, &pattern, err)) {
 		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
-		free(data);
+		free(pattern.data);
 		return 0;
 	}
 	HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
@@ -1989,11 +2560,103 @@ int pat_ref_push(struct pat_ref_elt *elt, struct pattern_expr *expr,
 	return 1;
 }
 
+/* This function loads the entries of the image of <ref> as regular entries
+ * placed before those added at run time, reindexes the expressions which were
+ * looking up the image, and releases the image. This is needed before an entry
+ * of the image is modified or deleted, or when an expression's match method
+ * cannot use the image. The expressions are locked while being reindexed,
+ * which may take a while on large images. Like on reload, entries which fail
+ * to load are ignored but logged. It returns 0 on memory error, in which case
+ * the image is left in place, otherwise 1.
+ */
+int pat_ref_unpack(struct pat_ref *ref)
+{
+	struct mapimg *img = ref->img;
+	struct list elts = LIST_HEAD_INIT(elts);
+	struct pat_ref_elt *elt, *safe;
+	struct pattern_expr *expr;
+	struct pattern pattern;
+	unsigned int i;
+	char *err = NULL;
+
+	if (!img)
+		return 1;
+
+	for (i = 0; i < img->nb_entries; i++) {
+		elt = pat_ref_new_elt(mapimg_key(img, i), mapimg_val(img, i), img->ent[i].line);
+		if (!elt)
+			goto fail;
+		LIST_ADDQ(&elts, &elt->list);
+	}
+	LIST_SPLICE(&ref->head, &elts);
+
+	list_for_each_entry(expr, &ref->pat, list) {
+		if (!expr->img)
+			continue;
+
+		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		expr->pat_head->prune(expr);
+		list_for_each_entry(elt, &ref->head, list) {
+			if (pat_ref_parse_elt(elt, expr, &pattern, &err)) {
+				if (expr->pat_head->index(expr, &pattern, &err))
+					continue;
+				free(pattern.data);
+			}
+			if (err)
+				send_log(NULL, LOG_NOTICE, "%s", err);
+			free(err);
+			err = NULL;
+		}
+		pat_iptrie_build(expr);
+		expr->img = NULL;
+		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+	}
+
+	ref->img = NULL;
+	mapimg_close(img);
+	return 1;
+
+ fail:
+	list_for_each_entry_safe(elt, safe, &elts, list) {
+		LIST_DEL(&elt->list);
+		free(elt->pattern);
+		free(elt->sample);
+		free(elt);
+	}
+	return 0;
+}
+
+/* Checks that the values of the entries of image <img> loaded from <filename>
+ * can be parsed for <expr>, like they would be when loading them. It returns
+ * 0 and fills <err> if one cannot, otherwise 1.
+ */
+static int pat_img_check(const struct mapimg *img, struct pattern_expr *expr,
+                         const char *filename, char **err)
+{
+	struct sample_data data;
+	const char *val;
+	unsigned int i;
+
+	if (!expr->pat_head->parse_smp)
+		return 1;
+
+	for (i = 0; i < img->nb_entries; i++) {
+		val = mapimg_val(img, i);
+		if (val && !expr->pat_head->parse_smp(val, &data)) {
+			memprintf(err, "unable to parse '%s' at line %d of file '%s'",
+			          val, img->ent[i].line, filename);
+			return 0;
+		}
+	}
+	return 1;
+}
+
 /* This function adds entry to <ref>. It can failed with memory error. The new
  * entry is added at all the pattern_expr registered in this reference. The
  * function stop on the first error encountered. It returns 0 and err is
  * filled. If an error is encountered, the complete add operation is cancelled.
- * If the insertion is a success the function returns 1.
+ * If the insertion is a success the function returns 1. If <ref> is being
+ * reloaded, the entry is also queued for the new version.
  */
 int pat_ref_add(struct pat_ref *ref,
                 const char *pattern, const char *sample,
@@ -2040,99 +2703,364 @@ int pat_ref_add(struct pat_ref *ref,
 		}
 	}
 
+	/* a reload in progress will replace the entries, it must keep this one */
+	if (ref->reload) {
+		struct pat_ref_elt *copy = pat_ref_new_elt(pattern, sample, -1);
+
+		if (!copy) {
+			pat_ref_delete_by_id(ref, elt);
+			memprintf(err, "out of memory error");
+			return 0;
+		}
+		LIST_ADDQ(&ref->reload->added, &copy->list);
+	}
+
 	return 1;
 }
 
-/* This function prunes <ref>, replaces all references by the references
- * of <replace>, and reindexes all the news values.
- *
- * The patterns are loaded in best effort and the errors are ignored,
- * but written in the logs.
+/* The following functions manage versions of the contents of a reference.
+ * A version is prepared and filled out of sight of the lookups, then committed
+ * at once : each expression of the reference is replaced by the expression of
+ * the version built for it, which the lookups start to use on their next call,
+ * and the replaced contents are released once no thread may still be using
+ * them. Only the reference's lock is taken, and only for short durations, so
+ * that even huge maps may be replaced without stalling the lookups.
  */
-void pat_ref_reload(struct pat_ref *ref, struct pat_ref *replace)
+
+/* Releases all the entries of list <head>, which nothing may reference. */
+static void pat_ref_free_elts(struct list *head)
 {
-	struct pattern_expr *expr;
 	struct pat_ref_elt *elt, *safe;
+
+	list_for_each_entry_safe(elt, safe, head, list) {
+		LIST_DEL(&elt->list);
+		free(elt->pattern);
+		free(elt->sample);
+		free(elt);
+	}
+}
+
+/* Releases version <ver> and its contents, which nothing may reference. */
+static void pat_ref_free_ver(struct pat_ref_ver *ver)
+{
+	int i;
+
+	for (i = 0; i < ver->nb_expr; i++) {
+		ver->expr[i]->pat_head->prune(ver->expr[i]);
+		free(ver->expr[i]);
+	}
+	pat_ref_free_elts(&ver->head);
+	pat_ref_free_elts(&ver->added);
+	mapimg_close(ver->img);
+	free(ver->expr);
+	free(ver);
+}
+
+/* Releases the contents replaced by a version, called once no thread may be
+ * using them anymore.
+ */
+static void pat_ref_release_ver(struct qsbr_node *node)
+{
+	pat_ref_free_ver(container_of(node, struct pat_ref_ver, node));
+}
+
+/* Allocates an empty version of <ref>, with one empty expression for each of
+ * the expressions of <ref>, using the same match method and flags. The version
+ * is not attached to <ref>. The reference's lock must be held. It returns NULL
+ * on memory error.
+ */
+static struct pat_ref_ver *pat_ref_new_ver(struct pat_ref *ref)
+{
+	struct pat_ref_ver *ver;
+	struct pattern_expr *live, *expr;
+
+	ver = calloc(1, sizeof(*ver));
+	if (!ver)
+		return NULL;
+
+	LIST_INIT(&ver->head);
+	LIST_INIT(&ver->added);
+	list_for_each_entry(live, &ref->pat, list)
+		ver->nb_expr++;
+
+	ver->expr = calloc(ver->nb_expr ? ver->nb_expr : 1, sizeof(*ver->expr));
+	if (!ver->expr) {
+		free(ver);
+		return NULL;
+	}
+
+	ver->nb_expr = 0;
+	list_for_each_entry(live, &ref->pat, list) {
+		expr = malloc(sizeof(*expr));
+		if (!expr) {
+			pat_ref_free_ver(ver);
+			return NULL;
+		}
+		pattern_init_expr(expr);
+		expr->mflags = live->mflags;
+		expr->pat_head = live->pat_head;
+		expr->ref = ref;
+		LIST_INIT(&expr->list);
+		HA_RWLOCK_INIT(&expr->lock);
+		ver->expr[ver->nb_expr++] = expr;
+	}
+	return ver;
+}
+
+/* Publishes version <ver> of <ref>. Each expression of <ref> is replaced with
+ * the one of <ver> at the same position, both in <ref> and for all the users
+ * of the expression, the entries and the image are swapped, and <ver> is
+ * retired with the replaced contents. Dumps in progress stop after the last
+ * entry they dumped. The reference's lock must be held.
+ */
+static void pat_ref_publish(struct pat_ref *ref, struct pat_ref_ver *ver)
+{
+	struct list elts = LIST_HEAD_INIT(elts);
+	struct pattern_expr_list *user;
+	struct pattern_expr *prev, *next, *expr;
+	struct pat_ref_elt *elt;
 	struct bref *bref, *back;
-	struct pattern pattern;
+	int i = 0;
 
+	list_for_each_entry_safe(prev, next, &ref->pat, list) {
+		if (i == ver->nb_expr)
+			break;
+		expr = ver->expr[i];
+		expr->revision = rdtsc();
 
-	HA_SPIN_LOCK(PATREF_LOCK, &ref->lock);
-	list_for_each_entry(expr, &ref->pat, list) {
-		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
+		list_for_each_entry(user, &prev->users, by_expr)
+			HA_ATOMIC_STORE(&user->expr, expr);
+		LIST_SPLICE(&expr->users, &prev->users);
+		LIST_INIT(&prev->users);
+
+		LIST_ADD(&prev->list, &expr->list);
+		LIST_DEL(&prev->list);
+		LIST_INIT(&prev->list);
+		ver->expr[i++] = prev;
 	}
 
-	/* all expr are locked, we can safely remove all pat_ref */
-	list_for_each_entry_safe(elt, safe, &ref->head, list) {
+	list_for_each_entry(elt, &ref->head, list) {
 		list_for_each_entry_safe(bref, back, &elt->back_refs, users) {
-			/*
-			 * we have to unlink all watchers. We must not relink them if
-			 * this elt  was the last one in the list.
-			 */
 			LIST_DEL(&bref->users);
 			LIST_INIT(&bref->users);
-			if (elt->list.n != &ref->head)
-				LIST_ADDQ(&LIST_ELEM(elt->list.n, typeof(elt), list)->back_refs, &bref->users);
-			bref->ref = elt->list.n;
+			bref->ref = &ref->head;
 		}
-		LIST_DEL(&elt->list);
-		free(elt->pattern);
-		free(elt->sample);
-		free(elt);
 	}
 
-	/* switch pat_ret_elt lists */
-	LIST_ADD(&replace->head, &ref->head);
-	LIST_DEL(&replace->head);
+	/* switch pat_ref_elt lists */
+	LIST_SPLICE(&elts, &ref->head);
+	LIST_INIT(&ref->head);
+	LIST_SPLICE(&ref->head, &ver->head);
+	LIST_INIT(&ver->head);
+	LIST_SPLICE(&ver->head, &elts);
 
-	list_for_each_entry(expr, &ref->pat, list) {
-		expr->pat_head->prune(expr);
-		list_for_each_entry(elt, &ref->head, list) {
-			char *err = NULL;
-			struct sample_data *data = NULL;
-
-			/* Create sample */
-			if (elt->sample && expr->pat_head->parse_smp) {
-				/* New sample. */
-				data = malloc(sizeof(*data));
-				if (!data)
-					continue;
+	ver->img = ref->img;
+	ref->img = NULL;
+	ref->gen++;
 
-				/* Parse value. */
-				if (!expr->pat_head->parse_smp(elt->sample, data)) {
-					memprintf(&err, "unable to parse '%s'", elt->sample);
-					send_log(NULL, LOG_NOTICE, "%s", err);
-					free(err);
-					free(data);
-					continue;
-				}
+	qsbr_retire(&ver->node, pat_ref_release_ver);
+}
 
-			}
+/* Returns the version <id> being prepared for <ref>, or NULL with <err>
+ * filled if it does not exist.
+ */
+static struct pat_ref_ver *pat_ref_get_ver(struct pat_ref *ref, unsigned int id, char **err)
+{
+	if (!ref->ver || ref->ver->id != id) {
+		memprintf(err, "version %u is not being prepared", id);
+		return NULL;
+	}
+	return ref->ver;
+}
 
-			/* initialise pattern */
-			memset(&pattern, 0, sizeof(pattern));
-			pattern.data = data;
-			pattern.ref = elt;
+/* This function prepares a new empty version of <ref>, discarding the one
+ * being prepared, if any. The reference's lock must be held. It returns the
+ * number of the new version, or 0 on memory error.
+ */
+unsigned int pat_ref_prepare(struct pat_ref *ref)
+{
+	struct pat_ref_ver *ver;
 
-			/* parse pattern */
-			if (!expr->pat_head->parse(elt->pattern, &pattern, expr->mflags, &err)) {
-				send_log(NULL, LOG_NOTICE, "%s", err);
-				free(err);
-				free(data);
-				continue;
-			}
+	ver = pat_ref_new_ver(ref);
+	if (!ver)
+		return 0;
 
-			/* index pattern */
-			if (!expr->pat_head->index(expr, &pattern, &err)) {
-				send_log(NULL, LOG_NOTICE, "%s", err);
+	ver->id = ++ref->last_ver;
+	if (!ver->id)
+		ver->id = ++ref->last_ver;
+
+	if (ref->ver)
+		pat_ref_free_ver(ref->ver);
+	ref->ver = ver;
+	return ver->id;
+}
+
+/* This function adds an entry to version <id> of <ref>, and indexes it in all
+ * the expressions of the version. Like with pat_ref_add(), the whole operation
+ * is cancelled on the first error, in which case 0 is returned and <err> is
+ * filled. The reference's lock must be held. It returns 1 on success.
+ */
+int pat_ref_add_ver(struct pat_ref *ref, unsigned int id,
+                    const char *pattern, const char *sample,
+                    char **err)
+{
+	struct pat_ref_ver *ver;
+	struct pat_ref_elt *elt;
+	int i;
+
+	ver = pat_ref_get_ver(ref, id, err);
+	if (!ver)
+		return 0;
+
+	elt = pat_ref_new_elt(pattern, sample, -1);
+	if (!elt) {
+		memprintf(err, "out of memory error");
+		return 0;
+	}
+
+	for (i = 0; i < ver->nb_expr; i++) {
+		if (!pat_ref_push(elt, ver->expr[i], 0, err)) {
+			while (i--)
+				pattern_delete(ver->expr[i], elt);
+			free(elt->pattern);
+			free(elt->sample);
+			free(elt);
+			return 0;
+		}
+	}
+
+	LIST_ADDQ(&ver->head, &elt->list);
+	return 1;
+}
+
+/* This function removes all the entries of version <id> of <ref>, which
+ * remains prepared. The reference's lock must be held. It returns 0 and fills
+ * <err> if the version does not exist or on memory error, otherwise 1.
+ */
+int pat_ref_clear_ver(struct pat_ref *ref, unsigned int id, char **err)
+{
+	struct pat_ref_ver *ver;
+
+	if (!pat_ref_get_ver(ref, id, err))
+		return 0;
+
+	ver = pat_ref_new_ver(ref);
+	if (!ver) {
+		memprintf(err, "out of memory error");
+		return 0;
+	}
+	ver->id = id;
+	pat_ref_free_ver(ref->ver);
+	ref->ver = ver;
+	return 1;
+}
+
+/* Builds the indexes of all the expressions of version <ver>, which must not
+ * be reachable by the lookups yet, so that no lock needs to be held.
+ */
+static void pat_ref_prebuild_ver(struct pat_ref_ver *ver)
+{
+	int i;
+
+	for (i = 0; i < ver->nb_expr; i++)
+		pat_prebuild(ver->expr[i]);
+}
+
+/* This function atomically replaces the contents of <ref> with those of its
+ * version <id>. Lookups performed after the call see the new contents, and
+ * the previous ones are released once no thread may be using them anymore.
+ * The reference's lock must not be held : it is only taken to detach the
+ * version and to publish it, the indexes being built in between. It returns 0
+ * and fills <err> if the version does not exist, otherwise 1.
+ */
+int pat_ref_commit(struct pat_ref *ref, unsigned int id, char **err)
+{
+	struct pat_ref_ver *ver;
+
+	HA_SPIN_LOCK(PATREF_LOCK, &ref->lock);
+	ver = pat_ref_get_ver(ref, id, err);
+	if (ver)
+		ref->ver = NULL;
+	HA_SPIN_UNLOCK(PATREF_LOCK, &ref->lock);
+
+	if (!ver)
+		return 0;
+
+	pat_ref_prebuild_ver(ver);
+
+	HA_SPIN_LOCK(PATREF_LOCK, &ref->lock);
+	pat_ref_publish(ref, ver);
+	HA_SPIN_UNLOCK(PATREF_LOCK, &ref->lock);
+	return 1;
+}
+
+/* Indexes all the entries of list <head> in the expressions of version <ver>
+ * and moves them to the version. Errors are ignored but written in the logs.
+ */
+static void pat_ref_load_ver(struct pat_ref_ver *ver, struct list *head)
+{
+	struct pat_ref_elt *elt, *safe;
+	char *err = NULL;
+	int i;
+
+	list_for_each_entry_safe(elt, safe, head, list) {
+		for (i = 0; i < ver->nb_expr; i++) {
+			if (!pat_ref_push(elt, ver->expr[i], 0, &err)) {
+				if (err)
+					send_log(NULL, LOG_NOTICE, "%s", err);
 				free(err);
-				free(data);
-				continue;
+				err = NULL;
 			}
 		}
-		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+		LIST_DEL(&elt->list);
+		LIST_ADDQ(&ver->head, &elt->list);
 	}
+}
+
+/* This function replaces the entries of <ref> with the entries of <replace>,
+ * and atomically replaces its expressions with new ones where these entries
+ * are indexed. The new expressions and their indexes are built without holding
+ * any lock. The entries added to <ref> in the mean time are added to the new
+ * expressions as well before they are published, so that none is lost.
+ *
+ * The patterns are loaded in best effort and the errors are ignored,
+ * but written in the logs.
+ */
+void pat_ref_reload(struct pat_ref *ref, struct pat_ref *replace)
+{
+	struct list added = LIST_HEAD_INIT(added);
+	struct pat_ref_ver *ver;
+
+	HA_SPIN_LOCK(PATREF_LOCK, &ref->lock);
+	ver = pat_ref_new_ver(ref);
+	if (ver && !ref->reload)
+		ref->reload = ver;
 	HA_SPIN_UNLOCK(PATREF_LOCK, &ref->lock);
+
+	if (!ver) {
+		send_log(NULL, LOG_NOTICE, "out of memory error while reloading '%s'",
+		         ref->reference ? ref->reference : ref->display);
+		return;
+	}
+
+	pat_ref_load_ver(ver, &replace->head);
+	while (1) {
+		pat_ref_prebuild_ver(ver);
+
+		HA_SPIN_LOCK(PATREF_LOCK, &ref->lock);
+		if (LIST_ISEMPTY(&ver->added)) {
+			if (ref->reload == ver)
+				ref->reload = NULL;
+			pat_ref_publish(ref, ver);
+			HA_SPIN_UNLOCK(PATREF_LOCK, &ref->lock);
+			break;
+		}
+		LIST_SPLICE(&added, &ver->added);
+		LIST_INIT(&ver->added);
+		HA_SPIN_UNLOCK(PATREF_LOCK, &ref->lock);
+
+		pat_ref_load_ver(ver, &added);
+	}
 }
 
 /* This function prune all entries of <ref>. This function
@@ -2150,6 +3078,7 @@ int pat_ref_prune(struct pat_ref *ref)
 	list_for_each_entry(expr, &ref->pat, list) {
 		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
 		expr->pat_head->prune(expr);
+		expr->img = NULL;
 		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
 		loops++;
 		/* yield often, some lists may be huge, especially those
@@ -2159,6 +3088,10 @@ int pat_ref_prune(struct pat_ref *ref)
 			return 0;
 	}
 
+	/* the image is not used anymore */
+	mapimg_close(ref->img);
+	ref->img = NULL;
+
 	/* we trash pat_ref_elt in a second time to ensure that data is
 	   free once there is no ref on it */
 	list_for_each_entry_safe(elt, safe, &ref->head, list) {
@@ -2279,6 +3212,7 @@ struct pattern_expr *pattern_new_expr(struct pattern_head *head, struct pat_ref
 
 	/* The new list element reference the pattern_expr. */
 	list->expr = expr;
+	LIST_ADDQ(&expr->users, &list->by_expr);
 
 	/* Link the list element with the pattern_head. */
 	LIST_ADDQ(&head->head, &list->list);
@@ -2457,7 +3391,9 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 	struct pat_ref *ref;
 	struct pattern_expr *expr;
 	struct pat_ref_elt *elt;
+	struct mapimg *img;
 	int reuse = 0;
+	int ret;
 
 	/* Lookup for the existing reference. */
 	ref = pat_ref_lookup(filename);
@@ -2474,8 +3410,25 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 			return 0;
 		}
 
-		if (load_smp) {
+		if (load_smp)
 			ref->flags |= PAT_REF_SMP;
+
+		/* The file may be an image produced by contrib/mapc */
+		ret = mapimg_open(filename, &img, err);
+		if (ret < 0)
+			return 0;
+
+		if (ret > 0) {
+			if (!(img->flags & MAPIMG_F_SMP) != !load_smp) {
+				memprintf(err, "The image \"%s\" was built from a %s column file "
+				               "and cannot be used as a %s column file.",
+				               filename, load_smp ? "one" : "two", load_smp ? "two" : "one");
+				mapimg_close(img);
+				return 0;
+			}
+			ref->img = img;
+		}
+		else if (load_smp) {
 			if (!pat_ref_read_from_file_smp(ref, filename, err))
 				return 0;
 		}
@@ -2545,6 +3498,23 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 	if (reuse)
 		return 1;
 
+	/* The entries of an image are looked up in place when the match method
+	 * allows it, only their values need to be checked. Otherwise they are
+	 * loaded as regular entries, for all the expressions.
+	 */
+	if (ref->img) {
+		if (pat_img_usable(ref->img, expr)) {
+			if (!pat_img_check(ref->img, expr, filename, err))
+				return 0;
+			expr->img = ref->img;
+			return 1;
+		}
+		if (!pat_ref_unpack(ref)) {
+			memprintf(err, "out of memory");
+			return 0;
+		}
+	}
+
 	/* Load reference content in the pattern expression. */
 	list_for_each_entry(elt, &ref->head, list) {
 		if (!pat_ref_push(elt, expr, patflags, err)) {
@@ -2554,10 +3524,29 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 			return 0;
 		}
 	}
+	pat_iptrie_build(expr);
 
 	return 1;
 }
 
+/* Sums the per-thread cache counters of <ref> into <sum>, which is zero if they
+ * are not counted.
+ */
+void pat_ref_cache_stats(const struct pat_ref *ref, struct pat_cache_ctr *sum)
+{
+	int thr;
+
+	sum->hit = sum->miss = sum->evict = 0;
+	if (!ref->cache_ctr)
+		return;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		sum->hit   += HA_ATOMIC_LOAD(&ref->cache_ctr[thr].hit);
+		sum->miss  += HA_ATOMIC_LOAD(&ref->cache_ctr[thr].miss);
+		sum->evict += HA_ATOMIC_LOAD(&ref->cache_ctr[thr].evict);
+	}
+}
+
 /* This function executes a pattern match on a sample. It applies pattern <expr>
  * to sample <smp>. The function returns NULL if the sample dont match. It returns
  * non-null if the sample match. If <fill> is true and the sample match, the
@@ -2567,6 +3556,7 @@ int pattern_read_from_file(struct pattern_head *head, unsigned int refflags,
 struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp, int fill)
 {
 	struct pattern_expr_list *list;
+	struct pattern_expr *expr;
 	struct pattern *pat;
 
 	if (!head->match) {
@@ -2584,9 +3574,15 @@ struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp
 	if (!sample_convert(smp, head->expect_type))
 		return NULL;
 
+	/* the sample's hash is shared by all expressions */
+	pat_smp_hash_state = PAT_HASH_PENDING;
 	list_for_each_entry(list, &head->head, list) {
-		HA_RWLOCK_RDLOCK(PATEXP_LOCK, &list->expr->lock);
-		pat = head->match(smp, list->expr, fill);
+		/* the expression may be replaced by a commit at any time, but
+		 * the one we got remains valid until we're done with it.
+		 */
+		expr = HA_ATOMIC_LOAD(&list->expr);
+		HA_RWLOCK_RDLOCK(PATEXP_LOCK, &expr->lock);
+		pat = head->match(smp, expr, fill);
 		if (pat) {
 			/* We duplicate the pattern cause it could be modified
 			   by another thread */
@@ -2623,11 +3619,13 @@ struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp
 						break;
 				}
 			}
-			HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &list->expr->lock);
+			HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &expr->lock);
+			pat_smp_hash_state = PAT_HASH_NONE;
 			return pat;
 		}
-		HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &list->expr->lock);
+		HA_RWLOCK_RDUNLOCK(PATEXP_LOCK, &expr->lock);
 	}
+	pat_smp_hash_state = PAT_HASH_NONE;
 	return NULL;
 }
 
@@ -2638,6 +3636,7 @@ void pattern_prune(struct pattern_head *head)
 
 	list_for_each_entry_safe(list, safe, &head->head, list) {
 		LIST_DEL(&list->list);
+		LIST_DEL(&list->by_expr);
 		if (list->do_free) {
 			LIST_DEL(&list->expr->list);
 			HA_RWLOCK_WRLOCK(PATEXP_LOCK, &list->expr->lock);
@@ -2720,10 +3719,17 @@ int pattern_finalize_config(void)
 	struct pat_ref *ref, **arr;
 	struct list pr = LIST_HEAD_INIT(pr);
 
-	pat_lru_seed = ha_random();
+	pat_cache_seed = ha_random();
 
 	/* Count pat_refs with user defined unique_id and totalt count */
 	list_for_each_entry(ref, &pattern_reference, list) {
+		if (global.tune.pattern_cache && !ref->cache_ctr) {
+			ref->cache_ctr = calloc(global.nbthread, sizeof(*ref->cache_ctr));
+			if (!ref->cache_ctr) {
+				ha_alert("Out of memory error.\n");
+				return ERR_ALERT | ERR_FATAL;
+			}
+		}
 		len++;
 		if (ref->unique_id != -1)
 			unassigned_pos++;
@@ -2775,18 +3781,110 @@ int pattern_finalize_config(void)
 	return 0;
 }
 
-static int pattern_per_thread_lru_alloc()
+static int pattern_per_thread_cache_alloc()
 {
 	if (!global.tune.pattern_cache)
 		return 1;
-	pat_lru_tree = lru64_new(global.tune.pattern_cache);
-	return !!pat_lru_tree;
+	pat_cache = patcache_new(global.tune.pattern_cache, global.tune.pattern_cache_budget);
+	return !!pat_cache;
+}
+
+static void pattern_per_thread_cache_free()
+{
+	patcache_free(pat_cache);
+	pat_cache = NULL;
+	free(pat_rx_area);
+	pat_rx_area = NULL;
+	pat_rx_area_size = 0;
+}
+
+REGISTER_PER_THREAD_ALLOC(pattern_per_thread_cache_alloc);
+REGISTER_PER_THREAD_FREE(pattern_per_thread_cache_free);
+
+/* config parser for global "tune.pattern.ip-trie", accepts "on" or "off" */
+static int pattern_parse_global_iptrie(char **args, int section_type, struct proxy *curpx,
+                                       struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_PATTERN_IPTRIE;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_PATTERN_IPTRIE;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.pattern.regex-prefilter", accepts "on" or "off" */
+static int pattern_parse_global_rxset(char **args, int section_type, struct proxy *curpx,
+                                      struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_PATTERN_RXSET;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_PATTERN_RXSET;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
 }
 
-static void pattern_per_thread_lru_free()
+/* config parser for global "tune.pattern.cache-indexed", accepts "on" or "off" */
+static int pattern_parse_global_cache_idx(char **args, int section_type, struct proxy *curpx,
+                                          struct proxy *defpx, const char *file, int line,
+                                          char **err)
 {
-	lru64_destroy(pat_lru_tree);
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_PATTERN_CACHE_IDX;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_PATTERN_CACHE_IDX;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
 }
 
-REGISTER_PER_THREAD_ALLOC(pattern_per_thread_lru_alloc);
-REGISTER_PER_THREAD_FREE(pattern_per_thread_lru_free);
+/* config parser for global "tune.pattern.cache-budget" */
+static int pattern_parse_global_cache_budget(char **args, int section_type, struct proxy *curpx,
+                                             struct proxy *defpx, const char *file, int line,
+                                             char **err)
+{
+	char *end;
+	long val;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	val = strtol(args[1], &end, 10);
+	if (!*args[1] || *end || val < 0 || val > INT_MAX) {
+		memprintf(err, "'%s' expects a positive numeric value but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	global.tune.pattern_cache_budget = val;
+	return 0;
+}
+
+/* register global config keywords */
+static struct cfg_kw_list pattern_cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.pattern.cache-budget", pattern_parse_global_cache_budget },
+	{ CFG_GLOBAL, "tune.pattern.cache-indexed", pattern_parse_global_cache_idx },
+	{ CFG_GLOBAL, "tune.pattern.ip-trie", pattern_parse_global_iptrie },
+	{ CFG_GLOBAL, "tune.pattern.regex-prefilter", pattern_parse_global_rxset },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &pattern_cfg_kws);
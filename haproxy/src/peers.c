@@ -1449,20 +1449,20 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 			break;
 
 		updateid = ts->upd.key;
-		ts->ref_cnt++;
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
 		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 
 		ret = peer_send_updatemsg(st, appctx, ts, updateid, new_pushed, use_timed);
 		if (ret <= 0) {
 			HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
-			ts->ref_cnt--;
+			HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 			if (!locked)
 				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 			return ret;
 		}
 
 		HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
-		ts->ref_cnt--;
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 		st->last_pushed = updateid;
 
 		if (peer_stksess_lookup == peer_teach_process_stksess_lookup &&
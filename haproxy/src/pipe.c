@@ -73,6 +73,12 @@ struct pipe *get_pipe()
 	if (pipe(pipefd) < 0)
 		goto fail;
 
+	/* splice() is always used with SPLICE_F_NONBLOCK, but data may also be
+	 * written into the pipe (see raw_sock_iou_to_pipe()), which must not
+	 * block either.
+	 */
+	fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+
 #ifdef F_SETPIPE_SZ
 	if (global.tune.pipesize)
 		fcntl(pipefd[0], F_SETPIPE_SZ, global.tune.pipesize);
@@ -24,6 +24,7 @@
 #include <haproxy/stats-t.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/thread.h>
+#include <haproxy/time.h>
 #include <haproxy/tools.h>
 
 
@@ -43,6 +44,31 @@ THREAD_LOCAL size_t pool_cache_count = 0;                /* #cache objects   */
 static struct list pools = LIST_HEAD_INIT(pools);
 int mem_poison_byte = -1;
 
+/* number of objects to pre-allocate in each pool on startup ("tune.pool-prealloc") */
+static unsigned int pool_prealloc_count = 0;
+
+/* pre-allocation results reported by "show pools" */
+static unsigned long long pool_prealloc_objs;   /* objects pre-allocated */
+static unsigned long long pool_prealloc_bytes;  /* memory used for this */
+static unsigned long long pool_prealloc_huge;   /* part of it backed by huge pages */
+static unsigned long long pool_prealloc_time;   /* time spent, in nanoseconds */
+static unsigned int pool_prealloc_pools;        /* number of pools concerned */
+
+#ifdef CONFIG_HAP_POOL_SLAB
+/* returns non-zero if any pool which is not slab-backed has free objects */
+static int pool_has_free_objects()
+{
+	struct pool_head *entry;
+
+	list_for_each_entry(entry, &pools, list) {
+		if (!(entry->flags & MEM_F_SLAB) && entry->free_list &&
+		    (int)(entry->allocated - entry->used) > (int)(entry->arena ? entry->prealloc : 0))
+			return 1;
+	}
+	return 0;
+}
+#endif
+
 #ifdef DEBUG_FAIL_ALLOC
 static int mem_fail_rate = 0;
 static int mem_should_fail(const struct pool_head *);
@@ -131,6 +157,12 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 			strlcpy2(pool->name, name, sizeof(pool->name));
 		pool->size = size;
 		pool->flags = flags;
+#ifdef CONFIG_HAP_POOL_SLAB
+		if (size && size <= SLAB_MAX_SIZE) {
+			pool->flags |= MEM_F_SLAB;
+			pool->slab_class = slab_size_class(size);
+		}
+#endif
 		LIST_ADDQ(start, &pool->list);
 
 #ifdef CONFIG_HAP_LOCAL_POOLS
@@ -175,6 +207,25 @@ void pool_evict_from_cache()
 #endif
 
 #ifdef CONFIG_HAP_LOCKLESS_POOLS
+/* Pushes the chain of free objects starting at <head> and ending at <tail>
+ * back into the free list of pool <pool>.
+ */
+static void pool_put_chain(struct pool_head *pool, void *head, void *tail)
+{
+	void **free_list;
+
+	free_list = _HA_ATOMIC_LOAD(&pool->free_list);
+	do {
+		while (unlikely(free_list == POOL_BUSY)) {
+			pl_cpu_relax();
+			free_list = _HA_ATOMIC_LOAD(&pool->free_list);
+		}
+		_HA_ATOMIC_STORE(POOL_LINK(pool, tail), (void *)free_list);
+		__ha_barrier_atomic_store();
+	} while (!_HA_ATOMIC_CAS(&pool->free_list, &free_list, head));
+	__ha_barrier_atomic_store();
+}
+
 /* Allocates new entries for pool <pool> until there are at least <avail> + 1
  * available, then returns the last one for immediate use, so that at least
  * <avail> are left available in the pool upon return. NULL is returned if the
@@ -191,6 +242,11 @@ void *__pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 	int limit = pool->limit;
 	int allocated = pool->allocated, allocated_orig = allocated;
 
+#ifdef CONFIG_HAP_POOL_SLAB
+	if (pool->flags & MEM_F_SLAB)
+		return pool_slab_alloc(pool, avail);
+#endif
+
 	/* stop point */
 	avail += pool->used;
 
@@ -251,7 +307,7 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
  */
 void pool_flush(struct pool_head *pool)
 {
-	void **next, *temp;
+	void **next, *temp, *kept = NULL, *kept_tail = NULL;
 	int removed = 0;
 
 	if (!pool)
@@ -275,36 +331,68 @@ void pool_flush(struct pool_head *pool)
 	while (next) {
 		temp = next;
 		next = *POOL_LINK(pool, temp);
+		if (pool_in_arena(pool, temp)) {
+			/* pre-allocated objects are kept */
+			*POOL_LINK(pool, temp) = kept;
+			if (!kept)
+				kept_tail = temp;
+			kept = temp;
+			continue;
+		}
 		removed++;
 		pool_free_area(temp, pool->size + POOL_EXTRA);
 	}
 	_HA_ATOMIC_SUB(&pool->allocated, removed);
-	/* here, we should have pool->allocated == pool->used */
+	if (kept)
+		pool_put_chain(pool, kept, kept_tail);
+	/* here, we should have pool->allocated == pool->used, plus the free
+	 * pre-allocated objects.
+	 */
 }
 
 /*
  * This function frees whatever can be freed in all pools, but respecting
  * the minimum thresholds imposed by owners. It makes sure to be alone to
- * run by using thread_isolate(). <pool_ctx> is unused.
+ * run by using thread_isolate(), which is only needed for pools which are
+ * not slab-backed. <pool_ctx> is unused.
  */
 void pool_gc(struct pool_head *pool_ctx)
 {
 	struct pool_head *entry;
 	int isolated = thread_isolated();
 
+#ifdef CONFIG_HAP_POOL_SLAB
+	slab_gc();
+	if (!pool_has_free_objects())
+		return;
+#endif
 	if (!isolated)
 		thread_isolate();
 
 	list_for_each_entry(entry, &pools, list) {
-		void *temp;
+		void *temp, *kept = NULL;
+		int nkept = 0;
 		//qfprintf(stderr, "Flushing pool %s\n", entry->name);
 		while (entry->free_list &&
-		       (int)(entry->allocated - entry->used) > (int)entry->minavail) {
+		       (int)(entry->allocated - entry->used - nkept) > (int)entry->minavail) {
 			temp = entry->free_list;
 			entry->free_list = *POOL_LINK(entry, temp);
+			if (pool_in_arena(entry, temp)) {
+				/* pre-allocated objects are kept */
+				*POOL_LINK(entry, temp) = kept;
+				kept = temp;
+				nkept++;
+				continue;
+			}
 			entry->allocated--;
 			pool_free_area(temp, entry->size + POOL_EXTRA);
 		}
+		while (kept) {
+			temp = kept;
+			kept = *POOL_LINK(entry, temp);
+			*POOL_LINK(entry, temp) = entry->free_list;
+			entry->free_list = temp;
+		}
 	}
 
 	if (!isolated)
@@ -313,6 +401,17 @@ void pool_gc(struct pool_head *pool_ctx)
 
 #else /* CONFIG_HAP_LOCKLESS_POOLS */
 
+/* Pushes the chain of free objects starting at <head> and ending at <tail>
+ * back into the free list of pool <pool>.
+ */
+static void pool_put_chain(struct pool_head *pool, void *head, void *tail)
+{
+	HA_SPIN_LOCK(POOL_LOCK, &pool->lock);
+	*POOL_LINK(pool, tail) = (void *)pool->free_list;
+	pool->free_list = head;
+	HA_SPIN_UNLOCK(POOL_LOCK, &pool->lock);
+}
+
 /* Allocates new entries for pool <pool> until there are at least <avail> + 1
  * available, then returns the last one for immediate use, so that at least
  * <avail> are left available in the pool upon return. NULL is returned if the
@@ -329,6 +428,10 @@ void *__pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 #ifdef DEBUG_FAIL_ALLOC
 	if (mem_should_fail(pool))
 		return NULL;
+#endif
+#ifdef CONFIG_HAP_POOL_SLAB
+	if (pool->flags & MEM_F_SLAB)
+		return pool_slab_alloc(pool, avail);
 #endif
 	/* stop point */
 	avail += pool->used;
@@ -384,7 +487,7 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
  */
 void pool_flush(struct pool_head *pool)
 {
-	void *temp, **next;
+	void *temp, **next, *kept = NULL, *kept_tail = NULL;
 
 	if (!pool)
 		return;
@@ -394,7 +497,8 @@ void pool_flush(struct pool_head *pool)
 	while (next) {
 		temp = next;
 		next = *POOL_LINK(pool, temp);
-		pool->allocated--;
+		if (!pool_in_arena(pool, temp))
+			pool->allocated--;
 	}
 
 	next = pool->free_list;
@@ -404,34 +508,66 @@ void pool_flush(struct pool_head *pool)
 	while (next) {
 		temp = next;
 		next = *POOL_LINK(pool, temp);
+		if (pool_in_arena(pool, temp)) {
+			/* pre-allocated objects are kept */
+			*POOL_LINK(pool, temp) = kept;
+			if (!kept)
+				kept_tail = temp;
+			kept = temp;
+			continue;
+		}
 		pool_free_area(temp, pool->size + POOL_EXTRA);
 	}
-	/* here, we should have pool->allocated == pool->used */
+	if (kept)
+		pool_put_chain(pool, kept, kept_tail);
+	/* here, we should have pool->allocated == pool->used, plus the free
+	 * pre-allocated objects.
+	 */
 }
 
 /*
  * This function frees whatever can be freed in all pools, but respecting
  * the minimum thresholds imposed by owners. It makes sure to be alone to
- * run by using thread_isolate(). <pool_ctx> is unused.
+ * run by using thread_isolate(), which is only needed for pools which are
+ * not slab-backed. <pool_ctx> is unused.
  */
 void pool_gc(struct pool_head *pool_ctx)
 {
 	struct pool_head *entry;
 	int isolated = thread_isolated();
 
+#ifdef CONFIG_HAP_POOL_SLAB
+	slab_gc();
+	if (!pool_has_free_objects())
+		return;
+#endif
 	if (!isolated)
 		thread_isolate();
 
 	list_for_each_entry(entry, &pools, list) {
-		void *temp;
+		void *temp, *kept = NULL;
+		int nkept = 0;
 		//qfprintf(stderr, "Flushing pool %s\n", entry->name);
 		while (entry->free_list &&
-		       (int)(entry->allocated - entry->used) > (int)entry->minavail) {
+		       (int)(entry->allocated - entry->used - nkept) > (int)entry->minavail) {
 			temp = entry->free_list;
 			entry->free_list = *POOL_LINK(entry, temp);
+			if (pool_in_arena(entry, temp)) {
+				/* pre-allocated objects are kept */
+				*POOL_LINK(entry, temp) = kept;
+				kept = temp;
+				nkept++;
+				continue;
+			}
 			entry->allocated--;
 			pool_free_area(temp, entry->size + POOL_EXTRA);
 		}
+		while (kept) {
+			temp = kept;
+			kept = *POOL_LINK(entry, temp);
+			*POOL_LINK(entry, temp) = entry->free_list;
+			entry->free_list = temp;
+		}
 	}
 
 	if (!isolated)
@@ -479,6 +615,189 @@ void pool_destroy_all()
 		pool_destroy(entry);
 }
 
+#ifndef DEBUG_UAF
+/* returns the space needed in the pre-allocation area for <count> objects of
+ * pool <pool>, which is always a multiple of a cache line.
+ */
+static inline size_t pool_prealloc_size(const struct pool_head *pool, unsigned int count)
+{
+	return ((size_t)count * ((pool->size + POOL_EXTRA + 15) & -16) + 63) & -64;
+}
+
+/* Places <count> pre-allocated objects for pool <pool> at <area>, which must
+ * be large enough, and adds them to the pool's free objects.
+ */
+static void pool_prealloc_fill(struct pool_head *pool, char *area, unsigned int count)
+{
+	size_t objsize = (pool->size + POOL_EXTRA + 15) & -16;
+	void *head = NULL, *tail = NULL, *ptr;
+	unsigned int n;
+
+	for (n = 0; n < count; n++) {
+		ptr = area + n * objsize;
+		*POOL_LINK(pool, ptr) = head;
+		if (!tail)
+			tail = ptr;
+		head = ptr;
+	}
+
+	pool->arena = area;
+	pool->arena_size = pool_prealloc_size(pool, count);
+	pool->prealloc = count;
+	_HA_ATOMIC_ADD(&pool->allocated, count);
+	pool_put_chain(pool, head, tail);
+}
+
+/* returns the number of objects to pre-allocate for pool <pool> */
+static unsigned int pool_prealloc_objects(const struct pool_head *pool)
+{
+	unsigned int count = pool_prealloc_count;
+
+	if (pool->limit)
+		count = MIN(count, pool->limit > pool->allocated ? pool->limit - pool->allocated : 0);
+	return count;
+}
+
+/* Pre-allocates "tune.pool-prealloc" objects in each pool so that the first
+ * requests do not have to wait for the system to allocate them. The objects
+ * of the pools which are not slab-backed are placed in a single area which is
+ * never released, backed by huge pages if "tune.pool-hugepages" is set, and
+ * enough slabs are reserved for the slab-backed ones. This is performed once,
+ * by the first thread, before any traffic is processed.
+ */
+static int pool_prealloc_all()
+{
+	struct pool_head *entry;
+	size_t size = 0;
+	uint64_t start;
+	unsigned int count;
+	int huge = POOL_ARENA_PAGES;
+	char *area;
+#ifdef CONFIG_HAP_POOL_SLAB
+	unsigned long long slab_objs[SLAB_CLASSES] = { };
+	unsigned int nb_slabs = 0, per_slab;
+	int cls;
+#endif
+
+	if (tid || !pool_prealloc_count)
+		return 1;
+
+	start = now_mono_time();
+	list_for_each_entry(entry, &pools, list) {
+		count = pool_prealloc_objects(entry);
+		if (!count)
+			continue;
+#ifdef CONFIG_HAP_POOL_SLAB
+		if (entry->flags & MEM_F_SLAB) {
+			slab_objs[entry->slab_class] += count;
+			entry->prealloc = count;
+			pool_prealloc_objs += count;
+			pool_prealloc_pools++;
+			continue;
+		}
+#endif
+		size += pool_prealloc_size(entry, count);
+	}
+
+	if (size) {
+		if (global.tune.options & GTUNE_POOL_HUGEPAGES) {
+			huge = POOL_ARENA_THP;
+			size = (size + POOL_HUGE_PAGE_SIZE - 1) & -POOL_HUGE_PAGE_SIZE;
+		}
+		else
+			size = (size + 4095) & -4096;
+
+		area = pool_alloc_arena(size, &huge);
+		if (!area)
+			ha_warning("Failed to pre-allocate %lu bytes for the pools.\n", (unsigned long)size);
+		else {
+			pool_prealloc_bytes += size;
+			if (huge != POOL_ARENA_PAGES)
+				pool_prealloc_huge += size;
+
+			list_for_each_entry(entry, &pools, list) {
+				if (entry->flags & MEM_F_SLAB)
+					continue;
+				count = pool_prealloc_objects(entry);
+				if (!count)
+					continue;
+				pool_prealloc_fill(entry, area, count);
+				if (huge != POOL_ARENA_PAGES)
+					entry->flags |= MEM_F_HUGE;
+				area += entry->arena_size;
+				pool_prealloc_objs += count;
+				pool_prealloc_pools++;
+			}
+		}
+	}
+
+#ifdef CONFIG_HAP_POOL_SLAB
+	for (cls = 0; cls < SLAB_CLASSES; cls++) {
+		per_slab = SLAB_SIZE / slab_classes[cls].size;
+		nb_slabs += (slab_objs[cls] + per_slab - 1) / per_slab;
+	}
+	count = slab_reserve(nb_slabs);
+	if (count < nb_slabs)
+		ha_warning("Failed to pre-allocate %u slabs out of %u.\n", nb_slabs - count, nb_slabs);
+	pool_prealloc_bytes += (unsigned long long)count * SLAB_SIZE;
+	if (count && slab_segments_huge) {
+		pool_prealloc_huge += (unsigned long long)count * SLAB_SIZE;
+		list_for_each_entry(entry, &pools, list) {
+			if ((entry->flags & MEM_F_SLAB) && entry->prealloc)
+				entry->flags |= MEM_F_HUGE;
+		}
+	}
+#endif
+	pool_prealloc_time = now_mono_time() - start;
+	return 1;
+}
+#endif /* DEBUG_UAF */
+
+#ifdef CONFIG_HAP_POOL_SLAB
+/* This function appends the usage of each slab class to the trash buffer. The
+ * fragmentation is the part of the class's slabs not holding used objects, and
+ * the rounding is the part of the used objects not needed by their pools.
+ */
+static void dump_slabs_to_trash()
+{
+	struct pool_head *entry;
+	unsigned long long mem, objs, req;
+	unsigned int slabs, used;
+	int cls, thr;
+
+	chunk_appendf(&trash, "Slab classes (%u kB slabs) :\n", SLAB_SIZE >> 10);
+	for (cls = 0; cls < SLAB_CLASSES; cls++) {
+		slabs = slab_classes[cls].slabs;
+		if (!slabs)
+			continue;
+
+		used = 0;
+		for (thr = 0; thr < MAX_THREADS; thr++)
+			used += slab_cache[thr][cls].allocs - slab_cache[thr][cls].frees;
+
+		req = 0;
+		list_for_each_entry(entry, &pools, list) {
+			if ((entry->flags & MEM_F_SLAB) && entry->slab_class == cls)
+				req += (unsigned long long)entry->used * entry->size;
+		}
+
+		mem  = (unsigned long long)slabs * SLAB_SIZE;
+		objs = (unsigned long long)used * slab_classes[cls].size;
+		if (objs > mem)
+			objs = mem;
+		if (req > objs)
+			req = objs;
+
+		chunk_appendf(&trash, "  - Class %d (%u bytes) : %u slabs (%llu bytes), %u used (%llu bytes), %u%% fragmentation, %u%% rounding\n",
+			      cls, slab_classes[cls].size, slabs, mem, used, objs,
+			      (unsigned int)((mem - objs) * 100 / mem),
+			      objs ? (unsigned int)((objs - req) * 100 / objs) : 0);
+	}
+	chunk_appendf(&trash, "Slabs: %u segments (%u bytes), %u free slabs resident, %u free slabs released.\n",
+		      slab_segments, slab_segments * SLAB_SEG_SIZE, slab_free_dirty, slab_free_clean);
+}
+#endif
+
 /* This function dumps memory usage information into the trash buffer. */
 void dump_pools_to_trash()
 {
@@ -492,12 +811,17 @@ void dump_pools_to_trash()
 #ifndef CONFIG_HAP_LOCKLESS_POOLS
 		HA_SPIN_LOCK(POOL_LOCK, &entry->lock);
 #endif
-		chunk_appendf(&trash, "  - Pool %s (%u bytes) : %u allocated (%u bytes), %u used, needed_avg %u, %u failures, %u users, @%p=%02d%s\n",
+		chunk_appendf(&trash, "  - Pool %s (%u bytes) : %u allocated (%u bytes), %u used, needed_avg %u, %u failures, %u users, @%p=%02d%s%s",
 			 entry->name, entry->size, entry->allocated,
 		         entry->size * entry->allocated, entry->used,
 		         swrate_avg(entry->needed_avg, POOL_AVG_SAMPLES), entry->failed,
 			 entry->users, entry, (int)pool_get_index(entry),
-			 (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "");
+			 (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "",
+			 (entry->flags & MEM_F_SLAB) ? " [SLAB]" : "");
+		if (entry->prealloc)
+			chunk_appendf(&trash, " [PREALLOC=%u%s]", entry->prealloc,
+				      (entry->flags & MEM_F_HUGE) ? ",HUGE" : "");
+		chunk_appendf(&trash, "\n");
 
 		allocated += entry->allocated * entry->size;
 		used += entry->used * entry->size;
@@ -508,6 +832,13 @@ void dump_pools_to_trash()
 	}
 	chunk_appendf(&trash, "Total: %d pools, %lu bytes allocated, %lu used.\n",
 		 nbpools, allocated, used);
+	if (pool_prealloc_count)
+		chunk_appendf(&trash, "Pre-allocated: %llu objects in %u pools, %llu bytes (%llu on huge pages) in %llu.%03llu ms.\n",
+			      pool_prealloc_objs, pool_prealloc_pools, pool_prealloc_bytes, pool_prealloc_huge,
+			      pool_prealloc_time / 1000000, pool_prealloc_time / 1000 % 1000);
+#ifdef CONFIG_HAP_POOL_SLAB
+	dump_slabs_to_trash();
+#endif
 }
 
 /* Dump statistics on pools usage. */
@@ -597,6 +928,9 @@ static void init_pools()
 }
 
 INITCALL0(STG_PREPARE, init_pools);
+#ifndef DEBUG_UAF
+REGISTER_PER_THREAD_ALLOC(pool_prealloc_all);
+#endif
 
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
@@ -660,11 +994,59 @@ static int mem_parse_global_fail_alloc(char **args, int section_type, struct pro
 }
 #endif
 
+/* config parser for global "tune.pool-prealloc" */
+static int mem_parse_global_prealloc(char **args, int section_type, struct proxy *curpx,
+                                     struct proxy *defpx, const char *file, int line,
+                                     char **err)
+{
+	char *end;
+	long val;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a number of objects.", args[0]);
+		return -1;
+	}
+
+	errno = 0;
+	val = strtol(args[1], &end, 10);
+	if (*end || errno == ERANGE || val < 0 || val > UINT_MAX) {
+		memprintf(err, "'%s' expects a number of objects between 0 and %u but got '%s'.",
+		          args[0], UINT_MAX, args[1]);
+		return -1;
+	}
+	pool_prealloc_count = val;
+	return 0;
+}
+
+/* config parser for global "tune.pool-hugepages", accepts "on" or "off" */
+static int mem_parse_global_hugepages(char **args, int section_type, struct proxy *curpx,
+                                      struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_POOL_HUGEPAGES;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_POOL_HUGEPAGES;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* register global config keywords */
 static struct cfg_kw_list mem_cfg_kws = {ILH, {
 #ifdef DEBUG_FAIL_ALLOC
 	{ CFG_GLOBAL, "tune.fail-alloc", mem_parse_global_fail_alloc },
 #endif
+	{ CFG_GLOBAL, "tune.pool-hugepages", mem_parse_global_hugepages },
+	{ CFG_GLOBAL, "tune.pool-prealloc", mem_parse_global_prealloc },
 	{ 0, NULL, NULL }
 }};
 
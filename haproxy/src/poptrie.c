@@ -0,0 +1,297 @@
+/*
+ * Compressed multibit trie for longest prefix matching.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This is a variant of the "Poptrie" (Asai & Ohara, SIGCOMM 2015). Each node
+ * consumes 6 bits of the address and only stores two 64-bit bitmaps and two
+ * base indexes, its children and leaves being found by counting the bits set
+ * before the slot. Leaves are pushed down to the deepest node covering them
+ * and consecutive identical leaves are merged, so that a lookup visits one
+ * node per 6 bits of the matched prefix and a single leaf, with no comparison.
+ *
+ * The trie is built at once from the list of prefixes: each node sorts its
+ * prefixes in place by slot (American flag sort), applies those ending within
+ * its 6 bits to its slots and passes the longer ones to its children. This
+ * costs O(prefixes * depth) and no allocation per prefix.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/net_helper.h>
+#include <haproxy/poptrie.h>
+
+#define POPTRIE_SLOTS   (1 << POPTRIE_STRIDE)
+
+/* Makes sure that the array at <*ptr> of <size>-byte elements, of which
+ * <*alloc> are allocated, may hold at least <need> elements. Returns 0 if out
+ * of memory.
+ */
+static int poptrie_grow(void **ptr, unsigned int *alloc, unsigned int need, size_t size)
+{
+	unsigned int count = *alloc ? *alloc : 16;
+	void *new;
+
+	if (need <= *alloc)
+		return 1;
+	while (count < need)
+		count *= 2;
+	new = realloc(*ptr, (size_t)count * size);
+	if (!new)
+		return 0;
+	*ptr = new;
+	*alloc = count;
+	return 1;
+}
+
+/* Allocates an empty trie for addresses of <width> bits (32 or 128). Returns
+ * NULL if out of memory.
+ */
+struct poptrie *poptrie_new(unsigned int width)
+{
+	struct poptrie *pt;
+
+	pt = calloc(1, sizeof(*pt));
+	if (!pt)
+		return NULL;
+	pt->width = width;
+	return pt;
+}
+
+/* Adds prefix <addr>/<len> to trie <pt>, which must not have been compiled
+ * yet. <addr> is in network byte order and is <pt->width> bits long. <item>
+ * is what lookups return when this prefix is the longest matching one, or the
+ * first added one among identical prefixes. Returns 0 if out of memory.
+ */
+int poptrie_add(struct poptrie *pt, const void *addr, unsigned int len, void *item)
+{
+	struct poptrie_pfx *pfx;
+	unsigned int count;
+	void *ptr;
+
+	if (pt->compiled)
+		return 0;
+
+	if (pt->nb_items == pt->alloc_items) {
+		count = pt->alloc_items ? pt->alloc_items * 2 : 16;
+		ptr = realloc(pt->items, (size_t)count * sizeof(*pt->items));
+		if (!ptr)
+			return 0;
+		pt->items = ptr;
+		ptr = realloc(pt->pfx, (size_t)count * sizeof(*pt->pfx));
+		if (!ptr)
+			return 0;
+		pt->pfx = ptr;
+		pt->alloc_items = count;
+	}
+
+	if (len > pt->width)
+		len = pt->width;
+
+	pfx = &pt->pfx[pt->nb_items];
+	if (pt->width == 32) {
+		pfx->hi = (uint64_t)read_n32(addr) << 32;
+		pfx->lo = 0;
+	}
+	else {
+		pfx->hi = read_n64(addr);
+		pfx->lo = read_n64((const char *)addr + 8);
+	}
+
+	/* clear the bits past the prefix */
+	if (len < 64) {
+		pfx->hi &= len ? ~0ULL << (64 - len) : 0;
+		pfx->lo = 0;
+	}
+	else if (len < 128)
+		pfx->lo &= (len == 64) ? 0 : ~0ULL << (128 - len);
+
+	pfx->len = len;
+	pfx->idx = pt->nb_items + 1;
+	pt->items[pt->nb_items++] = item;
+	return 1;
+}
+
+/* Returns the bucket prefix <p> goes to in a node starting at bit <d>: its
+ * slot if it is longer than the node, otherwise POPTRIE_SLOTS.
+ */
+static inline unsigned int poptrie_bucket(const struct poptrie_pfx *p, unsigned int d)
+{
+	if (p->len <= d + POPTRIE_STRIDE)
+		return POPTRIE_SLOTS;
+	return poptrie_slot(p->hi, p->lo, d);
+}
+
+/* Fills node <node> of trie <pt> which starts at bit <d>, from the <nb>
+ * prefixes at <pfx> which all belong to it. <def> is the leaf of the longest
+ * prefix covering the whole node. <pfx> is reordered. Returns 0 if out of
+ * memory.
+ */
+static int poptrie_build(struct poptrie *pt, unsigned int node, struct poptrie_pfx *pfx,
+                         unsigned int nb, unsigned int d, unsigned int def)
+{
+	unsigned int val[POPTRIE_SLOTS], rank[POPTRIE_SLOTS];
+	unsigned int cnt[POPTRIE_SLOTS + 1], start[POPTRIE_SLOTS + 1], next[POPTRIE_SLOTS + 1];
+	unsigned int s, b, i, first, last, base0, base1, k, prev;
+	uint64_t vector = 0, leafvec = 0;
+	struct poptrie_pfx tmp;
+
+	for (s = 0; s < POPTRIE_SLOTS; s++) {
+		val[s] = def;
+		rank[s] = 0;
+	}
+	memset(cnt, 0, sizeof(cnt));
+
+	/* apply the prefixes ending in this node to the slots they cover, the
+	 * longest one wins, then the first added one. <rank> is 1 + the length
+	 * of the prefix which set the slot, 0 if inherited.
+	 */
+	for (i = 0; i < nb; i++) {
+		b = poptrie_bucket(&pfx[i], d);
+		cnt[b]++;
+		if (b != POPTRIE_SLOTS)
+			continue;
+
+		first = poptrie_slot(pfx[i].hi, pfx[i].lo, d);
+		last = first + (1 << (d + POPTRIE_STRIDE - pfx[i].len));
+		for (s = first; s < last; s++) {
+			if (pfx[i].len + 1 > rank[s] ||
+			    (pfx[i].len + 1 == rank[s] && pfx[i].idx < val[s])) {
+				rank[s] = pfx[i].len + 1;
+				val[s] = pfx[i].idx;
+			}
+		}
+	}
+
+	/* group the longer prefixes by slot */
+	for (b = 0, i = 0; b <= POPTRIE_SLOTS; b++) {
+		start[b] = next[b] = i;
+		i += cnt[b];
+	}
+	for (b = 0; b <= POPTRIE_SLOTS; b++) {
+		while (next[b] < start[b] + cnt[b]) {
+			i = next[b];
+			s = poptrie_bucket(&pfx[i], d);
+			if (s == b) {
+				next[b]++;
+				continue;
+			}
+			tmp = pfx[i];
+			pfx[i] = pfx[next[s]];
+			pfx[next[s]++] = tmp;
+		}
+	}
+
+	for (s = 0; s < POPTRIE_SLOTS; s++)
+		if (cnt[s])
+			vector |= 1ULL << s;
+
+	/* reserve the children, they must be contiguous */
+	base1 = pt->nb_nodes;
+	if (!poptrie_grow((void **)&pt->nodes, &pt->alloc_nodes,
+	                  pt->nb_nodes + __builtin_popcountll(vector), sizeof(*pt->nodes)))
+		return 0;
+	pt->nb_nodes += __builtin_popcountll(vector);
+
+	/* leaves, merging consecutive identical ones */
+	base0 = pt->nb_leaves;
+	prev = 0;
+	for (s = 0, k = 0; s < POPTRIE_SLOTS; s++) {
+		if (vector & (1ULL << s))
+			continue;
+		if (k && val[s] == prev)
+			continue;
+		if (!poptrie_grow((void **)&pt->leaves, &pt->alloc_leaves,
+		                  pt->nb_leaves + 1, sizeof(*pt->leaves)))
+			return 0;
+		pt->leaves[pt->nb_leaves++] = val[s];
+		leafvec |= 1ULL << s;
+		prev = val[s];
+		k++;
+	}
+
+	pt->nodes[node].vector = vector;
+	pt->nodes[node].leafvec = leafvec;
+	pt->nodes[node].base1 = base1;
+	pt->nodes[node].base0 = base0;
+
+	for (s = 0, k = 0; s < POPTRIE_SLOTS; s++) {
+		if (!cnt[s])
+			continue;
+		if (!poptrie_build(pt, base1 + k++, pfx + start[s], cnt[s], d + POPTRIE_STRIDE, val[s]))
+			return 0;
+	}
+	return 1;
+}
+
+/* Builds trie <pt> from the prefixes added so far and releases them. No
+ * prefix may be added anymore. Returns 0 if out of memory, in which case the
+ * trie may only be freed.
+ */
+int poptrie_compile(struct poptrie *pt)
+{
+	void *ptr;
+
+	if (pt->compiled)
+		return 1;
+
+	if (!poptrie_grow((void **)&pt->nodes, &pt->alloc_nodes, 1, sizeof(*pt->nodes)))
+		return 0;
+	pt->nb_nodes = 1;
+
+	if (!poptrie_build(pt, 0, pt->pfx, pt->nb_items, 0, 0))
+		return 0;
+
+	free(pt->pfx);
+	pt->pfx = NULL;
+
+	/* give back the unused parts of the arrays */
+	if ((ptr = realloc(pt->nodes, pt->nb_nodes * sizeof(*pt->nodes)))) {
+		pt->nodes = ptr;
+		pt->alloc_nodes = pt->nb_nodes;
+	}
+	if ((ptr = realloc(pt->leaves, pt->nb_leaves * sizeof(*pt->leaves)))) {
+		pt->leaves = ptr;
+		pt->alloc_leaves = pt->nb_leaves;
+	}
+
+	pt->compiled = 1;
+	return 1;
+}
+
+/* Releases trie <pt>. NULL is supported. */
+void poptrie_free(struct poptrie *pt)
+{
+	if (!pt)
+		return;
+	free(pt->items);
+	free(pt->pfx);
+	free(pt->nodes);
+	free(pt->leaves);
+	free(pt);
+}
+
+/* Returns the number of bytes allocated for trie <pt> */
+size_t poptrie_mem(const struct poptrie *pt)
+{
+	size_t mem = sizeof(*pt);
+
+	mem += (size_t)pt->alloc_items * sizeof(*pt->items);
+	if (pt->pfx)
+		mem += (size_t)pt->alloc_items * sizeof(*pt->pfx);
+	mem += (size_t)pt->alloc_nodes * sizeof(*pt->nodes);
+	mem += (size_t)pt->alloc_leaves * sizeof(*pt->leaves);
+	return mem;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -574,6 +574,125 @@ proxy_parse_retry_on(char **args, int section, struct proxy *curpx,
 	return 0;
 }
 
+/* This function parses a "hedge-delay" statement in a backend section. It
+ * accepts either a time, or "p" followed by a percentile of the observed
+ * response times. It returns -1 if there is any error, 1 for a warning,
+ * otherwise zero.
+ */
+static int proxy_parse_hedge_delay(char **args, int section, struct proxy *curpx,
+                                   struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	unsigned int val;
+	const char *res;
+	char *end;
+
+	if (!*args[1]) {
+		memprintf(err, "'%s' expects a time or a percentile ('p' followed by 1 to 99) as argument", args[0]);
+		return -1;
+	}
+	if (!(curpx->cap & PR_CAP_BE)) {
+		memprintf(err, "'%s' only available in backend or listen section", args[0]);
+		return -1;
+	}
+
+	curpx->hedge_delay = curpx->hedge_pct = 0;
+	if (*args[1] == 'p') {
+		val = strtol(args[1] + 1, &end, 10);
+		if (end == args[1] + 1 || *end || val < 1 || val > 99) {
+			memprintf(err, "'%s' : percentile '%s' must be between p1 and p99", args[0], args[1]);
+			return -1;
+		}
+		curpx->hedge_pct = val;
+		return 0;
+	}
+
+	res = parse_time_err(args[1], &val, TIME_UNIT_MS);
+	if (res == PARSE_TIME_OVER) {
+		memprintf(err, "timer overflow in argument '%s' to '%s' (maximum value is 2147483647 ms or ~24.8 days)",
+			  args[1], args[0]);
+		return -1;
+	}
+	else if (res == PARSE_TIME_UNDER) {
+		memprintf(err, "timer underflow in argument '%s' to '%s' (minimum non-null value is 1 ms)",
+			  args[1], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in '%s'", *res, args[0]);
+		return -1;
+	}
+	curpx->hedge_delay = val;
+	return 0;
+}
+
+/* Returns the histogram bucket of a response time of <ms> milliseconds. The
+ * first 4 buckets hold 0 to 3ms, then each power of two is split in 4.
+ */
+static inline unsigned int proxy_hedge_bucket(unsigned int ms)
+{
+	unsigned int bit, bucket;
+
+	if (ms < 4)
+		return ms;
+	bit = my_flsl(ms) - 1;
+	bucket = (bit - 1) * 4 + ((ms >> (bit - 2)) & 3);
+	return MIN(bucket, PX_HEDGE_BUCKETS - 1);
+}
+
+/* Accounts a response time of <ms> milliseconds in backend <px>'s histogram.
+ * Every PX_HEDGE_WINDOW samples, all buckets are halved so that the estimated
+ * percentile follows the servers' recent behaviour.
+ */
+void proxy_hedge_add_sample(struct proxy *px, unsigned int ms)
+{
+	unsigned int removed = 0;
+	unsigned int half;
+	int i;
+
+	_HA_ATOMIC_ADD(&px->hedge_hist[proxy_hedge_bucket(ms)], 1);
+	if (_HA_ATOMIC_ADD(&px->hedge_samples, 1) != PX_HEDGE_WINDOW)
+		return;
+
+	for (i = 0; i < PX_HEDGE_BUCKETS; i++) {
+		half = px->hedge_hist[i] / 2;
+		_HA_ATOMIC_SUB(&px->hedge_hist[i], half);
+		removed += half;
+	}
+	_HA_ATOMIC_SUB(&px->hedge_samples, removed);
+}
+
+/* Returns the delay in milliseconds after which a request to backend <px>
+ * should be hedged, or 0 if it must not be. In percentile mode, the upper
+ * bound of the bucket the percentile falls into is returned, and nothing is
+ * hedged until enough samples were collected.
+ */
+unsigned int proxy_hedge_delay(const struct proxy *px)
+{
+	unsigned int total, target, sum = 0;
+	int i;
+
+	if (!px->hedge_pct)
+		return px->hedge_delay;
+
+	total = px->hedge_samples;
+	if (total < PX_HEDGE_MIN_SAMPLES)
+		return 0;
+
+	target = (unsigned long long)total * px->hedge_pct / 100;
+	for (i = 0; i < PX_HEDGE_BUCKETS - 1; i++) {
+		sum += px->hedge_hist[i];
+		if (sum > target)
+			break;
+	}
+
+	/* return the lower bound of the next bucket */
+	i++;
+	if (i < 4)
+		return i;
+	return (4 + (i & 3)) << (i / 4 - 1);
+}
+
 /* This function inserts proxy <px> into the tree of known proxies. The proxy's
  * name is used as the storing key so it must already have been initialized.
  */
@@ -1691,6 +1810,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_LISTEN, "max-keep-alive-queue", proxy_parse_max_ka_queue },
 	{ CFG_LISTEN, "declare", proxy_parse_declare },
 	{ CFG_LISTEN, "retry-on", proxy_parse_retry_on },
+	{ CFG_LISTEN, "hedge-delay", proxy_parse_hedge_delay },
 	{ 0, NULL, NULL },
 }};
 
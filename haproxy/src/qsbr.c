@@ -0,0 +1,108 @@
+/*
+ * Quiescent-state based deferred reclamation.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Some shared structures may be looked up without any lock nor reference.
+ * Objects removed from such structures are "retired" instead of being freed,
+ * and only released once all threads have gone through a quiescent state, in
+ * which they promise not to hold any pointer obtained from such a lookup. Each
+ * thread enters a quiescent state once per polling loop, and threads sleeping
+ * in the poller (reported in threads_harmless_mask) are quiescent as well.
+ *
+ * A global epoch is advanced whenever a thread waits for some objects to be
+ * released. An object retired while the epoch was E may be released once all
+ * running threads have observed an epoch greater than E.
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/global.h>
+#include <haproxy/qsbr.h>
+#include <haproxy/thread.h>
+
+volatile unsigned int qsbr_epoch = 1;
+struct qsbr_thread qsbr_ctx[MAX_THREADS];
+
+/* Retires object <node>, which must already be unreachable from the shared
+ * structures. Function <fct> will be called to release it once no thread may
+ * reference it anymore.
+ */
+void qsbr_retire(struct qsbr_node *node, void (*fct)(struct qsbr_node *))
+{
+	struct qsbr_thread *ctx = &qsbr_ctx[tid];
+
+	/* the epoch must be read after the object was unlinked */
+	__ha_barrier_full();
+	node->epoch = qsbr_epoch + 1;
+	node->free = fct;
+	node->next = NULL;
+	if (ctx->tail)
+		ctx->tail->next = node;
+	else
+		ctx->head = node;
+	ctx->tail = node;
+}
+
+/* Releases the objects retired by the current thread whose grace period is
+ * over. Must only be called from a quiescent state.
+ */
+void __qsbr_reclaim()
+{
+	struct qsbr_thread *ctx = &qsbr_ctx[tid];
+	struct qsbr_node *node;
+	unsigned long harmless;
+	unsigned int epoch, min;
+	int thr;
+
+	/* make the epoch move past the oldest object's one */
+	epoch = qsbr_epoch;
+	if ((int)(ctx->head->epoch - epoch) > 0)
+		epoch = HA_ATOMIC_ADD(&qsbr_epoch, 1);
+
+	min = epoch;
+	harmless = threads_harmless_mask;
+	for (thr = 0; thr < global.nbthread; thr++) {
+		unsigned int e;
+
+		if (thr == tid || (harmless & (1UL << thr)))
+			continue;
+		e = HA_ATOMIC_LOAD(&qsbr_ctx[thr].epoch);
+		if ((int)(e - min) < 0)
+			min = e;
+	}
+
+	while ((node = ctx->head) && (int)(node->epoch - min) <= 0) {
+		ctx->head = node->next;
+		if (!ctx->head)
+			ctx->tail = NULL;
+		node->free(node);
+	}
+}
+
+/* Releases all the objects retired by all threads without waiting for their
+ * grace period. Must only be called once no other thread may be running, such
+ * as on deinit, before destroying what these objects depend on.
+ */
+void qsbr_release_all()
+{
+	struct qsbr_node *node;
+	int thr;
+
+	for (thr = 0; thr < MAX_THREADS; thr++) {
+		while ((node = qsbr_ctx[thr].head)) {
+			qsbr_ctx[thr].head = node->next;
+			node->free(node);
+		}
+		qsbr_ctx[thr].tail = NULL;
+	}
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
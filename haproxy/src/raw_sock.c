@@ -28,6 +28,7 @@
 #include <haproxy/fd.h>
 #include <haproxy/freq_ctr.h>
 #include <haproxy/global.h>
+#include <haproxy/iouring.h>
 #include <haproxy/pipe.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/ticks.h>
@@ -37,6 +38,34 @@
 
 #if defined(USE_LINUX_SPLICE)
 
+/* Moves up to <count> bytes received in advance in <ctx> to <pipe>. Pipes are
+ * created with a non-blocking producer side, so a full pipe doesn't block the
+ * process. Returns the number of bytes moved.
+ */
+static int raw_sock_iou_to_pipe(struct connection *conn, struct iou_sock *ctx, struct pipe *pipe, unsigned int count)
+{
+	int ret;
+
+	if (count > b_data(&ctx->rx))
+		count = b_data(&ctx->rx);
+
+	ret = write(pipe->prod, b_head(&ctx->rx), count);
+
+	if (ret <= 0) {
+		/* pipe full */
+		conn->flags |= CO_FL_WAIT_ROOM;
+		return 0;
+	}
+
+	b_del(&ctx->rx, ret);
+	pipe->data += ret;
+	if (b_data(&ctx->rx))
+		conn->flags |= CO_FL_WAIT_ROOM;
+	else
+		b_free(&ctx->rx);
+	return ret;
+}
+
 /* A pipe contains 16 segments max, and it's common to see segments of 1448 bytes
  * because of timestamps. Use this as a hint for not looping on splice().
  */
@@ -54,6 +83,7 @@
  */
 int raw_sock_to_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe, unsigned int count)
 {
+	struct iou_sock *ctx = xprt_ctx;
 	int ret;
 	int retval = 0;
 
@@ -67,6 +97,24 @@ int raw_sock_to_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe,
 	conn->flags &= ~CO_FL_WAIT_ROOM;
 	errno = 0;
 
+	if (ctx) {
+		/* the poller must not receive in advance anymore, and what it
+		 * already received must be delivered first.
+		 */
+		ctx->flags = (ctx->flags & ~IOU_SOCK_RX_ENABLED) | IOU_SOCK_RX_SPLICE;
+		if (b_data(&ctx->rx)) {
+			retval = raw_sock_iou_to_pipe(conn, ctx, pipe, count);
+			goto leave;
+		}
+		if (ctx->rx_err) {
+			conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+			errno = ctx->rx_err;
+			goto leave;
+		}
+		if (ctx->flags & IOU_SOCK_RX_SHUT)
+			goto out_read0;
+	}
+
 	/* Under Linux, if FD_POLL_HUP is set, we have reached the end.
 	 * Since older splice() implementations were buggy and returned
 	 * EAGAIN on end of read, let's bypass the call to splice() now.
@@ -214,6 +262,48 @@ int raw_sock_from_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pip
 #endif /* USE_LINUX_SPLICE */
 
 
+/* Delivers up to <count> bytes received in advance by the poller for <conn>
+ * into <buf>, then reports the shutdown or error it may have met. The FD is
+ * marked as not ready once the data are consumed if the last recv() emptied
+ * the socket buffer. Returns the number of bytes delivered.
+ */
+static size_t raw_sock_iou_to_buf(struct connection *conn, struct iou_sock *ctx, struct buffer *buf, size_t count)
+{
+	size_t try, done = 0;
+
+	while (count && b_data(&ctx->rx)) {
+		try = b_contig_space(buf);
+		if (!try)
+			break;
+
+		if (try > count)
+			try = count;
+
+		if (try > b_data(&ctx->rx))
+			try = b_data(&ctx->rx);
+
+		try = b_getblk(&ctx->rx, b_tail(buf), try, 0);
+		b_add(buf, try);
+		b_del(&ctx->rx, try);
+		done += try;
+		count -= try;
+	}
+
+	if (b_data(&ctx->rx))
+		return done;
+
+	b_free(&ctx->rx);
+	if (ctx->rx_err) {
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+		errno = ctx->rx_err;
+	}
+	else if (ctx->flags & IOU_SOCK_RX_SHUT)
+		conn_sock_read0(conn);
+	else if (ctx->flags & IOU_SOCK_RX_DRAINED)
+		fd_cant_recv(conn->handle.fd);
+	return done;
+}
+
 /* Receive up to <count> bytes from connection <conn>'s socket and store them
  * into buffer <buf>. Only one call to recv() is performed, unless the
  * buffer wraps, in which case a second call may be performed. The connection's
@@ -226,6 +316,7 @@ int raw_sock_from_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pip
  */
 static size_t raw_sock_to_buf(struct connection *conn, void *xprt_ctx, struct buffer *buf, size_t count, int flags)
 {
+	struct iou_sock *ctx = xprt_ctx;
 	ssize_t ret;
 	size_t try, done = 0;
 
@@ -238,6 +329,15 @@ static size_t raw_sock_to_buf(struct connection *conn, void *xprt_ctx, struct bu
 	conn->flags &= ~CO_FL_WAIT_ROOM;
 	errno = 0;
 
+	if (ctx && !(conn->flags & (CO_FL_WAIT_L4_CONN | CO_FL_HANDSHAKE))) {
+		/* the handshakes are done, the poller may now receive for us */
+		if (!(ctx->flags & IOU_SOCK_RX_SPLICE))
+			ctx->flags |= IOU_SOCK_RX_ENABLED;
+
+		if (b_data(&ctx->rx) || ctx->rx_err || (ctx->flags & IOU_SOCK_RX_SHUT))
+			return raw_sock_iou_to_buf(conn, ctx, buf, count);
+	}
+
 	if (unlikely(!(fdtab[conn->handle.fd].ev & FD_POLL_IN))) {
 		/* stop here if we reached the end of data */
 		if ((fdtab[conn->handle.fd].ev & (FD_POLL_ERR|FD_POLL_HUP)) == FD_POLL_HUP)
@@ -331,6 +431,94 @@ static size_t raw_sock_to_buf(struct connection *conn, void *xprt_ctx, struct bu
 }
 
 
+/* Copies up to <len> bytes starting at offset <ofs> of the data described by
+ * the <iovcnt> vectors of <iov> into <blk>. Returns the number of bytes
+ * copied.
+ */
+static size_t raw_sock_iov_getblk(const struct iovec *iov, int iovcnt, char *blk, size_t len, size_t ofs)
+{
+	size_t done = 0, try;
+
+	for (; iovcnt && done < len; iov++, iovcnt--) {
+		if (ofs >= iov->iov_len) {
+			ofs -= iov->iov_len;
+			continue;
+		}
+		try = MIN(iov->iov_len - ofs, len - done);
+		memcpy(blk + done, (char *)iov->iov_base + ofs, try);
+		done += try;
+		ofs = 0;
+	}
+	return done;
+}
+
+/* Reports the bytes of <buf>, or of the <iovcnt> vectors of <iov> if <buf> is
+ * NULL, the kernel accepted for <conn> since the last call, then copies up to
+ * <count> following bytes into <ctx> and posts their send() to the poller's
+ * ring. Returns the number of bytes sent, or (size_t)-1 if the data could not
+ * be posted and must be sent directly.
+ *
+ * The data are only reported as sent once the request completes, so that the
+ * caller keeps them until then. Reporting them when they are posted would let
+ * the caller shut the socket down or close it while they are still queued,
+ * and they would be lost. This does not delay the data: the send() is
+ * performed with MSG_DONTWAIT by the io_uring_enter() that submits it with
+ * the next poll, and its completion is processed by that same poll, which
+ * wakes the caller up again in the same loop. The cost is one more call per
+ * send, and at most one buffer in flight per connection and polling loop.
+ */
+static size_t raw_sock_iou_send(struct connection *conn, struct iou_sock *ctx, const struct buffer *buf,
+                                const struct iovec *iov, int iovcnt, size_t count, int flags)
+{
+	size_t done, try;
+	int send_flag;
+
+	if (ctx->tx_err) {
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+		errno = ctx->tx_err;
+		return 0;
+	}
+
+	done = ctx->tx_acked;
+	if (done > count)
+		done = count;
+	ctx->tx_acked -= done;
+	count -= done;
+
+	if (ctx->flags & IOU_SOCK_TX_POSTED) {
+		/* wait for the pending request to complete */
+		fd_cant_send(conn->handle.fd);
+		return done;
+	}
+
+	if (!count) {
+		fd_stop_send(conn->handle.fd);
+		return done;
+	}
+
+	if (!b_size(&ctx->tx) && !b_alloc_margin(&ctx->tx, 0))
+		return done ? done : (size_t)-1;
+
+	b_reset(&ctx->tx);
+	if (buf)
+		try = b_getblk(buf, b_tail(&ctx->tx), MIN(count, b_size(&ctx->tx)), done);
+	else
+		try = raw_sock_iov_getblk(iov, iovcnt, b_tail(&ctx->tx), MIN(count, b_size(&ctx->tx)), done);
+	b_add(&ctx->tx, try);
+
+	send_flag = 0;
+	if (try < count || flags & CO_SFL_MSG_MORE)
+		send_flag |= MSG_MORE;
+
+	if (!iou_sock_post_send(ctx, send_flag)) {
+		b_free(&ctx->tx);
+		return done ? done : (size_t)-1;
+	}
+
+	fd_cant_send(conn->handle.fd);
+	return done;
+}
+
 /* Send up to <count> pending bytes from buffer <buf> to connection <conn>'s
  * socket. <flags> may contain some CO_SFL_* flags to hint the system about
  * other pending data for example, but this flag is ignored at the moment.
@@ -344,6 +532,7 @@ static size_t raw_sock_to_buf(struct connection *conn, void *xprt_ctx, struct bu
  */
 static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const struct buffer *buf, size_t count, int flags)
 {
+	struct iou_sock *ctx = xprt_ctx;
 	ssize_t ret;
 	size_t try, done;
 	int send_flag;
@@ -361,6 +550,12 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		return 0;
 	}
 
+	if (ctx && !(conn->flags & CO_FL_WAIT_L4_CONN)) {
+		done = raw_sock_iou_send(conn, ctx, buf, NULL, 0, count, flags);
+		if (done != (size_t)-1)
+			goto out;
+	}
+
 	done = 0;
 	/* send the largest possible block. For this we perform only one call
 	 * to send() unless the buffer wraps and we exactly fill the first hunk,
@@ -403,6 +598,7 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		conn->flags &= ~CO_FL_WAIT_L4_CONN;
 	}
 
+ out:
 	if (done > 0) {
 		/* we count the total bytes sent, and the send rate for 32-byte
 		 * blocks. The reason for the latter is that freq_ctr are
@@ -414,6 +610,86 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 	return done;
 }
 
+/* Send the data described by the <iovcnt> vectors of <iov> to connection
+ * <conn>'s socket using a single sendmsg() call, which must not be passed more
+ * than IOV_MAX vectors. <flags> may contain CO_SFL_MSG_MORE to indicate that
+ * more data immediately follow. The connection's flags are updated with
+ * whatever special event is detected (error, empty). As for raw_sock_from_buf(),
+ * the caller is responsible for the polling update and for consuming the data
+ * based on the return value, which is the number of bytes sent.
+ */
+static size_t raw_sock_from_iov(struct connection *conn, void *xprt_ctx, const struct iovec *iov, int iovcnt, int flags)
+{
+	struct iou_sock *ctx = xprt_ctx;
+	struct msghdr msg;
+	ssize_t ret;
+	size_t count, done;
+	int send_flag, i;
+
+	if (!conn_ctrl_ready(conn))
+		return 0;
+
+	if (!fd_send_ready(conn->handle.fd))
+		return 0;
+
+	if (conn->flags & CO_FL_SOCK_WR_SH) {
+		/* it's already closed */
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH;
+		errno = EPIPE;
+		return 0;
+	}
+
+	for (count = i = 0; i < iovcnt; i++)
+		count += iov[i].iov_len;
+
+	if (ctx && !(conn->flags & CO_FL_WAIT_L4_CONN)) {
+		done = raw_sock_iou_send(conn, ctx, NULL, iov, iovcnt, count, flags);
+		if (done != (size_t)-1)
+			goto out;
+	}
+
+	done = 0;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+
+	send_flag = MSG_DONTWAIT | MSG_NOSIGNAL;
+	if (flags & CO_SFL_MSG_MORE)
+		send_flag |= MSG_MORE;
+
+	do {
+		ret = sendmsg(conn->handle.fd, &msg, send_flag);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret > 0) {
+		done = ret;
+
+		/* if the system buffer is full, don't insist */
+		if (done < count)
+			fd_cant_send(conn->handle.fd);
+		else
+			fd_stop_send(conn->handle.fd);
+	}
+	else if (ret == 0 || errno == EAGAIN || errno == ENOTCONN || errno == EINPROGRESS) {
+		/* nothing written, we need to poll for write first */
+		fd_cant_send(conn->handle.fd);
+	}
+	else {
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+	}
+
+	if (unlikely(conn->flags & CO_FL_WAIT_L4_CONN) && done) {
+		conn->flags &= ~CO_FL_WAIT_L4_CONN;
+	}
+
+ out:
+	if (done > 0) {
+		_HA_ATOMIC_ADD(&global.out_bytes, done);
+		update_freq_ctr(&global.out_32bps, (done + 16) / 32);
+	}
+	return done;
+}
+
 /* Called from the upper layer, to subscribe <es> to events <event_type>. The
  * event subscriber <es> is not allowed to change from a previous call as long
  * as at least one event is still subscribed. The <event_type> must only be a
@@ -443,9 +719,26 @@ static int raw_sock_remove_xprt(struct connection *conn, void *xprt_ctx, void *t
 	return -1;
 }
 
+/* Prepares the socket I/O context of <conn> when its I/Os are to be performed
+ * by the poller. Without one, the I/Os are performed directly. Always returns
+ * zero.
+ */
+static int raw_sock_init(struct connection *conn, void **xprt_ctx)
+{
+	*xprt_ctx = iou_sock_new(conn->handle.fd);
+	return 0;
+}
+
+/* Releases the socket I/O context <xprt_ctx> of <conn> if any */
+static void raw_sock_close(struct connection *conn, void *xprt_ctx)
+{
+	iou_sock_free(xprt_ctx);
+}
+
 /* transport-layer operations for RAW sockets */
 static struct xprt_ops raw_sock = {
 	.snd_buf  = raw_sock_from_buf,
+	.snd_iov  = raw_sock_from_iov,
 	.rcv_buf  = raw_sock_to_buf,
 	.subscribe = raw_sock_subscribe,
 	.unsubscribe = raw_sock_unsubscribe,
@@ -456,7 +749,8 @@ static struct xprt_ops raw_sock = {
 #endif
 	.shutr    = NULL,
 	.shutw    = NULL,
-	.close    = NULL,
+	.init     = raw_sock_init,
+	.close    = raw_sock_close,
 	.name     = "RAW",
 };
 
@@ -0,0 +1,438 @@
+/*
+ * Literal prefilter for lists of regular expressions.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Most regexes used to filter requests contain literal words which must be
+ * present for them to match. These words are extracted from the regexes'
+ * source and looked up all at once in the tested string using an
+ * Aho-Corasick automaton, which tells which regexes may match. Only these
+ * candidates need to be run. The extraction is conservative : whenever the
+ * syntax is not fully understood, the regex is considered as always being a
+ * candidate, so that the prefilter never changes the result.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/acm.h>
+#include <haproxy/api.h>
+#include <haproxy/intops.h>
+#include <haproxy/rxset.h>
+
+/* maximum number of top-level alternatives of a regex for which literals are
+ * extracted, regexes with more alternatives are always candidates.
+ */
+#define RXSET_MAX_BRANCHES 16
+
+/* literal being extracted from a branch of a regex */
+struct rxset_run {
+	char str[RXSET_MAX_FACTOR + 1];
+	unsigned int len;
+};
+
+/* If <p> points to a quantifier, returns a pointer to the first character
+ * following it, including a lazy or possessive mark, and sets <*min> to its
+ * minimum count. Otherwise returns <p> and sets <*min> to 1.
+ */
+static const char *rxset_skip_quant(const char *p, unsigned int *min)
+{
+	const char *q;
+
+	*min = 1;
+	if (*p == '*' || *p == '?') {
+		*min = 0;
+		p++;
+	}
+	else if (*p == '+')
+		p++;
+	else if (*p == '{' && isdigit((unsigned char)p[1])) {
+		/* {n}, {n,} or {n,m}, anything else is a literal brace */
+		*min = 0;
+		for (q = p + 1; isdigit((unsigned char)*q); q++)
+			*min = *min < 1000 ? *min * 10 + *q - '0' : *min;
+		if (*q == ',')
+			for (q++; isdigit((unsigned char)*q); q++)
+				;
+		if (*q != '}') {
+			*min = 1;
+			return p;
+		}
+		p = q + 1;
+	}
+	else
+		return p;
+
+	if (*p == '?' || *p == '+')
+		p++;
+	return p;
+}
+
+/* Skips the character class starting at <p>, which points to the opening
+ * bracket. Returns a pointer to the character following the class, or NULL
+ * if it is not terminated.
+ */
+static const char *rxset_skip_class(const char *p)
+{
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	while (*p != ']') {
+		if (!*p)
+			return NULL;
+		if (*p == '\\') {
+			if (!p[1])
+				return NULL;
+			p += 2;
+			continue;
+		}
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			/* POSIX class such as [:alpha:] */
+			const char *end = strchr(p + 2, p[1]);
+
+			if (!end || end[1] != ']')
+				return NULL;
+			p = end + 2;
+			continue;
+		}
+		p++;
+	}
+	return p + 1;
+}
+
+/* Skips the group starting at <p>, which points to the opening parenthesis.
+ * Returns a pointer to the character following the group, or NULL if it is
+ * not terminated or contains a quoted sequence which could hide parenthesis.
+ */
+static const char *rxset_skip_group(const char *p)
+{
+	unsigned int depth = 0;
+
+	while (1) {
+		switch (*p) {
+		case 0:
+			return NULL;
+		case '\\':
+			if (!p[1] || p[1] == 'Q')
+				return NULL;
+			p += 2;
+			continue;
+		case '[':
+			p = rxset_skip_class(p);
+			if (!p)
+				return NULL;
+			continue;
+		case '(':
+			depth++;
+			break;
+		case ')':
+			if (!--depth)
+				return p + 1;
+			break;
+		}
+		p++;
+	}
+}
+
+/* Terminates the literal being built in <run>, keeping it in <best> if it is
+ * longer than the current one.
+ */
+static inline void rxset_end_run(struct rxset_run *run, struct rxset_run *best)
+{
+	if (run->len > best->len)
+		*best = *run;
+	run->len = 0;
+}
+
+/* Extracts from regex <rx> the longest literal which must appear in any string
+ * matched by each of its top-level alternatives, and stores them in <lits>,
+ * which can hold RXSET_MAX_BRANCHES of them. Literals are case-folded if
+ * <icase> is set. The regex uses the POSIX extended or the PCRE syntax, as
+ * regex_comp() compiles it. Returns the number of alternatives, or 0 if a
+ * literal of at least RXSET_MIN_FACTOR characters could not be found for each
+ * of them, or if the regex uses a syntax which is not handled.
+ */
+static int rxset_extract(const char *rx, int icase, struct rxset_run *lits)
+{
+	struct rxset_run run, best;
+	const char *p = rx, *q;
+	unsigned int min;
+	int nb = 0;
+	unsigned char c;
+
+	run.len = best.len = 0;
+	while (1) {
+		c = *p;
+		switch (c) {
+		case 0:
+		case '|':
+			/* end of an alternative */
+			rxset_end_run(&run, &best);
+			if (best.len < RXSET_MIN_FACTOR || nb == RXSET_MAX_BRANCHES)
+				return 0;
+			best.str[best.len] = 0;
+			lits[nb++] = best;
+			if (!c)
+				return nb;
+			run.len = best.len = 0;
+			p++;
+			continue;
+
+		case '(':
+			/* inline options and verbs change the way the rest of the
+			 * regex is interpreted.
+			 */
+			if (p[1] == '*' ||
+			    (p[1] == '?' && (isalpha((unsigned char)p[2]) || p[2] == '-' || p[2] == '^')))
+				return 0;
+			p = rxset_skip_group(p);
+			if (!p)
+				return 0;
+			rxset_end_run(&run, &best);
+			p = rxset_skip_quant(p, &min);
+			continue;
+
+		case ')':
+			return 0;
+
+		case '[':
+			p = rxset_skip_class(p);
+			if (!p)
+				return 0;
+			rxset_end_run(&run, &best);
+			p = rxset_skip_quant(p, &min);
+			continue;
+
+		case '.': case '^': case '$':
+		case '*': case '+': case '?': case '{':
+			rxset_end_run(&run, &best);
+			p = rxset_skip_quant(p + 1, &min);
+			continue;
+
+		case '\\':
+			c = p[1];
+			if (!c)
+				return 0;
+			if (isalnum(c)) {
+				/* classes and assertions only end the literal, the
+				 * other escapes are not handled.
+				 */
+				if (!strchr("dDwWsSbBAzZGhHvVR", c))
+					return 0;
+				rxset_end_run(&run, &best);
+				p = rxset_skip_quant(p + 2, &min);
+				continue;
+			}
+			p += 2;
+			break;
+
+		default:
+			p++;
+			break;
+		}
+
+		/* <c> is a literal character, possibly quantified */
+		q = rxset_skip_quant(p, &min);
+		if (!min || (icase && c >= 0x80)) {
+			rxset_end_run(&run, &best);
+			p = q;
+			continue;
+		}
+		if (icase)
+			c = tolower(c);
+		if (run.len < RXSET_MAX_FACTOR)
+			run.str[run.len++] = c;
+
+		/* a repeated character is required but not what follows it */
+		if (q != p)
+			rxset_end_run(&run, &best);
+		p = q;
+	}
+}
+
+/* Allocates an empty set. <flags> may contain RXSET_F_ICASE. Returns NULL if
+ * out of memory.
+ */
+struct rxset *rxset_new(unsigned int flags)
+{
+	struct rxset *rs;
+
+	rs = calloc(1, sizeof(*rs));
+	if (!rs)
+		return NULL;
+	rs->flags = flags & RXSET_F_ICASE;
+	return rs;
+}
+
+/* Adds a literal <str> (or an empty one for a regex without literals) found in
+ * regex number <rx> of set <rs>. Returns 0 if out of memory.
+ */
+static int rxset_add_factor(struct rxset *rs, const char *str, unsigned int rx)
+{
+	struct rxset_bfct *bfct;
+	unsigned int n;
+
+	if (rs->nb_bfct == rs->alloc_bfct) {
+		n = rs->alloc_bfct ? rs->alloc_bfct * 2 : 16;
+		bfct = realloc(rs->bfct, n * sizeof(*bfct));
+		if (!bfct)
+			return 0;
+		rs->bfct = bfct;
+		rs->alloc_bfct = n;
+	}
+	strcpy(rs->bfct[rs->nb_bfct].str, str);
+	rs->bfct[rs->nb_bfct].rx = rx;
+	rs->nb_bfct++;
+	return 1;
+}
+
+/* Adds the source of regex <regex> to set <rs>, which must not have been
+ * compiled yet. <item> is associated with the regex. Returns 0 if out of
+ * memory, otherwise non-zero.
+ */
+int rxset_add(struct rxset *rs, const char *regex, void *item)
+{
+	struct rxset_run lits[RXSET_MAX_BRANCHES];
+	unsigned int n;
+	void **items;
+	int i, nb;
+
+	if (rs->flags & RXSET_F_COMPILED)
+		return 0;
+
+	if (rs->nb_items == rs->alloc_items) {
+		n = rs->alloc_items ? rs->alloc_items * 2 : 16;
+		items = realloc(rs->items, n * sizeof(*items));
+		if (!items)
+			return 0;
+		rs->items = items;
+		rs->alloc_items = n;
+	}
+
+	nb = rxset_extract(regex, rs->flags & RXSET_F_ICASE, lits);
+	if (!nb && !rxset_add_factor(rs, "", rs->nb_items))
+		return 0;
+	for (i = 0; i < nb; i++)
+		if (!rxset_add_factor(rs, lits[i].str, rs->nb_items))
+			return 0;
+
+	rs->items[rs->nb_items++] = item;
+	return 1;
+}
+
+/* sorts literals alphabetically, then by regex number */
+static int rxset_cmp_bfct(const void *a, const void *b)
+{
+	const struct rxset_bfct *fa = a, *fb = b;
+	int ret = strcmp(fa->str, fb->str);
+
+	if (ret)
+		return ret;
+	return (fa->rx > fb->rx) - (fa->rx < fb->rx);
+}
+
+/* Builds the lookup structures of set <rs> from the regexes added so far. No
+ * regex may be added anymore. Returns 0 if out of memory, in which case the
+ * set may only be freed, otherwise non-zero.
+ */
+int rxset_compile(struct rxset *rs)
+{
+	struct rxset_bfct *f;
+	unsigned int i, nb_rx = 0;
+
+	if (rs->flags & RXSET_F_COMPILED)
+		return 1;
+
+	rs->map_longs = (rs->nb_items + LONGBITS - 1) / LONGBITS;
+	rs->always = calloc(rs->map_longs + 1, sizeof(*rs->always));
+	rs->fct_first = malloc((rs->nb_bfct + 1) * sizeof(*rs->fct_first));
+	rs->fct_rx = malloc((rs->nb_bfct + 1) * sizeof(*rs->fct_rx));
+	rs->acm = acm_new(ACM_F_ALL | ((rs->flags & RXSET_F_ICASE) ? ACM_F_ICASE : 0));
+	if (!rs->always || !rs->fct_first || !rs->fct_rx || !rs->acm)
+		return 0;
+
+	qsort(rs->bfct, rs->nb_bfct, sizeof(*rs->bfct), rxset_cmp_bfct);
+	for (i = 0; i < rs->nb_bfct; i++) {
+		f = &rs->bfct[i];
+		if (!*f->str) {
+			ha_bit_set(f->rx, (long *)rs->always);
+			continue;
+		}
+		if (!rs->nb_factors || strcmp(f->str, rs->bfct[i - 1].str) != 0) {
+			/* new distinct literal, patterns are numbered in order */
+			if (!acm_add(rs->acm, f->str, strlen(f->str), NULL))
+				return 0;
+			rs->fct_first[rs->nb_factors++] = nb_rx;
+		}
+		else if (f->rx == rs->bfct[i - 1].rx)
+			continue;
+		rs->fct_rx[nb_rx++] = f->rx;
+	}
+	rs->fct_first[rs->nb_factors] = nb_rx;
+
+	if (!acm_compile(rs->acm))
+		return 0;
+
+	free(rs->bfct);
+	rs->bfct = NULL;
+	rs->nb_bfct = rs->alloc_bfct = 0;
+	rs->flags |= RXSET_F_COMPILED;
+	return 1;
+}
+
+/* Releases set <rs>. NULL is supported. */
+void rxset_free(struct rxset *rs)
+{
+	if (!rs)
+		return;
+	acm_free(rs->acm);
+	free(rs->bfct);
+	free(rs->fct_first);
+	free(rs->fct_rx);
+	free(rs->always);
+	free(rs->items);
+	free(rs);
+}
+
+/* Looks up the literals of compiled set <rs> in the <len> bytes of <str>, and
+ * returns a bitmap in which bit N is set if regex number N may match <str>.
+ * The regexes whose bit is not set cannot match. <area> is a long-aligned
+ * work area of rxset_area_size() bytes, which the bitmap is part of.
+ */
+unsigned long *rxset_candidates(const struct rxset *rs, const char *str, size_t len, unsigned long *area)
+{
+	unsigned long *cand = area, *fmap = area + rs->map_longs;
+	unsigned int fct_longs = (rs->nb_factors + LONGBITS - 1) / LONGBITS;
+	unsigned int w, f, j;
+	unsigned long bits;
+
+	memcpy(cand, rs->always, rs->map_longs * sizeof(*cand));
+	if (!rs->nb_factors)
+		return cand;
+
+	memset(fmap, 0, fct_longs * sizeof(*fmap));
+	if (!acm_mark_sub(rs->acm, str, len, fmap))
+		return cand;
+
+	for (w = 0; w < fct_longs; w++) {
+		for (bits = fmap[w]; bits; bits &= bits - 1) {
+			f = w * LONGBITS + __builtin_ctzl(bits);
+			for (j = rs->fct_first[f]; j < rs->fct_first[f + 1]; j++)
+				ha_bit_set(rs->fct_rx[j], (long *)cand);
+		}
+	}
+	return cand;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -389,6 +389,26 @@ static int srv_parse_pool_max_conn(char **args, int *cur_arg, struct proxy *curp
 	return 0;
 }
 
+/* parse the "pool-warm-conn" server keyword */
+static int srv_parse_pool_warm_conn(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
+{
+	char *arg;
+
+	arg = args[*cur_arg + 1];
+	if (!*arg) {
+		memprintf(err, "'%s' expects <value> as argument.\n", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	if ((int)atoi(arg) < 0) {
+		memprintf(err, "'%s' must be >= 0", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	newsrv->warm_conns = atoi(arg);
+
+	return 0;
+}
+
 /* parse the "id" server keyword */
 static int srv_parse_id(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
 {
@@ -1281,6 +1301,7 @@ static struct srv_kw_list srv_kws = { "ALL", { }, {
 	{ "pool-low-conn",       srv_parse_pool_low_conn,       1,  1 }, /* Set the min number of orphan idle connecbefore being allowed to pick from other threads */
 	{ "pool-max-conn",       srv_parse_pool_max_conn,       1,  1 }, /* Set the max number of orphan idle connections, 0 means unlimited */
 	{ "pool-purge-delay",    srv_parse_pool_purge_delay,    1,  1 }, /* Set the time before we destroy orphan idle connections, defaults to 1s */
+	{ "pool-warm-conn",      srv_parse_pool_warm_conn,      1,  1 }, /* Set the number of idle connections to establish in advance */
 	{ "proto",               srv_parse_proto,               1,  1 }, /* Set the proto to use for all outgoing connections */
 	{ "proxy-v2-options",    srv_parse_proxy_v2_options,    1,  1 }, /* options for send-proxy-v2 */
 	{ "redir",               srv_parse_redir,               1,  1 }, /* Enable redirection mode */
@@ -1758,6 +1779,7 @@ static void srv_settings_cpy(struct server *srv, struct server *src, int srv_tmp
 	srv->pool_purge_delay = src->pool_purge_delay;
 	srv->low_idle_conns = src->low_idle_conns;
 	srv->max_idle_conns = src->max_idle_conns;
+	srv->warm_conns = src->warm_conns;
 	srv->max_reuse = src->max_reuse;
 
 	if (srv_tmpl)
@@ -5412,21 +5434,20 @@ struct task *srv_cleanup_toremove_connections(struct task *task, void *context,
 	return task;
 }
 
-/* Move toremove_nb connections from idle_list to toremove_list, -1 means
- * moving them all.
+/* Move toremove_nb connections from idle_tree to toremove_list, -1 means
+ * moving them all. The takeover lock of the tree's thread must be held.
  * Returns the number of connections moved.
  */
-static int srv_migrate_conns_to_remove(struct mt_list *idle_list, struct mt_list *toremove_list, int toremove_nb)
+static int srv_migrate_conns_to_remove(struct eb_root *idle_tree, struct mt_list *toremove_list, int toremove_nb)
 {
-	struct mt_list *elt1, elt2;
+	struct eb64_node *node;
 	struct connection *conn;
 	int i = 0;
 
-	mt_list_for_each_entry_safe(conn, idle_list, list, elt1, elt2) {
-		if (toremove_nb != -1 && i >= toremove_nb)
-			break;
-		MT_LIST_DEL_SAFE_NOINIT(elt1);
-		MT_LIST_ADDQ_NOCHECK(toremove_list, &conn->list);
+	while ((toremove_nb == -1 || i < toremove_nb) && (node = eb64_first(idle_tree))) {
+		conn = eb64_entry(node, struct connection, hash_node);
+		eb64_delete(node);
+		MT_LIST_ADDQ(toremove_list, &conn->list);
 		i++;
 	}
 	return i;
@@ -5447,10 +5468,12 @@ static void srv_cleanup_connections(struct server *srv)
 	HA_SPIN_LOCK(OTHER_LOCK, &idle_conn_srv_lock);
 	for (i = tid;;) {
 		did_remove = 0;
-		if (srv_migrate_conns_to_remove(&srv->idle_conns[i], &idle_conns[i].toremove_conns, -1) > 0)
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
+		if (srv_migrate_conns_to_remove(&srv->idle_conns_tree[i], &idle_conns[i].toremove_conns, -1) > 0)
 			did_remove = 1;
-		if (srv_migrate_conns_to_remove(&srv->safe_conns[i], &idle_conns[i].toremove_conns, -1) > 0)
+		if (srv_migrate_conns_to_remove(&srv->safe_conns_tree[i], &idle_conns[i].toremove_conns, -1) > 0)
 			did_remove = 1;
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
 		if (did_remove)
 			task_wakeup(idle_conns[i].cleanup_task, TASK_WOKEN_OTHER);
 
@@ -5501,6 +5524,9 @@ struct task *srv_cleanup_idle_connections(struct task *task, void *context, unsi
 		if (curr_idle == 0)
 			goto remove;
 		exceed_conns = srv->curr_used_conns + curr_idle - MAX(srv->max_used_conns, srv->est_need_conns);
+		/* the warm pool is refilled anyway, do not fight it */
+		if (exceed_conns > (int)(curr_idle - srv->warm_conns))
+			exceed_conns = curr_idle - srv->warm_conns;
 		exceed_conns = to_kill = exceed_conns / 2 + (exceed_conns & 1);
 
 		srv->est_need_conns = (srv->est_need_conns + srv->max_used_conns) / 2;
@@ -5521,12 +5547,14 @@ struct task *srv_cleanup_idle_connections(struct task *task, void *context, unsi
 			max_conn = (exceed_conns * srv->curr_idle_thr[i]) /
 			           curr_idle + 1;
 
-			j = srv_migrate_conns_to_remove(&srv->idle_conns[i], &idle_conns[i].toremove_conns, max_conn);
+			HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
+			j = srv_migrate_conns_to_remove(&srv->idle_conns_tree[i], &idle_conns[i].toremove_conns, max_conn);
 			if (j > 0)
 				did_remove = 1;
 			if (max_conn - j > 0 &&
-			    srv_migrate_conns_to_remove(&srv->safe_conns[i], &idle_conns[i].toremove_conns, max_conn - j) > 0)
+			    srv_migrate_conns_to_remove(&srv->safe_conns_tree[i], &idle_conns[i].toremove_conns, max_conn - j) > 0)
 				did_remove = 1;
+			HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[i].takeover_lock);
 
 			if (did_remove)
 				task_wakeup(idle_conns[i].cleanup_task, TASK_WOKEN_OTHER);
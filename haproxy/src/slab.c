@@ -0,0 +1,350 @@
+/*
+ * Size-class slab allocator backing the memory pools.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * When built with USE_POOL_SLAB, pools whose objects are not larger than
+ * SLAB_MAX_SIZE share a small set of size classes instead of each having its
+ * own free list refilled by malloc(). Memory is mapped by aligned segments cut
+ * into slabs, and each slab is assigned to one class and owned by one thread,
+ * which allocates and releases its objects without any atomic operation.
+ * Objects released by other threads are pushed to a lock-free list in their
+ * slab and collected by the owner once it runs out of objects. Slabs which
+ * become empty go back to a global list, past a few of them their pages are
+ * returned to the system, so that memory is released incrementally without
+ * having to isolate threads.
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/global.h>
+#include <haproxy/list.h>
+#include <haproxy/pool-os.h>
+#include <haproxy/pool-t.h>
+#include <haproxy/slab.h>
+#include <haproxy/thread.h>
+
+#ifdef CONFIG_HAP_POOL_SLAB
+
+struct slab_class slab_classes[SLAB_CLASSES];
+struct slab_cache slab_cache[MAX_THREADS][SLAB_CLASSES];
+unsigned int slab_segments;     /* number of segments mapped */
+unsigned int slab_free_dirty;   /* free slabs still resident */
+unsigned int slab_free_clean;   /* free slabs returned to the system */
+unsigned int slab_reserved;     /* free slabs pre-allocated on startup */
+unsigned int slab_segments_huge; /* segments backed by huge pages */
+
+static struct list slab_dirty_list = LIST_HEAD_INIT(slab_dirty_list);
+static struct list slab_clean_list = LIST_HEAD_INIT(slab_clean_list);
+static volatile unsigned long slab_gc_mask; /* threads requested to collect their slabs */
+static unsigned int slab_max_dirty = SLAB_MAX_DIRTY; /* free slabs kept resident */
+
+__decl_aligned_spinlock(slab_lock); /* protects the free slabs and segments */
+
+/* Returns a slab which was never used, carved from the current segment, or
+ * from a new one if needed. NULL is returned if a new segment cannot be
+ * allocated. Must be called with the slab lock held.
+ */
+static struct slab *slab_carve()
+{
+	static struct slab_segment *seg;
+	static unsigned int seg_next = SLAB_PER_SEG;
+	struct slab *s;
+
+	if (seg_next == SLAB_PER_SEG) {
+		seg = pool_alloc_aligned_area(SLAB_SEG_SIZE, SLAB_SEG_SIZE);
+		if (!seg)
+			return NULL;
+		if ((global.tune.options & GTUNE_POOL_HUGEPAGES) &&
+		    pool_advise_huge_area(seg, SLAB_SEG_SIZE))
+			slab_segments_huge++;
+		slab_segments++;
+		seg_next = 0;
+	}
+	/* the first slab starts after the segment's header */
+	s = &seg->slabs[seg_next];
+	s->area = (char *)seg + seg_next * SLAB_SIZE;
+	if (!seg_next)
+		s->area += sizeof(*seg);
+	seg_next++;
+	return s;
+}
+
+/* Returns a free slab initialized for class <cls> and owned by the current
+ * thread. Resident free slabs are preferred, then those returned to the
+ * system, then new ones are carved. NULL is returned if a new segment is
+ * needed and cannot be allocated.
+ */
+static struct slab *slab_get_free(int cls)
+{
+	struct slab *s = NULL;
+
+	HA_SPIN_LOCK(POOL_LOCK, &slab_lock);
+	if (!LIST_ISEMPTY(&slab_dirty_list)) {
+		s = LIST_NEXT(&slab_dirty_list, struct slab *, list);
+		LIST_DEL(&s->list);
+		slab_free_dirty--;
+	}
+	else if (!LIST_ISEMPTY(&slab_clean_list)) {
+		s = LIST_NEXT(&slab_clean_list, struct slab *, list);
+		LIST_DEL(&s->list);
+		slab_free_clean--;
+	}
+	else if ((s = slab_carve()) == NULL)
+		goto out;
+	slab_classes[cls].slabs++;
+ out:
+	HA_SPIN_UNLOCK(POOL_LOCK, &slab_lock);
+
+	if (s) {
+		s->size = slab_classes[cls].size;
+		s->nb_objs = (SLAB_SIZE - ((uintptr_t)s->area & (SLAB_SIZE - 1))) / s->size;
+		s->next_new = 0;
+		s->used = 0;
+		s->free = NULL;
+		s->remote = NULL;
+		s->cls = cls;
+		s->owner = tid;
+	}
+	return s;
+}
+
+/* Returns the pages of free slab <s> to the system and moves it to the list of
+ * clean slabs. The slab must not be in any list.
+ */
+static void slab_clean(struct slab *s)
+{
+	char *start = (char *)(((uintptr_t)s->area + 4095) & -(uintptr_t)4096);
+	char *end = (char *)(((uintptr_t)s->area & -(uintptr_t)SLAB_SIZE) + SLAB_SIZE);
+
+	pool_release_area(start, end - start);
+
+	HA_SPIN_LOCK(POOL_LOCK, &slab_lock);
+	LIST_ADD(&slab_clean_list, &s->list);
+	slab_free_clean++;
+	HA_SPIN_UNLOCK(POOL_LOCK, &slab_lock);
+}
+
+/* Puts empty slab <s> owned by the current thread back into the free slabs
+ * list. If too many free slabs are resident, the oldest one is returned to the
+ * system. The slab must not be in any list.
+ */
+static void slab_put_free(struct slab *s)
+{
+	struct slab *old = NULL;
+
+	s->state = SLAB_ST_FREE;
+	HA_SPIN_LOCK(POOL_LOCK, &slab_lock);
+	slab_classes[s->cls].slabs--;
+	s->cls = -1;
+	s->owner = -1;
+	LIST_ADD(&slab_dirty_list, &s->list);
+	if (++slab_free_dirty > slab_max_dirty) {
+		old = LIST_PREV(&slab_dirty_list, struct slab *, list);
+		LIST_DEL(&old->list);
+		slab_free_dirty--;
+	}
+	HA_SPIN_UNLOCK(POOL_LOCK, &slab_lock);
+
+	if (old)
+		slab_clean(old);
+}
+
+/* Moves the objects released by other threads into slab <s> to its free list.
+ * The slab must be owned by the current thread. Returns the number of objects
+ * collected.
+ */
+static unsigned int slab_collect(struct slab *s)
+{
+	void *list, **last;
+	unsigned int n;
+
+	if (!s->remote)
+		return 0;
+
+	list = _HA_ATOMIC_XCHG(&s->remote, NULL);
+	__ha_barrier_atomic_load();
+	for (n = 1, last = list; *last; last = *last)
+		n++;
+
+	*last = s->free;
+	s->free = list;
+	s->used -= n;
+	return n;
+}
+
+/* Collects the objects released by other threads into all slabs owned by the
+ * current thread, and frees the slabs which become empty.
+ */
+static void slab_gc_local()
+{
+	struct slab_cache *sc;
+	struct slab *s, *back;
+	int cls;
+
+	_HA_ATOMIC_AND(&slab_gc_mask, ~tid_bit);
+	for (cls = 0; cls < SLAB_CLASSES; cls++) {
+		sc = &slab_cache[tid][cls];
+		list_for_each_entry_safe(s, back, &sc->full, list) {
+			if (slab_collect(s))
+				__slab_requeue(s);
+		}
+		list_for_each_entry_safe(s, back, &sc->partial, list) {
+			slab_collect(s);
+			if (!s->used) {
+				LIST_DEL(&s->list);
+				slab_put_free(s);
+			}
+		}
+	}
+}
+
+/* Slow path of slab_alloc(), called when the current slab of class <cls> has
+ * no free object left. Objects released by other threads are collected first,
+ * then another slab of the class is picked, or a new one is assigned to it.
+ */
+void *__slab_alloc(int cls)
+{
+	struct slab_cache *sc = &slab_cache[tid][cls];
+	struct slab *s = sc->cur;
+	int scan;
+
+	if (unlikely(slab_gc_mask & tid_bit))
+		slab_gc_local();
+
+	if (s) {
+		if (slab_collect(s))
+			goto alloc;
+		s->state = SLAB_ST_FULL;
+		LIST_ADDQ(&sc->full, &s->list);
+		sc->cur = NULL;
+	}
+
+	if (!LIST_ISEMPTY(&sc->partial)) {
+		s = LIST_NEXT(&sc->partial, struct slab *, list);
+		LIST_DEL(&s->list);
+		goto set_cur;
+	}
+
+	/* full slabs may have received objects from other threads */
+	for (scan = 0; scan < SLAB_SCAN_MAX && !LIST_ISEMPTY(&sc->full); scan++) {
+		s = LIST_NEXT(&sc->full, struct slab *, list);
+		LIST_DEL(&s->list);
+		if (slab_collect(s))
+			goto set_cur;
+		LIST_ADDQ(&sc->full, &s->list);
+	}
+
+	s = slab_get_free(cls);
+	if (!s)
+		return NULL;
+ set_cur:
+	s->state = SLAB_ST_CUR;
+	sc->cur = s;
+ alloc:
+	sc->allocs++;
+	return __slab_pop(s);
+}
+
+/* Called by slab_free() when the current thread released an object into one of
+ * its slabs which was either full or is now empty, and is not the current one.
+ * The slab is moved to the partial list or freed.
+ */
+void __slab_requeue(struct slab *s)
+{
+	LIST_DEL(&s->list);
+	if (!s->used) {
+		slab_put_free(s);
+		return;
+	}
+	s->state = SLAB_ST_PARTIAL;
+	LIST_ADD(&slab_cache[tid][s->cls].partial, &s->list);
+}
+
+/* Releases as much memory as possible: the current thread collects its slabs
+ * immediately, other threads will do so on their next slow allocation, and all
+ * resident free slabs except the reserved ones are returned to the system. No
+ * thread isolation is needed.
+ */
+void slab_gc()
+{
+	struct slab *s;
+
+	_HA_ATOMIC_OR(&slab_gc_mask, all_threads_mask & ~tid_bit);
+	slab_gc_local();
+
+	while (1) {
+		s = NULL;
+		HA_SPIN_LOCK(POOL_LOCK, &slab_lock);
+		if (slab_free_dirty > slab_reserved) {
+			s = LIST_NEXT(&slab_dirty_list, struct slab *, list);
+			LIST_DEL(&s->list);
+			slab_free_dirty--;
+		}
+		HA_SPIN_UNLOCK(POOL_LOCK, &slab_lock);
+		if (!s)
+			break;
+		slab_clean(s);
+	}
+}
+
+/* Pre-allocates <count> free slabs and faults their pages in. They are kept
+ * resident even when memory is released. Returns the number of slabs which
+ * could be allocated.
+ */
+unsigned int slab_reserve(unsigned int count)
+{
+	struct slab *s;
+	unsigned int n;
+
+	HA_SPIN_LOCK(POOL_LOCK, &slab_lock);
+	for (n = 0; n < count; n++) {
+		s = slab_carve();
+		if (!s)
+			break;
+		pool_touch_area(s->area, SLAB_SIZE - ((uintptr_t)s->area & (SLAB_SIZE - 1)));
+		s->state = SLAB_ST_FREE;
+		s->cls = -1;
+		s->owner = -1;
+		LIST_ADDQ(&slab_dirty_list, &s->list);
+		slab_free_dirty++;
+	}
+	slab_reserved += n;
+	slab_max_dirty += n;
+	HA_SPIN_UNLOCK(POOL_LOCK, &slab_lock);
+	return n;
+}
+
+/* Initializes the size classes and the per-thread contexts */
+static void slab_init()
+{
+	unsigned int base;
+	int cls, thr;
+
+	for (cls = 0; cls < SLAB_CLASSES; cls++) {
+		if (cls < SLAB_SMALL_MAX / SLAB_SMALL_STEP)
+			slab_classes[cls].size = (cls + 1) * SLAB_SMALL_STEP;
+		else {
+			base = SLAB_SMALL_MAX << ((cls - SLAB_SMALL_MAX / SLAB_SMALL_STEP) / 4);
+			slab_classes[cls].size = base + base / 4 * ((cls - SLAB_SMALL_MAX / SLAB_SMALL_STEP) % 4 + 1);
+		}
+
+		for (thr = 0; thr < MAX_THREADS; thr++) {
+			LIST_INIT(&slab_cache[thr][cls].partial);
+			LIST_INIT(&slab_cache[thr][cls].full);
+		}
+	}
+}
+
+INITCALL0(STG_PREPARE, slab_init);
+
+#endif /* CONFIG_HAP_POOL_SLAB */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,348 @@
+/*
+ * Kernel TLS transmit offload for SSL frontends
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Once the handshake of a connection accepted on a "bind" line with the "ktls"
+ * option is complete, the server write key and IV are derived again from what
+ * OpenSSL exposes (the application traffic secret reported to the keylog
+ * callback in TLS 1.3, the master secret in TLS 1.2) and passed to the kernel
+ * with the sequence number of the next record, which is tracked by counting
+ * the records OpenSSL sent after its Finished message. From then on the
+ * application data are sent in clear on the socket, which makes splicing
+ * possible, while OpenSSL keeps decrypting what is received. Only AES-GCM and
+ * ChaCha20-Poly1305 are supported, other ciphers stay in userland, as do the
+ * connections for which the kernel refuses the keys.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <linux/tls.h>
+
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+#include <haproxy/api.h>
+#include <haproxy/connection.h>
+#include <haproxy/intops.h>
+#include <haproxy/openssl-compat.h>
+#include <haproxy/ssl_ktls.h>
+#include <haproxy/ssl_sock.h>
+
+#ifdef HAVE_SSL_KTLS
+
+/* set when the kernel reported it does not know about TLS, so that we stop
+ * trying on every connection.
+ */
+static int ktls_unavailable;
+
+/* The ssl_sock context is the one of the BIO, which remains valid when other
+ * transport layers are stacked above it during the handshake.
+ */
+static inline struct ssl_sock_ctx *ssl_ktls_ctx(const SSL *ssl)
+{
+	BIO *bio = SSL_get_wbio(ssl);
+
+	return bio ? BIO_get_data(bio) : NULL;
+}
+
+/* SSL/TLS protocol message callback counting the records sent with the
+ * application keys.
+ */
+void ssl_ktls_msg_cbk(struct connection *conn, int write_p, int version,
+                      int content_type, const void *buf, size_t len, SSL *ssl)
+{
+	struct ssl_sock_ctx *ctx;
+
+	if (!write_p)
+		return;
+
+	ctx = ssl_ktls_ctx(ssl);
+	if (!ctx || !(ctx->xprt_st & SSL_SOCK_ST_FL_KTLS))
+		return;
+
+	if (content_type == SSL3_RT_HEADER) {
+		if (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_SEQ)
+			ctx->ktls_seq++;
+	}
+	else if (content_type == SSL3_RT_HANDSHAKE && len && *(const unsigned char *)buf == SSL3_MT_FINISHED) {
+		/* the header of the record carrying the Finished message was
+		 * already reported. It was the first one sent with the new
+		 * keys in TLS 1.2, while TLS 1.3 switches to the application
+		 * keys right after it.
+		 */
+		ctx->ktls_seq = (SSL_version(ssl) >= TLS1_3_VERSION) ? 0 : 1;
+		ctx->xprt_st |= SSL_SOCK_ST_FL_KTLS_SEQ;
+	}
+}
+
+/* Keylog callback hook retrieving the TLS 1.3 server application traffic
+ * secret of a connection expecting kTLS.
+ */
+void ssl_ktls_keylog(const SSL *ssl, const char *line)
+{
+	struct ssl_sock_ctx *ctx;
+	const char *hex;
+	size_t len, i;
+	int hi, lo;
+
+	if (strncmp(line, "SERVER_TRAFFIC_SECRET_0 ", 24) != 0)
+		return;
+
+	ctx = ssl_ktls_ctx(ssl);
+	if (!ctx || !(ctx->xprt_st & SSL_SOCK_ST_FL_KTLS))
+		return;
+
+	hex = strrchr(line, ' ') + 1;
+	len = strlen(hex);
+	if ((len & 1) || len / 2 > sizeof(ctx->ktls_secret))
+		return;
+
+	for (i = 0; i < len / 2; i++) {
+		hi = hex2i(hex[2 * i]);
+		lo = hex2i(hex[2 * i + 1]);
+		if (hi < 0 || lo < 0)
+			return;
+		ctx->ktls_secret[i] = (hi << 4) | lo;
+	}
+	ctx->ktls_secret_len = len / 2;
+}
+
+/* TLS 1.3 HKDF-Expand-Label(<secret>, <label>, "", <out_len>) (RFC8446#7.1).
+ * Returns 0 on failure.
+ */
+static int ssl_ktls_expand_label(const EVP_MD *md, unsigned char *secret, size_t secret_len,
+                                 const char *label, unsigned char *out, size_t out_len)
+{
+	unsigned char info[16];
+	size_t llen = strlen(label), ilen = 0;
+	EVP_PKEY_CTX *pctx;
+	int ret = 0;
+
+	info[ilen++] = out_len >> 8;
+	info[ilen++] = out_len;
+	info[ilen++] = 6 + llen;
+	memcpy(info + ilen, "tls13 ", 6);
+	ilen += 6;
+	memcpy(info + ilen, label, llen);
+	ilen += llen;
+	info[ilen++] = 0; /* empty context */
+
+	pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+	if (pctx &&
+	    EVP_PKEY_derive_init(pctx) > 0 &&
+	    EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+	    EVP_PKEY_CTX_set_hkdf_md(pctx, md) > 0 &&
+	    EVP_PKEY_CTX_set1_hkdf_key(pctx, secret, secret_len) > 0 &&
+	    EVP_PKEY_CTX_add1_hkdf_info(pctx, info, ilen) > 0 &&
+	    EVP_PKEY_derive(pctx, out, &out_len) > 0)
+		ret = 1;
+	EVP_PKEY_CTX_free(pctx);
+	return ret;
+}
+
+/* TLS 1.2 key block of <len> bytes (RFC5246#6.3). Returns 0 on failure. */
+static int ssl_ktls_key_block(SSL *ssl, const EVP_MD *md, unsigned char *out, size_t len)
+{
+	unsigned char master[SSL_MAX_MASTER_KEY_LENGTH];
+	unsigned char srv_random[SSL3_RANDOM_SIZE], cli_random[SSL3_RANDOM_SIZE];
+	size_t master_len;
+	EVP_PKEY_CTX *pctx;
+	int ret = 0;
+
+	master_len = SSL_SESSION_get_master_key(SSL_get_session(ssl), master, sizeof(master));
+	if (SSL_get_server_random(ssl, srv_random, sizeof(srv_random)) != sizeof(srv_random) ||
+	    SSL_get_client_random(ssl, cli_random, sizeof(cli_random)) != sizeof(cli_random))
+		goto out;
+
+	pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_TLS1_PRF, NULL);
+	if (pctx &&
+	    EVP_PKEY_derive_init(pctx) > 0 &&
+	    EVP_PKEY_CTX_set_tls1_prf_md(pctx, md) > 0 &&
+	    EVP_PKEY_CTX_set1_tls1_prf_secret(pctx, master, master_len) > 0 &&
+	    EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, (const unsigned char *)"key expansion", 13) > 0 &&
+	    EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, srv_random, sizeof(srv_random)) > 0 &&
+	    EVP_PKEY_CTX_add1_tls1_prf_seed(pctx, cli_random, sizeof(cli_random)) > 0 &&
+	    EVP_PKEY_derive(pctx, out, &len) > 0)
+		ret = 1;
+	EVP_PKEY_CTX_free(pctx);
+ out:
+	OPENSSL_cleanse(master, sizeof(master));
+	return ret;
+}
+
+/* Tries to hand the transmit side of the connection of <ctx> over to the
+ * kernel once its handshake is complete. Returns non-zero on success, in which
+ * case SSL_SOCK_ST_FL_KTLS_TX is set, otherwise the connection goes on with
+ * OpenSSL. No further attempt is made either way.
+ */
+int ssl_ktls_start(struct ssl_sock_ctx *ctx)
+{
+	union {
+		struct tls_crypto_info info;
+		struct tls12_crypto_info_aes_gcm_128 gcm128;
+		struct tls12_crypto_info_aes_gcm_256 gcm256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+		struct tls12_crypto_info_chacha20_poly1305 chacha;
+#endif
+	} ci;
+	unsigned char block[2 * 32 + 2 * 12];
+	unsigned char seq[8];
+	const unsigned char *key, *iv;
+	const SSL_CIPHER *cipher;
+	const EVP_MD *md;
+	int version, key_len, iv_len, ci_len, i;
+	int ret = 0;
+
+	memset(&ci, 0, sizeof(ci));
+	if (ktls_unavailable || !(ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_SEQ))
+		goto out;
+
+	version = SSL_version(ctx->ssl);
+	cipher = SSL_get_current_cipher(ctx->ssl);
+	if ((version != TLS1_2_VERSION && version != TLS1_3_VERSION) || !cipher)
+		goto out;
+
+	md = SSL_CIPHER_get_handshake_digest(cipher);
+	if (!md)
+		goto out;
+
+	switch (SSL_CIPHER_get_cipher_nid(cipher)) {
+	case NID_aes_128_gcm:
+		key_len = 16;
+		iv_len = 12;
+		ci.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+		ci_len = sizeof(ci.gcm128);
+		break;
+	case NID_aes_256_gcm:
+		key_len = 32;
+		iv_len = 12;
+		ci.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+		ci_len = sizeof(ci.gcm256);
+		break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case NID_chacha20_poly1305:
+		key_len = 32;
+		iv_len = 12;
+		ci.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+		ci_len = sizeof(ci.chacha);
+		break;
+#endif
+	default:
+		goto out;
+	}
+
+	if (version == TLS1_3_VERSION) {
+		ci.info.version = TLS_1_3_VERSION;
+		if (!ctx->ktls_secret_len ||
+		    !ssl_ktls_expand_label(md, ctx->ktls_secret, ctx->ktls_secret_len, "key", block, key_len) ||
+		    !ssl_ktls_expand_label(md, ctx->ktls_secret, ctx->ktls_secret_len, "iv", block + key_len, iv_len))
+			goto out;
+		key = block;
+		iv  = block + key_len;
+	}
+	else {
+		/* AES-GCM only has a 4-byte implicit IV in TLS 1.2 (RFC5288) */
+		if (ci.info.cipher_type == TLS_CIPHER_AES_GCM_128 ||
+		    ci.info.cipher_type == TLS_CIPHER_AES_GCM_256)
+			iv_len = 4;
+		if (!ssl_ktls_key_block(ctx->ssl, md, block, 2 * (key_len + iv_len)))
+			goto out;
+		/* client key, server key, client IV, server IV */
+		ci.info.version = TLS_1_2_VERSION;
+		key = block + key_len;
+		iv  = block + 2 * key_len + iv_len;
+	}
+
+	for (i = 0; i < 8; i++)
+		seq[i] = ctx->ktls_seq >> (56 - 8 * i);
+
+	switch (ci.info.cipher_type) {
+	case TLS_CIPHER_AES_GCM_128:
+		memcpy(ci.gcm128.key, key, sizeof(ci.gcm128.key));
+		memcpy(ci.gcm128.salt, iv, sizeof(ci.gcm128.salt));
+		/* TLS 1.2 sends an explicit nonce, we use the sequence number */
+		memcpy(ci.gcm128.iv, (version == TLS1_3_VERSION) ? iv + 4 : seq, sizeof(ci.gcm128.iv));
+		memcpy(ci.gcm128.rec_seq, seq, sizeof(ci.gcm128.rec_seq));
+		break;
+	case TLS_CIPHER_AES_GCM_256:
+		memcpy(ci.gcm256.key, key, sizeof(ci.gcm256.key));
+		memcpy(ci.gcm256.salt, iv, sizeof(ci.gcm256.salt));
+		memcpy(ci.gcm256.iv, (version == TLS1_3_VERSION) ? iv + 4 : seq, sizeof(ci.gcm256.iv));
+		memcpy(ci.gcm256.rec_seq, seq, sizeof(ci.gcm256.rec_seq));
+		break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case TLS_CIPHER_CHACHA20_POLY1305:
+		memcpy(ci.chacha.key, key, sizeof(ci.chacha.key));
+		memcpy(ci.chacha.iv, iv, sizeof(ci.chacha.iv));
+		memcpy(ci.chacha.rec_seq, seq, sizeof(ci.chacha.rec_seq));
+		break;
+#endif
+	}
+
+	if (setsockopt(ctx->conn->handle.fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+		if (errno == ENOENT || errno == ENOPROTOOPT)
+			ktls_unavailable = 1;
+		goto out;
+	}
+
+	/* Without TX keys the ULP passes everything through, so a failure
+	 * here (e.g. an old kernel without TLS 1.3) leaves the socket usable.
+	 */
+	if (setsockopt(ctx->conn->handle.fd, SOL_TLS, TLS_TX, &ci, ci_len) < 0)
+		goto out;
+
+	ctx->xprt_st |= SSL_SOCK_ST_FL_KTLS_TX;
+	ret = 1;
+ out:
+	ctx->xprt_st &= ~(SSL_SOCK_ST_FL_KTLS | SSL_SOCK_ST_FL_KTLS_SEQ);
+	OPENSSL_cleanse(&ci, sizeof(ci));
+	OPENSSL_cleanse(block, sizeof(block));
+	OPENSSL_cleanse(ctx->ktls_secret, sizeof(ctx->ktls_secret));
+	ctx->ktls_secret_len = 0;
+	return ret;
+}
+
+/* Sends a close_notify alert on the connection of <ctx> whose records are
+ * built by the kernel. Returns non-zero if it was sent.
+ */
+int ssl_ktls_close_notify(struct ssl_sock_ctx *ctx)
+{
+	static const unsigned char alert[2] = { SSL3_AL_WARNING, SSL_AD_CLOSE_NOTIFY };
+	char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = (void *)alert;
+	iov.iov_len  = sizeof(alert);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*CMSG_DATA(cmsg) = SSL3_RT_ALERT;
+
+	return sendmsg(ctx->conn->handle.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(alert);
+}
+
+#endif /* HAVE_SSL_KTLS */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
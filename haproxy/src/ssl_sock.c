@@ -68,6 +68,7 @@
 #include <haproxy/shctx.h>
 #include <haproxy/ssl_ckch.h>
 #include <haproxy/ssl_crtlist.h>
+#include <haproxy/ssl_ktls.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/ssl_utils.h>
 #include <haproxy/stats-t.h>
@@ -153,6 +154,15 @@ static int ha_ssl_write(BIO *h, const char *buf, int num)
 	int ret;
 
 	ctx = BIO_get_data(h);
+#ifdef HAVE_SSL_KTLS
+	/* the kernel now builds the records, anything OpenSSL would emit
+	 * (e.g. a KeyUpdate) cannot be sent anymore.
+	 */
+	if (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX) {
+		BIO_clear_retry_flags(h);
+		return -1;
+	}
+#endif
 	tmpbuf.size = num;
 	tmpbuf.area = (void *)(uintptr_t)buf;
 	tmpbuf.data = num;
@@ -574,6 +584,12 @@ static int ssl_sock_register_msg_callbacks(void)
 			return ERR_ABORT;
 	}
 #endif
+#ifdef HAVE_SSL_KTLS
+	if (global_ssl.ktls) {
+		if (!ssl_sock_register_msg_callback(ssl_ktls_msg_cbk))
+			return ERR_ABORT;
+	}
+#endif
 
 	return 0;
 }
@@ -4179,6 +4195,11 @@ void SSL_CTX_keylog(const SSL *ssl, const char *line)
 	char *lastarg = NULL;
 	char *dst = NULL;
 
+#ifdef HAVE_SSL_KTLS
+	if (global_ssl.ktls)
+		ssl_ktls_keylog(ssl, line);
+#endif
+
 	keylog = SSL_get_ex_data(ssl, ssl_keylog_index);
 	if (!keylog)
 		return;
@@ -5286,6 +5307,14 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 
 		SSL_set_accept_state(ctx->ssl);
 
+#ifdef HAVE_SSL_KTLS
+		if (__objt_listener(conn->target)->bind_conf->ssl_options & BC_SSL_O_KTLS) {
+			ctx->xprt_st |= SSL_SOCK_ST_FL_KTLS;
+			ctx->ktls_seq = 0;
+			ctx->ktls_secret_len = 0;
+		}
+#endif
+
 		/* leave init state and start handshake */
 		conn->flags |= CO_FL_SSL_WAIT_HS | CO_FL_WAIT_L6_CONN;
 #if (HA_OPENSSL_VERSION_NUMBER >= 0x10101000L)
@@ -5592,6 +5621,12 @@ static int ssl_sock_handshake(struct connection *conn, unsigned int flag)
 		}
 	}
 
+#ifdef HAVE_SSL_KTLS
+	/* only once, after the initial handshake */
+	if (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS)
+		ssl_ktls_start(ctx);
+#endif
+
 	/* The connection is now established at both layers, it's time to leave */
 	conn->flags &= ~(flag | CO_FL_WAIT_L4_CONN | CO_FL_WAIT_L6_CONN);
 	return 1;
@@ -5737,7 +5772,7 @@ struct task *ssl_sock_io_cb(struct task *t, void *context, unsigned short state)
 	conn = ctx->conn;
 	conn_in_list = conn->flags & CO_FL_LIST_MASK;
 	if (conn_in_list)
-		MT_LIST_DEL(&conn->list);
+		conn_delete_from_tree(conn);
 	HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	/* First if we're doing an handshake, try that */
 	if (ctx->conn->flags & CO_FL_SSL_WAIT_HS)
@@ -5786,10 +5821,12 @@ struct task *ssl_sock_io_cb(struct task *t, void *context, unsigned short state)
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
 
+		HA_SPIN_LOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 		if (conn_in_list == CO_FL_SAFE_LIST)
-			MT_LIST_ADDQ(&srv->safe_conns[tid], &conn->list);
+			eb64_insert(&srv->safe_conns_tree[tid], &conn->hash_node);
 		else
-			MT_LIST_ADDQ(&srv->idle_conns[tid], &conn->list);
+			eb64_insert(&srv->idle_conns_tree[tid], &conn->hash_node);
+		HA_SPIN_UNLOCK(OTHER_LOCK, &idle_conns[tid].takeover_lock);
 	}
 	return NULL;
 }
@@ -5940,6 +5977,16 @@ static size_t ssl_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		/* a handshake was requested */
 		return 0;
 
+#ifdef HAVE_SSL_KTLS
+	if (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX) {
+		/* the kernel encrypts what we send */
+		done = ctx->xprt->snd_buf(conn, ctx->xprt_ctx, buf, count, flags);
+		if (done)
+			conn->flags &= ~CO_FL_WAIT_L4L6;
+		goto leave;
+	}
+#endif
+
 	/* send the largest possible block. For this we perform only one call
 	 * to send() unless the buffer wraps and we exactly fill the first hunk,
 	 * in which case we accept to do it once again.
@@ -6060,6 +6107,32 @@ static size_t ssl_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 	goto leave;
 }
 
+#ifdef HAVE_SSL_KTLS
+/* Send data from a pipe to a connection whose records are built by the kernel,
+ * see ssl_sock_can_snd_pipe(). Returns the number of bytes sent.
+ */
+static int ssl_sock_from_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe)
+{
+	struct ssl_sock_ctx *ctx = xprt_ctx;
+
+	if (!ctx || !(ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX) || !ctx->xprt->snd_pipe) {
+		conn->flags |= CO_FL_ERROR;
+		return 0;
+	}
+	return ctx->xprt->snd_pipe(conn, ctx->xprt_ctx, pipe);
+}
+
+/* Returns non-zero if data may be spliced to the connection, that is, once
+ * the kernel builds its records.
+ */
+static int ssl_sock_can_snd_pipe(const struct connection *conn, void *xprt_ctx)
+{
+	struct ssl_sock_ctx *ctx = xprt_ctx;
+
+	return ctx && (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX) && ctx->xprt->snd_pipe;
+}
+#endif
+
 static void ssl_sock_close(struct connection *conn, void *xprt_ctx) {
 
 	struct ssl_sock_ctx *ctx = xprt_ctx;
@@ -6140,6 +6213,15 @@ static void ssl_sock_shutw(struct connection *conn, void *xprt_ctx, int clean)
 
 	if (conn->flags & (CO_FL_WAIT_XPRT | CO_FL_SSL_WAIT_HS))
 		return;
+#ifdef HAVE_SSL_KTLS
+	if (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX) {
+		/* OpenSSL cannot write anymore, the alert is sent by the kernel */
+		if (clean && !(SSL_get_shutdown(ctx->ssl) & SSL_SENT_SHUTDOWN))
+			ssl_ktls_close_notify(ctx);
+		SSL_set_shutdown(ctx->ssl, SSL_get_shutdown(ctx->ssl) | SSL_SENT_SHUTDOWN);
+		return;
+	}
+#endif
 	if (!clean)
 		/* don't sent notify on SSL_shutdown */
 		SSL_set_quiet_shutdown(ctx->ssl, 1);
@@ -6508,6 +6590,8 @@ static int ssl_sock_show_fd(struct buffer *buf, const struct connection *conn, c
 		ret = 1;
 	}
 	chunk_appendf(&trash, " xctx.st=%d", sctx->xprt_st);
+	if (sctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX)
+		chunk_appendf(&trash, " .ktls=tx");
 
 	if (sctx->xprt) {
 		chunk_appendf(&trash, " .xprt=%s", sctx->xprt->name);
@@ -6820,7 +6904,12 @@ struct xprt_ops ssl_sock = {
 	.remove_xprt = ssl_remove_xprt,
 	.add_xprt = ssl_add_xprt,
 	.rcv_pipe = NULL,
+#ifdef HAVE_SSL_KTLS
+	.snd_pipe = ssl_sock_from_pipe,
+	.can_snd_pipe = ssl_sock_can_snd_pipe,
+#else
 	.snd_pipe = NULL,
+#endif
 	.shutr    = NULL,
 	.shutw    = ssl_sock_shutw,
 	.close    = ssl_sock_close,
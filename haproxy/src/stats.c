@@ -249,6 +249,10 @@ const struct name_desc stat_fields[ST_F_TOTAL_FIELDS] = {
 	[ST_F_SAFE_CONN_CUR]                 = { .name = "safe_conn_cur",               .desc = "Current number of safe idle connections"},
 	[ST_F_USED_CONN_CUR]                 = { .name = "used_conn_cur",               .desc = "Current number of connections in use"},
 	[ST_F_NEED_CONN_EST]                 = { .name = "need_conn_est",               .desc = "Estimated needed number of connections"},
+	[ST_F_WARM_HIT]                      = { .name = "warm_hit",                    .desc = "Total number of requests which found a connection from the warm pool"},
+	[ST_F_WARM_MISS]                     = { .name = "warm_miss",                   .desc = "Total number of connections established for requests while a warm pool is set"},
+	[ST_F_HEDGE_SENT]                    = { .name = "hedge_sent",                  .desc = "Total number of requests sent again to another server after a slow response (see hedge-delay)"},
+	[ST_F_HEDGE_RESP]                    = { .name = "hedge_resp",                  .desc = "Total number of responses received after a hedge, from the server the request was sent again to"},
 };
 
 /* one line of info */
@@ -1708,6 +1712,10 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 	stats[ST_F_SAFE_CONN_CUR] = mkf_u32(0, sv->curr_safe_nb);
 	stats[ST_F_USED_CONN_CUR] = mkf_u32(0, sv->curr_used_conns);
 	stats[ST_F_NEED_CONN_EST] = mkf_u32(0, sv->est_need_conns);
+	stats[ST_F_WARM_HIT]  = mkf_u64(FN_COUNTER, sv->counters.warm_hit);
+	stats[ST_F_WARM_MISS] = mkf_u64(FN_COUNTER, sv->counters.warm_miss);
+	stats[ST_F_HEDGE_SENT] = mkf_u64(FN_COUNTER, sv->counters.hedge_sent);
+	stats[ST_F_HEDGE_RESP] = mkf_u64(FN_COUNTER, sv->counters.hedge_resp);
 
 	/* status */
 	fld_status = chunk_newstr(out);
@@ -1917,6 +1925,8 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 	stats[ST_F_EINT]     = mkf_u64(FN_COUNTER, px->be_counters.internal_errors);
 	stats[ST_F_CONNECT]  = mkf_u64(FN_COUNTER, px->be_counters.connect);
 	stats[ST_F_REUSE]    = mkf_u64(FN_COUNTER, px->be_counters.reuse);
+	stats[ST_F_HEDGE_SENT] = mkf_u64(FN_COUNTER, px->be_counters.hedge_sent);
+	stats[ST_F_HEDGE_RESP] = mkf_u64(FN_COUNTER, px->be_counters.hedge_resp);
 	stats[ST_F_STATUS]   = mkf_str(FO_STATUS, (px->lbprm.tot_weight > 0 || !px->srv) ? "UP" : "DOWN");
 	stats[ST_F_WEIGHT]   = mkf_u32(FN_AVG, (px->lbprm.tot_weight * px->lbprm.wmult + px->lbprm.wdiv - 1) / px->lbprm.wdiv);
 	stats[ST_F_ACT]      = mkf_u32(0, px->srv_act);
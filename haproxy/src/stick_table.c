@@ -17,6 +17,7 @@
 #include <import/ebmbtree.h>
 #include <import/ebsttree.h>
 #include <import/ebistree.h>
+#include <import/xxhash.h>
 
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
@@ -32,6 +33,7 @@
 #include <haproxy/pool.h>
 #include <haproxy/proto_tcp.h>
 #include <haproxy/proxy.h>
+#include <haproxy/qsbr.h>
 #include <haproxy/sample.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/stick_table.h>
@@ -76,64 +78,142 @@ struct stktable *stktable_find_by_name(const char *name)
 	return NULL;
 }
 
+/* Returns the hash of lookup key <key> in table <t> */
+static inline unsigned int stktable_key_hash(const struct stktable *t, const struct stktable_key *key)
+{
+	if (t->type == SMP_T_STR)
+		return XXH32(key->key, MIN(key->key_len, t->key_size - 1), 0);
+	return XXH32(key->key, t->key_size, 0);
+}
+
+/* Returns the index of the shard of table <t> which holds the entries whose
+ * key hash is <hash>.
+ */
+static inline unsigned int stktable_hash_shard(const struct stktable *t, unsigned int hash)
+{
+	if (t->nb_shards == 1)
+		return 0;
+	return hash % t->nb_shards;
+}
+
+/* Returns the index of the shard of table <t> which holds the entries matching
+ * lookup key <key>.
+ */
+static inline unsigned int stktable_key_shard(const struct stktable *t, const struct stktable_key *key)
+{
+	return stktable_hash_shard(t, stktable_key_hash(t, key));
+}
+
+/* Publishes sticky session <ts> into the lock-free lookup index of its shard,
+ * which must be locked. The session must be fully initialized.
+ */
+static inline void stksess_link_bucket(struct stktable *t, struct stksess *ts)
+{
+	struct stktable_shard *shard = &t->shards[ts->shard];
+	struct stksess **head = &shard->buckets[ts->hash >> shard->bucket_shift];
+
+	ts->hnext = *head;
+	__ha_barrier_store();
+	HA_ATOMIC_STORE(head, ts);
+}
+
+/* Removes sticky session <ts> from the lock-free lookup index of its shard,
+ * which must be locked. Its own link is left intact for readers which might
+ * still be walking past it.
+ */
+static inline void stksess_unlink_bucket(struct stktable *t, struct stksess *ts)
+{
+	struct stktable_shard *shard = &t->shards[ts->shard];
+	struct stksess **prev = &shard->buckets[ts->hash >> shard->bucket_shift];
+
+	while (*prev && *prev != ts)
+		prev = &(*prev)->hnext;
+	if (*prev)
+		HA_ATOMIC_STORE(prev, ts->hnext);
+}
+
 /*
  * Free an allocated sticky session <ts>, and decrease sticky sessions counter
  * in table <t>.
  */
 void __stksess_free(struct stktable *t, struct stksess *ts)
 {
-	t->current--;
+	HA_ATOMIC_SUB(&t->current, 1);
 	pool_free(t->pool, (void *)ts - round_ptr_size(t->data_size));
 }
 
 /*
  * Free an allocated sticky session <ts>, and decrease sticky sessions counter
- * in table <t>.
- * This function locks the table
+ * in table <t>. The session must not be stored in the table, so that no lock
+ * is needed.
  */
 void stksess_free(struct stktable *t, struct stksess *ts)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 	__stksess_free(t, ts);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+}
+
+/* Releases the memory of a sticky session retired by __stksess_kill() */
+static void stksess_release_retired(struct qsbr_node *node)
+{
+	struct stksess *ts = container_of(node, struct stksess, retired.node);
+
+	pool_free(ts->retired.table->pool, (void *)ts - round_ptr_size(ts->retired.table->data_size));
 }
 
 /*
- * Kill an stksess (only if its ref_cnt is zero).
+ * Kill an stksess (only if its ref_cnt is zero). The entry's shard must be
+ * locked. The table's lock is also taken if the entry is in the updates tree
+ * since peers may take references on it from there. The entry's memory is
+ * only released once threads which might have found it using a lock-free
+ * lookup are done with it.
  */
 int __stksess_kill(struct stktable *t, struct stksess *ts)
 {
 	if (ts->ref_cnt)
 		return 0;
 
+	if (ts->upd.node.leaf_p) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+		if (ts->ref_cnt) {
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+			return 0;
+		}
+		eb32_delete(&ts->upd);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	}
+
 	eb32_delete(&ts->exp);
-	eb32_delete(&ts->upd);
 	ebmb_delete(&ts->key);
-	__stksess_free(t, ts);
+	stksess_unlink_bucket(t, ts);
+	HA_ATOMIC_SUB(&t->current, 1);
+	ts->retired.table = t;
+	qsbr_retire(&ts->retired.node, stksess_release_retired);
 	return 1;
 }
 
 /*
  * Decrease the refcount if decrefcnt is not 0.
  * and try to kill the stksess
- * This function locks the table
+ * This function locks the entry's shard
  */
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
+	struct stktable_shard *shard = &t->shards[ts->shard];
 	int ret;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 	ret = __stksess_kill(t, ts);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return ret;
 }
 
 /*
  * Initialize or update the key in the sticky session <ts> present in table <t>
- * from the value present in <key>.
+ * from the value present in <key>. The shard the session belongs to is updated
+ * accordingly, so the session must not be stored in the table.
  */
 void stksess_setkey(struct stktable *t, struct stksess *ts, struct stktable_key *key)
 {
@@ -143,6 +223,8 @@ void stksess_setkey(struct stktable *t, struct stksess *ts, struct stktable_key
 		memcpy(ts->key.key, key->key, MIN(t->key_size - 1, key->key_len));
 		ts->key.key[MIN(t->key_size - 1, key->key_len)] = 0;
 	}
+	ts->hash = stktable_key_hash(t, key);
+	ts->shard = stktable_hash_shard(t, ts->hash);
 }
 
 
@@ -154,6 +236,9 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 {
 	memset((void *)ts - t->data_size, 0, t->data_size);
 	ts->ref_cnt = 0;
+	ts->shard = 0;
+	ts->hash = 0;
+	ts->hnext = NULL;
 	ts->key.node.leaf_p = NULL;
 	ts->exp.node.leaf_p = NULL;
 	ts->upd.node.leaf_p = NULL;
@@ -163,20 +248,22 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 }
 
 /*
- * Trash oldest <to_batch> sticky sessions from table <t>
+ * Trash oldest <to_batch> sticky sessions from shard <shard> of table <t>,
+ * which must be locked.
  * Returns number of trashed sticky sessions. It may actually trash less
  * than expected if finding these requires too long a search time (e.g.
  * most of them have ts->ref_cnt>0).
  */
-int __stktable_trash_oldest(struct stktable *t, int to_batch)
+int __stktable_trash_oldest(struct stktable *t, unsigned int shard, int to_batch)
 {
+	struct eb_root *exps = &t->shards[shard].exps;
 	struct stksess *ts;
 	struct eb32_node *eb;
 	int max_search = to_batch * 2; // no more than 50% misses
 	int batched = 0;
 	int looped = 0;
 
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	eb = eb32_lookup_ge(exps, now_ms - TIMER_LOOK_BACK);
 
 	while (batched < to_batch) {
 
@@ -189,7 +276,7 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 			if (looped)
 				break;
 			looped = 1;
-			eb = eb32_first(&t->exps);
+			eb = eb32_first(exps);
 			if (likely(!eb))
 				break;
 		}
@@ -205,14 +292,13 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 		if (ts->ref_cnt)
 			continue;
 
-		eb32_delete(&ts->exp);
-
 		if (ts->expire != ts->exp.key) {
+			eb32_delete(&ts->exp);
 			if (!tick_isset(ts->expire))
 				continue;
 
 			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+			eb32_insert(exps, &ts->exp);
 
 			if (!eb || eb->key > ts->exp.key)
 				eb = &ts->exp;
@@ -220,11 +306,9 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 			continue;
 		}
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
-		batched++;
+		/* session expired, trash it unless a peer just grabbed it */
+		if (__stksess_kill(t, ts))
+			batched++;
 	}
 
 	return batched;
@@ -233,47 +317,79 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 /*
  * Trash oldest <to_batch> sticky sessions from table <t>
  * Returns number of trashed sticky sessions.
- * This function locks the table
+ * This function locks the table's shards one at a time
  */
 int stktable_trash_oldest(struct stktable *t, int to_batch)
 {
-	int ret;
+	unsigned int shard;
+	int ret = 0;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ret = __stktable_trash_oldest(t, to_batch);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	for (shard = 0; shard < t->nb_shards && ret < to_batch; shard++) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->shards[shard].lock);
+		ret += __stktable_trash_oldest(t, shard, to_batch - ret);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[shard].lock);
+	}
 
 	return ret;
 }
+
 /*
- * Allocate and initialise a new sticky session.
+ * Makes room for a new sticky session in table <t> by trashing up to <to_batch>
+ * of the oldest sessions of shard <shard>, which must be locked. If none may
+ * be trashed there, the other shards are tried, but only if they are not
+ * locked, so that concurrent allocations never wait for each other. Returns
+ * the number of trashed sticky sessions.
+ */
+static int stktable_make_room(struct stktable *t, unsigned int shard, int to_batch)
+{
+	unsigned int i, other;
+	int ret;
+
+	ret = __stktable_trash_oldest(t, shard, to_batch);
+	for (i = 1; !ret && i < t->nb_shards; i++) {
+		other = (shard + i) % t->nb_shards;
+		if (HA_SPIN_TRYLOCK(STK_TABLE_LOCK, &t->shards[other].lock) != 0)
+			continue;
+		ret = __stktable_trash_oldest(t, other, to_batch);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[other].lock);
+	}
+	return ret;
+}
+
+/*
+ * Allocate and initialise a new sticky session. Shard <shard> of table <t>
+ * must be locked, older sessions may be trashed from it if the table is full.
  * The new sticky session is returned or NULL in case of lack of memory.
  * Sticky sessions should only be allocated this way, and must be freed using
  * stksess_free(). Table <t>'s sticky session counter is increased. If <key>
  * is not NULL, it is assigned to the new session.
  */
-struct stksess *__stksess_new(struct stktable *t, struct stktable_key *key)
+struct stksess *__stksess_new(struct stktable *t, unsigned int shard, struct stktable_key *key)
 {
 	struct stksess *ts;
 
-	if (unlikely(t->current == t->size)) {
-		if ( t->nopurge )
-			return NULL;
-
-		if (!__stktable_trash_oldest(t, (t->size >> 8) + 1))
-			return NULL;
+	/* the slot is reserved first so that concurrent allocations from
+	 * other shards cannot overflow the table.
+	 */
+	if (unlikely(HA_ATOMIC_ADD(&t->current, 1) > t->size)) {
+		if (t->nopurge || !stktable_make_room(t, shard, (t->size >> 8) + 1))
+			goto fail;
 	}
 
 	ts = pool_alloc(t->pool);
-	if (ts) {
-		t->current++;
-		ts = (void *)ts + round_ptr_size(t->data_size);
-		__stksess_init(t, ts);
-		if (key)
-			stksess_setkey(t, ts, key);
-	}
+	if (!ts)
+		goto fail;
 
+	ts = (void *)ts + round_ptr_size(t->data_size);
+	__stksess_init(t, ts);
+	ts->shard = shard;
+	if (key)
+		stksess_setkey(t, ts, key);
 	return ts;
+
+ fail:
+	HA_ATOMIC_SUB(&t->current, 1);
+	return NULL;
 }
 /*
  * Allocate and initialise a new sticky session.
@@ -281,31 +397,35 @@ struct stksess *__stksess_new(struct stktable *t, struct stktable_key *key)
  * Sticky sessions should only be allocated this way, and must be freed using
  * stksess_free(). Table <t>'s sticky session counter is increased. If <key>
  * is not NULL, it is assigned to the new session.
- * This function locks the table
+ * This function locks the shard the session belongs to, or the current
+ * thread's one if there is no key yet.
  */
 struct stksess *stksess_new(struct stktable *t, struct stktable_key *key)
 {
 	struct stksess *ts;
+	unsigned int shard;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts = __stksess_new(t, key);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	shard = key ? stktable_key_shard(t, key) : tid % t->nb_shards;
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->shards[shard].lock);
+	ts = __stksess_new(t, shard, key);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[shard].lock);
 
 	return ts;
 }
 
 /*
- * Looks in table <t> for a sticky session matching key <key>.
+ * Looks in shard <shard> of table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  */
-struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *key)
+struct stksess *__stktable_lookup_key(struct stktable *t, unsigned int shard, struct stktable_key *key)
 {
+	struct eb_root *keys = &t->shards[shard].keys;
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup_len(&t->keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
+		eb = ebst_lookup_len(keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
 	else
-		eb = ebmb_lookup(&t->keys, key->key, t->key_size);
+		eb = ebmb_lookup(keys, key->key, t->key_size);
 
 	if (unlikely(!eb)) {
 		/* no session found */
@@ -319,33 +439,36 @@ struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *k
  * Looks in table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the shard's lock
  */
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key)
 {
+	unsigned int shard = stktable_key_shard(t, key);
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts = __stktable_lookup_key(t, key);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->shards[shard].lock);
+	ts = __stktable_lookup_key(t, shard, key);
 	if (ts)
-		ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[shard].lock);
 
 	return ts;
 }
 
 /*
- * Looks in table <t> for a sticky session with same key as <ts>.
+ * Looks in table <t> for a sticky session with same key as <ts>, in the shard
+ * designated by <ts>.
  * Returns pointer on requested sticky session or NULL if none was found.
  */
 struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
 {
+	struct eb_root *keys = &t->shards[ts->shard].keys;
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup(&(t->keys), (char *)ts->key.key);
+		eb = ebst_lookup(keys, (char *)ts->key.key);
 	else
-		eb = ebmb_lookup(&(t->keys), ts->key.key, t->key_size);
+		eb = ebmb_lookup(keys, ts->key.key, t->key_size);
 
 	if (unlikely(!eb))
 		return NULL;
@@ -357,37 +480,95 @@ struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
  * Looks in table <t> for a sticky session with same key as <ts>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the shard's lock
  */
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts)
 {
 	struct stksess *lts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->shards[ts->shard].lock);
 	lts = __stktable_lookup(t, ts);
 	if (lts)
-		lts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_ADD(&lts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[ts->shard].lock);
 
 	return lts;
 }
 
+/*
+ * Looks in table <t> for a sticky session matching key <key> without taking
+ * any lock nor reference, for callers which only need to read the entry's
+ * data. The returned entry may be removed from the table at any time, but
+ * remains valid until the current thread goes back to the polling loop, so it
+ * must neither be modified, nor kept past the current processing. Returns NULL
+ * if none was found.
+ */
+struct stksess *stktable_peek_key(struct stktable *t, struct stktable_key *key)
+{
+	struct stktable_shard *shard;
+	struct stksess *ts;
+	unsigned int hash, len;
+
+	len = t->type == SMP_T_STR ? MIN(key->key_len, t->key_size - 1) : t->key_size;
+	hash = stktable_key_hash(t, key);
+	shard = &t->shards[stktable_hash_shard(t, hash)];
+
+	ts = HA_ATOMIC_LOAD(&shard->buckets[hash >> shard->bucket_shift]);
+	for (; ts; ts = HA_ATOMIC_LOAD(&ts->hnext)) {
+		if (ts->hash != hash || memcmp(ts->key.key, key->key, len) != 0)
+			continue;
+		if (t->type == SMP_T_STR && ts->key.key[len])
+			continue;
+		return ts;
+	}
+	return NULL;
+}
+
+/* Same as stktable_peek_key() but looks up the key of entry <ts>, which may
+ * belong to another table of the same type.
+ */
+struct stksess *stktable_peek(struct stktable *t, struct stksess *ts)
+{
+	struct stktable_key key;
+
+	key.key = ts->key.key;
+	key.key_len = t->type == SMP_T_STR ? strlen((char *)ts->key.key) : t->key_size;
+	return stktable_peek_key(t, &key);
+}
+
+/* Makes sure the expiration task of table <t> will run no later than <expire>.
+ * The task's date is only ever advanced, using a CAS so that no lock is needed.
+ */
+static void stktable_requeue_exp(struct stktable *t, int expire)
+{
+	int old_exp, new_exp;
+
+	old_exp = t->exp_task->expire;
+	do {
+		new_exp = tick_first(expire, old_exp);
+		if (new_exp == old_exp)
+			return;
+	} while (!HA_ATOMIC_CAS(&t->exp_task->expire, &old_exp, new_exp));
+
+	task_queue(t->exp_task);
+}
+
 /* Update the expiration timer for <ts> but do not touch its expiration node.
  * The table's expiration timer is updated if set.
  * The node will be also inserted into the update tree if needed, at a position
- * depending if the update is a local or coming from a remote node
+ * depending if the update is a local or coming from a remote node. The caller
+ * must hold a reference on <ts>. The table's lock is taken to update the tree.
  */
 void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local, int expire)
 {
 	struct eb32_node * eb;
 	ts->expire = expire;
-	if (t->expire) {
-		t->exp_task->expire = t->exp_next = tick_first(ts->expire, t->exp_next);
-		task_queue(t->exp_task);
-	}
+	if (t->expire)
+		stktable_requeue_exp(t, expire);
 
 	/* If sync is enabled */
 	if (t->sync_task) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 		if (local) {
 			/* If this entry is not in the tree
 			   or not scheduled for at least one peer */
@@ -403,6 +584,7 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
 					eb32_insert(&t->updates, &ts->upd);
 				}
 			}
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
 			task_wakeup(t->sync_task, TASK_WOKEN_MSG);
 		}
 		else {
@@ -415,6 +597,7 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
 					eb32_insert(&t->updates, &ts->upd);
 				}
 			}
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
 		}
 	}
 }
@@ -427,11 +610,9 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
  */
 void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 	__stktable_touch_with_exp(t, ts, 0, ts->expire);
 	if (decrefcnt)
-		ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 }
 
 /* Update the expiration timer for <ts> but do not touch its expiration node.
@@ -444,53 +625,50 @@ void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
 	int expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 	__stktable_touch_with_exp(t, ts, 1, expire);
 	if (decrefcnt)
-		ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 }
 /* Just decrease the ref_cnt of the current session. Does nothing if <ts> is NULL */
 static void stktable_release(struct stktable *t, struct stksess *ts)
 {
 	if (!ts)
 		return;
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 }
 
 /* Insert new sticky session <ts> in the table. It is assumed that it does not
- * yet exist (the caller must check this). The table's timeout is updated if it
- * is set. <ts> is returned.
+ * yet exist (the caller must check this), and the session's shard must be
+ * locked. The table's timeout is updated if it is set. <ts> is returned.
  */
 void __stktable_store(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_shard *shard = &t->shards[ts->shard];
 
-	ebmb_insert(&t->keys, &ts->key, t->key_size);
+	ebmb_insert(&shard->keys, &ts->key, t->key_size);
 	ts->exp.key = ts->expire;
-	eb32_insert(&t->exps, &ts->exp);
-	if (t->expire) {
-		t->exp_task->expire = t->exp_next = tick_first(ts->expire, t->exp_next);
-		task_queue(t->exp_task);
-	}
+	eb32_insert(&shard->exps, &ts->exp);
+	stksess_link_bucket(t, ts);
+	if (t->expire)
+		stktable_requeue_exp(t, ts->expire);
 }
 
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
- * could be created. The entry's expiration is updated.
+ * could be created. The entry's expiration is updated. <shard> must be the
+ * key's shard, and must be locked.
  */
-struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_key *key)
+struct stksess *__stktable_get_entry(struct stktable *table, unsigned int shard, struct stktable_key *key)
 {
 	struct stksess *ts;
 
 	if (!key)
 		return NULL;
 
-	ts = __stktable_lookup_key(table, key);
+	ts = __stktable_lookup_key(table, shard, key);
 	if (ts == NULL) {
 		/* entry does not exist, initialize a new one */
-		ts = __stksess_new(table, key);
+		ts = __stksess_new(table, shard, key);
 		if (!ts)
 			return NULL;
 		__stktable_store(table, ts);
@@ -500,23 +678,29 @@ struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_key
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
  * could be created. The entry's expiration is updated.
- * This function locks the table, and the refcount of the entry is increased.
+ * This function locks the key's shard, and the refcount of the entry is
+ * increased.
  */
 struct stksess *stktable_get_entry(struct stktable *table, struct stktable_key *key)
 {
 	struct stksess *ts;
+	unsigned int shard;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->lock);
-	ts = __stktable_get_entry(table, key);
+	if (!key)
+		return NULL;
+
+	shard = stktable_key_shard(table, key);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->shards[shard].lock);
+	ts = __stktable_get_entry(table, shard, key);
 	if (ts)
-		ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->lock);
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->shards[shard].lock);
 
 	return ts;
 }
 
 /* Lookup for an entry with the same key and store the submitted
- * stksess if not found.
+ * stksess if not found. The submitted session's shard must be locked.
  */
 struct stksess *__stktable_set_entry(struct stktable *table, struct stksess *nts)
 {
@@ -532,31 +716,35 @@ struct stksess *__stktable_set_entry(struct stktable *table, struct stksess *nts
 
 /* Lookup for an entry with the same key and store the submitted
  * stksess if not found.
- * This function locks the table, and the refcount of the entry is increased.
+ * This function locks the submitted session's shard, and the refcount of the
+ * entry is increased.
  */
 struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
 {
 	struct stksess *ts;
+	unsigned int shard = nts->shard;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->lock);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->shards[shard].lock);
 	ts = __stktable_set_entry(table, nts);
-	ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->lock);
+	HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->shards[shard].lock);
 
 	return ts;
 }
 /*
- * Trash expired sticky sessions from table <t>. The next expiration date is
- * returned.
+ * Trash expired sticky sessions from shard <shard> of table <t>. The next
+ * expiration date for this shard is returned.
  */
-static int stktable_trash_expired(struct stktable *t)
+static int stktable_trash_expired(struct stktable *t, unsigned int shard)
 {
+	struct stktable_shard *sh = &t->shards[shard];
 	struct stksess *ts;
 	struct eb32_node *eb;
+	int exp_next = TICK_ETERNITY;
 	int looped = 0;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+	eb = eb32_lookup_ge(&sh->exps, now_ms - TIMER_LOOK_BACK);
 
 	while (1) {
 		if (unlikely(!eb)) {
@@ -568,15 +756,15 @@ static int stktable_trash_expired(struct stktable *t)
 			if (looped)
 				break;
 			looped = 1;
-			eb = eb32_first(&t->exps);
+			eb = eb32_first(&sh->exps);
 			if (likely(!eb))
 				break;
 		}
 
 		if (likely(tick_is_lt(now_ms, eb->key))) {
 			/* timer not expired yet, revisit it later */
-			t->exp_next = eb->key;
-			goto out_unlock;
+			exp_next = eb->key;
+			break;
 		}
 
 		/* timer looks expired, detach it from the queue */
@@ -587,58 +775,78 @@ static int stktable_trash_expired(struct stktable *t)
 		if (ts->ref_cnt)
 			continue;
 
-		eb32_delete(&ts->exp);
-
 		if (!tick_is_expired(ts->expire, now_ms)) {
+			eb32_delete(&ts->exp);
 			if (!tick_isset(ts->expire))
 				continue;
 
 			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+			eb32_insert(&sh->exps, &ts->exp);
 
 			if (!eb || eb->key > ts->exp.key)
 				eb = &ts->exp;
 			continue;
 		}
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
+		/* session expired, trash it unless a peer just grabbed it */
+		__stksess_kill(t, ts);
 	}
 
-	/* We have found no task to expire in any tree */
-	t->exp_next = TICK_ETERNITY;
-out_unlock:
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
-	return t->exp_next;
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+	return exp_next;
 }
 
 /*
  * Task processing function to trash expired sticky sessions. A pointer to the
- * task itself is returned since it never dies.
+ * task itself is returned since it never dies. The task's date is reset before
+ * visiting the shards, so that entries touched meanwhile can requeue it, and
+ * the earliest of both dates is kept.
  */
 static struct task *process_table_expire(struct task *task, void *context, unsigned short state)
 {
 	struct stktable *t = context;
+	unsigned int shard;
+	int exp_next = TICK_ETERNITY;
+	int old_exp;
 
-	task->expire = stktable_trash_expired(t);
+	HA_ATOMIC_STORE(&task->expire, TICK_ETERNITY);
+	for (shard = 0; shard < t->nb_shards; shard++)
+		exp_next = tick_first(exp_next, stktable_trash_expired(t, shard));
+
+	old_exp = task->expire;
+	while (!HA_ATOMIC_CAS(&task->expire, &old_exp, tick_first(exp_next, old_exp)))
+		;
 	return task;
 }
 
 /* Perform minimal stick table intializations, report 0 in case of error, 1 if OK. */
 int stktable_init(struct stktable *t)
 {
+	unsigned int shard, bits;
 	int peers_retval = 0;
 	if (t->size) {
-		t->keys = EB_ROOT_UNIQUE;
-		memset(&t->exps, 0, sizeof(t->exps));
+		if (!t->nb_shards)
+			t->nb_shards = 1;
+		t->shards = calloc(t->nb_shards, sizeof(*t->shards));
+		if (!t->shards)
+			return 0;
+		/* about one lookup bucket per entry */
+		bits = (t->size + t->nb_shards - 1) / t->nb_shards;
+		bits = bits > 16 ? my_flsl(bits - 1) : 4;
+		for (shard = 0; shard < t->nb_shards; shard++) {
+			t->shards[shard].keys = EB_ROOT_UNIQUE;
+			memset(&t->shards[shard].exps, 0, sizeof(t->shards[shard].exps));
+			t->shards[shard].buckets = calloc(1UL << bits, sizeof(*t->shards[shard].buckets));
+			if (!t->shards[shard].buckets)
+				return 0;
+			t->shards[shard].bucket_shift = 32 - bits;
+			HA_SPIN_INIT(&t->shards[shard].lock);
+		}
 		t->updates = EB_ROOT_UNIQUE;
 		HA_SPIN_INIT(&t->lock);
 
 		t->pool = create_pool("sticktables", sizeof(struct stksess) + round_ptr_size(t->data_size) + t->key_size, MEM_F_SHARED);
 
-		t->exp_next = TICK_ETERNITY;
 		if ( t->expire ) {
 			t->exp_task = task_new(MAX_THREADS_MASK);
 			if (!t->exp_task)
@@ -655,6 +863,23 @@ int stktable_init(struct stktable *t)
 	return 1;
 }
 
+/* Releases the resources allocated by stktable_init() for table <t>. No other
+ * thread may be running. The entries still waiting for their grace period are
+ * released first since they belong to the table's pool.
+ */
+void stktable_deinit(struct stktable *t)
+{
+	unsigned int shard;
+
+	qsbr_release_all();
+	pool_destroy(t->pool);
+	t->pool = NULL;
+	for (shard = 0; t->shards && shard < t->nb_shards; shard++)
+		free(t->shards[shard].buckets);
+	free(t->shards);
+	t->shards = NULL;
+}
+
 /*
  * Configuration keywords of known table types
  */
@@ -800,6 +1025,24 @@ int parse_stick_table(const char *file, int linenum, char **args,
 			t->nopurge = 1;
 			idx++;
 		}
+		else if (strcmp(args[idx], "shards") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			val = atoi(args[idx]);
+			if (val < 1 || val > STKTABLE_MAX_SHARDS) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects a number of shards between 1 and %d, got '%s'.\n",
+					 file, linenum, args[0], args[idx-1], STKTABLE_MAX_SHARDS, args[idx]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->nb_shards = val;
+			idx++;
+		}
 		else if (strcmp(args[idx], "type") == 0) {
 			idx++;
 			if (stktable_parse_type(args, &idx, &t->type, &t->key_size) != 0) {
@@ -1117,12 +1360,11 @@ static int sample_conv_in_table(const struct arg *arg_p, struct sample *smp, voi
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->data.type = SMP_T_BOOL;
 	smp->data.u.sint = !!ts;
 	smp->flags = SMP_F_VOL_TEST;
-	stktable_release(t, ts);
 	return 1;
 }
 
@@ -1145,7 +1387,7 @@ static int sample_conv_table_bytes_in_rate(const struct arg *arg_p, struct sampl
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1159,7 +1401,6 @@ static int sample_conv_table_bytes_in_rate(const struct arg *arg_p, struct sampl
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_in_rate),
                                                        t->data_arg[STKTABLE_DT_BYTES_IN_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1182,7 +1423,7 @@ static int sample_conv_table_conn_cnt(const struct arg *arg_p, struct sample *sm
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1195,7 +1436,6 @@ static int sample_conv_table_conn_cnt(const struct arg *arg_p, struct sample *sm
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, conn_cnt);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1218,7 +1458,7 @@ static int sample_conv_table_conn_cur(const struct arg *arg_p, struct sample *sm
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1231,7 +1471,6 @@ static int sample_conv_table_conn_cur(const struct arg *arg_p, struct sample *sm
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, conn_cur);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1254,7 +1493,7 @@ static int sample_conv_table_conn_rate(const struct arg *arg_p, struct sample *s
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1268,7 +1507,6 @@ static int sample_conv_table_conn_rate(const struct arg *arg_p, struct sample *s
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, conn_rate),
                                                        t->data_arg[STKTABLE_DT_CONN_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1291,7 +1529,7 @@ static int sample_conv_table_bytes_out_rate(const struct arg *arg_p, struct samp
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1305,7 +1543,6 @@ static int sample_conv_table_bytes_out_rate(const struct arg *arg_p, struct samp
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_out_rate),
                                                        t->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1328,7 +1565,7 @@ static int sample_conv_table_gpt0(const struct arg *arg_p, struct sample *smp, v
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1341,7 +1578,6 @@ static int sample_conv_table_gpt0(const struct arg *arg_p, struct sample *smp, v
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, gpt0);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1364,7 +1600,7 @@ static int sample_conv_table_gpc0(const struct arg *arg_p, struct sample *smp, v
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1377,7 +1613,6 @@ static int sample_conv_table_gpc0(const struct arg *arg_p, struct sample *smp, v
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, gpc0);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1400,7 +1635,7 @@ static int sample_conv_table_gpc0_rate(const struct arg *arg_p, struct sample *s
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1414,7 +1649,6 @@ static int sample_conv_table_gpc0_rate(const struct arg *arg_p, struct sample *s
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, gpc0_rate),
                                                        t->data_arg[STKTABLE_DT_GPC0_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1437,7 +1671,7 @@ static int sample_conv_table_gpc1(const struct arg *arg_p, struct sample *smp, v
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1450,7 +1684,6 @@ static int sample_conv_table_gpc1(const struct arg *arg_p, struct sample *smp, v
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, gpc1);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1473,7 +1706,7 @@ static int sample_conv_table_gpc1_rate(const struct arg *arg_p, struct sample *s
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1487,7 +1720,6 @@ static int sample_conv_table_gpc1_rate(const struct arg *arg_p, struct sample *s
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, gpc1_rate),
                                                        t->data_arg[STKTABLE_DT_GPC1_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1510,7 +1742,7 @@ static int sample_conv_table_http_err_cnt(const struct arg *arg_p, struct sample
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1523,7 +1755,6 @@ static int sample_conv_table_http_err_cnt(const struct arg *arg_p, struct sample
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, http_err_cnt);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1546,7 +1777,7 @@ static int sample_conv_table_http_err_rate(const struct arg *arg_p, struct sampl
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1560,7 +1791,6 @@ static int sample_conv_table_http_err_rate(const struct arg *arg_p, struct sampl
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_err_rate),
                                                        t->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1583,7 +1813,7 @@ static int sample_conv_table_http_req_cnt(const struct arg *arg_p, struct sample
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1596,7 +1826,6 @@ static int sample_conv_table_http_req_cnt(const struct arg *arg_p, struct sample
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, http_req_cnt);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1619,7 +1848,7 @@ static int sample_conv_table_http_req_rate(const struct arg *arg_p, struct sampl
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1633,7 +1862,6 @@ static int sample_conv_table_http_req_rate(const struct arg *arg_p, struct sampl
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_req_rate),
                                                        t->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1656,7 +1884,7 @@ static int sample_conv_table_kbytes_in(const struct arg *arg_p, struct sample *s
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1669,7 +1897,6 @@ static int sample_conv_table_kbytes_in(const struct arg *arg_p, struct sample *s
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, bytes_in_cnt) >> 10;
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1692,7 +1919,7 @@ static int sample_conv_table_kbytes_out(const struct arg *arg_p, struct sample *
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1705,7 +1932,6 @@ static int sample_conv_table_kbytes_out(const struct arg *arg_p, struct sample *
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, bytes_out_cnt) >> 10;
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1728,7 +1954,7 @@ static int sample_conv_table_server_id(const struct arg *arg_p, struct sample *s
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1741,7 +1967,6 @@ static int sample_conv_table_server_id(const struct arg *arg_p, struct sample *s
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, server_id);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1764,7 +1989,7 @@ static int sample_conv_table_sess_cnt(const struct arg *arg_p, struct sample *sm
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1777,7 +2002,6 @@ static int sample_conv_table_sess_cnt(const struct arg *arg_p, struct sample *sm
 	if (ptr)
 		smp->data.u.sint = stktable_data_cast(ptr, sess_cnt);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1800,7 +2024,7 @@ static int sample_conv_table_sess_rate(const struct arg *arg_p, struct sample *s
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1814,7 +2038,6 @@ static int sample_conv_table_sess_rate(const struct arg *arg_p, struct sample *s
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, sess_rate),
                                                        t->data_arg[STKTABLE_DT_SESS_RATE].u);
 
-	stktable_release(t, ts);
 	return !!ptr;
 }
 
@@ -1836,7 +2059,7 @@ static int sample_conv_table_trackers(const struct arg *arg_p, struct sample *sm
 	if (!key)
 		return 0;
 
-	ts = stktable_lookup_key(t, key);
+	ts = stktable_peek_key(t, key);
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
@@ -1847,7 +2070,6 @@ static int sample_conv_table_trackers(const struct arg *arg_p, struct sample *sm
 
 	smp->data.u.sint = ts->ref_cnt;
 
-	stktable_release(t, ts);
 	return 1;
 }
 
@@ -2194,8 +2416,8 @@ smp_fetch_table_avl(const struct arg *args, struct sample *smp, const char *kw,
  * multiple tables). <strm> is allowed to be NULL, in which case only
  * the session will be consulted.
  */
-struct stkctr *
-smp_fetch_sc_stkctr(struct session *sess, struct stream *strm, const struct arg *args, const char *kw, struct stkctr *stkctr)
+static struct stkctr *
+__smp_fetch_sc_stkctr(struct session *sess, struct stream *strm, const struct arg *args, const char *kw, struct stkctr *stkctr, int peek)
 {
 	struct stkctr *stkptr;
 	struct stksess *stksess;
@@ -2227,7 +2449,8 @@ smp_fetch_sc_stkctr(struct session *sess, struct stream *strm, const struct arg
 			return NULL;
 
 		stkctr->table = args->data.t;
-		stkctr_set_entry(stkctr, stktable_lookup_key(stkctr->table, key));
+		stkctr_set_entry(stkctr, peek ? stktable_peek_key(stkctr->table, key) :
+		                                stktable_lookup_key(stkctr->table, key));
 		return stkctr;
 	}
 
@@ -2255,12 +2478,30 @@ smp_fetch_sc_stkctr(struct session *sess, struct stream *strm, const struct arg
 	if (unlikely(args[arg].type == ARGT_TAB)) {
 		/* an alternate table was specified, let's look up the same key there */
 		stkctr->table = args[arg].data.t;
-		stkctr_set_entry(stkctr, stktable_lookup(stkctr->table, stksess));
+		stkctr_set_entry(stkctr, peek ? stktable_peek(stkctr->table, stksess) :
+		                                stktable_lookup(stkctr->table, stksess));
 		return stkctr;
 	}
 	return stkptr;
 }
 
+struct stkctr *
+smp_fetch_sc_stkctr(struct session *sess, struct stream *strm, const struct arg *args, const char *kw, struct stkctr *stkctr)
+{
+	return __smp_fetch_sc_stkctr(sess, strm, args, kw, stkctr, 0);
+}
+
+/* Same as smp_fetch_sc_stkctr() except that when <stkctr> is returned, no
+ * reference is taken on its entry, which was looked up using
+ * stktable_peek_key(). It is meant for fetches which only read the entry's
+ * data, and must not be kept past the current processing.
+ */
+static struct stkctr *
+smp_fetch_sc_peek_stkctr(struct session *sess, struct stream *strm, const struct arg *args, const char *kw, struct stkctr *stkctr)
+{
+	return __smp_fetch_sc_stkctr(sess, strm, args, kw, stkctr, 1);
+}
+
 /* same as smp_fetch_sc_stkctr() but dedicated to src_* and can create
  * the entry if it doesn't exist yet. This is needed for a few fetch
  * functions which need to create an entry, such as src_inc_gpc* and
@@ -2308,13 +2549,9 @@ smp_fetch_sc_tracked(const struct arg *args, struct sample *smp, const char *kw,
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_BOOL;
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	smp->data.u.sint = !!stkctr;
 
-	/* release the ref count */
-	if (stkctr == &tmpstkctr)
-		stktable_release(stkctr->table, stkctr_entry(stkctr));
-
 	return 1;
 }
 
@@ -2329,7 +2566,7 @@ smp_fetch_sc_get_gpt0(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2341,20 +2578,10 @@ smp_fetch_sc_get_gpt0(const struct arg *args, struct sample *smp, const char *kw
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPT0);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, gpt0);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2370,7 +2597,7 @@ smp_fetch_sc_get_gpc0(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2382,20 +2609,10 @@ smp_fetch_sc_get_gpc0(const struct arg *args, struct sample *smp, const char *kw
 		void *ptr;
 
 		ptr  = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC0);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, gpc0);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2411,7 +2628,7 @@ smp_fetch_sc_get_gpc1(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2423,20 +2640,10 @@ smp_fetch_sc_get_gpc1(const struct arg *args, struct sample *smp, const char *kw
 		void *ptr;
 
 		ptr  = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC1);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, gpc1);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2452,7 +2659,7 @@ smp_fetch_sc_gpc0_rate(const struct arg *args, struct sample *smp, const char *k
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2463,21 +2670,11 @@ smp_fetch_sc_gpc0_rate(const struct arg *args, struct sample *smp, const char *k
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC0_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, gpc0_rate),
 		                  stkctr->table->data_arg[STKTABLE_DT_GPC0_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2493,7 +2690,7 @@ smp_fetch_sc_gpc1_rate(const struct arg *args, struct sample *smp, const char *k
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2504,21 +2701,11 @@ smp_fetch_sc_gpc1_rate(const struct arg *args, struct sample *smp, const char *k
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC1_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, gpc1_rate),
 		                  stkctr->table->data_arg[STKTABLE_DT_GPC1_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2727,7 +2914,7 @@ smp_fetch_sc_conn_cnt(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2738,22 +2925,10 @@ smp_fetch_sc_conn_cnt(const struct arg *args, struct sample *smp, const char *kw
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_CONN_CNT);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, conn_cnt);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
-
-
 	}
 	return 1;
 }
@@ -2768,7 +2943,7 @@ smp_fetch_sc_conn_rate(const struct arg *args, struct sample *smp, const char *k
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2779,21 +2954,11 @@ smp_fetch_sc_conn_rate(const struct arg *args, struct sample *smp, const char *k
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_CONN_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, conn_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_CONN_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2860,7 +3025,7 @@ smp_fetch_sc_conn_cur(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2871,20 +3036,10 @@ smp_fetch_sc_conn_cur(const struct arg *args, struct sample *smp, const char *kw
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_CONN_CUR);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, conn_cur);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2899,7 +3054,7 @@ smp_fetch_sc_sess_cnt(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2910,20 +3065,10 @@ smp_fetch_sc_sess_cnt(const struct arg *args, struct sample *smp, const char *kw
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_SESS_CNT);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, sess_cnt);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2937,7 +3082,7 @@ smp_fetch_sc_sess_rate(const struct arg *args, struct sample *smp, const char *k
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2948,21 +3093,11 @@ smp_fetch_sc_sess_rate(const struct arg *args, struct sample *smp, const char *k
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_SESS_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, sess_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_SESS_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -2977,7 +3112,7 @@ smp_fetch_sc_http_req_cnt(const struct arg *args, struct sample *smp, const char
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -2988,20 +3123,10 @@ smp_fetch_sc_http_req_cnt(const struct arg *args, struct sample *smp, const char
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_HTTP_REQ_CNT);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, http_req_cnt);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3016,7 +3141,7 @@ smp_fetch_sc_http_req_rate(const struct arg *args, struct sample *smp, const cha
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3027,21 +3152,11 @@ smp_fetch_sc_http_req_rate(const struct arg *args, struct sample *smp, const cha
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_HTTP_REQ_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_req_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3056,7 +3171,7 @@ smp_fetch_sc_http_err_cnt(const struct arg *args, struct sample *smp, const char
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3067,20 +3182,10 @@ smp_fetch_sc_http_err_cnt(const struct arg *args, struct sample *smp, const char
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_HTTP_ERR_CNT);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, http_err_cnt);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3095,7 +3200,7 @@ smp_fetch_sc_http_err_rate(const struct arg *args, struct sample *smp, const cha
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3106,21 +3211,11 @@ smp_fetch_sc_http_err_rate(const struct arg *args, struct sample *smp, const cha
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_HTTP_ERR_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_err_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3135,7 +3230,7 @@ smp_fetch_sc_kbytes_in(const struct arg *args, struct sample *smp, const char *k
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3146,20 +3241,10 @@ smp_fetch_sc_kbytes_in(const struct arg *args, struct sample *smp, const char *k
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_BYTES_IN_CNT);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, bytes_in_cnt) >> 10;
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3174,7 +3259,7 @@ smp_fetch_sc_bytes_in_rate(const struct arg *args, struct sample *smp, const cha
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3185,21 +3270,11 @@ smp_fetch_sc_bytes_in_rate(const struct arg *args, struct sample *smp, const cha
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_BYTES_IN_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_in_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_BYTES_IN_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3214,7 +3289,7 @@ smp_fetch_sc_kbytes_out(const struct arg *args, struct sample *smp, const char *
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3225,20 +3300,10 @@ smp_fetch_sc_kbytes_out(const struct arg *args, struct sample *smp, const char *
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_BYTES_OUT_CNT);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = stktable_data_cast(ptr, bytes_out_cnt) >> 10;
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3253,7 +3318,7 @@ smp_fetch_sc_bytes_out_rate(const struct arg *args, struct sample *smp, const ch
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
@@ -3264,21 +3329,11 @@ smp_fetch_sc_bytes_out_rate(const struct arg *args, struct sample *smp, const ch
 		void *ptr;
 
 		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_BYTES_OUT_RATE);
-		if (!ptr) {
-			if (stkctr == &tmpstkctr)
-				stktable_release(stkctr->table, stkctr_entry(stkctr));
+		if (!ptr)
 			return 0; /* parameter not stored */
-		}
-
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
 
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_out_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u);
-
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		if (stkctr == &tmpstkctr)
-			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
 	return 1;
 }
@@ -3292,20 +3347,13 @@ smp_fetch_sc_trackers(const struct arg *args, struct sample *smp, const char *kw
 	struct stkctr tmpstkctr;
 	struct stkctr *stkctr;
 
-	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	stkctr = smp_fetch_sc_peek_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
 	if (!stkctr)
 		return 0;
 
 	smp->flags = SMP_F_VOL_TEST;
 	smp->data.type = SMP_T_SINT;
-	if (stkctr == &tmpstkctr) {
-		smp->data.u.sint = stkctr_entry(stkctr) ? (stkctr_entry(stkctr)->ref_cnt-1) : 0;
-		stktable_release(stkctr->table, stkctr_entry(stkctr));
-	}
-	else {
-		smp->data.u.sint = stkctr_entry(stkctr) ? stkctr_entry(stkctr)->ref_cnt : 0;
-	}
-
+	smp->data.u.sint = stkctr_entry(stkctr) ? stkctr_entry(stkctr)->ref_cnt : 0;
 	return 1;
 }
 
@@ -3683,6 +3731,29 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
 	}
 }
 
+/* Returns the first entry of table <t> found in shard <*shard> or in the next
+ * ones, with its refcount increased, and sets <*shard> to the shard it was
+ * found in. NULL is returned if these shards are empty.
+ */
+static struct stksess *stktable_first_entry(struct stktable *t, unsigned int *shard)
+{
+	struct ebmb_node *eb;
+	struct stksess *ts = NULL;
+
+	for (; *shard < t->nb_shards; (*shard)++) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->shards[*shard].lock);
+		eb = ebmb_first(&t->shards[*shard].keys);
+		if (eb) {
+			ts = ebmb_entry(eb, struct stksess, key);
+			HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[*shard].lock);
+		if (ts)
+			break;
+	}
+	return ts;
+}
+
 /* This function is used to deal with table operations (dump or clear depending
  * on the action stored in appctx->private). It returns 0 if the output buffer is
  * full and it needs to be called again, otherwise non-zero.
@@ -3691,6 +3762,7 @@ static int cli_io_handler_table(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
 	struct stream *s = si_strm(si);
+	struct stktable_shard *shard;
 	struct ebmb_node *eb;
 	int skip_entry;
 	int show = appctx->ctx.table.action == STK_CLI_ACT_SHOW;
@@ -3743,16 +3815,12 @@ static int cli_io_handler_table(struct appctx *appctx)
 				if (appctx->ctx.table.target &&
 				    (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) >= ACCESS_LVL_OPER) {
 					/* dump entries only if table explicitly requested */
-					HA_SPIN_LOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
-					eb = ebmb_first(&appctx->ctx.table.t->keys);
-					if (eb) {
-						appctx->ctx.table.entry = ebmb_entry(eb, struct stksess, key);
-						appctx->ctx.table.entry->ref_cnt++;
+					appctx->ctx.table.shard = 0;
+					appctx->ctx.table.entry = stktable_first_entry(appctx->ctx.table.t, &appctx->ctx.table.shard);
+					if (appctx->ctx.table.entry) {
 						appctx->st2 = STAT_ST_LIST;
-						HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
 						break;
 					}
-					HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
 				}
 			}
 			appctx->ctx.table.t = appctx->ctx.table.t->next;
@@ -3820,8 +3888,9 @@ static int cli_io_handler_table(struct appctx *appctx)
 
 			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &appctx->ctx.table.entry->lock);
 
-			HA_SPIN_LOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
-			appctx->ctx.table.entry->ref_cnt--;
+			shard = &appctx->ctx.table.t->shards[appctx->ctx.table.shard];
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+			HA_ATOMIC_SUB(&appctx->ctx.table.entry->ref_cnt, 1);
 
 			eb = ebmb_next(&appctx->ctx.table.entry->key);
 			if (eb) {
@@ -3831,8 +3900,8 @@ static int cli_io_handler_table(struct appctx *appctx)
 					__stksess_kill_if_expired(appctx->ctx.table.t, old);
 				else if (!skip_entry && !appctx->ctx.table.entry->ref_cnt)
 					__stksess_kill(appctx->ctx.table.t, old);
-				appctx->ctx.table.entry->ref_cnt++;
-				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+				HA_ATOMIC_ADD(&appctx->ctx.table.entry->ref_cnt, 1);
+				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 				break;
 			}
 
@@ -3842,7 +3911,13 @@ static int cli_io_handler_table(struct appctx *appctx)
 			else if (!skip_entry && !appctx->ctx.table.entry->ref_cnt)
 				__stksess_kill(appctx->ctx.table.t, appctx->ctx.table.entry);
 
-			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+
+			/* continue with the next non-empty shard if any */
+			appctx->ctx.table.shard++;
+			appctx->ctx.table.entry = stktable_first_entry(appctx->ctx.table.t, &appctx->ctx.table.shard);
+			if (appctx->ctx.table.entry)
+				break;
 
 			appctx->ctx.table.t = appctx->ctx.table.t->next;
 			appctx->st2 = STAT_ST_INFO;
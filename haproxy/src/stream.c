@@ -2040,7 +2040,7 @@ struct task *process_stream(struct task *t, void *context, unsigned short state)
 	    (global.tune.options & GTUNE_USE_SPLICE) &&
 	    (objt_cs(si_f->end) && __objt_cs(si_f->end)->conn->xprt && __objt_cs(si_f->end)->conn->xprt->rcv_pipe &&
 	     __objt_cs(si_f->end)->conn->mux && __objt_cs(si_f->end)->conn->mux->rcv_pipe) &&
-	    (objt_cs(si_b->end) && __objt_cs(si_b->end)->conn->xprt && __objt_cs(si_b->end)->conn->xprt->snd_pipe &&
+	    (objt_cs(si_b->end) && conn_xprt_can_snd_pipe(__objt_cs(si_b->end)->conn) &&
 	     __objt_cs(si_b->end)->conn->mux && __objt_cs(si_b->end)->conn->mux->snd_pipe) &&
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_REQ) ||
@@ -2066,7 +2066,9 @@ struct task *process_stream(struct task *t, void *context, unsigned short state)
 				 */
 				si_b->state = SI_ST_REQ; /* new connection requested */
 				si_b->conn_retries = s->be->conn_retries;
-				if ((s->be->retry_type &~ PR_RE_CONN_FAILED) &&
+				if (((s->be->retry_type &~ PR_RE_CONN_FAILED) ||
+				     ((s->be->hedge_delay || s->be->hedge_pct) && s->txn &&
+				      (s->txn->meth == HTTP_METH_GET || s->txn->meth == HTTP_METH_HEAD))) &&
 				    (s->be->mode == PR_MODE_HTTP) &&
 				    !(si_b->flags & SI_FL_D_L7_RETRY))
 					si_b->flags |= SI_FL_L7_RETRY;
@@ -2231,7 +2233,7 @@ struct task *process_stream(struct task *t, void *context, unsigned short state)
 	if (!(res->flags & (CF_KERN_SPLICING|CF_SHUTR)) &&
 	    res->to_forward &&
 	    (global.tune.options & GTUNE_USE_SPLICE) &&
-	    (objt_cs(si_f->end) && __objt_cs(si_f->end)->conn->xprt && __objt_cs(si_f->end)->conn->xprt->snd_pipe &&
+	    (objt_cs(si_f->end) && conn_xprt_can_snd_pipe(__objt_cs(si_f->end)->conn) &&
 	     __objt_cs(si_f->end)->conn->mux && __objt_cs(si_f->end)->conn->mux->snd_pipe) &&
 	    (objt_cs(si_b->end) && __objt_cs(si_b->end)->conn->xprt && __objt_cs(si_b->end)->conn->xprt->rcv_pipe &&
 	     __objt_cs(si_b->end)->conn->mux && __objt_cs(si_b->end)->conn->mux->rcv_pipe) &&
@@ -2356,6 +2358,8 @@ struct task *process_stream(struct task *t, void *context, unsigned short state)
 						  tick_first(res->rex, res->wex)));
 		if (!req->analysers)
 			req->analyse_exp = TICK_ETERNITY;
+		if (!res->analysers)
+			res->analyse_exp = TICK_ETERNITY;
 
 		if ((sess->fe->options & PR_O_CONTSTATS) && (s->flags & SF_BE_ASSIGNED) &&
 		          (!tick_isset(req->analyse_exp) || tick_is_expired(req->analyse_exp, now_ms)))
@@ -665,7 +665,7 @@ int si_cs_send(struct conn_stream *cs)
 	if (!conn->mux)
 		return 0;
 
-	if (oc->pipe && conn->xprt->snd_pipe && conn->mux->snd_pipe) {
+	if (oc->pipe && conn_xprt_can_snd_pipe(conn) && conn->mux->snd_pipe) {
 		ret = conn->mux->snd_pipe(cs, oc->pipe);
 		if (ret > 0)
 			did_send = 1;
@@ -37,6 +37,7 @@ DECLARE_POOL(pool_head_notification, "notification", sizeof(struct notification)
 
 unsigned int nb_tasks = 0;
 volatile unsigned long global_tasks_mask = 0; /* Mask of threads with tasks in the global runqueue */
+volatile unsigned long stealable_tasks_mask = 0; /* Mask of threads with tasks to be stolen */
 unsigned int tasks_run_queue = 0;
 unsigned int tasks_run_queue_cur = 0;    /* copy of the run queue size */
 unsigned int nb_tasks_cur = 0;     /* copy of the tasks count */
@@ -48,7 +49,11 @@ __decl_aligned_spinlock(rq_lock); /* spin lock related to run queue */
 __decl_aligned_rwlock(wq_lock);   /* RW lock related to the wait queue */
 
 #ifdef USE_THREAD
+#ifdef USE_TIMER_WHEEL
+struct twheel timers;       /* timing wheel, global */
+#else
 struct eb_root timers;      /* sorted timers tree, global */
+#endif
 struct eb_root rqueue;      /* tree constituting the run queue */
 int global_rqueue_size; /* Number of element sin the global runqueue */
 #endif
@@ -110,17 +115,146 @@ void task_kill(struct task *t)
 	}
 }
 
+#ifdef USE_THREAD
+/* Makes sure that thread <thr> is advertised in stealable_tasks_mask if and
+ * only if its steal queue contains at least TASK_STEAL_MIN tasks. It may be
+ * called by any thread, and the mask is checked again after being cleared in
+ * case the owner would have added tasks in the mean time.
+ */
+static void task_steal_update_mask(int thr)
+{
+	struct task_steal_queue *q = &task_per_thread[thr].stealq;
+
+	if (q->tail - q->head >= TASK_STEAL_MIN || !(stealable_tasks_mask & (1UL << thr)))
+		return;
+
+	_HA_ATOMIC_AND(&stealable_tasks_mask, ~(1UL << thr));
+	__ha_barrier_atomic_store();
+	if (q->tail - q->head >= TASK_STEAL_MIN)
+		_HA_ATOMIC_OR(&stealable_tasks_mask, 1UL << thr);
+}
+
+/* Appends task <t> to the current thread's steal queue, which must not be
+ * full. Once the queue holds enough tasks, the thread is advertised as having
+ * tasks to be stolen and a sleeping thread is woken up to come and take some.
+ */
+static void task_steal_push(struct task *t)
+{
+	struct task_steal_queue *q = &sched->stealq;
+	unsigned int tail = q->tail;
+	unsigned long m;
+
+	q->entry[tail % TASK_STEAL_QSIZE] = t;
+	__ha_barrier_store();
+	q->tail = tail + 1;
+
+	if (tail + 1 - q->head < TASK_STEAL_MIN || (stealable_tasks_mask & tid_bit))
+		return;
+
+	_HA_ATOMIC_OR(&stealable_tasks_mask, tid_bit);
+	__ha_barrier_atomic_store();
+
+	m = sleeping_thread_mask & all_threads_mask & ~tid_bit;
+	if (m) {
+		m = (m & (m - 1)) ^ m; // keep lowest bit set
+		_HA_ATOMIC_AND(&sleeping_thread_mask, ~m);
+		wake_thread(my_ffsl(m) - 1);
+	}
+}
+
+/* Takes the oldest task from steal queue <q>, which may belong to any thread,
+ * and updates the run queue counters the same way as __task_unlink_rq().
+ * Returns NULL if the queue is empty.
+ */
+static struct task *task_steal_pop(struct task_steal_queue *q)
+{
+	unsigned int head = q->head;
+	struct task *t;
+
+	do {
+		if (head == q->tail)
+			return NULL;
+		__ha_barrier_load();
+		t = q->entry[head % TASK_STEAL_QSIZE];
+	} while (!_HA_ATOMIC_CAS(&q->head, &head, head + 1));
+
+	_HA_ATOMIC_SUB(&tasks_run_queue, 1);
+	if (likely(t->nice))
+		_HA_ATOMIC_SUB(&niced_tasks, 1);
+	return t;
+}
+
+/* Moves up to <max> tasks from steal queue <q> to the current thread's list of
+ * normal tasklets. Returns the number of tasks moved.
+ */
+static unsigned int task_steal_run(struct task_steal_queue *q, unsigned int max)
+{
+	struct task_per_thread * const tt = sched;
+	unsigned int done;
+	struct task *t;
+
+	for (done = 0; done < max; done++) {
+		t = task_steal_pop(q);
+		if (!t)
+			break;
+
+		/* Make sure the entry doesn't appear to be in a list */
+		LIST_INIT(&((struct tasklet *)t)->list);
+		tasklet_insert_into_tasklet_list(&tt->tasklets[TL_NORMAL], (struct tasklet *)t);
+		tt->tl_class_mask |= 1 << TL_NORMAL;
+		_HA_ATOMIC_ADD(&tt->task_list_size, 1);
+		activity[tid].tasksw++;
+	}
+	return done;
+}
+
+/* Steals up to <max> tasks from the other threads advertised in
+ * stealable_tasks_mask, and moves them to the current thread's list of normal
+ * tasklets. At most half of a thread's queue is taken at once, and threads are
+ * visited starting from the next one so that the load spreads evenly.
+ */
+static void task_steal_from_others(unsigned int max)
+{
+	struct task_steal_queue *q;
+	unsigned int len, done;
+	int thr, i;
+
+	for (i = 1; i < global.nbthread && max; i++) {
+		thr = (tid + i) % global.nbthread;
+		if (!(stealable_tasks_mask & (1UL << thr)))
+			continue;
+
+		q = &task_per_thread[thr].stealq;
+		len = q->tail - q->head;
+		if ((int)len < TASK_STEAL_MIN) {
+			task_steal_update_mask(thr);
+			continue;
+		}
+
+		done = task_steal_run(q, MIN((len + 1) / 2, max));
+		activity[tid].stolen += done;
+		max -= done;
+		task_steal_update_mask(thr);
+	}
+}
+#endif
+
 /* Puts the task <t> in run queue at a position depending on t->nice. <t> is
  * returned. The nice value assigns boosts in 32th of the run queue size. A
  * nice value of -1024 sets the task to -tasks_run_queue*32, while a nice value
  * of 1024 sets the task to tasks_run_queue*32. The state flags are cleared, so
- * the caller will have to set its flags after this call.
+ * the caller will have to set its flags after this call. A NULL <root> means
+ * the current thread's steal queue, in which case the nice value is ignored
+ * and the global run queue is used instead if the steal queue is full.
  * The task must not already be in the run queue. If unsure, use the safer
  * task_wakeup() function.
  */
 void __task_wakeup(struct task *t, struct eb_root *root)
 {
 #ifdef USE_THREAD
+	if (!root && sched->stealq.tail - sched->stealq.head >= TASK_STEAL_QSIZE)
+		root = &rqueue;
+
 	if (root == &rqueue) {
 		HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
 	}
@@ -148,6 +282,12 @@ void __task_wakeup(struct task *t, struct eb_root *root)
 	if (task_profiling_mask & tid_bit)
 		t->call_date = now_mono_time();
 
+#ifdef USE_THREAD
+	if (!root) {
+		task_steal_push(t);
+		return;
+	}
+#endif
 	eb32sc_insert(root, &t->rq, t->thread_mask);
 #ifdef USE_THREAD
 	if (root == &rqueue) {
@@ -191,20 +331,28 @@ void __task_wakeup(struct task *t, struct eb_root *root)
  * at all about locking so the caller must be careful when deciding whether to
  * lock or not around this call.
  */
+#ifdef USE_TIMER_WHEEL
+void __task_queue(struct task *task, struct twheel *wq)
+#else
 void __task_queue(struct task *task, struct eb_root *wq)
+#endif
 {
 	if (likely(task_in_wq(task)))
 		__task_unlink_wq(task);
 
 	/* the task is not in the queue now */
-	task->wq.key = task->expire;
 #ifdef DEBUG_CHECK_INVALID_EXPIRATION_DATES
-	if (tick_is_lt(task->wq.key, now_ms))
+	if (tick_is_lt(task->expire, now_ms))
 		/* we're queuing too far away or in the past (most likely) */
 		return;
 #endif
 
+#ifdef USE_TIMER_WHEEL
+	twheel_insert(wq, &task->wq, task->expire, now_ms);
+#else
+	task->wq.key = task->expire;
 	eb32_insert(wq, &task->wq);
+#endif
 }
 
 /*
@@ -216,21 +364,12 @@ void wake_expired_tasks()
 	struct task_per_thread * const tt = sched; // thread's tasks
 	int max_processed = global.tune.runqueue_depth;
 	struct task *task;
-	struct eb32_node *eb;
 	__decl_thread(int key);
 
 	while (max_processed-- > 0) {
-  lookup_next_local:
-		eb = eb32_lookup_ge(&tt->timers, now_ms - TIMER_LOOK_BACK);
-		if (!eb) {
-			/* we might have reached the end of the tree, typically because
-			* <now_ms> is in the first half and we're first scanning the last
-			* half. Let's loop back to the beginning of the tree now.
-			*/
-			eb = eb32_first(&tt->timers);
-			if (likely(!eb))
-				break;
-		}
+		task = wq_first(&tt->timers);
+		if (!task)
+			break;
 
 		/* It is possible that this task was left at an earlier place in the
 		 * tree because a recent call to task_queue() has not moved it. This
@@ -250,13 +389,12 @@ void wake_expired_tasks()
 		 * wakeups.
 		 */
 
-		task = eb32_entry(eb, struct task, wq);
 		if (tick_is_expired(task->expire, now_ms)) {
 			/* expired task, wake it up */
 			__task_unlink_wq(task);
 			task_wakeup(task, TASK_WOKEN_TIMER);
 		}
-		else if (task->expire != eb->key) {
+		else if (task->expire != task->wq.key) {
 			/* task is not expired but its key doesn't match so let's
 			 * update it and skip to next apparently expired task.
 			 */
@@ -271,22 +409,14 @@ void wake_expired_tasks()
 	}
 
 #ifdef USE_THREAD
-	if (eb_is_empty(&timers))
+	if (wq_is_empty(&timers))
 		goto leave;
 
 	HA_RWLOCK_RDLOCK(TASK_WQ_LOCK, &wq_lock);
-	eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
-	if (!eb) {
-		eb = eb32_first(&timers);
-		if (likely(!eb)) {
-			HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
-			goto leave;
-		}
-	}
-	key = eb->key;
+	key = wq_next_key(&timers);
 	HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
 
-	if (tick_is_lt(now_ms, key))
+	if (!tick_isset(key) || tick_is_lt(now_ms, key))
 		goto leave;
 
 	/* There's really something of interest here, let's visit the queue */
@@ -296,24 +426,16 @@ void wake_expired_tasks()
   lookup_next:
 		if (max_processed-- <= 0)
 			break;
-		eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
-		if (!eb) {
-			/* we might have reached the end of the tree, typically because
-			* <now_ms> is in the first half and we're first scanning the last
-			* half. Let's loop back to the beginning of the tree now.
-			*/
-			eb = eb32_first(&timers);
-			if (likely(!eb))
-				break;
-		}
+		task = wq_first(&timers);
+		if (!task)
+			break;
 
-		task = eb32_entry(eb, struct task, wq);
 		if (tick_is_expired(task->expire, now_ms)) {
 			/* expired task, wake it up */
 			__task_unlink_wq(task);
 			task_wakeup(task, TASK_WOKEN_TIMER);
 		}
-		else if (task->expire != eb->key) {
+		else if (task->expire != task->wq.key) {
 			/* task is not expired but its key doesn't match so let's
 			 * update it and skip to next apparently expired task.
 			 */
@@ -342,34 +464,18 @@ void wake_expired_tasks()
 int next_timer_expiry()
 {
 	struct task_per_thread * const tt = sched; // thread's tasks
-	struct eb32_node *eb;
 	int ret = TICK_ETERNITY;
-	__decl_thread(int key = TICK_ETERNITY);
+	__decl_thread(int key);
 
 	/* first check in the thread-local timers */
-	eb = eb32_lookup_ge(&tt->timers, now_ms - TIMER_LOOK_BACK);
-	if (!eb) {
-		/* we might have reached the end of the tree, typically because
-		 * <now_ms> is in the first half and we're first scanning the last
-		 * half. Let's loop back to the beginning of the tree now.
-		 */
-		eb = eb32_first(&tt->timers);
-	}
-
-	if (eb)
-		ret = eb->key;
+	ret = wq_next_key(&tt->timers);
 
 #ifdef USE_THREAD
-	if (!eb_is_empty(&timers)) {
+	if (!wq_is_empty(&timers)) {
 		HA_RWLOCK_RDLOCK(TASK_WQ_LOCK, &wq_lock);
-		eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
-		if (!eb)
-			eb = eb32_first(&timers);
-		if (eb)
-			key = eb->key;
+		key = wq_next_key(&timers);
 		HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
-		if (eb)
-			ret = tick_first(ret, key);
+		ret = tick_first(ret, key);
 	}
 #endif
 	return ret;
@@ -551,6 +657,9 @@ void process_runnable_tasks()
 	struct mt_list *tmp_list;
 	unsigned int queue;
 	int max_processed;
+#ifdef USE_THREAD
+	unsigned int steal_max;
+#endif
 
 	ti->flags &= ~TI_FL_STUCK; // this thread is still running
 
@@ -576,7 +685,8 @@ void process_runnable_tasks()
 
 	/* normal tasklets list gets a default weight of ~37% */
 	if ((tt->tl_class_mask & (1 << TL_NORMAL)) ||
-	    (sched->rqueue_size > 0) || (global_tasks_mask & tid_bit))
+	    (sched->rqueue_size > 0) || (global_tasks_mask & tid_bit) ||
+	    (tt->stealq.head != tt->stealq.tail) || (stealable_tasks_mask & ~tid_bit))
 		max[TL_NORMAL] = default_weights[TL_NORMAL];
 
 	/* bulk tasklets list gets a default weight of ~13% */
@@ -600,6 +710,15 @@ void process_runnable_tasks()
 
 	lrq = grq = NULL;
 
+#ifdef USE_THREAD
+	/* In work stealing mode, the tasks woken up by this thread are picked
+	 * first from its steal queue for up to half of the budget, so that they
+	 * cannot be starved by the run queues.
+	 */
+	if (tt->stealq.head != tt->stealq.tail && tt->task_list_size < max[TL_NORMAL])
+		task_steal_run(&tt->stealq, (max[TL_NORMAL] - tt->task_list_size + 1) / 2);
+#endif
+
 	/* pick up to max[TL_NORMAL] regular tasks from prio-ordered run queues */
 	/* Note: the grq lock is always held when grq is not null */
 	while (tt->task_list_size < max[TL_NORMAL]) {
@@ -665,6 +784,20 @@ void process_runnable_tasks()
 		grq = NULL;
 	}
 
+#ifdef USE_THREAD
+	/* complete with the rest of our steal queue, then with tasks stolen
+	 * from overloaded threads if we still have some room.
+	 */
+	if (tt->task_list_size < max[TL_NORMAL]) {
+		steal_max = max[TL_NORMAL] - tt->task_list_size;
+		if (tt->stealq.head != tt->stealq.tail)
+			steal_max -= task_steal_run(&tt->stealq, steal_max);
+		if (steal_max && (stealable_tasks_mask & ~tid_bit))
+			task_steal_from_others(steal_max);
+	}
+	task_steal_update_mask(tid);
+#endif
+
 	/* Merge the list of tasklets waken up by other threads to the
 	 * main list.
 	 */
@@ -738,7 +871,6 @@ void mworker_cleantasks()
 {
 	struct task *t;
 	int i;
-	struct eb32_node *tmp_wq = NULL;
 	struct eb32sc_node *tmp_rq = NULL;
 
 #ifdef USE_THREAD
@@ -750,12 +882,8 @@ void mworker_cleantasks()
 		task_destroy(t);
 	}
 	/* cleanup the timers queue */
-	tmp_wq = eb32_first(&timers);
-	while (tmp_wq) {
-		t = eb32_entry(tmp_wq, struct task, wq);
-		tmp_wq = eb32_next(tmp_wq);
+	while ((t = wq_pick(&timers)))
 		task_destroy(t);
-	}
 #endif
 	/* clean the per thread run queue */
 	for (i = 0; i < global.nbthread; i++) {
@@ -766,12 +894,8 @@ void mworker_cleantasks()
 			task_destroy(t);
 		}
 		/* cleanup the per thread timers queue */
-		tmp_wq = eb32_first(&task_per_thread[i].timers);
-		while (tmp_wq) {
-			t = eb32_entry(tmp_wq, struct task, wq);
-			tmp_wq = eb32_next(tmp_wq);
+		while ((t = wq_pick(&task_per_thread[i].timers)))
 			task_destroy(t);
-		}
 	}
 }
 
@@ -783,9 +907,15 @@ static void init_task()
 #ifdef USE_THREAD
 	memset(&timers, 0, sizeof(timers));
 	memset(&rqueue, 0, sizeof(rqueue));
+#ifdef USE_TIMER_WHEEL
+	twheel_init(&timers);
+#endif
 #endif
 	memset(&task_per_thread, 0, sizeof(task_per_thread));
 	for (i = 0; i < MAX_THREADS; i++) {
+#ifdef USE_TIMER_WHEEL
+		twheel_init(&task_per_thread[i].timers);
+#endif
 		LIST_INIT(&task_per_thread[i].tasklets[TL_URGENT]);
 		LIST_INIT(&task_per_thread[i].tasklets[TL_NORMAL]);
 		LIST_INIT(&task_per_thread[i].tasklets[TL_BULK]);
@@ -812,9 +942,29 @@ static int cfg_parse_tune_sched_low_latency(char **args, int section_type, struc
 	return 0;
 }
 
+/* config parser for global "tune.sched.work-stealing", accepts "on" or "off" */
+static int cfg_parse_tune_sched_work_stealing(char **args, int section_type, struct proxy *curpx,
+                                              struct proxy *defpx, const char *file, int line,
+                                              char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_SCHED_WORK_STEALING;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_SCHED_WORK_STEALING;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.sched.low-latency", cfg_parse_tune_sched_low_latency },
+	{ CFG_GLOBAL, "tune.sched.work-stealing", cfg_parse_tune_sched_work_stealing },
 	{ 0, NULL, NULL }
 }};
 
@@ -0,0 +1,168 @@
+/*
+ * Hierarchical timing wheel.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The wheel stores nodes sorted by 32-bit dates which may wrap, as long as
+ * all of them remain within 2^31 of the wheel's current date. Inserting and
+ * removing a node are O(1) operations which only touch the node, the slot's
+ * list head and a bitmap. The wheel's current date <cur> is moved forward when
+ * looking for expired nodes, and each node is cascaded at most once per level
+ * on its way to the first level, where all nodes of a slot share the same date.
+ * Empty areas are skipped using the bitmaps so that visiting the wheel after
+ * a long pause remains cheap.
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/list.h>
+#include <haproxy/twheel.h>
+
+/* Initializes wheel <w> */
+void twheel_init(struct twheel *w)
+{
+	int i;
+
+	w->cur = 0;
+	for (i = 0; i < TWHEEL_LEVELS; i++)
+		w->used[i] = 0;
+	for (i = 0; i <= TWHEEL_LATE; i++)
+		LIST_INIT(&w->slots[i]);
+}
+
+/* Moves the nodes of the upper levels' slots covering the wheel's current date
+ * to lower levels, starting from the highest one. This is normally only needed
+ * when <cur> enters a new slot at these levels.
+ */
+static void twheel_cascade(struct twheel *w)
+{
+	struct twheel_node *n;
+	struct list *head;
+	unsigned int level, slot;
+
+	for (level = TWHEEL_LEVELS - 1; level > 0; level--) {
+		slot = (w->cur >> (level * TWHEEL_BITS)) & (TWHEEL_SLOTS - 1);
+		if (!(w->used[level] & (1ULL << slot)))
+			continue;
+
+		w->used[level] &= ~(1ULL << slot);
+		head = &w->slots[level * TWHEEL_SLOTS + slot];
+		while (!LIST_ISEMPTY(head)) {
+			n = LIST_NEXT(head, struct twheel_node *, list);
+			LIST_DEL(&n->list);
+			__twheel_insert(w, n);
+		}
+	}
+}
+
+/* Looks up the first date at or after the current one where wheel <w> has
+ * something to do, and stores it into <next>. For the first level, this is
+ * the exact date of the nodes to expire, for upper levels it is the date where
+ * their slot has to be cascaded, which is before the nodes' dates. If nodes
+ * were queued in the past, the date of one of them is returned. Returns 0 if
+ * the wheel is empty, otherwise non-zero. The wheel is not modified.
+ */
+int twheel_next(const struct twheel *w, unsigned int *next)
+{
+	unsigned int cur = w->cur;
+	unsigned int level, shift, digit, slot;
+	uint64_t m;
+
+	if (!LIST_ISEMPTY(&w->slots[TWHEEL_LATE])) {
+		*next = LIST_NEXT(&w->slots[TWHEEL_LATE], struct twheel_node *, list)->key;
+		return 1;
+	}
+
+	for (level = 0; level < TWHEEL_LEVELS; level++) {
+		shift = level * TWHEEL_BITS;
+		digit = (cur >> shift) & (TWHEEL_SLOTS - 1);
+		m = w->used[level] & (~0ULL << digit);
+		if (!m) {
+			if (level < TWHEEL_LEVELS - 1 || !w->used[level])
+				continue;
+			/* the last level covers the whole range and wraps */
+			m = w->used[level];
+		}
+
+		slot = __builtin_ctzll(m);
+		if (slot == digit)
+			*next = cur;
+		else if (level == TWHEEL_LEVELS - 1)
+			*next = slot << shift;
+		else
+			*next = (cur & ~((1U << (shift + TWHEEL_BITS)) - 1)) | (slot << shift);
+		return 1;
+	}
+	return 0;
+}
+
+/* Moves the current date of wheel <w> to <now> if the wheel is empty, or if
+ * it was left behind and nothing remains to be done before <now>. This keeps
+ * the dates of newly inserted nodes comparable to the wheel's.
+ */
+void twheel_catchup(struct twheel *w, unsigned int now)
+{
+	unsigned int next;
+
+	if (!twheel_next(w, &next))
+		w->cur = now;
+	else if ((int)(now - w->cur) > 0 && (int)(next - now) > 0)
+		w->cur = now;
+}
+
+/* Returns the first node of wheel <w> queued for a date before or equal to
+ * <now>, or NULL if there is none. The wheel's current date is moved up to
+ * <now> + 1 while visiting it, but not past the returned node. The node is not
+ * removed, the caller is expected to either delete it or queue it again at a
+ * later date before calling this function again.
+ */
+struct twheel_node *twheel_first_expired(struct twheel *w, unsigned int now)
+{
+	unsigned int next, slot;
+
+	while (1) {
+		if (!LIST_ISEMPTY(&w->slots[TWHEEL_LATE]))
+			return LIST_NEXT(&w->slots[TWHEEL_LATE], struct twheel_node *, list);
+
+		if ((int)(now - w->cur) < 0)
+			break;
+
+		twheel_cascade(w);
+		slot = w->cur & (TWHEEL_SLOTS - 1);
+		if (w->used[0] & (1ULL << slot))
+			return LIST_NEXT(&w->slots[slot], struct twheel_node *, list);
+
+		/* nothing left at this date, skip to the next one */
+		if (!twheel_next(w, &next) || (int)(next - now) > 0) {
+			w->cur = now + 1;
+			break;
+		}
+		w->cur = next;
+	}
+	return NULL;
+}
+
+/* Returns any node queued in wheel <w>, or NULL if the wheel is empty */
+struct twheel_node *twheel_pick(const struct twheel *w)
+{
+	unsigned int level;
+
+	if (!LIST_ISEMPTY(&w->slots[TWHEEL_LATE]))
+		return LIST_NEXT(&w->slots[TWHEEL_LATE], struct twheel_node *, list);
+
+	for (level = 0; level < TWHEEL_LEVELS; level++) {
+		if (w->used[level])
+			return LIST_NEXT(&w->slots[level * TWHEEL_SLOTS + __builtin_ctzll(w->used[level])],
+			                 struct twheel_node *, list);
+	}
+	return NULL;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,252 @@
+/*
+ * Micro-benchmarks of the label trie used to index "-m dom" patterns.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The trie is first checked against the list walk it replaces, on patterns and
+ * strings built from a tiny vocabulary with all delimiters, repeated and
+ * surrounding delimiters and mixed case, so that most lookups match several
+ * patterns, in both case sensitive and insensitive modes. Then
+ * BENCH_DT_PATTERNS random host names of 2 to 4 labels are indexed and looked
+ * up with host names of which half are subdomains of one of them.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/domtrie.h>
+
+#define BENCH_DT_PATTERNS  10000   /* number of host names indexed */
+#define BENCH_DT_SMP       1024    /* number of host names looked up, power of 2 */
+
+struct bench_dt_pat {
+	char *str;
+	int len;
+};
+
+static struct bench_dt_pat bench_dt_pats[BENCH_DT_PATTERNS];
+static struct bench_dt_pat bench_dt_smp[BENCH_DT_SMP];
+static struct domtrie *bench_dt;
+static unsigned int bench_dt_seed = 2463534242U;
+
+static unsigned int bench_dt_rnd()
+{
+	bench_dt_seed ^= bench_dt_seed << 13;
+	bench_dt_seed ^= bench_dt_seed >> 17;
+	bench_dt_seed ^= bench_dt_seed << 5;
+	return bench_dt_seed;
+}
+
+static int bench_dt_is_delim(char c)
+{
+	return c == '/' || c == '?' || c == '.' || c == ':';
+}
+
+/* same algorithm as match_word() in src/pattern.c, used by the list walk */
+static int bench_dt_match_word(const char *str, int len, const struct bench_dt_pat *p, int icase)
+{
+	const char *ps = p->str, *c, *end;
+	int pl = p->len, may_match = 1;
+
+	while (pl > 0 && bench_dt_is_delim(*ps)) {
+		pl--;
+		ps++;
+	}
+	while (pl > 0 && bench_dt_is_delim(ps[pl - 1]))
+		pl--;
+	if (!pl || pl > len)
+		return 0;
+
+	end = str + len - pl;
+	for (c = str; c <= end; c++) {
+		if (bench_dt_is_delim(*c)) {
+			may_match = 1;
+			continue;
+		}
+		if (!may_match)
+			continue;
+		if (icase) {
+			if (strncasecmp(ps, c, pl) == 0 && (c == end || bench_dt_is_delim(c[pl])))
+				return 1;
+		} else {
+			if (strncmp(ps, c, pl) == 0 && (c == end || bench_dt_is_delim(c[pl])))
+				return 1;
+		}
+		may_match = 0;
+	}
+	return 0;
+}
+
+static struct bench_dt_pat *bench_dt_match_list(const char *str, int len, struct bench_dt_pat *pats, int count, int icase)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (bench_dt_match_word(str, len, &pats[i], icase))
+			return &pats[i];
+	return NULL;
+}
+
+/* builds a string of 1 to <max> words of a tiny vocabulary with any delimiter */
+static int bench_dt_make_word_str(char *buf, int max)
+{
+	static const char *words[] = { "a", "b", "ab", "A", "ba", "com", "Com", "" };
+	static const char delims[] = "..../?:";
+	int i, n = 1 + bench_dt_rnd() % max, len = 0;
+
+	if (!(bench_dt_rnd() % 4))
+		buf[len++] = delims[bench_dt_rnd() % 7];
+	for (i = 0; i < n; i++) {
+		if (i)
+			buf[len++] = delims[bench_dt_rnd() % 7];
+		len += sprintf(buf + len, "%s", words[bench_dt_rnd() % 8]);
+	}
+	if (!(bench_dt_rnd() % 4))
+		buf[len++] = delims[bench_dt_rnd() % 7];
+	buf[len] = 0;
+	return len;
+}
+
+/* Checks that the trie and the list walk return the same pattern. Returns 0
+ * if they differ or on failure.
+ */
+static int bench_dt_check(int icase)
+{
+	struct bench_dt_pat pats[300], *exp, *got;
+	struct domtrie *dt;
+	char buf[256];
+	int i, len, ret = 0;
+
+	memset(pats, 0, sizeof(pats));
+	dt = domtrie_new(icase ? DOMTRIE_F_ICASE : 0, "/?.:");
+	if (!dt)
+		return 0;
+	for (i = 0; i < 300; i++) {
+		pats[i].len = bench_dt_make_word_str(buf, 4);
+		pats[i].str = strdup(buf);
+		if (!pats[i].str || !domtrie_add(dt, pats[i].str, pats[i].len, &pats[i]))
+			goto out;
+	}
+
+	for (i = 0; i < 100000; i++) {
+		len = bench_dt_make_word_str(buf, 6);
+		exp = bench_dt_match_list(buf, len, pats, 300, icase);
+		got = domtrie_find(dt, buf, len);
+		if (exp != got) {
+			fprintf(stderr, "bench: domtrie mismatch on '%s' (icase=%d): list '%s', trie '%s'\n",
+			        buf, icase, exp ? exp->str : "-", got ? got->str : "-");
+			goto out;
+		}
+	}
+	ret = 1;
+ out:
+	domtrie_free(dt);
+	for (i = 0; i < 300; i++)
+		free(pats[i].str);
+	return ret;
+}
+
+/* builds a host name of <labels> labels */
+static int bench_dt_make_host(char *buf, int labels)
+{
+	static const char *tld[] = { "com", "net", "org", "io", "de", "fr" };
+	int i, j, len = 0;
+
+	for (i = 0; i < labels - 1; i++) {
+		for (j = 3 + bench_dt_rnd() % 8; j; j--)
+			buf[len++] = 'a' + bench_dt_rnd() % 26;
+		buf[len++] = '.';
+	}
+	return len + sprintf(buf + len, "%s", tld[bench_dt_rnd() % 6]);
+}
+
+/* Checks the trie then builds the host names and their trie once. Returns 0
+ * on failure.
+ */
+static int bench_dt_setup()
+{
+	static int ready;
+	char buf[256];
+	int i;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	if (!bench_dt_check(0) || !bench_dt_check(1))
+		return 0;
+
+	bench_dt = domtrie_new(DOMTRIE_F_ICASE, "/?.:");
+	if (!bench_dt)
+		return 0;
+
+	for (i = 0; i < BENCH_DT_PATTERNS; i++) {
+		bench_dt_pats[i].len = bench_dt_make_host(buf, 2 + bench_dt_rnd() % 3);
+		bench_dt_pats[i].str = strdup(buf);
+		if (!bench_dt_pats[i].str ||
+		    !domtrie_add(bench_dt, bench_dt_pats[i].str, bench_dt_pats[i].len, &bench_dt_pats[i]))
+			return 0;
+	}
+
+	for (i = 0; i < BENCH_DT_SMP; i++) {
+		bench_dt_smp[i].len = bench_dt_make_host(buf, 3);
+		if (i & 1)
+			bench_dt_smp[i].len = sprintf(buf, "www.%s", bench_dt_pats[bench_dt_rnd() % BENCH_DT_PATTERNS].str);
+		bench_dt_smp[i].str = strdup(buf);
+		if (!bench_dt_smp[i].str)
+			return 0;
+	}
+
+	ready = 1;
+	return 1;
+}
+
+static void bench_dt_find(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+	struct bench_dt_pat *smp;
+
+	if (!bench_dt_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		smp = &bench_dt_smp[i & (BENCH_DT_SMP - 1)];
+		found += !!domtrie_find(bench_dt, smp->str, smp->len);
+	}
+	bench_stop(run);
+	bench_sink += found;
+}
+
+/* the list walk which the trie replaces */
+static void bench_dt_find_list(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+	struct bench_dt_pat *smp;
+
+	if (!bench_dt_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		smp = &bench_dt_smp[i & (BENCH_DT_SMP - 1)];
+		found += !!bench_dt_match_list(smp->str, smp->len, bench_dt_pats, BENCH_DT_PATTERNS, 1);
+	}
+	bench_stop(run);
+	bench_sink += found;
+}
+
+REGISTER_BENCH("domtrie.find", bench_dt_find);
+REGISTER_BENCH("domtrie.find.list", bench_dt_find_list);
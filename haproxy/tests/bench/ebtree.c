@@ -0,0 +1,150 @@
+/*
+ * Micro-benchmarks of the elastic binary trees.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <import/eb32tree.h>
+#include <import/eb64tree.h>
+#include <import/ebsttree.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+
+#define BENCH_EB_KEYS 65536   /* number of keys in each tree, power of 2 */
+
+static struct eb_root bench_eb32_root = EB_ROOT;
+static struct eb_root bench_eb64_root = EB_ROOT;
+static struct eb_root bench_ebst_root = EB_ROOT;
+static struct eb32_node *bench_eb32_nodes;
+static struct eb64_node *bench_eb64_nodes;
+static struct ebmb_node **bench_ebst_nodes;
+
+/* Fills the trees with pseudo-random keys once. Returns 0 on failure. */
+static int bench_eb_setup()
+{
+	static int ready;
+	unsigned int x = 2463534242U;
+	char key[32];
+	int i, len;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	bench_eb32_nodes = calloc(BENCH_EB_KEYS, sizeof(*bench_eb32_nodes));
+	bench_eb64_nodes = calloc(BENCH_EB_KEYS, sizeof(*bench_eb64_nodes));
+	bench_ebst_nodes = calloc(BENCH_EB_KEYS, sizeof(*bench_ebst_nodes));
+	if (!bench_eb32_nodes || !bench_eb64_nodes || !bench_ebst_nodes)
+		return 0;
+
+	for (i = 0; i < BENCH_EB_KEYS; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+
+		bench_eb32_nodes[i].key = x;
+		eb32_insert(&bench_eb32_root, &bench_eb32_nodes[i]);
+
+		bench_eb64_nodes[i].key = (unsigned long long)x * 0x9E3779B97F4A7C15ULL;
+		eb64_insert(&bench_eb64_root, &bench_eb64_nodes[i]);
+
+		len = snprintf(key, sizeof(key), "session-%08x", x);
+		bench_ebst_nodes[i] = calloc(1, sizeof(struct ebmb_node) + len + 1);
+		if (!bench_ebst_nodes[i])
+			return 0;
+		memcpy(bench_ebst_nodes[i]->key, key, len + 1);
+		ebst_insert(&bench_ebst_root, bench_ebst_nodes[i]);
+	}
+	ready = 1;
+	return 1;
+}
+
+static void bench_eb32_lookup(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+
+	if (!bench_eb_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++)
+		found += !!eb32_lookup(&bench_eb32_root, bench_eb32_nodes[(i * 40503) & (BENCH_EB_KEYS - 1)].key);
+	bench_stop(run);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+static void bench_eb64_lookup(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+
+	if (!bench_eb_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++)
+		found += !!eb64_lookup(&bench_eb64_root, bench_eb64_nodes[(i * 40503) & (BENCH_EB_KEYS - 1)].key);
+	bench_stop(run);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+/* removes a node and inserts it back, as done by timers and queues */
+static void bench_eb32_delete_insert(struct bench_run *run)
+{
+	struct eb32_node *node;
+	unsigned long long i;
+
+	if (!bench_eb_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		node = &bench_eb32_nodes[(i * 40503) & (BENCH_EB_KEYS - 1)];
+		eb32_delete(node);
+		eb32_insert(&bench_eb32_root, node);
+	}
+	bench_stop(run);
+}
+
+static void bench_ebst_lookup(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+
+	if (!bench_eb_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++)
+		found += !!ebst_lookup(&bench_ebst_root,
+		                       (const char *)bench_ebst_nodes[(i * 40503) & (BENCH_EB_KEYS - 1)]->key);
+	bench_stop(run);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+REGISTER_BENCH("ebtree.eb32.lookup", bench_eb32_lookup);
+REGISTER_BENCH("ebtree.eb64.lookup", bench_eb64_lookup);
+REGISTER_BENCH("ebtree.eb32.delete_insert", bench_eb32_delete_insert);
+REGISTER_BENCH("ebtree.ebst.lookup", bench_ebst_lookup);
@@ -0,0 +1,119 @@
+/*
+ * Micro-benchmarks of the HTX messages.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/buf.h>
+#include <haproxy/htx.h>
+
+#define BENCH_HTX_SIZE 16384
+
+static const struct ist bench_htx_hdrs[][2] = {
+	{ IST("host"),            IST("api.example.com") },
+	{ IST("user-agent"),      IST("Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/91.0.4472.124 Safari/537.36") },
+	{ IST("accept"),          IST("application/json, text/plain, */*") },
+	{ IST("accept-encoding"), IST("gzip, deflate, br") },
+	{ IST("accept-language"), IST("en-US,en;q=0.9") },
+	{ IST("cookie"),          IST("_ga=GA1.2.1804416291.1623412345; session=s%3AJ8x9kQ2mZ7vX4pL1nR6tY3wB5cF0hD8a") },
+	{ IST("x-request-id"),    IST("4bf92f3577b34da6a3ce929d0e0e4736") },
+	{ IST("content-type"),    IST("application/json") },
+	{ IST("content-length"),  IST("4096") },
+	{ IST("connection"),      IST("keep-alive") },
+};
+
+static char bench_htx_body[4096];
+
+/* Adds a POST request with a 4kB body to <htx>. Returns 0 on failure. */
+static int bench_htx_fill(struct htx *htx)
+{
+	struct htx_sl *sl;
+	int i;
+
+	sl = htx_add_stline(htx, HTX_BLK_REQ_SL, HTX_SL_F_VER_11 | HTX_SL_F_XFER_LEN | HTX_SL_F_CLEN,
+	                    ist("POST"), ist("/api/v2/accounts/8f3c2a91/transactions"), ist("HTTP/1.1"));
+	if (!sl)
+		return 0;
+	for (i = 0; i < sizeof(bench_htx_hdrs) / sizeof(bench_htx_hdrs[0]); i++)
+		if (!htx_add_header(htx, bench_htx_hdrs[i][0], bench_htx_hdrs[i][1]))
+			return 0;
+	if (!htx_add_endof(htx, HTX_BLK_EOH))
+		return 0;
+	sl->hdrs_bytes = htx_used_space(htx);
+	if (htx_add_data(htx, ist2(bench_htx_body, sizeof(bench_htx_body))) != sizeof(bench_htx_body))
+		return 0;
+	return htx_add_endof(htx, HTX_BLK_EOM) != NULL;
+}
+
+/* builds a whole request into an empty message */
+static void bench_htx_add(struct bench_run *run)
+{
+	struct buffer buf;
+	struct htx *htx;
+	unsigned long long i;
+
+	buf = b_make(malloc(BENCH_HTX_SIZE), BENCH_HTX_SIZE, 0, 0);
+	if (!b_orig(&buf)) {
+		run->failed = 1;
+		return;
+	}
+	htx = htx_from_buf(&buf);
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		htx_reset(htx);
+		if (!bench_htx_fill(htx))
+			run->failed = 1;
+	}
+	bench_stop(run);
+	run->bytes = htx_used_space(htx);
+	free(b_orig(&buf));
+}
+
+/* moves a whole request from one message to another and back */
+static void bench_htx_xfer(struct bench_run *run)
+{
+	struct buffer buf[2];
+	struct htx *htx[2];
+	struct htx_ret ret;
+	unsigned long long i;
+	size_t used;
+
+	buf[0] = b_make(malloc(BENCH_HTX_SIZE), BENCH_HTX_SIZE, 0, 0);
+	buf[1] = b_make(malloc(BENCH_HTX_SIZE), BENCH_HTX_SIZE, 0, 0);
+	if (!b_orig(&buf[0]) || !b_orig(&buf[1])) {
+		run->failed = 1;
+		goto end;
+	}
+	htx[0] = htx_from_buf(&buf[0]);
+	htx[1] = htx_from_buf(&buf[1]);
+	if (!bench_htx_fill(htx[0])) {
+		run->failed = 1;
+		goto end;
+	}
+	used = htx_used_space(htx[0]);
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		ret = htx_xfer_blks(htx[(i + 1) & 1], htx[i & 1], BENCH_HTX_SIZE, HTX_BLK_UNUSED);
+		if (ret.ret != used || !htx_is_empty(htx[i & 1]))
+			run->failed = 1;
+	}
+	bench_stop(run);
+	run->bytes = used;
+ end:
+	free(b_orig(&buf[0]));
+	free(b_orig(&buf[1]));
+}
+
+REGISTER_BENCH("htx.add_request", bench_htx_add);
+REGISTER_BENCH("htx.xfer_blks", bench_htx_xfer);
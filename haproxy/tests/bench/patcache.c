@@ -0,0 +1,139 @@
+/*
+ * Micro-benchmarks of the pattern lookup cache.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * BENCH_PC_KEYS distinct values are looked up in BENCH_PC_DOMAINS expressions,
+ * following a Zipf-like distribution so that a few values are very common. An
+ * operation is a lookup into a cache of BENCH_PC_ENTRIES entries, followed on
+ * a miss by the storage of its result, with the set-associative cache or with
+ * the LRU tree it replaces.
+ */
+
+#include <stdlib.h>
+
+#include <import/lru.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/patcache.h>
+
+#define BENCH_PC_ENTRIES   10000     /* number of entries of each cache */
+#define BENCH_PC_KEYS      100000    /* number of distinct values */
+#define BENCH_PC_DOMAINS   4         /* number of expressions */
+#define BENCH_PC_LOOKUPS   (1 << 20) /* number of lookups prepared, power of 2 */
+
+static unsigned long long *bench_pc_qry;
+static char bench_pc_dom[BENCH_PC_DOMAINS][64];
+static struct patcache *bench_pc;
+static struct lru64_head *bench_pc_lru;
+
+/* returns a 64-bit hash of <v>, as XXH64() would of the sample */
+static unsigned long long bench_pc_hash(unsigned long long v)
+{
+	v ^= v >> 31;
+	v *= 0x7FB5D329728EA185ULL;
+	v ^= v >> 27;
+	v *= 0x81DADEF4BC2DD44DULL;
+	return v ^ (v >> 33);
+}
+
+/* Prepares the lookups and the caches once. Returns 0 on failure. */
+static int bench_pc_setup()
+{
+	static int ready;
+	unsigned int x = 2463534242U;
+	unsigned int i, lo, hi, mid;
+	double *cdf, sum = 0, r;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	bench_pc_qry = calloc(BENCH_PC_LOOKUPS, sizeof(*bench_pc_qry));
+	cdf = calloc(BENCH_PC_KEYS, sizeof(*cdf));
+	bench_pc = patcache_new(BENCH_PC_ENTRIES, 0);
+	bench_pc_lru = lru64_new(BENCH_PC_ENTRIES);
+	if (!bench_pc_qry || !cdf || !bench_pc || !bench_pc_lru) {
+		free(cdf);
+		return 0;
+	}
+
+	/* Zipf distribution of exponent 1 */
+	for (i = 0; i < BENCH_PC_KEYS; i++)
+		cdf[i] = (sum += 1.0 / (i + 1));
+	for (i = 0; i < BENCH_PC_LOOKUPS; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		r = (x / 4294967296.0) * sum;
+		for (lo = 0, hi = BENCH_PC_KEYS - 1; lo < hi; ) {
+			mid = (lo + hi) / 2;
+			if (cdf[mid] < r)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		bench_pc_qry[i] = bench_pc_hash(lo * 131ULL + x % BENCH_PC_DOMAINS);
+	}
+	free(cdf);
+	ready = 1;
+	return 1;
+}
+
+static void bench_pc_get_put(struct bench_run *run)
+{
+	unsigned long long i, q, key, hits = 0;
+	void *dom, *data;
+
+	if (!bench_pc_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		q = bench_pc_qry[i & (BENCH_PC_LOOKUPS - 1)];
+		dom = bench_pc_dom[q % BENCH_PC_DOMAINS];
+		key = patcache_key(q, dom, 1);
+		if (patcache_get(bench_pc, dom, key, &data))
+			hits++;
+		else
+			patcache_put(bench_pc, dom, key, dom);
+	}
+	bench_stop(run);
+
+	bench_sink += hits;
+}
+
+/* the LRU tree which the set-associative cache replaces */
+static void bench_pc_get_put_lru(struct bench_run *run)
+{
+	unsigned long long i, q, hits = 0;
+	struct lru64 *l;
+	void *dom;
+
+	if (!bench_pc_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		q = bench_pc_qry[i & (BENCH_PC_LOOKUPS - 1)];
+		dom = bench_pc_dom[q % BENCH_PC_DOMAINS];
+		l = lru64_get(q, bench_pc_lru, dom, 1);
+		if (l && l->domain)
+			hits++;
+		else if (l)
+			lru64_commit(l, dom, dom, 1, NULL);
+	}
+	bench_stop(run);
+
+	bench_sink += hits;
+}
+
+REGISTER_BENCH("patcache.get_put", bench_pc_get_put);
+REGISTER_BENCH("patcache.get_put.lru", bench_pc_get_put_lru);
@@ -0,0 +1,274 @@
+/*
+ * Micro-benchmarks of the pattern lookups, for each index type.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The lists are built once, the first time they are needed, with a fixed seed
+ * so that all runs look up the same samples. Lookups go through
+ * pattern_exec_match() as for ACLs, without the lookup cache, which is only
+ * allocated once the configuration is parsed. The indexes built on first use
+ * are built before the measurement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/global.h>
+#include <haproxy/pattern.h>
+#include <haproxy/sample.h>
+
+#define BENCH_PAT_SMP  1024   /* number of distinct samples looked up, power of 2 */
+#define BENCH_PAT_LEN  128    /* max length of a pattern or a sample */
+
+struct bench_pat_list {
+	int match;                         /* PAT_MATCH_* */
+	int count;                         /* number of patterns */
+	void (*make_pat)(char *buf, int i);
+	void (*make_smp)(struct sample *smp, char *buf, int i);
+	struct pattern_head head;
+	struct sample smp[BENCH_PAT_SMP];
+	char buf[BENCH_PAT_SMP][BENCH_PAT_LEN];
+	int ready;
+};
+
+static unsigned int bench_pat_seed;
+
+static unsigned int bench_pat_rnd()
+{
+	bench_pat_seed ^= bench_pat_seed << 13;
+	bench_pat_seed ^= bench_pat_seed >> 17;
+	bench_pat_seed ^= bench_pat_seed << 5;
+	return bench_pat_seed;
+}
+
+static const char *bench_pat_words[] = {
+	"select", "union", "insert", "delete", "script", "onerror", "onload", "alert",
+	"passwd", "shadow", "eval", "exec", "system", "concat", "sleep", "benchmark",
+	"document", "cookie", "iframe", "javascript", "vbscript", "expression", "base64",
+	"waitfor", "xp_cmdshell", "information_schema", "load_file", "outfile",
+};
+#define BENCH_PAT_WORDS (sizeof(bench_pat_words) / sizeof(bench_pat_words[0]))
+
+/* builds a host name of 2 to 4 labels */
+static int bench_pat_host(char *buf, int labels)
+{
+	static const char *tld[] = { "com", "net", "org", "io", "de", "fr" };
+	int i, j, len = 0;
+
+	for (i = 0; i < labels - 1; i++) {
+		for (j = 3 + bench_pat_rnd() % 8; j; j--)
+			buf[len++] = 'a' + bench_pat_rnd() % 26;
+		buf[len++] = '.';
+	}
+	return len + sprintf(buf + len, "%s", tld[bench_pat_rnd() % 6]);
+}
+
+static void bench_pat_str_smp(struct sample *smp, char *buf, int len)
+{
+	smp->data.type = SMP_T_STR;
+	smp->data.u.str.area = buf;
+	smp->data.u.str.data = len;
+	smp->data.u.str.size = len + 1;
+}
+
+/* exact host names */
+static void bench_pat_str_pat(char *buf, int i)
+{
+	bench_pat_host(buf, 2 + bench_pat_rnd() % 3);
+}
+
+/* half of the samples are host names from the list */
+static void bench_pat_str_lookup(struct sample *smp, char *buf, int i)
+{
+	int len = bench_pat_host(buf, 2 + bench_pat_rnd() % 3);
+
+	bench_pat_str_smp(smp, buf, len);
+}
+
+/* IPv4 networks of 8 to 32 bits */
+static void bench_pat_ip_pat(char *buf, int i)
+{
+	unsigned int ip = bench_pat_rnd();
+
+	sprintf(buf, "%u.%u.%u.%u/%u", ip >> 24, (ip >> 16) & 255, (ip >> 8) & 255, ip & 255,
+	        8 + bench_pat_rnd() % 25);
+}
+
+static void bench_pat_ip_lookup(struct sample *smp, char *buf, int i)
+{
+	smp->data.type = SMP_T_IPV4;
+	smp->data.u.ipv4.s_addr = bench_pat_rnd();
+}
+
+/* words looked up in URIs, a few of which end with two words, and a few paths */
+static void bench_pat_word_pat(char *buf, int i)
+{
+	if (i % 8 == 0)
+		sprintf(buf, "/api/v1/users/%u/", i * 100);
+	else
+		sprintf(buf, "%s%u", bench_pat_words[i % BENCH_PAT_WORDS], i / (unsigned int)BENCH_PAT_WORDS);
+}
+
+static void bench_pat_uri_lookup(struct sample *smp, char *buf, int i)
+{
+	int len;
+
+	len = sprintf(buf, "/api/v1/users/%u/search?q=%u&page=%u",
+	              bench_pat_rnd() % 1000 * 100, bench_pat_rnd() % 100000, bench_pat_rnd() % 100);
+	if (i % 16 == 0)
+		len += sprintf(buf + len, "&x=%s+%s%u", bench_pat_words[bench_pat_rnd() % BENCH_PAT_WORDS],
+		               bench_pat_words[bench_pat_rnd() % BENCH_PAT_WORDS], bench_pat_rnd() % 40);
+	bench_pat_str_smp(smp, buf, len);
+}
+
+/* regexes looking like WAF rules */
+static void bench_pat_reg_pat(char *buf, int i)
+{
+	sprintf(buf, "%s[^a-z]+%s[0-9]*$", bench_pat_words[bench_pat_rnd() % BENCH_PAT_WORDS],
+	        bench_pat_words[bench_pat_rnd() % BENCH_PAT_WORDS]);
+}
+
+/* host names of which half are subdomains of one from the list */
+static void bench_pat_dom_lookup(struct sample *smp, char *buf, int i)
+{
+	int len = sprintf(buf, "www.");
+
+	len += bench_pat_host(buf + len, 2 + bench_pat_rnd() % 3);
+	bench_pat_str_smp(smp, buf, len);
+}
+
+static struct bench_pat_list bench_pat_str = {
+	.match = PAT_MATCH_STR, .count = 10000,
+	.make_pat = bench_pat_str_pat, .make_smp = bench_pat_str_lookup,
+};
+static struct bench_pat_list bench_pat_ip = {
+	.match = PAT_MATCH_IP, .count = 10000,
+	.make_pat = bench_pat_ip_pat, .make_smp = bench_pat_ip_lookup,
+};
+static struct bench_pat_list bench_pat_sub = {
+	.match = PAT_MATCH_SUB, .count = 1000,
+	.make_pat = bench_pat_word_pat, .make_smp = bench_pat_uri_lookup,
+};
+static struct bench_pat_list bench_pat_beg = {
+	.match = PAT_MATCH_BEG, .count = 1000,
+	.make_pat = bench_pat_word_pat, .make_smp = bench_pat_uri_lookup,
+};
+static struct bench_pat_list bench_pat_end = {
+	.match = PAT_MATCH_END, .count = 1000,
+	.make_pat = bench_pat_word_pat, .make_smp = bench_pat_uri_lookup,
+};
+static struct bench_pat_list bench_pat_reg = {
+	.match = PAT_MATCH_REG, .count = 300,
+	.make_pat = bench_pat_reg_pat, .make_smp = bench_pat_uri_lookup,
+};
+static struct bench_pat_list bench_pat_dom = {
+	.match = PAT_MATCH_DOM, .count = 10000,
+	.make_pat = bench_pat_str_pat, .make_smp = bench_pat_dom_lookup,
+};
+
+/* Builds list <l> and its samples if not done yet. Half of the string samples
+ * looked up in exact or domain lists are patterns of the list. Returns 0 on
+ * failure.
+ */
+static int bench_pat_setup(struct bench_pat_list *l)
+{
+	char name[32], pat[BENCH_PAT_LEN], *err = NULL;
+	struct pat_ref *ref;
+	int i;
+
+	if (l->ready)
+		return l->ready > 0;
+
+	l->ready = -1;
+	bench_pat_seed = 2463534242U;
+	pattern_init_head(&l->head);
+	l->head.parse       = pat_parse_fcts[l->match];
+	l->head.index       = pat_index_fcts[l->match];
+	l->head.match       = pat_match_fcts[l->match];
+	l->head.delete      = pat_delete_fcts[l->match];
+	l->head.prune       = pat_prune_fcts[l->match];
+	l->head.expect_type = pat_match_types[l->match];
+
+	snprintf(name, sizeof(name), "bench-%d", l->match);
+	ref = pat_ref_new(name, name, PAT_REF_ACL);
+	if (!ref || !pattern_new_expr(&l->head, ref, PAT_MF_NO_DNS, &err, NULL))
+		goto fail;
+
+	for (i = 0; i < l->count; i++) {
+		l->make_pat(pat, i);
+		if (i < BENCH_PAT_SMP / 2 && (l->match == PAT_MATCH_STR || l->match == PAT_MATCH_DOM))
+			strcpy(l->buf[i * 2], pat);
+		if (!pat_ref_add(ref, pat, NULL, &err))
+			goto fail;
+	}
+
+	for (i = 0; i < BENCH_PAT_SMP; i++) {
+		if (*l->buf[i])
+			bench_pat_str_smp(&l->smp[i], l->buf[i], strlen(l->buf[i]));
+		else
+			l->make_smp(&l->smp[i], l->buf[i], i);
+	}
+	l->ready = 1;
+	return 1;
+ fail:
+	fprintf(stderr, "bench: cannot build the list of patterns: %s\n", err ? err : "out of memory");
+	free(err);
+	return 0;
+}
+
+/* Looks up the samples of list <l> in turn, with the index options of
+ * <options> (GTUNE_PATTERN_*) enabled.
+ */
+static void bench_pat_run(struct bench_run *run, struct bench_pat_list *l, unsigned int options)
+{
+	unsigned int saved = global.tune.options;
+	unsigned long long i, found = 0;
+
+	if (!bench_pat_setup(l)) {
+		run->failed = 1;
+		return;
+	}
+
+	global.tune.options &= ~(GTUNE_PATTERN_IPTRIE | GTUNE_PATTERN_RXSET);
+	global.tune.options |= options;
+
+	/* builds the indexes */
+	pattern_exec_match(&l->head, &l->smp[0], 0);
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++)
+		found += !!pattern_exec_match(&l->head, &l->smp[i & (BENCH_PAT_SMP - 1)], 0);
+	bench_stop(run);
+
+	/* all lists must match some of the samples but not all of them */
+	if (run->iters >= BENCH_PAT_SMP && (!found || found == run->iters))
+		run->failed = 1;
+	bench_sink += found;
+	global.tune.options = saved;
+}
+
+static void bench_pat_str_tree(struct bench_run *run)  { bench_pat_run(run, &bench_pat_str, 0); }
+static void bench_pat_ip_tree(struct bench_run *run)   { bench_pat_run(run, &bench_pat_ip, 0); }
+static void bench_pat_ip_trie(struct bench_run *run)   { bench_pat_run(run, &bench_pat_ip, GTUNE_PATTERN_IPTRIE); }
+static void bench_pat_sub_acm(struct bench_run *run)   { bench_pat_run(run, &bench_pat_sub, 0); }
+static void bench_pat_beg_acm(struct bench_run *run)   { bench_pat_run(run, &bench_pat_beg, 0); }
+static void bench_pat_end_acm(struct bench_run *run)   { bench_pat_run(run, &bench_pat_end, 0); }
+static void bench_pat_reg_list(struct bench_run *run)  { bench_pat_run(run, &bench_pat_reg, 0); }
+static void bench_pat_reg_rxset(struct bench_run *run) { bench_pat_run(run, &bench_pat_reg, GTUNE_PATTERN_RXSET); }
+static void bench_pat_dom_trie(struct bench_run *run)  { bench_pat_run(run, &bench_pat_dom, 0); }
+
+REGISTER_BENCH("pattern.str.tree", bench_pat_str_tree);
+REGISTER_BENCH("pattern.ip.tree", bench_pat_ip_tree);
+REGISTER_BENCH("pattern.ip.trie", bench_pat_ip_trie);
+REGISTER_BENCH("pattern.sub.acm", bench_pat_sub_acm);
+REGISTER_BENCH("pattern.beg.acm", bench_pat_beg_acm);
+REGISTER_BENCH("pattern.end.acm", bench_pat_end_acm);
+REGISTER_BENCH("pattern.reg.list", bench_pat_reg_list);
+REGISTER_BENCH("pattern.reg.prefilter", bench_pat_reg_rxset);
+REGISTER_BENCH("pattern.dom.trie", bench_pat_dom_trie);
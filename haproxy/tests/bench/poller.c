@@ -0,0 +1,358 @@
+/*
+ * Micro-benchmarks of the event loops used by the "epoll" and "io_uring"
+ * pollers.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * A client thread keeps BENCH_PL_CONNS loopback TCP connections busy with
+ * small requests, and the measured loop answers them. An operation is one
+ * request. The loops mimic what the pollers do for level-triggered FDs : epoll
+ * registers each FD once and calls epoll_wait() on each loop, while io_uring
+ * uses one-shot POLL_ADD requests which are re-armed after each event and
+ * submitted with the wait in a single io_uring_enter(). In both cases each
+ * request costs one recv() and one send(). The syscalls made by the measured
+ * loop are counted and reported per request. These loops are models of the
+ * pollers, not the pollers themselves, which need the FD table and threads.
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#ifdef USE_IOURING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+
+#if defined(USE_EPOLL) || defined(USE_IOURING)
+
+#ifndef POLLRDHUP
+/* POLLRDHUP was defined late in libc, and it appeared in kernel 2.6.17 */
+#define POLLRDHUP 0x2000
+#endif
+
+#define BENCH_PL_CONNS   64    /* number of connections */
+#define BENCH_PL_MSGLEN  64    /* size of requests and responses */
+
+/* the connections of one loop, and the client's state */
+struct bench_pl_ctx {
+	int cli_fd[BENCH_PL_CONNS];
+	int srv_fd[BENCH_PL_CONNS];
+	unsigned long long reqs;     /* requests the client must send */
+};
+
+/* Creates the loopback connections of <ctx>. Returns 0 on failure. */
+static int bench_pl_conns(struct bench_pl_ctx *ctx)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int one = 1;
+	int lfd, i;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0)
+		return 0;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0 || listen(lfd, BENCH_PL_CONNS) < 0 ||
+	    getsockname(lfd, (struct sockaddr *)&sin, &len) < 0)
+		goto fail;
+
+	for (i = 0; i < BENCH_PL_CONNS; i++) {
+		ctx->cli_fd[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if (ctx->cli_fd[i] < 0 ||
+		    connect(ctx->cli_fd[i], (struct sockaddr *)&sin, sizeof(sin)) < 0)
+			goto fail;
+		ctx->srv_fd[i] = accept(lfd, NULL, NULL);
+		if (ctx->srv_fd[i] < 0)
+			goto fail;
+		setsockopt(ctx->cli_fd[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		setsockopt(ctx->srv_fd[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	close(lfd);
+	return 1;
+ fail:
+	close(lfd);
+	return 0;
+}
+
+/* Sends one request per connection then waits for all responses until
+ * <ctx->reqs> requests were sent. On error, the connections are shut down so
+ * that the measured loop stops.
+ */
+static void *bench_pl_client(void *arg)
+{
+	struct bench_pl_ctx *ctx = arg;
+	char buf[BENCH_PL_MSGLEN];
+	unsigned long long sent = 0;
+	int i, n;
+
+	memset(buf, 'x', sizeof(buf));
+	while (sent < ctx->reqs) {
+		n = ctx->reqs - sent < BENCH_PL_CONNS ? ctx->reqs - sent : BENCH_PL_CONNS;
+		for (i = 0; i < n; i++)
+			if (send(ctx->cli_fd[i], buf, sizeof(buf), 0) != sizeof(buf))
+				goto fail;
+		for (i = 0; i < n; i++)
+			if (recv(ctx->cli_fd[i], buf, sizeof(buf), MSG_WAITALL) != sizeof(buf))
+				goto fail;
+		sent += n;
+	}
+	return NULL;
+ fail:
+	for (i = 0; i < BENCH_PL_CONNS; i++)
+		shutdown(ctx->cli_fd[i], SHUT_RDWR);
+	return NULL;
+}
+
+/* Answers the data pending on <fd>, adding the number of syscalls to <run>.
+ * Returns the number of bytes answered, 0 if none was pending or <0 once the
+ * client is gone.
+ */
+static int bench_pl_serve(struct bench_run *run, int fd)
+{
+	char buf[BENCH_PL_MSGLEN];
+	ssize_t ret;
+
+	run->syscalls++;
+	ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (ret == 0)
+		return -1;
+	if (ret < 0)
+		return 0;
+	run->syscalls++;
+	if (send(fd, buf, ret, MSG_DONTWAIT) != ret)
+		return -1;
+	return ret;
+}
+
+/* Starts the client for <run->iters> requests on <ctx> in <thr>. Returns 0 on
+ * failure.
+ */
+static int bench_pl_start(struct bench_run *run, struct bench_pl_ctx *ctx, pthread_t *thr)
+{
+	ctx->reqs = run->iters;
+	return pthread_create(thr, NULL, bench_pl_client, ctx) == 0;
+}
+
+/* Waits for the client of <ctx> in <thr> to leave. If <run> failed, the
+ * connections are shut down first so that it doesn't wait for responses.
+ */
+static void bench_pl_stop(struct bench_run *run, struct bench_pl_ctx *ctx, pthread_t thr)
+{
+	int i;
+
+	if (run->failed)
+		for (i = 0; i < BENCH_PL_CONNS; i++)
+			shutdown(ctx->srv_fd[i], SHUT_RDWR);
+	pthread_join(thr, NULL);
+}
+
+#endif /* USE_EPOLL || USE_IOURING */
+
+#ifdef USE_EPOLL
+
+static struct bench_pl_ctx bench_pl_epoll_ctx;
+static int bench_pl_epoll_fd = -1;
+
+/* Creates the connections and registers them once. Returns 0 on failure. */
+static int bench_pl_epoll_setup()
+{
+	struct bench_pl_ctx *ctx = &bench_pl_epoll_ctx;
+	struct epoll_event ev;
+	static int ready;
+	int i;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	if (!bench_pl_conns(ctx))
+		return 0;
+	bench_pl_epoll_fd = epoll_create(BENCH_PL_CONNS);
+	if (bench_pl_epoll_fd < 0)
+		return 0;
+	for (i = 0; i < BENCH_PL_CONNS; i++) {
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = ctx->srv_fd[i];
+		if (epoll_ctl(bench_pl_epoll_fd, EPOLL_CTL_ADD, ctx->srv_fd[i], &ev) < 0)
+			return 0;
+	}
+	ready = 1;
+	return 1;
+}
+
+static void bench_pl_epoll(struct bench_run *run)
+{
+	struct epoll_event ev[BENCH_PL_CONNS];
+	unsigned long long left;
+	pthread_t thr;
+	int i, n, ret;
+
+	if (!bench_pl_epoll_setup() || !bench_pl_start(run, &bench_pl_epoll_ctx, &thr)) {
+		run->failed = 1;
+		return;
+	}
+
+	left = run->iters * BENCH_PL_MSGLEN;
+	bench_start(run);
+	while (left && !run->failed) {
+		run->syscalls++;
+		n = epoll_wait(bench_pl_epoll_fd, ev, BENCH_PL_CONNS, 1000);
+		if (n <= 0)
+			run->failed = 1;
+		for (i = 0; i < n; i++) {
+			ret = bench_pl_serve(run, ev[i].data.fd);
+			if (ret < 0)
+				run->failed = 1;
+			else
+				left -= ret;
+		}
+	}
+	bench_stop(run);
+	bench_pl_stop(run, &bench_pl_epoll_ctx, thr);
+}
+
+REGISTER_BENCH("poller.epoll.request", bench_pl_epoll);
+
+#endif /* USE_EPOLL */
+
+#ifdef USE_IOURING
+
+#define BENCH_PL_ENTRIES  (2 * BENCH_PL_CONNS)   /* ring size */
+
+static struct bench_pl_ctx bench_pl_iou_ctx;
+
+/* the mapped rings */
+static struct {
+	int fd;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	unsigned int tail;         /* next SQE to fill */
+} bench_pl_iou;
+
+/* Prepares a one-shot POLL_ADD request for <fd>, submitted with the next wait */
+static void bench_pl_iou_arm(int fd)
+{
+	unsigned int idx = bench_pl_iou.tail & *bench_pl_iou.sq_mask;
+	struct io_uring_sqe *sqe = &bench_pl_iou.sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = POLLIN | POLLRDHUP;
+	sqe->user_data = fd;
+	bench_pl_iou.sq_array[idx] = idx;
+	bench_pl_iou.tail++;
+}
+
+/* Creates the connections and the ring, and arms all connections once.
+ * Returns 0 on failure.
+ */
+static int bench_pl_iou_setup()
+{
+	struct bench_pl_ctx *ctx = &bench_pl_iou_ctx;
+	struct io_uring_params p;
+	static int ready;
+	void *sq, *cq, *sqes;
+	int i;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	if (!bench_pl_conns(ctx))
+		return 0;
+
+	memset(&p, 0, sizeof(p));
+	bench_pl_iou.fd = syscall(__NR_io_uring_setup, BENCH_PL_ENTRIES, &p);
+	if (bench_pl_iou.fd < 0)
+		return 0;
+	sq = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned int), PROT_READ | PROT_WRITE,
+	          MAP_SHARED | MAP_POPULATE, bench_pl_iou.fd, IORING_OFF_SQ_RING);
+	cq = mmap(NULL, p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe), PROT_READ | PROT_WRITE,
+	          MAP_SHARED | MAP_POPULATE, bench_pl_iou.fd, IORING_OFF_CQ_RING);
+	sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+	            MAP_SHARED | MAP_POPULATE, bench_pl_iou.fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+		return 0;
+
+	bench_pl_iou.sqes     = sqes;
+	bench_pl_iou.sq_head  = sq + p.sq_off.head;
+	bench_pl_iou.sq_tail  = sq + p.sq_off.tail;
+	bench_pl_iou.sq_mask  = sq + p.sq_off.ring_mask;
+	bench_pl_iou.sq_array = sq + p.sq_off.array;
+	bench_pl_iou.cq_head  = cq + p.cq_off.head;
+	bench_pl_iou.cq_tail  = cq + p.cq_off.tail;
+	bench_pl_iou.cq_mask  = cq + p.cq_off.ring_mask;
+	bench_pl_iou.cqes     = cq + p.cq_off.cqes;
+	bench_pl_iou.tail     = *bench_pl_iou.sq_tail;
+
+	for (i = 0; i < BENCH_PL_CONNS; i++)
+		bench_pl_iou_arm(ctx->srv_fd[i]);
+	ready = 1;
+	return 1;
+}
+
+static void bench_pl_iouring(struct bench_run *run)
+{
+	unsigned long long left;
+	unsigned int head, tail;
+	pthread_t thr;
+	int fd, ret;
+
+	if (!bench_pl_iou_setup() || !bench_pl_start(run, &bench_pl_iou_ctx, &thr)) {
+		run->failed = 1;
+		return;
+	}
+
+	left = run->iters * BENCH_PL_MSGLEN;
+	bench_start(run);
+	while (left && !run->failed) {
+		__atomic_store_n(bench_pl_iou.sq_tail, bench_pl_iou.tail, __ATOMIC_RELEASE);
+		run->syscalls++;
+		if (syscall(__NR_io_uring_enter, bench_pl_iou.fd, bench_pl_iou.tail - *bench_pl_iou.sq_head,
+		            1, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+			run->failed = 1;
+
+		head = *bench_pl_iou.cq_head;
+		tail = __atomic_load_n(bench_pl_iou.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			fd = bench_pl_iou.cqes[head & *bench_pl_iou.cq_mask].user_data;
+			ret = bench_pl_serve(run, fd);
+			if (ret < 0) {
+				run->failed = 1;
+				continue;
+			}
+			left -= ret;
+			bench_pl_iou_arm(fd);
+		}
+		__atomic_store_n(bench_pl_iou.cq_head, head, __ATOMIC_RELEASE);
+	}
+	bench_stop(run);
+	bench_pl_stop(run, &bench_pl_iou_ctx, thr);
+}
+
+REGISTER_BENCH("poller.io_uring.request", bench_pl_iouring);
+
+#endif /* USE_IOURING */
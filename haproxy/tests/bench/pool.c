@@ -0,0 +1,76 @@
+/*
+ * Micro-benchmarks of the memory pools.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/pool.h>
+
+#define BENCH_POOL_BATCH 64
+
+static struct pool_head *bench_pool;
+
+/* creates the pool, of the size of a small struct, once */
+static int bench_pool_setup()
+{
+	if (!bench_pool)
+		bench_pool = create_pool("bench", 256, MEM_F_SHARED);
+	return bench_pool != NULL;
+}
+
+/* allocates an object and releases it immediately, hitting the cache */
+static void bench_pool_alloc_free(struct bench_run *run)
+{
+	unsigned long long i;
+	void *ptr;
+
+	if (!bench_pool_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		ptr = pool_alloc(bench_pool);
+		if (!ptr) {
+			run->failed = 1;
+			break;
+		}
+		pool_free(bench_pool, ptr);
+	}
+	bench_stop(run);
+}
+
+/* allocates a batch of objects then releases them, one op per object */
+static void bench_pool_batch(struct bench_run *run)
+{
+	void *ptr[BENCH_POOL_BATCH];
+	unsigned long long i;
+	int j;
+
+	if (!bench_pool_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i += BENCH_POOL_BATCH) {
+		for (j = 0; j < BENCH_POOL_BATCH; j++) {
+			ptr[j] = pool_alloc(bench_pool);
+			if (!ptr[j])
+				run->failed = 1;
+		}
+		for (j = 0; j < BENCH_POOL_BATCH; j++)
+			pool_free(bench_pool, ptr[j]);
+	}
+	bench_stop(run);
+}
+
+REGISTER_BENCH("pool.alloc_free", bench_pool_alloc_free);
+REGISTER_BENCH("pool.alloc_free.batch64", bench_pool_batch);
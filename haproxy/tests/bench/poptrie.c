@@ -0,0 +1,165 @@
+/*
+ * Micro-benchmarks of the compressed trie used to index IP patterns.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * BENCH_PT_PREFIXES random IPv4 prefixes, with lengths between /8 and /32
+ * biased towards /16-/24 as found in GeoIP and reputation lists, are inserted
+ * into an ebmb prefix tree made of pattern_tree nodes as "-m ip" does, and the
+ * trie is built from this tree as when "tune.pattern.ip-trie" is enabled.
+ * Half of the addresses looked up belong to one of the prefixes. The tree and
+ * the trie must return the same node for all of them. The build benchmark
+ * reports the time per prefix.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <import/ebmbtree.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/pattern-t.h>
+#include <haproxy/poptrie.h>
+
+#define BENCH_PT_PREFIXES  100000   /* number of prefixes */
+#define BENCH_PT_ADDRS     65536    /* number of addresses looked up, power of 2 */
+
+static struct eb_root bench_pt_tree = EB_ROOT;
+static struct poptrie *bench_pt;
+static unsigned int bench_pt_addr[BENCH_PT_ADDRS];
+
+/* Builds a trie from the tree. Returns NULL on failure. */
+static struct poptrie *bench_pt_build()
+{
+	struct ebmb_node *eb;
+	struct poptrie *pt;
+
+	pt = poptrie_new(32);
+	if (!pt)
+		return NULL;
+	for (eb = ebmb_first(&bench_pt_tree); eb; eb = ebmb_next(eb))
+		if (!poptrie_add(pt, eb->key, eb->node.pfx, eb))
+			goto fail;
+	if (!poptrie_compile(pt))
+		goto fail;
+	return pt;
+ fail:
+	poptrie_free(pt);
+	return NULL;
+}
+
+/* Builds the tree, the trie and the addresses once, and checks the lookups.
+ * Returns 0 on failure.
+ */
+static int bench_pt_setup()
+{
+	static int ready;
+	struct pattern_tree *node;
+	unsigned int x = 2463534242U;
+	static unsigned int pfx[BENCH_PT_PREFIXES];
+	int i, len;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	for (i = 0; i < BENCH_PT_PREFIXES; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		len = (x & 3) ? 16 + x % 9 : 8 + x % 25;
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		pfx[i] = htonl(x & (~0U << (32 - len)));
+
+		node = calloc(1, sizeof(*node) + 4);
+		if (!node)
+			return 0;
+		memcpy(node->node.key, &pfx[i], 4);
+		node->node.node.pfx = len;
+		ebmb_insert_prefix(&bench_pt_tree, &node->node, 4);
+	}
+
+	for (i = 0; i < BENCH_PT_ADDRS; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		bench_pt_addr[i] = x;
+		if (i & 1)
+			bench_pt_addr[i] = htonl((ntohl(pfx[x % BENCH_PT_PREFIXES]) & 0xffffff00) | (x & 0xff));
+	}
+
+	bench_pt = bench_pt_build();
+	if (!bench_pt)
+		return 0;
+
+	for (i = 0; i < BENCH_PT_ADDRS; i++)
+		if (ebmb_lookup_longest(&bench_pt_tree, &bench_pt_addr[i]) !=
+		    poptrie_lookup4(bench_pt, &bench_pt_addr[i]))
+			return 0;
+
+	ready = 1;
+	return 1;
+}
+
+static void bench_pt_lookup4(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+
+	if (!bench_pt_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++)
+		found += !!poptrie_lookup4(bench_pt, &bench_pt_addr[i & (BENCH_PT_ADDRS - 1)]);
+	bench_stop(run);
+	bench_sink += found;
+}
+
+/* the ebmb tree which the trie replaces */
+static void bench_pt_lookup4_ebmb(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+
+	if (!bench_pt_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++)
+		found += !!ebmb_lookup_longest(&bench_pt_tree, &bench_pt_addr[i & (BENCH_PT_ADDRS - 1)]);
+	bench_stop(run);
+	bench_sink += found;
+}
+
+/* an operation is the insertion of one prefix into a trie being built */
+static void bench_pt_build_all(struct bench_run *run)
+{
+	unsigned long long done;
+	struct poptrie *pt;
+
+	if (!bench_pt_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	for (done = 0; done < run->iters; done += BENCH_PT_PREFIXES) {
+		bench_start(run);
+		pt = bench_pt_build();
+		bench_stop(run);
+		if (!pt) {
+			run->failed = 1;
+			return;
+		}
+		bench_sink += poptrie_mem(pt);
+		poptrie_free(pt);
+	}
+	run->elapsed = run->elapsed * run->iters / done;
+}
+
+REGISTER_BENCH("poptrie.lookup4", bench_pt_lookup4);
+REGISTER_BENCH("poptrie.lookup4.ebmb", bench_pt_lookup4_ebmb);
+REGISTER_BENCH("poptrie.build", bench_pt_build_all);
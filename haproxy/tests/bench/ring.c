@@ -0,0 +1,45 @@
+/*
+ * Micro-benchmarks of the ring buffers.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/applet-t.h>
+#include <haproxy/bench.h>
+#include <haproxy/ring.h>
+
+static struct ring *bench_ring;
+
+/* writes a log-like message with a prefix into a 1MB ring with no reader */
+static void bench_ring_write(struct bench_run *run)
+{
+	static const struct ist pfx[] = { IST("<134>Jul 14 12:00:00 haproxy[1234]: ") };
+	static const struct ist msg[] = {
+		IST("127.0.0.1:51234 [14/Jul/2021:12:00:00.000] fe be/srv1 0/0/1/2/3 200 1234 - - ---- 1/1/0/0/0 0/0 \"GET / HTTP/1.1\""),
+	};
+	unsigned long long i;
+	ssize_t ret;
+
+	if (!bench_ring)
+		bench_ring = ring_new(1024 * 1024);
+	if (!bench_ring) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		ret = ring_write(bench_ring, ~0, pfx, 1, msg, 1);
+		if (ret <= 0)
+			run->failed = 1;
+	}
+	bench_stop(run);
+	run->bytes = pfx[0].len + msg[0].len;
+}
+
+REGISTER_BENCH("ring.write", bench_ring_write);
@@ -0,0 +1,236 @@
+/*
+ * Micro-benchmarks of the literal prefilter used for "-m reg" lists.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The prefilter is first checked with random regexes built from a small
+ * vocabulary of literals, escapes, classes, groups, quantifiers and
+ * alternatives, in the POSIX extended syntax, case-sensitive or not, run
+ * against random strings : every regex which matches must be a candidate.
+ * Then BENCH_RX_COUNT regexes looking like WAF rules are run against strings
+ * looking like URIs, of which a few contain attacks, with and without the
+ * prefilter.
+ */
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/intops.h>
+#include <haproxy/rxset.h>
+
+#define BENCH_RX_COUNT  3000   /* number of regexes */
+#define BENCH_RX_SMP    1024   /* number of strings looked up, power of 2 */
+
+static regex_t bench_rx[BENCH_RX_COUNT];
+static char *bench_rx_smp[BENCH_RX_SMP];
+static struct rxset *bench_rs;
+static unsigned long *bench_rx_area;
+static unsigned int bench_rx_seed = 2463534242U;
+
+static unsigned int bench_rx_rnd()
+{
+	bench_rx_seed ^= bench_rx_seed << 13;
+	bench_rx_seed ^= bench_rx_seed >> 17;
+	bench_rx_seed ^= bench_rx_seed << 5;
+	return bench_rx_seed;
+}
+
+static const char *bench_rx_pick(const char **tab)
+{
+	int n;
+
+	for (n = 0; tab[n]; n++)
+		;
+	return tab[bench_rx_rnd() % n];
+}
+
+static void bench_rx_make_regex(char *buf)
+{
+	static const char *ere[] = {
+		"abc", "Abc", "bca", "cab", "a", "b", "c", ".", "\\.", "[ab]", "[^c]", "[[:alpha:]]",
+		"x*", "ab?", "ab+", "c{2}", "c{0,2}", "(ab|ca)", "(?:abc)", "(b)+", "\\d", "\\w",
+		"^", "$", "|", "ab{1,}", "abc*", "\\|", "\\(", "(?i)", "{", NULL
+	};
+	int i, n = 1 + bench_rx_rnd() % 6;
+
+	*buf = 0;
+	for (i = 0; i < n; i++)
+		strcat(buf, bench_rx_pick(ere));
+}
+
+static void bench_rx_make_str(char *buf)
+{
+	static const char *words[] = {
+		"abc", "ABC", "bca", "cab", "a", "b", "c", "x", "cc", "1", ".", "|", "(", "ab", "?", "+", NULL
+	};
+	int i, n = bench_rx_rnd() % 8;
+
+	*buf = 0;
+	for (i = 0; i < n; i++)
+		strcat(buf, bench_rx_pick(words));
+}
+
+/* Checks that no regex which matches is rejected by the prefilter. Returns 0
+ * if one is or on failure.
+ */
+static int bench_rx_check(int icase)
+{
+	regex_t rx[200];
+	struct rxset *rs;
+	unsigned long *area = NULL, *cand;
+	char buf[256];
+	int i, j, nb = 0, ret = 0;
+
+	rs = rxset_new(icase ? RXSET_F_ICASE : 0);
+	if (!rs)
+		return 0;
+	while (nb < 200) {
+		bench_rx_make_regex(buf);
+		if (regcomp(&rx[nb], buf, REG_EXTENDED | (icase ? REG_ICASE : 0) | REG_NOSUB) != 0)
+			continue;
+		nb++;
+		if (!rxset_add(rs, buf, NULL))
+			goto out;
+	}
+	if (!rxset_compile(rs))
+		goto out;
+	area = malloc(rxset_area_size(rs));
+	if (!area)
+		goto out;
+
+	for (i = 0; i < 100000; i++) {
+		bench_rx_make_str(buf);
+		cand = rxset_candidates(rs, buf, strlen(buf), area);
+		for (j = 0; j < nb; j++) {
+			if (!ha_bit_test(j, (long *)cand) && regexec(&rx[j], buf, 0, NULL, 0) == 0) {
+				fprintf(stderr, "bench: rxset rejected regex %d for '%s' (icase=%d)\n", j, buf, icase);
+				goto out;
+			}
+		}
+	}
+	ret = 1;
+ out:
+	for (j = 0; j < nb; j++)
+		regfree(&rx[j]);
+	rxset_free(rs);
+	free(area);
+	return ret;
+}
+
+/* Checks the prefilter then builds the regexes and the strings once. Returns
+ * 0 on failure.
+ */
+static int bench_rx_setup()
+{
+	static const char *kw[] = {
+		"select", "union", "insert", "delete", "script", "onerror", "onload", "alert",
+		"passwd", "shadow", "eval", "exec", "system", "concat", "sleep", "benchmark",
+		"document", "cookie", "iframe", "javascript", "vbscript", "expression", "base64",
+		"waitfor", "xp_cmdshell", "information_schema", "load_file", "outfile", NULL
+	};
+	static const char *paths[] = {
+		"/index.html", "/api/v1/users", "/static/app.js", "/search", "/login", "/img/logo.png", NULL
+	};
+	static int ready;
+	char buf[256];
+	int i;
+
+	if (ready)
+		return ready > 0;
+
+	ready = -1;
+	if (!bench_rx_check(0) || !bench_rx_check(1))
+		return 0;
+
+	bench_rs = rxset_new(RXSET_F_ICASE);
+	if (!bench_rs)
+		return 0;
+	for (i = 0; i < BENCH_RX_COUNT; i++) {
+		/* two keywords separated by anything, with a random suffix */
+		snprintf(buf, sizeof(buf), "%s[^a-z]+%s.*%c%u", bench_rx_pick(kw), bench_rx_pick(kw),
+		         'a' + bench_rx_rnd() % 26, bench_rx_rnd() % 1000);
+		if (regcomp(&bench_rx[i], buf, REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0 ||
+		    !rxset_add(bench_rs, buf, NULL))
+			return 0;
+	}
+	if (!rxset_compile(bench_rs))
+		return 0;
+	bench_rx_area = malloc(rxset_area_size(bench_rs));
+	if (!bench_rx_area)
+		return 0;
+
+	for (i = 0; i < BENCH_RX_SMP; i++) {
+		snprintf(buf, sizeof(buf), "%s?q=%u&id=%u%s%s", bench_rx_pick(paths),
+		         bench_rx_rnd() % 100000, bench_rx_rnd() % 1000,
+		         (i % 100) ? "" : "&x=1+UNION+SELECT+", (i % 100) ? "" : bench_rx_pick(kw));
+		bench_rx_smp[i] = strdup(buf);
+		if (!bench_rx_smp[i])
+			return 0;
+	}
+
+	ready = 1;
+	return 1;
+}
+
+static void bench_rx_match(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+	unsigned long *cand;
+	const char *smp;
+	int j;
+
+	if (!bench_rx_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		smp = bench_rx_smp[i & (BENCH_RX_SMP - 1)];
+		cand = rxset_candidates(bench_rs, smp, strlen(smp), bench_rx_area);
+		for (j = 0; j < BENCH_RX_COUNT; j++) {
+			if (ha_bit_test(j, (long *)cand) && regexec(&bench_rx[j], smp, 0, NULL, 0) == 0) {
+				found++;
+				break;
+			}
+		}
+	}
+	bench_stop(run);
+	bench_sink += found;
+}
+
+/* the list walk which the prefilter avoids */
+static void bench_rx_match_list(struct bench_run *run)
+{
+	unsigned long long i, found = 0;
+	const char *smp;
+	int j;
+
+	if (!bench_rx_setup()) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		smp = bench_rx_smp[i & (BENCH_RX_SMP - 1)];
+		for (j = 0; j < BENCH_RX_COUNT; j++) {
+			if (regexec(&bench_rx[j], smp, 0, NULL, 0) == 0) {
+				found++;
+				break;
+			}
+		}
+	}
+	bench_stop(run);
+	bench_sink += found;
+}
+
+REGISTER_BENCH("rxset.match", bench_rx_match);
+REGISTER_BENCH("rxset.match.list", bench_rx_match_list);
@@ -0,0 +1,259 @@
+/*
+ * Micro-benchmarks of the stick-tables.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The tables are IPv4 tables storing http_req_cnt, filled once with all the
+ * keys looked up so that no entry is allocated nor purged while measuring.
+ * An operation is what a "track-sc" rule does : stktable_get_entry(), the
+ * counter's update under the entry's lock, then stktable_touch_local(). The
+ * threaded variants split the operations between BENCH_STK_THREADS threads
+ * to measure the contention on the shards' locks, and report the wall clock
+ * time per operation.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/stick_table.h>
+
+#define BENCH_STK_KEYS     65536   /* number of keys in each table, power of 2 */
+#define BENCH_STK_THREADS  4       /* number of threads of the threaded variants */
+
+struct bench_stk_table {
+	unsigned int nb_shards;
+	struct stktable t;
+	int ready;
+};
+
+struct bench_stk_thread {
+	pthread_t thr;
+	struct stktable *t;
+	unsigned long long first;
+	unsigned long long iters;
+	unsigned long long found;
+};
+
+static struct bench_stk_table bench_stk_1shard   = { .nb_shards = 1 };
+static struct bench_stk_table bench_stk_16shards = { .nb_shards = 16 };
+static unsigned int bench_stk_addr[BENCH_STK_KEYS];
+static pthread_barrier_t bench_stk_barrier;
+
+/* Returns the lookup key of the <i>th address, which must remain valid */
+static struct stktable_key bench_stk_key(unsigned long long i)
+{
+	struct stktable_key key;
+
+	key.key = &bench_stk_addr[(i * 40503) & (BENCH_STK_KEYS - 1)];
+	key.key_len = sizeof(bench_stk_addr[0]);
+	return key;
+}
+
+/* Builds table <b> and stores all the keys into it if not done yet. Returns
+ * 0 on failure.
+ */
+static int bench_stk_setup(struct bench_stk_table *b)
+{
+	struct stktable_key key;
+	struct stksess *ts;
+	unsigned int x = 2463534242U;
+	int i;
+
+	if (b->ready)
+		return b->ready > 0;
+
+	b->ready = -1;
+	for (i = 0; i < BENCH_STK_KEYS; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		bench_stk_addr[i] = x;
+	}
+
+	b->t.id = "bench";
+	b->t.type = SMP_T_IPV4;
+	b->t.key_size = sizeof(bench_stk_addr[0]);
+	b->t.size = BENCH_STK_KEYS * 2;
+	b->t.nb_shards = b->nb_shards;
+	if (stktable_alloc_data_type(&b->t, STKTABLE_DT_HTTP_REQ_CNT, NULL) != PE_NONE ||
+	    !stktable_init(&b->t))
+		return 0;
+
+	for (i = 0; i < BENCH_STK_KEYS; i++) {
+		key = bench_stk_key(i);
+		ts = stktable_get_entry(&b->t, &key);
+		if (!ts)
+			return 0;
+		stktable_touch_local(&b->t, ts, 1);
+	}
+	b->ready = 1;
+	return 1;
+}
+
+/* Tracks the <iters> keys following the <first>th one in table <t> like a
+ * "track-sc" rule. Returns the number of entries found.
+ */
+static unsigned long long bench_stk_track(struct stktable *t, unsigned long long first, unsigned long long iters)
+{
+	struct stktable_key key;
+	struct stksess *ts;
+	unsigned long long i, found = 0;
+	void *ptr;
+
+	for (i = first; i < first + iters; i++) {
+		key = bench_stk_key(i);
+		ts = stktable_get_entry(t, &key);
+		if (!ts)
+			continue;
+		ptr = stktable_data_ptr(t, ts, STKTABLE_DT_HTTP_REQ_CNT);
+		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+		stktable_data_cast(ptr, http_req_cnt)++;
+		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+		stktable_touch_local(t, ts, 1);
+		found++;
+	}
+	return found;
+}
+
+static void bench_stk_get_entry(struct bench_run *run, struct bench_stk_table *b)
+{
+	unsigned long long found;
+
+	if (!bench_stk_setup(b)) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	found = bench_stk_track(&b->t, 0, run->iters);
+	bench_stop(run);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+static void *bench_stk_thread_main(void *arg)
+{
+	struct bench_stk_thread *thr = arg;
+
+	pthread_barrier_wait(&bench_stk_barrier);
+	thr->found = bench_stk_track(thr->t, thr->first, thr->iters);
+	return NULL;
+}
+
+/* same as bench_stk_get_entry() with the operations split between threads */
+static void bench_stk_get_entry_mt(struct bench_run *run, struct bench_stk_table *b)
+{
+	struct bench_stk_thread thr[BENCH_STK_THREADS];
+	unsigned long long found = 0;
+	int i, started;
+
+	if (!bench_stk_setup(b) || pthread_barrier_init(&bench_stk_barrier, NULL, BENCH_STK_THREADS + 1) != 0) {
+		run->failed = 1;
+		return;
+	}
+
+	for (started = 0; started < BENCH_STK_THREADS; started++) {
+		thr[started].t = &b->t;
+		thr[started].first = run->iters * started / BENCH_STK_THREADS;
+		thr[started].iters = run->iters * (started + 1) / BENCH_STK_THREADS - thr[started].first;
+		thr[started].found = 0;
+		if (pthread_create(&thr[started].thr, NULL, bench_stk_thread_main, &thr[started]) != 0)
+			break;
+	}
+
+	if (started < BENCH_STK_THREADS) {
+		/* the barrier cannot be passed, the threads must be cancelled */
+		for (i = 0; i < started; i++) {
+			pthread_cancel(thr[i].thr);
+			pthread_join(thr[i].thr, NULL);
+		}
+		pthread_barrier_destroy(&bench_stk_barrier);
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	pthread_barrier_wait(&bench_stk_barrier);
+	for (i = 0; i < BENCH_STK_THREADS; i++) {
+		pthread_join(thr[i].thr, NULL);
+		found += thr[i].found;
+	}
+	bench_stop(run);
+	pthread_barrier_destroy(&bench_stk_barrier);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+/* looks the keys up for a fetch, taking and dropping a reference */
+static void bench_stk_lookup_key(struct bench_run *run)
+{
+	struct stktable *t = &bench_stk_1shard.t;
+	struct stktable_key key;
+	struct stksess *ts;
+	unsigned long long i, found = 0;
+
+	if (!bench_stk_setup(&bench_stk_1shard)) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		key = bench_stk_key(i);
+		ts = stktable_lookup_key(t, &key);
+		if (ts) {
+			found++;
+			HA_ATOMIC_SUB(&ts->ref_cnt, 1);
+		}
+	}
+	bench_stop(run);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+/* looks the keys up for a fetch, without lock nor reference */
+static void bench_stk_peek_key(struct bench_run *run)
+{
+	struct stktable *t = &bench_stk_1shard.t;
+	struct stktable_key key;
+	unsigned long long i, found = 0;
+
+	if (!bench_stk_setup(&bench_stk_1shard)) {
+		run->failed = 1;
+		return;
+	}
+
+	bench_start(run);
+	for (i = 0; i < run->iters; i++) {
+		key = bench_stk_key(i);
+		found += !!stktable_peek_key(t, &key);
+	}
+	bench_stop(run);
+
+	if (found != run->iters)
+		run->failed = 1;
+	bench_sink += found;
+}
+
+static void bench_stk_get_entry_1shard(struct bench_run *run)      { bench_stk_get_entry(run, &bench_stk_1shard); }
+static void bench_stk_get_entry_16shards(struct bench_run *run)    { bench_stk_get_entry(run, &bench_stk_16shards); }
+static void bench_stk_get_entry_mt_1shard(struct bench_run *run)   { bench_stk_get_entry_mt(run, &bench_stk_1shard); }
+static void bench_stk_get_entry_mt_16shards(struct bench_run *run) { bench_stk_get_entry_mt(run, &bench_stk_16shards); }
+
+REGISTER_BENCH("stktable.track.1shard", bench_stk_get_entry_1shard);
+REGISTER_BENCH("stktable.track.16shards", bench_stk_get_entry_16shards);
+REGISTER_BENCH("stktable.track.4thr.1shard", bench_stk_get_entry_mt_1shard);
+REGISTER_BENCH("stktable.track.4thr.16shards", bench_stk_get_entry_mt_16shards);
+REGISTER_BENCH("stktable.lookup_key", bench_stk_lookup_key);
+REGISTER_BENCH("stktable.peek_key", bench_stk_peek_key);
@@ -0,0 +1,189 @@
+/*
+ * Micro-benchmarks of the tasks' wait queues : eb32 trees and timing wheels.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Timers are queued by batches of up to BENCH_WQ_TIMERS at random dates
+ * between 1 and 61 seconds in the future. Depending on the benchmark, an
+ * operation inserts a timer, re-arms it to another random date by removing
+ * then inserting it as happens on each I/O for idle keep-alive connections, or
+ * expires it, the date being moved forward one millisecond at a time until all
+ * timers of the batch have expired. Only this operation is measured. The dates
+ * start close to the 32-bit wrapping point so that it is crossed by the first
+ * batch, and each timer must expire exactly at its date.
+ */
+
+#include <import/eb32tree.h>
+
+#include <haproxy/api.h>
+#include <haproxy/bench.h>
+#include <haproxy/twheel.h>
+
+#define BENCH_WQ_TIMERS  65536        /* max number of timers queued at once */
+#define BENCH_WQ_START   0xfffff000U  /* first date */
+#define BENCH_WQ_BACK    (1U << 31)   /* look-back of the eb32 wait queue */
+
+enum bench_wq_op {
+	BENCH_WQ_INSERT,
+	BENCH_WQ_REARM,
+	BENCH_WQ_EXPIRE,
+};
+
+struct bench_wq_timer {
+	struct eb32_node eb;
+	struct twheel_node tw;
+};
+
+static struct bench_wq_timer bench_wq_timers[BENCH_WQ_TIMERS];
+static unsigned int bench_wq_delay[2 * BENCH_WQ_TIMERS];   /* for insertion, then re-arming */
+static struct eb_root bench_wq_root = EB_ROOT;
+static struct twheel bench_wq_wheel;
+static unsigned int bench_wq_eb_now = BENCH_WQ_START;
+static unsigned int bench_wq_tw_now = BENCH_WQ_START;
+
+/* Sets the random delays and the wheel up once */
+static void bench_wq_setup()
+{
+	static int ready;
+	unsigned int x = 2463534242U;
+	int i;
+
+	if (ready)
+		return;
+
+	for (i = 0; i < 2 * BENCH_WQ_TIMERS; i++) {
+		x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+		bench_wq_delay[i] = 1000 + x % 60000;
+	}
+	twheel_init(&bench_wq_wheel);
+	ready = 1;
+}
+
+/* Runs <run->iters> operations <op> on the eb32 wait queue */
+static void bench_wq_eb(struct bench_run *run, enum bench_wq_op op)
+{
+	unsigned int now = bench_wq_eb_now;
+	unsigned long long done, bad = 0;
+	struct eb32_node *eb;
+	unsigned int i, n;
+
+	bench_wq_setup();
+	for (done = 0; done < run->iters; done += n) {
+		n = run->iters - done < BENCH_WQ_TIMERS ? run->iters - done : BENCH_WQ_TIMERS;
+
+		if (op == BENCH_WQ_INSERT)
+			bench_start(run);
+		for (i = 0; i < n; i++) {
+			bench_wq_timers[i].eb.key = now + bench_wq_delay[i];
+			eb32_insert(&bench_wq_root, &bench_wq_timers[i].eb);
+		}
+		if (op == BENCH_WQ_INSERT)
+			bench_stop(run);
+
+		if (op == BENCH_WQ_REARM) {
+			bench_start(run);
+			for (i = 0; i < n; i++) {
+				eb32_delete(&bench_wq_timers[i].eb);
+				bench_wq_timers[i].eb.key = now + bench_wq_delay[BENCH_WQ_TIMERS + i];
+				eb32_insert(&bench_wq_root, &bench_wq_timers[i].eb);
+			}
+			bench_stop(run);
+		}
+
+		if (op != BENCH_WQ_EXPIRE) {
+			for (i = 0; i < n; i++)
+				eb32_delete(&bench_wq_timers[i].eb);
+			continue;
+		}
+
+		/* same walk as wake_expired_tasks() */
+		bench_start(run);
+		for (i = 0; i < n; now++) {
+			while (1) {
+				eb = eb32_lookup_ge(&bench_wq_root, now - BENCH_WQ_BACK);
+				if (!eb)
+					eb = eb32_first(&bench_wq_root);
+				if (!eb || (int)(eb->key - now) > 0)
+					break;
+				bad += eb->key != now;
+				eb32_delete(eb);
+				i++;
+			}
+		}
+		bench_stop(run);
+	}
+
+	if (bad)
+		run->failed = 1;
+	bench_wq_eb_now = now;
+	bench_sink += now;
+}
+
+/* Runs <run->iters> operations <op> on the timing wheel */
+static void bench_wq_tw(struct bench_run *run, enum bench_wq_op op)
+{
+	unsigned int now = bench_wq_tw_now;
+	unsigned long long done, bad = 0;
+	struct twheel_node *tw;
+	unsigned int i, n;
+
+	bench_wq_setup();
+	for (done = 0; done < run->iters; done += n) {
+		n = run->iters - done < BENCH_WQ_TIMERS ? run->iters - done : BENCH_WQ_TIMERS;
+
+		if (op == BENCH_WQ_INSERT)
+			bench_start(run);
+		for (i = 0; i < n; i++)
+			twheel_insert(&bench_wq_wheel, &bench_wq_timers[i].tw, now + bench_wq_delay[i], now);
+		if (op == BENCH_WQ_INSERT)
+			bench_stop(run);
+
+		if (op == BENCH_WQ_REARM) {
+			bench_start(run);
+			for (i = 0; i < n; i++) {
+				twheel_delete(&bench_wq_timers[i].tw);
+				twheel_insert(&bench_wq_wheel, &bench_wq_timers[i].tw,
+				              now + bench_wq_delay[BENCH_WQ_TIMERS + i], now);
+			}
+			bench_stop(run);
+		}
+
+		if (op != BENCH_WQ_EXPIRE) {
+			for (i = 0; i < n; i++)
+				twheel_delete(&bench_wq_timers[i].tw);
+			continue;
+		}
+
+		bench_start(run);
+		for (i = 0; i < n; now++) {
+			while ((tw = twheel_first_expired(&bench_wq_wheel, now))) {
+				bad += tw->key != now;
+				twheel_delete(tw);
+				i++;
+			}
+		}
+		bench_stop(run);
+	}
+
+	if (bad || !twheel_is_empty(&bench_wq_wheel))
+		run->failed = 1;
+	bench_wq_tw_now = now;
+	bench_sink += now;
+}
+
+static void bench_wq_eb_insert(struct bench_run *run) { bench_wq_eb(run, BENCH_WQ_INSERT); }
+static void bench_wq_eb_rearm(struct bench_run *run)  { bench_wq_eb(run, BENCH_WQ_REARM); }
+static void bench_wq_eb_expire(struct bench_run *run) { bench_wq_eb(run, BENCH_WQ_EXPIRE); }
+static void bench_wq_tw_insert(struct bench_run *run) { bench_wq_tw(run, BENCH_WQ_INSERT); }
+static void bench_wq_tw_rearm(struct bench_run *run)  { bench_wq_tw(run, BENCH_WQ_REARM); }
+static void bench_wq_tw_expire(struct bench_run *run) { bench_wq_tw(run, BENCH_WQ_EXPIRE); }
+
+REGISTER_BENCH("wq.eb32.insert", bench_wq_eb_insert);
+REGISTER_BENCH("wq.eb32.rearm", bench_wq_eb_rearm);
+REGISTER_BENCH("wq.eb32.expire", bench_wq_eb_expire);
+REGISTER_BENCH("wq.twheel.insert", bench_wq_tw_insert);
+REGISTER_BENCH("wq.twheel.rearm", bench_wq_tw_rearm);
+REGISTER_BENCH("wq.twheel.expire", bench_wq_tw_expire);